@@ -0,0 +1,496 @@
+/**
+ * @file batch_pipeline.cpp
+ * @brief Staged parse -> emulate -> emit pipeline for multi-module jobs.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include "batch_pipeline.h"
+#include "bounded_queue.h"
+#include "program_image.h"
+#include "signature_cache.h"
+#include "signature_corpus.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            struct ModuleJob
+            {
+                std::size_t index = 0;
+                std::string path;
+                // Declaration order matters -- emulator must die before the
+                // module and module before its context.
+                LLVMContext context;
+                std::unique_ptr<Module> module;
+                std::unique_ptr<LlvmIrEmulator> emulator;
+                /// Set with @c BatchConfig::images. Threads then take
+                /// emulators of the image from @c idle and put them back.
+                std::shared_ptr<const ProgramImage> image;
+                std::mutex idleMutex;
+                std::vector<std::unique_ptr<LlvmIrEmulator>> idle;
+                std::vector<Function*> functions;
+                std::size_t next = 0;
+                std::atomic<std::size_t> done{0};
+            };
+
+            std::unique_ptr<LlvmIrEmulator> takeEmulator(
+                    ModuleJob& job,
+                    const BatchConfig& config)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(job.idleMutex);
+                    if (!job.idle.empty())
+                    {
+                        auto emu = std::move(job.idle.back());
+                        job.idle.pop_back();
+                        return emu;
+                    }
+                }
+                std::unique_ptr<LlvmIrEmulator> emu(new LlvmIrEmulator(job.image, config.lazy));
+                emu->setTieringPolicy(config.tiering);
+                return emu;
+            }
+
+            struct WriterItem
+            {
+                std::size_t module = 0;
+                std::size_t function = 0;
+                /// If set, this is not a result, but announcement that
+                /// module has @c count results.
+                bool announce = false;
+                std::size_t count = 0;
+                FunctionResult result;
+            };
+
+/**
+* Hands out module indexes in increasing order, but only while there is a
+* free in-flight slot. Because slots are freed by the writer in module
+* order too, the lowest unwritten module always holds a slot and the
+* pipeline can not deadlock.
+*/
+            class SlotGate
+            {
+            public:
+                SlotGate(unsigned slots, std::size_t modules) :
+                        _free(slots ? slots : 1),
+                        _modules(modules)
+                {
+
+                }
+
+                bool take(std::size_t& index)
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _cv.wait(lock, [this]() {
+                        return _free > 0 || _next >= _modules;
+                    });
+                    if (_next >= _modules)
+                    {
+                        return false;
+                    }
+                    --_free;
+                    index = _next++;
+                    return true;
+                }
+
+                void release()
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    ++_free;
+                    _cv.notify_all();
+                }
+
+            private:
+                std::mutex _mutex;
+                std::condition_variable _cv;
+                unsigned _free;
+                std::size_t _next = 0;
+                const std::size_t _modules;
+            };
+
+            FunctionResult emulateJobFunction(
+                    ModuleJob& job,
+                    Function* f,
+                    const BatchConfig& config)
+            {
+                SignatureCacheKey key;
+                if (config.cache)
+                {
+                    key = signatureCacheKey(f, config);
+                    CachedSignature cs;
+                    if (config.cache->lookup(key, cs))
+                    {
+                        FunctionResult r;
+                        r.modulePath = job.path;
+                        r.functionName = f->getName().str();
+                        r.signature = std::move(cs.signature);
+                        r.stats = cs.stats;
+                        r.cached = true;
+                        return r;
+                    }
+                }
+
+                FunctionResult r;
+                if (job.image)
+                {
+                    auto emu = takeEmulator(job, config);
+                    r = emulateFunction(*emu, f, config);
+                    std::lock_guard<std::mutex> lock(job.idleMutex);
+                    job.idle.push_back(std::move(emu));
+                }
+                else
+                {
+                    if (!job.emulator)
+                    {
+                        job.emulator.reset(new LlvmIrEmulator(job.module.get(), config.lazy));
+                        job.emulator->setJitEnabled(config.jit);
+                        job.emulator->setTieringPolicy(config.tiering);
+                    }
+                    r = emulateFunction(*job.emulator, f, config);
+                }
+                r.modulePath = job.path;
+                if (config.cache && !r.failed)
+                {
+                    CachedSignature cs;
+                    cs.signature = r.signature;
+                    cs.stats = r.stats;
+                    config.cache->insert(key, cs);
+                }
+                return r;
+            }
+
+        } // anonymous namespace
+
+        std::vector<llvm::GenericValue> makeArguments(
+                llvm::Function* f,
+                uint64_t seed)
+        {
+            std::mt19937_64 rng(seed);
+            std::vector<GenericValue> args;
+            for (auto aIt = f->arg_begin(); aIt != f->arg_end(); ++aIt)
+            {
+                Type* t = aIt->getType();
+                uint64_t r = seed ? rng() : 0;
+                GenericValue gv;
+                if (t->isIntegerTy())
+                {
+                    gv.IntVal = APInt(t->getIntegerBitWidth(), r);
+                }
+                else if (t->isFloatTy())
+                {
+                    gv.FloatVal = float(int64_t(r % 2001) - 1000);
+                }
+                else if (t->isDoubleTy())
+                {
+                    gv.DoubleVal = double(int64_t(r % 2001) - 1000);
+                }
+                args.push_back(gv);
+            }
+            return args;
+        }
+
+        FunctionResult emulateFunction(
+                LlvmIrEmulator& emu,
+                llvm::Function* f,
+                uint64_t seed)
+        {
+            FunctionResult r;
+            r.functionName = f->getName().str();
+
+            // Earlier runs must not leak memory, globals or heap blocks into
+            // this one, the result would depend on the order of functions.
+            emu.reset();
+            emu.setSeed(seed);
+            try
+            {
+                emu.runFunction(f, makeArguments(f, seed), true);
+            }
+            catch (const std::exception&)
+            {
+                r.failed = true;
+            }
+            r.stats = emu.getRunStats();
+
+            if (!r.failed)
+            {
+                r.signature = emu.similairtyString();
+            }
+            emu.setSimilarityStringToNull();
+            return r;
+        }
+
+        FunctionResult emulateFunction(
+                LlvmIrEmulator& emu,
+                llvm::Function* f,
+                const BatchConfig& config)
+        {
+            if (!config.stable)
+            {
+                return emulateFunction(emu, f, config.seed);
+            }
+
+            auto s = stableSignature(emu, f, config.stability);
+            FunctionResult r;
+            r.functionName = f->getName().str();
+            r.signature = std::move(s.signature);
+            r.stats = s.stats;
+            r.failed = s.failedRuns == s.runs;
+            return r;
+        }
+
+        SignatureCacheKey signatureCacheKey(
+                const llvm::Function* f,
+                const BatchConfig& config)
+        {
+            SignatureCacheKey key;
+            key.functionHash = functionStructuralHash(f);
+            key.seed = config.seed;
+            key.configHash = configurationHash(config.stable
+                    ? config.config
+                            + ";stable=" + std::to_string(config.stability.seeds)
+                            + "," + std::to_string(config.stability.firstSeed)
+                            + "," + std::to_string(config.stability.threshold)
+                    : config.config);
+            return key;
+        }
+
+//
+//=============================================================================
+// BatchPipeline
+//=============================================================================
+//
+
+        BatchPipeline::BatchPipeline(const BatchConfig& config) :
+                _config(config)
+        {
+            if (_config.emulationThreads == 0)
+            {
+                _config.emulationThreads = std::max(1u, std::thread::hardware_concurrency());
+            }
+            if (_config.parseThreads == 0)
+            {
+                _config.parseThreads = 1;
+            }
+            if (_config.modulesInFlight == 0)
+            {
+                _config.modulesInFlight = 1;
+            }
+        }
+
+        void BatchPipeline::run(
+                const std::vector<std::string>& modulePaths,
+                Sink sink)
+        {
+            const std::size_t n = modulePaths.size();
+            if (n == 0)
+            {
+                return;
+            }
+
+            SlotGate gate(_config.modulesInFlight, n);
+            // There are never more jobs than in-flight slots, so pushes to
+            // the ready queue never block.
+            BoundedQueue<std::shared_ptr<ModuleJob>> ready(_config.modulesInFlight);
+            BoundedQueue<WriterItem> results(4 * 1024);
+
+            std::mutex stateMutex;
+            unsigned activeParsers = _config.parseThreads;
+            std::size_t liveJobs = 0;
+
+            auto parse = [&]()
+            {
+                std::size_t idx = 0;
+                while (gate.take(idx))
+                {
+                    auto job = std::make_shared<ModuleJob>();
+                    job->index = idx;
+                    job->path = modulePaths[idx];
+
+                    SMDiagnostic err;
+                    job->module = _config.lazy
+                            ? getLazyIRFileModule(job->path, err, job->context)
+                            : parseIRFile(job->path, err, job->context);
+                    if (job->module && _config.images)
+                    {
+                        job->image = ProgramImage::build(job->module.get());
+                        if (!job->image)
+                        {
+                            job->module.reset();
+                        }
+                    }
+
+                    WriterItem announce;
+                    announce.module = idx;
+                    announce.announce = true;
+                    if (!job->module)
+                    {
+                        // Unparsable module yields one failed result.
+                        announce.count = 1;
+                        results.push(std::move(announce));
+                        WriterItem failed;
+                        failed.module = idx;
+                        failed.result.modulePath = job->path;
+                        failed.result.failed = true;
+                        results.push(std::move(failed));
+                        continue;
+                    }
+
+                    for (Function& f : *job->module)
+                    {
+                        if (!f.isDeclaration())
+                        {
+                            job->functions.push_back(&f);
+                        }
+                    }
+                    announce.count = job->functions.size();
+                    results.push(std::move(announce));
+                    if (job->functions.empty())
+                    {
+                        continue;
+                    }
+
+                    {
+                        std::lock_guard<std::mutex> lock(stateMutex);
+                        ++liveJobs;
+                    }
+                    ready.push(std::move(job));
+                }
+
+                std::lock_guard<std::mutex> lock(stateMutex);
+                if (--activeParsers == 0 && liveJobs == 0)
+                {
+                    ready.close();
+                }
+            };
+
+            auto emulate = [&]()
+            {
+                std::unique_ptr<CorpusWriter::Appender> appender;
+                if (_config.corpus)
+                {
+                    appender = _config.corpus->makeAppender();
+                }
+
+                std::shared_ptr<ModuleJob> job;
+                while (ready.pop(job))
+                {
+                    std::size_t fi = job->next++;
+                    bool more = job->next < job->functions.size();
+                    // Other threads may take the next function of an image
+                    // right away.
+                    if (more && job->image)
+                    {
+                        ready.push(job);
+                    }
+
+                    WriterItem item;
+                    item.module = job->index;
+                    item.function = fi;
+                    item.result = emulateJobFunction(*job, job->functions[fi], _config);
+                    if (appender)
+                    {
+                        appender->add(item.result);
+                    }
+                    results.push(std::move(item));
+
+                    bool last = ++job->done == job->functions.size();
+                    if (more && !job->image)
+                    {
+                        ready.push(std::move(job));
+                        continue;
+                    }
+
+                    // Free module and emulators as soon as they are not
+                    // needed -- the last thread working on the module does.
+                    job.reset();
+                    if (!last)
+                    {
+                        continue;
+                    }
+                    std::lock_guard<std::mutex> lock(stateMutex);
+                    if (--liveJobs == 0 && activeParsers == 0)
+                    {
+                        ready.close();
+                    }
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (unsigned i = 0; i < _config.parseThreads; ++i)
+            {
+                threads.emplace_back(parse);
+            }
+            for (unsigned i = 0; i < _config.emulationThreads; ++i)
+            {
+                threads.emplace_back(emulate);
+            }
+
+            // Writer runs in the calling thread.
+            std::map<std::pair<std::size_t, std::size_t>, FunctionResult> pending;
+            std::map<std::size_t, std::size_t> counts;
+            std::size_t curModule = 0;
+            std::size_t curFunction = 0;
+            WriterItem item;
+            while (curModule < n && results.pop(item))
+            {
+                if (item.announce)
+                {
+                    counts[item.module] = item.count;
+                }
+                else
+                {
+                    pending.emplace(
+                            std::make_pair(item.module, item.function),
+                            std::move(item.result));
+                }
+
+                while (curModule < n)
+                {
+                    auto cIt = counts.find(curModule);
+                    if (cIt == counts.end())
+                    {
+                        break;
+                    }
+                    if (curFunction == cIt->second)
+                    {
+                        counts.erase(cIt);
+                        gate.release();
+                        ++curModule;
+                        curFunction = 0;
+                        continue;
+                    }
+                    auto pIt = pending.find(std::make_pair(curModule, curFunction));
+                    if (pIt == pending.end())
+                    {
+                        break;
+                    }
+                    sink(pIt->second);
+                    pending.erase(pIt);
+                    ++curFunction;
+                }
+            }
+
+            results.close();
+            for (auto& t : threads)
+            {
+                t.join();
+            }
+        }
+
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,152 @@
+/**
+ * @file batch_pipeline.h
+ * @brief Staged parse -> emulate -> emit pipeline for multi-module jobs.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_BATCH_PIPELINE_H
+#define RETDEC_LLVMIR_EMUL_BATCH_PIPELINE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <llvm/ExecutionEngine/GenericValue.h>
+#include <llvm/IR/Function.h>
+
+#include "llvmir-emul.h"
+#include "stable_signature.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        class CorpusWriter;
+        class SignatureCache;
+        struct SignatureCacheKey;
+
+/**
+ * Result of emulating one function.
+ */
+        struct FunctionResult
+        {
+            std::string modulePath;
+            std::string functionName;
+            std::string signature;
+            RunStats stats;
+            /// Result was taken from @c SignatureCache.
+            bool cached = false;
+            /// Emulation threw, @c signature is empty.
+            bool failed = false;
+        };
+
+/**
+ * Arguments for emulation of @a f. Seed @c 0 gives all-zero arguments,
+ * any other seed gives pseudo-random integer arguments that depend only on
+ * the seed and the argument position.
+ */
+        std::vector<llvm::GenericValue> makeArguments(
+                llvm::Function* f,
+                uint64_t seed);
+
+/**
+ * Runs @a f on arguments from @c makeArguments(), with the emulator seeded
+ * by @a seed, and collects the similarity string and run stats. The
+ * emulator is reset first (see @c LlvmIrEmulator::reset()), so results do
+ * not depend on what it ran before.
+ * The emulator's similarity string is consumed (set to null) by this.
+ */
+        FunctionResult emulateFunction(
+                LlvmIrEmulator& emu,
+                llvm::Function* f,
+                uint64_t seed);
+
+        struct BatchConfig
+        {
+            /// Threads reading and parsing modules.
+            unsigned parseThreads = 2;
+            /// Threads emulating functions. 0 means hardware concurrency.
+            unsigned emulationThreads = 0;
+            /// Maximum number of modules that are parsed but not completely
+            /// written out. This bounds the pipeline's memory.
+            unsigned modulesInFlight = 4;
+            /// Use lazy loading and lazy global initialization.
+            bool lazy = false;
+            /// Run eligible functions natively if the backend is built in.
+            /// Signatures do not change, so this is not part of cache keys.
+            bool jit = false;
+            /// Decode every module into a @c ProgramImage, so that all the
+            /// emulation threads can work on functions of one module at
+            /// once. Images materialize whole modules, and emulators of an
+            /// image do not run natively -- @c jit is then ignored.
+            bool images = false;
+            /// When functions of a module are promoted to faster tiers.
+            /// Tiers do not change signatures either.
+            TieringPolicy tiering;
+            uint64_t seed = 0;
+            /// Emit @c stableSignature() of every function instead of the
+            /// signature of a single run with @c seed.
+            bool stable = false;
+            StabilityConfig stability;
+            /// Optional cache consulted before emulating a function.
+            SignatureCache* cache = nullptr;
+            /// Configuration string that is part of cache keys.
+            std::string config;
+            /// Optional corpus every emulation thread appends its results
+            /// to. The caller finishes it after @c run().
+            CorpusWriter* corpus = nullptr;
+        };
+
+/**
+ * Emulates @a f the way @a config says -- one run with @c config.seed, or
+ * @c stableSignature() if @c config.stable is set. The cache is not used.
+ */
+        FunctionResult emulateFunction(
+                LlvmIrEmulator& emu,
+                llvm::Function* f,
+                const BatchConfig& config);
+
+/**
+ * Key of @a f's result under @a config in @c BatchConfig::cache.
+ */
+        SignatureCacheKey signatureCacheKey(
+                const llvm::Function* f,
+                const BatchConfig& config);
+
+/**
+ * Emulates all defined functions of many modules.
+ *
+ * Stages:
+ * 1. Parse threads read modules, each into its own @c LLVMContext. A module
+ *    is only parsed once a slot among @c modulesInFlight is free, which is
+ *    what keeps a slow emulation stage from piling up parsed modules.
+ * 2. Emulation threads take modules from a ready queue, emulate their next
+ *    function and put them back. Emulator and IR of one module are not
+ *    thread safe, so a module is held by at most one thread at a time,
+ *    but threads interleave all the parsed modules. A huge module therefore
+ *    occupies one thread while others keep working on the rest -- unless
+ *    @c images is set: a module is then put back as soon as its next
+ *    function is taken, and every thread emulates it with its own emulator
+ *    of the module's image.
+ * 3. A single writer passes results to the sink in module and function
+ *    order, and frees the module's slot after its last result.
+ *
+ * Parsing of later modules overlaps emulation of earlier ones.
+ */
+        class BatchPipeline
+        {
+        public:
+            using Sink = std::function<void(const FunctionResult&)>;
+
+        public:
+            explicit BatchPipeline(const BatchConfig& config);
+
+            void run(const std::vector<std::string>& modulePaths, Sink sink);
+
+        private:
+            BatchConfig _config;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
@@ -0,0 +1,109 @@
+/**
+ * @file bounded_queue.h
+ * @brief Blocking multi-producer multi-consumer queue with limited capacity.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_BOUNDED_QUEUE_H
+#define RETDEC_LLVMIR_EMUL_BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace retdec {
+    namespace llvmir_emul {
+
+/**
+ * Producers block in @c push() while the queue is full, consumers block in
+ * @c pop() while it is empty. This is what provides backpressure between
+ * pipeline stages.
+ *
+ * After @c close(), pushes fail and pops drain the remaining items and then
+ * fail.
+ */
+        template<typename T>
+        class BoundedQueue
+        {
+        public:
+            explicit BoundedQueue(std::size_t capacity) :
+                    _capacity(capacity ? capacity : 1)
+            {
+
+            }
+
+            bool push(T item)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _notFull.wait(lock, [this]() {
+                    return _closed || _items.size() < _capacity;
+                });
+                if (_closed)
+                {
+                    return false;
+                }
+                _items.push_back(std::move(item));
+                _notEmpty.notify_one();
+                return true;
+            }
+
+            bool pop(T& item)
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _notEmpty.wait(lock, [this]() {
+                    return _closed || !_items.empty();
+                });
+                if (_items.empty())
+                {
+                    return false;
+                }
+                item = std::move(_items.front());
+                _items.pop_front();
+                _notFull.notify_one();
+                return true;
+            }
+
+/**
+ * Like @c pop(), but does not block.
+ * @return @c false if there is nothing to pop right now.
+ */
+            bool tryPop(T& item)
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                if (_items.empty())
+                {
+                    return false;
+                }
+                item = std::move(_items.front());
+                _items.pop_front();
+                _notFull.notify_one();
+                return true;
+            }
+
+            void close()
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _closed = true;
+                _notFull.notify_all();
+                _notEmpty.notify_all();
+            }
+
+            std::size_t size() const
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                return _items.size();
+            }
+
+        private:
+            const std::size_t _capacity;
+            mutable std::mutex _mutex;
+            std::condition_variable _notFull;
+            std::condition_variable _notEmpty;
+            std::deque<T> _items;
+            bool _closed = false;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
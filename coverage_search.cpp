@@ -0,0 +1,285 @@
+/**
+ * @file coverage_search.cpp
+ * @brief Coverage-guided search for function arguments.
+ */
+
+#include <algorithm>
+#include <random>
+#include <set>
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+
+#include "batch_pipeline.h"
+#include "coverage_search.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+/**
+* @a f and all defined functions it (transitively) calls directly.
+*/
+            std::vector<Function*> collectFunctions(Function* f)
+            {
+                std::vector<Function*> ret;
+                std::set<Function*> seen;
+                ret.push_back(f);
+                seen.insert(f);
+                for (std::size_t k = 0; k < ret.size(); ++k)
+                {
+                    for (auto& bb : *ret[k])
+                    for (auto& i : bb)
+                    {
+                        auto* call = dyn_cast<CallInst>(&i);
+                        Function* callee = call ? call->getCalledFunction() : nullptr;
+                        if (callee
+                                && !callee->isDeclaration()
+                                && seen.insert(callee).second)
+                        {
+                            ret.push_back(callee);
+                        }
+                    }
+                }
+                return ret;
+            }
+
+            void addConstants(Function* f, std::set<uint64_t>& out)
+            {
+                for (auto& bb : *f)
+                for (auto& i : bb)
+                {
+                    auto* icmp = dyn_cast<ICmpInst>(&i);
+                    if (icmp == nullptr)
+                    {
+                        continue;
+                    }
+                    for (unsigned k = 0; k < 2; ++k)
+                    {
+                        auto* ci = dyn_cast<ConstantInt>(icmp->getOperand(k));
+                        if (ci == nullptr || ci->getBitWidth() > 64)
+                        {
+                            continue;
+                        }
+                        // Sign extended, so that truncation to a narrower
+                        // argument keeps negative constants negative.
+                        uint64_t c = ci->getSExtValue();
+                        out.insert(c);
+                        out.insert(c - 1);
+                        out.insert(c + 1);
+                    }
+                }
+            }
+
+            bool isMutable(const Type* t)
+            {
+                return t->isIntegerTy() || t->isFloatTy() || t->isDoubleTy();
+            }
+
+            class Mutator
+            {
+            public:
+                Mutator(const std::vector<uint64_t>& constants, uint64_t seed) :
+                        _constants(constants),
+                        _rng(seed)
+                {
+
+                }
+
+                void mutate(Function* f, std::vector<GenericValue>& args)
+                {
+                    std::vector<unsigned> positions;
+                    unsigned pos = 0;
+                    for (auto aIt = f->arg_begin(); aIt != f->arg_end(); ++aIt, ++pos)
+                    {
+                        if (isMutable(aIt->getType()))
+                        {
+                            positions.push_back(pos);
+                        }
+                    }
+                    if (positions.empty())
+                    {
+                        return;
+                    }
+
+                    unsigned n = 1 + _rng() % 2;
+                    for (unsigned k = 0; k < n; ++k)
+                    {
+                        unsigned p = positions[_rng() % positions.size()];
+                        auto aIt = f->arg_begin();
+                        std::advance(aIt, p);
+                        mutate(aIt->getType(), args[p]);
+                    }
+                }
+
+            private:
+                void mutate(Type* t, GenericValue& gv)
+                {
+                    uint64_t c = _constants[_rng() % _constants.size()];
+                    int64_t delta = int64_t(_rng() % 33) - 16;
+                    unsigned op = _rng() % 3;
+
+                    if (t->isIntegerTy())
+                    {
+                        unsigned w = t->getIntegerBitWidth();
+                        switch (op)
+                        {
+                            case 0:
+                                gv.IntVal.flipBit(_rng() % w);
+                                break;
+                            case 1:
+                                gv.IntVal = APInt(w, c);
+                                break;
+                            default:
+                                gv.IntVal = gv.IntVal + APInt(w, uint64_t(delta));
+                                break;
+                        }
+                    }
+                    else if (t->isFloatTy())
+                    {
+                        gv.FloatVal = op == 1 ? float(int64_t(c))
+                                : op == 0 ? -gv.FloatVal
+                                : gv.FloatVal + float(delta);
+                    }
+                    else if (t->isDoubleTy())
+                    {
+                        gv.DoubleVal = op == 1 ? double(int64_t(c))
+                                : op == 0 ? -gv.DoubleVal
+                                : gv.DoubleVal + double(delta);
+                    }
+                }
+
+            private:
+                const std::vector<uint64_t>& _constants;
+                std::mt19937_64 _rng;
+            };
+
+            std::size_t coveredBlocks(
+                    const LlvmIrEmulator& emu,
+                    const std::vector<Function*>& fncs)
+            {
+                const BlockCoverage& cov = emu.getBlockCoverage();
+                std::size_t ret = 0;
+                for (Function* f : fncs)
+                {
+                    for (auto& bb : *f)
+                    {
+                        ret += cov.contains(&bb);
+                    }
+                }
+                return ret;
+            }
+
+        } // anonymous namespace
+
+        std::vector<uint64_t> harvestInterestingConstants(
+                llvm::Function* f,
+                bool callees)
+        {
+            std::set<uint64_t> cs = {
+                    0, 1, uint64_t(-1), 2,
+                    0x7f, 0x80, 0xff,
+                    0x7fff, 0x8000, 0xffff,
+                    0x7fffffff, 0x80000000, 0xffffffff,
+                    0x7fffffffffffffff, 0x8000000000000000};
+
+            if (callees)
+            {
+                for (Function* fnc : collectFunctions(f))
+                {
+                    addConstants(fnc, cs);
+                }
+            }
+            else
+            {
+                addConstants(f, cs);
+            }
+            return std::vector<uint64_t>(cs.begin(), cs.end());
+        }
+
+        CoverageSearchResult coverageSearch(
+                LlvmIrEmulator& emu,
+                llvm::Function* f,
+                const CoverageSearchConfig& config)
+        {
+            CoverageSearchResult res;
+            std::vector<Function*> fncs = collectFunctions(f);
+            for (Function* fnc : fncs)
+            {
+                res.blocksTotal += fnc->size();
+            }
+
+            std::vector<uint64_t> constants = harvestInterestingConstants(
+                    f,
+                    config.calleeConstants);
+            Mutator mutator(constants, config.seed);
+            bool mutable_ = std::any_of(f->arg_begin(), f->arg_end(),
+                    [](const Argument& a) { return isMutable(a.getType()); });
+
+            emu.resetBlockCoverage();
+
+            // Every input starts from the initial memory and globals, only
+            // the block coverage is carried over from run to run.
+            ResetPolicy policy;
+            policy.coverage = false;
+
+            // Keeps args if they reached a new block.
+            auto tryInput = [&](std::vector<GenericValue> args)
+            {
+                std::size_t before = res.blocksCovered;
+                ++res.runs;
+                emu.reset(policy);
+                bool failed = false;
+                try
+                {
+                    emu.runFunction(f, args, true);
+                }
+                catch (const std::exception&)
+                {
+                    failed = true;
+                    ++res.failedRuns;
+                }
+                std::string sig = failed ? std::string() : emu.similairtyString();
+                emu.setSimilarityStringToNull();
+
+                res.blocksCovered = coveredBlocks(emu, fncs);
+                if (res.blocksCovered == before)
+                {
+                    return false;
+                }
+                CoverageInput in;
+                in.arguments = std::move(args);
+                in.signature = std::move(sig);
+                in.newBlocks = res.blocksCovered - before;
+                res.signature += in.signature;
+                res.corpus.push_back(std::move(in));
+                return true;
+            };
+
+            tryInput(makeArguments(f, 0));
+            if (mutable_ && res.runs < config.maxRuns)
+            {
+                tryInput(makeArguments(f, config.seed));
+            }
+
+            // Without arguments to mutate, runs differ only by chance.
+            std::mt19937_64 rng(config.seed ^ 0x9e3779b97f4a7c15);
+            unsigned stale = 0;
+            while (mutable_
+                    && !res.corpus.empty()
+                    && res.runs < config.maxRuns
+                    && stale < config.saturation
+                    && res.blocksCovered < res.blocksTotal)
+            {
+                auto args = res.corpus[rng() % res.corpus.size()].arguments;
+                mutator.mutate(f, args);
+                stale = tryInput(std::move(args)) ? 0 : stale + 1;
+            }
+
+            return res;
+        }
+
+    } // llvmir_emul
+} // retdec
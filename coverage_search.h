@@ -0,0 +1,82 @@
+/**
+ * @file coverage_search.h
+ * @brief Coverage-guided search for function arguments.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_COVERAGE_SEARCH_H
+#define RETDEC_LLVMIR_EMUL_COVERAGE_SEARCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <llvm/ExecutionEngine/GenericValue.h>
+#include <llvm/IR/Function.h>
+
+#include "llvmir-emul.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        struct CoverageSearchConfig
+        {
+            /// Emulation runs at most, including the initial inputs.
+            unsigned maxRuns = 64;
+            /// Stop after this many runs in a row reach no new block.
+            unsigned saturation = 16;
+            uint64_t seed = 1;
+            /// Harvest constants from functions called by the searched one
+            /// too, not only from the function itself.
+            bool calleeConstants = true;
+        };
+
+        struct CoverageInput
+        {
+            std::vector<llvm::GenericValue> arguments;
+            std::string signature;
+            /// Blocks first reached by this input.
+            std::size_t newBlocks = 0;
+        };
+
+        struct CoverageSearchResult
+        {
+            /// Inputs that reached new blocks, in the order found.
+            std::vector<CoverageInput> corpus;
+            /// Similarity strings of all kept inputs concatenated.
+            std::string signature;
+            unsigned runs = 0;
+            unsigned failedRuns = 0;
+            std::size_t blocksCovered = 0;
+            /// Blocks of the function and (if harvested) of its callees.
+            std::size_t blocksTotal = 0;
+        };
+
+/**
+ * Integer constants compared by @c icmp in @a f (and its callees if
+ * @a callees), together with their neighbours and the usual boundary
+ * values. Sorted and unique.
+ */
+        std::vector<uint64_t> harvestInterestingConstants(
+                llvm::Function* f,
+                bool callees = true);
+
+/**
+ * Looks for arguments of @a f that together cover as many blocks as
+ * possible. Starts from all-zero and one random input, then repeatedly
+ * mutates a kept input -- bit flips, harvested @c icmp constants, small
+ * deltas -- and keeps the mutant only if the emulator's block coverage
+ * grew. Stops when every block is covered, coverage saturated, or the run
+ * budget is spent.
+ *
+ * The emulator's block coverage is reset at the start and its similarity
+ * string is consumed by every run.
+ */
+        CoverageSearchResult coverageSearch(
+                LlvmIrEmulator& emu,
+                llvm::Function* f,
+                const CoverageSearchConfig& config = CoverageSearchConfig());
+
+    } // llvmir_emul
+} // retdec
+
+#endif
@@ -0,0 +1,147 @@
+/**
+ * @file emulated_heap.cpp
+ * @brief Allocator of blocks in the emulated address space.
+ */
+
+#include <algorithm>
+
+#include <llvm/Support/MathExtras.h>
+
+#include "emulated_heap.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        EmulatedHeap::EmulatedHeap(const HeapConfig& config) :
+                _config(config),
+                _top(config.base),
+                _free(SMALL_CLASSES)
+        {
+
+        }
+
+        unsigned EmulatedHeap::sizeClass(uint64_t size)
+        {
+            if (size <= 128)
+            {
+                return unsigned((size + 15) / 16) - 1;
+            }
+            unsigned p = llvm::Log2_64(size - 1);
+            uint64_t step = uint64_t(1) << (p - 2);
+            unsigned idx = unsigned((size - (uint64_t(1) << p) + step - 1) / step);
+            return 8 + (p - 7) * 4 + idx - 1;
+        }
+
+        uint64_t EmulatedHeap::classSize(unsigned c)
+        {
+            if (c < 8)
+            {
+                return (c + 1) * 16;
+            }
+            unsigned p = 7 + (c - 8) / 4;
+            return (uint64_t(1) << p) + ((c - 8) % 4 + 1) * (uint64_t(1) << (p - 2));
+        }
+
+/**
+* A large slot is reused for requests down to half of its size -- there is
+* no splitting, and an exact fit is rare.
+*/
+        uint64_t EmulatedHeap::allocate(uint64_t size)
+        {
+            size = std::max<uint64_t>(size, 1);
+            uint64_t need = size + _config.guardBytes;
+            if (need < size || need > _config.limit)
+            {
+                return 0;
+            }
+
+            uint64_t addr = 0;
+            uint64_t slot = 0;
+            if (need <= classSize(SMALL_CLASSES - 1))
+            {
+                unsigned c = sizeClass(need);
+                slot = classSize(c);
+                auto& list = _free[c];
+                if (!list.empty())
+                {
+                    addr = list.back();
+                    list.pop_back();
+                }
+            }
+            else
+            {
+                slot = (need + LARGE_ALIGNMENT - 1) & ~(LARGE_ALIGNMENT - 1);
+                auto it = _freeLarge.lower_bound(slot);
+                if (it != _freeLarge.end() && it->first / 2 <= slot)
+                {
+                    slot = it->first;
+                    addr = it->second.back();
+                    it->second.pop_back();
+                    if (it->second.empty())
+                    {
+                        _freeLarge.erase(it);
+                    }
+                }
+                else if (_top % LARGE_ALIGNMENT)
+                {
+                    _top += LARGE_ALIGNMENT - _top % LARGE_ALIGNMENT;
+                }
+            }
+
+            if (addr == 0)
+            {
+                if (slot > _config.base + _config.limit - _top)
+                {
+                    return 0;
+                }
+                addr = _top;
+                _top += slot;
+            }
+            _live[addr] = Block{size, slot};
+            return addr;
+        }
+
+        uint64_t EmulatedHeap::release(uint64_t addr)
+        {
+            auto it = _live.find(addr);
+            if (it == _live.end())
+            {
+                return 0;
+            }
+            uint64_t slot = it->second.slot;
+            _live.erase(it);
+
+            if (slot <= classSize(SMALL_CLASSES - 1))
+            {
+                _free[sizeClass(slot)].push_back(addr);
+            }
+            else
+            {
+                _freeLarge[slot].push_back(addr);
+            }
+            return slot;
+        }
+
+        uint64_t EmulatedHeap::getSize(uint64_t addr) const
+        {
+            auto it = _live.find(addr);
+            return it != _live.end() ? it->second.size : 0;
+        }
+
+        std::size_t EmulatedHeap::getLiveBlocks() const
+        {
+            return _live.size();
+        }
+
+        uint64_t EmulatedHeap::getUsedBytes() const
+        {
+            return _top - _config.base;
+        }
+
+        const HeapConfig& EmulatedHeap::getConfig() const
+        {
+            return _config;
+        }
+
+    } // llvmir_emul
+} // retdec
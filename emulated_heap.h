@@ -0,0 +1,93 @@
+/**
+ * @file emulated_heap.h
+ * @brief Allocator of blocks in the emulated address space.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_EMULATED_HEAP_H
+#define RETDEC_LLVMIR_EMUL_EMULATED_HEAP_H
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        struct HeapConfig
+        {
+            /// Start of the heap. Emulated globals live at host addresses
+            /// of their @c GlobalVariable objects, the default is far below
+            /// the host heap and mappings of 64-bit Linux.
+            uint64_t base = 0x100000000000;
+            /// Address space the heap may take, allocations beyond fail.
+            uint64_t limit = uint64_t(1) << 36;
+            /// Unused bytes after every block, so that small overflows do
+            /// not reach the next block.
+            uint64_t guardBytes = 0;
+        };
+
+/**
+ * Heap of emulated @c malloc() and @c alloca blocks. Nothing is backed by
+ * host memory -- blocks are address ranges of the paged memory model.
+ *
+ * Small blocks come from size classes (16 byte steps up to 128 bytes, then
+ * four classes per power of two up to 64 KiB), larger ones are rounded up
+ * to 4 KiB pages. Freed blocks go to a free list of their class and are
+ * reused last-in first-out, new ones are cut from the top of the heap.
+ * Addresses are therefore a function of the sequence of calls only, equal
+ * in every run and every process.
+ */
+        class EmulatedHeap
+        {
+        public:
+            explicit EmulatedHeap(const HeapConfig& config = HeapConfig());
+
+/**
+ * @return Address of a block of @a size bytes aligned to 16 bytes, or @c 0
+ *         if the heap is exhausted.
+ */
+            uint64_t allocate(uint64_t size);
+/**
+ * @return Bytes of the slot (block, guard and rounding) freed, @c 0 if
+ *         @a addr is not the start of a live block.
+ */
+            uint64_t release(uint64_t addr);
+/**
+ * @return Requested size of the live block at @a addr, or @c 0.
+ */
+            uint64_t getSize(uint64_t addr) const;
+
+            std::size_t getLiveBlocks() const;
+/**
+ * @return Bytes of address space ever cut from the top.
+ */
+            uint64_t getUsedBytes() const;
+            const HeapConfig& getConfig() const;
+
+        private:
+            static const unsigned SMALL_CLASSES = 44;
+            static const uint64_t LARGE_ALIGNMENT = 4096;
+
+            static unsigned sizeClass(uint64_t size);
+            static uint64_t classSize(unsigned c);
+
+            struct Block
+            {
+                uint64_t size;
+                uint64_t slot;
+            };
+
+        private:
+            HeapConfig _config;
+            uint64_t _top;
+            std::vector<std::vector<uint64_t>> _free;
+            /// Free large slots by their size.
+            std::map<uint64_t, std::vector<uint64_t>> _freeLarge;
+            std::unordered_map<uint64_t, Block> _live;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
@@ -0,0 +1,142 @@
+/**
+ * @file emulator_pool.cpp
+ * @brief Per-thread pool of emulators reused across functions.
+ */
+
+#include <algorithm>
+
+#include "emulator_pool.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        EmulatorPool::EmulatorPool(std::size_t capacity) :
+                _capacity(capacity)
+        {
+
+        }
+
+        EmulatorPool& EmulatorPool::local()
+        {
+            static thread_local EmulatorPool pool;
+            return pool;
+        }
+
+        EmulatorPool::Lease EmulatorPool::acquire(llvm::Module* m, bool lazyGlobals)
+        {
+            Lease l = take(m, nullptr, lazyGlobals);
+            if (l)
+            {
+                return l;
+            }
+            std::unique_ptr<LlvmIrEmulator> emu(new LlvmIrEmulator(m, lazyGlobals));
+            return lease(std::move(emu), m, nullptr, lazyGlobals);
+        }
+
+        EmulatorPool::Lease EmulatorPool::acquire(
+                std::shared_ptr<const ProgramImage> image,
+                bool lazyGlobals)
+        {
+            const llvm::Module* m = image->getModule();
+            const ProgramImage* key = image.get();
+            Lease l = take(m, key, lazyGlobals);
+            if (l)
+            {
+                return l;
+            }
+            std::unique_ptr<LlvmIrEmulator> emu(
+                    new LlvmIrEmulator(std::move(image), lazyGlobals));
+            return lease(std::move(emu), m, key, lazyGlobals);
+        }
+
+/**
+* The most recently returned emulator is taken -- its buffers are the
+* likeliest to be warm.
+*/
+        EmulatorPool::Lease EmulatorPool::take(
+                const llvm::Module* m,
+                const ProgramImage* image,
+                bool lazyGlobals)
+        {
+            for (auto it = _idle.rbegin(); it != _idle.rend(); ++it)
+            {
+                if (it->module == m
+                        && it->image == image
+                        && it->lazyGlobals == lazyGlobals)
+                {
+                    std::unique_ptr<LlvmIrEmulator> emu = std::move(it->emulator);
+                    _idle.erase(std::next(it).base());
+                    return lease(std::move(emu), m, image, lazyGlobals);
+                }
+            }
+            return Lease(nullptr, [](LlvmIrEmulator*) {});
+        }
+
+        EmulatorPool::Lease EmulatorPool::lease(
+                std::unique_ptr<LlvmIrEmulator> emu,
+                const llvm::Module* m,
+                const ProgramImage* image,
+                bool lazyGlobals)
+        {
+            return Lease(emu.release(), [this, m, image, lazyGlobals](LlvmIrEmulator* e) {
+                std::unique_ptr<LlvmIrEmulator> owned(e);
+                if (_capacity == 0)
+                {
+                    return;
+                }
+                owned->reset(_policy);
+                Idle idle;
+                idle.module = m;
+                idle.image = image;
+                idle.lazyGlobals = lazyGlobals;
+                idle.emulator = std::move(owned);
+                _idle.push_back(std::move(idle));
+                trim();
+            });
+        }
+
+        void EmulatorPool::trim()
+        {
+            if (_idle.size() > _capacity)
+            {
+                _idle.erase(_idle.begin(), _idle.end() - _capacity);
+            }
+        }
+
+        void EmulatorPool::evict(const llvm::Module* m)
+        {
+            _idle.erase(
+                    std::remove_if(_idle.begin(), _idle.end(), [m](const Idle& i) {
+                        return i.module == m;
+                    }),
+                    _idle.end());
+        }
+
+        void EmulatorPool::clear()
+        {
+            _idle.clear();
+        }
+
+        void EmulatorPool::setCapacity(std::size_t capacity)
+        {
+            _capacity = capacity;
+            trim();
+        }
+
+        std::size_t EmulatorPool::getCapacity() const
+        {
+            return _capacity;
+        }
+
+        std::size_t EmulatorPool::getIdleCount() const
+        {
+            return _idle.size();
+        }
+
+        void EmulatorPool::setResetPolicy(const ResetPolicy& policy)
+        {
+            _policy = policy;
+        }
+
+    } // llvmir_emul
+} // retdec
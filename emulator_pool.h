@@ -0,0 +1,112 @@
+/**
+ * @file emulator_pool.h
+ * @brief Per-thread pool of emulators reused across functions.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_EMULATOR_POOL_H
+#define RETDEC_LLVMIR_EMUL_EMULATOR_POOL_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <llvm/IR/Module.h>
+
+#include "llvmir-emul.h"
+#include "program_image.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+/**
+ * Idle emulators of recently used modules. Constructing an emulator
+ * initializes all globals of its module, resetting one (see
+ * @c LlvmIrEmulator::reset()) only undoes what the last runs changed, so
+ * callers emulating many functions of the same module lease emulators from
+ * here instead of creating them.
+ *
+ * A pool is not thread-safe -- each thread uses its own, see @c local().
+ * Leases must be returned to the pool they came from before it is
+ * destroyed, and idle emulators of a module must be evicted before the
+ * module is.
+ */
+        class EmulatorPool
+        {
+        public:
+/**
+ * Emulator leased from a pool. Destroying the lease resets the emulator
+ * and returns it to the pool.
+ */
+            using Lease = std::unique_ptr<
+                    LlvmIrEmulator,
+                    std::function<void(LlvmIrEmulator*)>>;
+
+        public:
+            explicit EmulatorPool(std::size_t capacity = 4);
+
+/**
+ * @return Pool of the calling thread.
+ */
+            static EmulatorPool& local();
+
+/**
+ * @return Idle emulator of @a m created with the same @a lazyGlobals, or a
+ *         new one.
+ */
+            Lease acquire(llvm::Module* m, bool lazyGlobals = false);
+/**
+ * @return Idle emulator of @a image created with the same @a lazyGlobals,
+ *         or a new one.
+ */
+            Lease acquire(
+                    std::shared_ptr<const ProgramImage> image,
+                    bool lazyGlobals = false);
+
+/**
+ * Destroys idle emulators of @a m, including those sharing an image of it.
+ */
+            void evict(const llvm::Module* m);
+            void clear();
+
+/**
+ * Idle emulators kept at most. The least recently returned ones are
+ * destroyed first.
+ */
+            void setCapacity(std::size_t capacity);
+            std::size_t getCapacity() const;
+            std::size_t getIdleCount() const;
+/**
+ * What is cleared when leases are returned. Profiles are kept by default,
+ * so reused emulators keep hot functions in their tiers.
+ */
+            void setResetPolicy(const ResetPolicy& policy);
+
+        private:
+            struct Idle
+            {
+                const llvm::Module* module;
+                const ProgramImage* image;
+                bool lazyGlobals;
+                std::unique_ptr<LlvmIrEmulator> emulator;
+            };
+
+            Lease take(const llvm::Module* m, const ProgramImage* image, bool lazyGlobals);
+            Lease lease(
+                    std::unique_ptr<LlvmIrEmulator> emu,
+                    const llvm::Module* m,
+                    const ProgramImage* image,
+                    bool lazyGlobals);
+            void trim();
+
+        private:
+            /// Least recently returned first.
+            std::vector<Idle> _idle;
+            std::size_t _capacity;
+            ResetPolicy _policy;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
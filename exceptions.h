@@ -8,6 +8,7 @@
 #define RETDEC_LLVMIR_EMUL_EXCEPTIONS_H
 
 #include <cassert>
+#include <iostream>
 #include <sstream>
 #include <stdexcept>
 
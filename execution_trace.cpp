@@ -0,0 +1,524 @@
+/**
+ * @file execution_trace.cpp
+ * @brief Compressed binary traces of emulation streamed to files.
+ */
+
+#include <cstring>
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+
+#include "execution_trace.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            const char TRACE_MAGIC[8] = {'L', 'L', 'E', 'M', 'T', 'R', 'A', 'C'};
+            const uint32_t TRACE_VERSION = 1;
+            /// Bits of an event's first byte holding its kind.
+            const unsigned KIND_BITS = 3;
+
+            static_assert(sizeof(TraceHeader) == 32, "unexpected padding");
+            static_assert(sizeof(TraceChunkHeader) == 8, "unexpected padding");
+
+            unsigned streamOf(TraceEvent event)
+            {
+                switch (event)
+                {
+                    case TraceEvent::Instruction:
+                        return 0;
+                    case TraceEvent::Block:
+                        return 1;
+                    case TraceEvent::Call:
+                        return 2;
+                    case TraceEvent::MemoryLoad:
+                    case TraceEvent::MemoryStore:
+                        return 3;
+                    case TraceEvent::GlobalLoad:
+                    case TraceEvent::GlobalStore:
+                        return 4;
+                }
+                return 0;
+            }
+
+            uint64_t zigzag(uint64_t delta)
+            {
+                return (delta << 1) ^ uint64_t(int64_t(delta) >> 63);
+            }
+
+            uint64_t unzigzag(uint64_t v)
+            {
+                return (v >> 1) ^ (~(v & 1) + 1);
+            }
+
+/**
+* Appends the varint of (@a zz << @c KIND_BITS | @a kind). The value has up
+* to 67 bits, so the kind shares the first byte with the low bits of
+* @a zz instead of being shifted into a 64-bit number.
+*/
+            void putEvent(std::vector<uint8_t>& out, unsigned kind, uint64_t zz)
+            {
+                uint8_t b = kind | uint8_t((zz & 0xf) << KIND_BITS);
+                zz >>= 7 - KIND_BITS;
+                while (zz)
+                {
+                    out.push_back(b | 0x80);
+                    b = zz & 0x7f;
+                    zz >>= 7;
+                }
+                out.push_back(b);
+            }
+
+/**
+* @return @c False if the varint at @a pos is truncated or too long.
+*/
+            bool getEvent(
+                    const uint8_t*& pos,
+                    const uint8_t* end,
+                    unsigned& kind,
+                    uint64_t& zz)
+            {
+                if (pos == end)
+                {
+                    return false;
+                }
+                uint8_t b = *pos++;
+                kind = b & ((1 << KIND_BITS) - 1);
+                zz = (b & 0x7f) >> KIND_BITS;
+                unsigned shift = 7 - KIND_BITS;
+                while (b & 0x80)
+                {
+                    if (pos == end || shift >= 64)
+                    {
+                        return false;
+                    }
+                    b = *pos++;
+                    zz |= uint64_t(b & 0x7f) << shift;
+                    shift += 7;
+                }
+                return true;
+            }
+
+        } // anonymous namespace
+
+//
+//=============================================================================
+// TraceIds
+//=============================================================================
+//
+
+        TraceIds::TraceIds(const llvm::Module* m)
+        {
+            for (auto& g : m->globals())
+            {
+                _ids[&g] = _globals.size();
+                _globals.push_back(&g);
+            }
+            for (auto& f : *m)
+            {
+                _ids[&f] = _functions.size();
+                _functions.push_back(&f);
+                for (auto& bb : f)
+                {
+                    _ids[&bb] = _blocks.size();
+                    _blocks.push_back(&bb);
+                    for (auto& i : bb)
+                    {
+                        _ids[&i] = _instructions.size();
+                        _instructions.push_back(&i);
+                    }
+                }
+            }
+        }
+
+        uint64_t TraceIds::find(const llvm::Value* v) const
+        {
+            auto it = _ids.find(v);
+            return it != _ids.end() ? it->second : UNKNOWN;
+        }
+
+        uint64_t TraceIds::getId(const llvm::Instruction* i) const
+        {
+            return find(i);
+        }
+
+        uint64_t TraceIds::getId(const llvm::BasicBlock* bb) const
+        {
+            return find(bb);
+        }
+
+        uint64_t TraceIds::getId(const llvm::GlobalVariable* g) const
+        {
+            return find(g);
+        }
+
+        uint64_t TraceIds::getId(const llvm::Function* f) const
+        {
+            return f ? find(f) : UNKNOWN;
+        }
+
+        const llvm::Instruction* TraceIds::getInstruction(uint64_t id) const
+        {
+            return id < _instructions.size() ? _instructions[id] : nullptr;
+        }
+
+        const llvm::BasicBlock* TraceIds::getBlock(uint64_t id) const
+        {
+            return id < _blocks.size() ? _blocks[id] : nullptr;
+        }
+
+        const llvm::GlobalVariable* TraceIds::getGlobal(uint64_t id) const
+        {
+            return id < _globals.size() ? _globals[id] : nullptr;
+        }
+
+        const llvm::Function* TraceIds::getFunction(uint64_t id) const
+        {
+            return id < _functions.size() ? _functions[id] : nullptr;
+        }
+
+        bool TraceIds::matches(const TraceHeader& header) const
+        {
+            return header.instructions == _instructions.size()
+                    && header.blocks == _blocks.size()
+                    && header.globals == _globals.size()
+                    && header.functions == _functions.size();
+        }
+
+        void TraceIds::fill(TraceHeader& header) const
+        {
+            header.instructions = _instructions.size();
+            header.blocks = _blocks.size();
+            header.globals = _globals.size();
+            header.functions = _functions.size();
+        }
+
+//
+//=============================================================================
+// TraceWriter
+//=============================================================================
+//
+
+        TraceWriter::TraceWriter(
+                const std::string& path,
+                const llvm::Module* m,
+                std::size_t chunkBytes) :
+                _path(path),
+                _ids(m),
+                _chunkBytes(std::min<std::size_t>(std::max<std::size_t>(chunkBytes, 16), 1 << 30))
+        {
+            // A varint takes at most 10 bytes, the buffer never grows.
+            _chunk.reserve(_chunkBytes + 10);
+
+            _file = std::fopen((_path + ".tmp").c_str(), "wb");
+            if (_file == nullptr)
+            {
+                return;
+            }
+            TraceHeader h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, TRACE_MAGIC, sizeof(h.magic));
+            h.version = TRACE_VERSION;
+            _ids.fill(h);
+            _ok = std::fwrite(&h, sizeof(h), 1, _file) == 1;
+            _written = sizeof(h);
+        }
+
+        TraceWriter::~TraceWriter()
+        {
+            if (_file)
+            {
+                finish();
+            }
+        }
+
+        bool TraceWriter::isOpen() const
+        {
+            return _file != nullptr && _ok;
+        }
+
+        void TraceWriter::instruction(const llvm::Instruction* i)
+        {
+            add(TraceEvent::Instruction, _ids.getId(i));
+        }
+
+        void TraceWriter::block(const llvm::BasicBlock* bb)
+        {
+            add(TraceEvent::Block, _ids.getId(bb));
+        }
+
+        void TraceWriter::memoryLoad(uint64_t addr)
+        {
+            add(TraceEvent::MemoryLoad, addr);
+        }
+
+        void TraceWriter::memoryStore(uint64_t addr)
+        {
+            add(TraceEvent::MemoryStore, addr);
+        }
+
+        void TraceWriter::globalLoad(const llvm::GlobalVariable* g)
+        {
+            add(TraceEvent::GlobalLoad, _ids.getId(g));
+        }
+
+        void TraceWriter::globalStore(const llvm::GlobalVariable* g)
+        {
+            add(TraceEvent::GlobalStore, _ids.getId(g));
+        }
+
+        void TraceWriter::call(const llvm::Function* callee)
+        {
+            add(TraceEvent::Call, _ids.getId(callee));
+        }
+
+        void TraceWriter::add(TraceEvent event, uint64_t value)
+        {
+            uint64_t& prev = _prev[streamOf(event)];
+            putEvent(_chunk, unsigned(event), zigzag(value - prev));
+            prev = value;
+            ++_chunkEvents;
+            ++_events;
+            if (_chunk.size() >= _chunkBytes)
+            {
+                flushChunk();
+            }
+        }
+
+        void TraceWriter::flushChunk()
+        {
+            if (_chunkEvents == 0)
+            {
+                return;
+            }
+            if (_ok)
+            {
+                TraceChunkHeader h;
+                h.bytes = _chunk.size();
+                h.events = _chunkEvents;
+                _ok = std::fwrite(&h, sizeof(h), 1, _file) == 1
+                        && std::fwrite(_chunk.data(), 1, _chunk.size(), _file) == _chunk.size();
+                _written += sizeof(h) + _chunk.size();
+            }
+            _chunk.clear();
+            _chunkEvents = 0;
+            memset(_prev, 0, sizeof(_prev));
+        }
+
+        bool TraceWriter::finish()
+        {
+            if (_file == nullptr)
+            {
+                return false;
+            }
+            flushChunk();
+            std::string tmp = _path + ".tmp";
+            bool ok = _ok;
+            ok = std::fflush(_file) == 0 && ok;
+            ok = std::fclose(_file) == 0 && ok;
+            _file = nullptr;
+            ok = ok && std::rename(tmp.c_str(), _path.c_str()) == 0;
+            if (!ok)
+            {
+                std::remove(tmp.c_str());
+            }
+            _ok = ok;
+            return ok;
+        }
+
+        const TraceIds& TraceWriter::getIds() const
+        {
+            return _ids;
+        }
+
+        uint64_t TraceWriter::getEventCount() const
+        {
+            return _events;
+        }
+
+        uint64_t TraceWriter::getBytesWritten() const
+        {
+            return _written;
+        }
+
+//
+//=============================================================================
+// ExecutionTrace::Iterator
+//=============================================================================
+//
+
+        ExecutionTrace::Iterator::Iterator(
+                const ExecutionTrace* trace,
+                std::size_t first,
+                std::size_t last) :
+                _trace(trace),
+                _chunk(first),
+                _last(last)
+        {
+            enterChunk();
+            ++*this;
+        }
+
+/**
+* Moves to the first non-empty chunk from @c _chunk on, or to the end.
+*/
+        void ExecutionTrace::Iterator::enterChunk()
+        {
+            for (; _chunk < _last; ++_chunk)
+            {
+                const Chunk& c = _trace->_chunks[_chunk];
+                if (c.bytes)
+                {
+                    _pos = c.data;
+                    _end = c.data + c.bytes;
+                    memset(_prev, 0, sizeof(_prev));
+                    return;
+                }
+            }
+            _pos = nullptr;
+            _end = nullptr;
+        }
+
+        const TraceRecord& ExecutionTrace::Iterator::operator*() const
+        {
+            return _record;
+        }
+
+        const TraceRecord* ExecutionTrace::Iterator::operator->() const
+        {
+            return &_record;
+        }
+
+        ExecutionTrace::Iterator& ExecutionTrace::Iterator::operator++()
+        {
+            if (_pos != nullptr && _pos == _end)
+            {
+                ++_chunk;
+                enterChunk();
+            }
+            unsigned kind = 0;
+            uint64_t zz = 0;
+            if (_pos == nullptr
+                    || !getEvent(_pos, _end, kind, zz)
+                    || kind > unsigned(TraceEvent::Call))
+            {
+                _pos = nullptr;
+                _end = nullptr;
+                return *this;
+            }
+            _record.event = TraceEvent(kind);
+            uint64_t& prev = _prev[streamOf(_record.event)];
+            prev += unzigzag(zz);
+            _record.value = prev;
+            return *this;
+        }
+
+/**
+* Iterators differ in where the next event starts, all finished ones are
+* equal.
+*/
+        bool ExecutionTrace::Iterator::operator==(const Iterator& o) const
+        {
+            return _pos == o._pos && (_pos == nullptr || _chunk == o._chunk);
+        }
+
+        bool ExecutionTrace::Iterator::operator!=(const Iterator& o) const
+        {
+            return !(*this == o);
+        }
+
+//
+//=============================================================================
+// ExecutionTrace
+//=============================================================================
+//
+
+        bool ExecutionTrace::open(const std::string& path)
+        {
+            _header = nullptr;
+            _chunks.clear();
+            _events = 0;
+            if (!_file.open(path) || _file.size() < sizeof(TraceHeader))
+            {
+                return false;
+            }
+
+            auto* h = reinterpret_cast<const TraceHeader*>(_file.data());
+            if (memcmp(h->magic, TRACE_MAGIC, sizeof(h->magic)) != 0
+                    || h->version != TRACE_VERSION)
+            {
+                _file.close();
+                return false;
+            }
+
+            auto* data = reinterpret_cast<const uint8_t*>(_file.data());
+            uint64_t size = _file.size();
+            uint64_t pos = sizeof(TraceHeader);
+            while (pos < size)
+            {
+                TraceChunkHeader ch;
+                if (size - pos < sizeof(ch))
+                {
+                    _file.close();
+                    return false;
+                }
+                memcpy(&ch, data + pos, sizeof(ch));
+                pos += sizeof(ch);
+                if (ch.bytes > size - pos)
+                {
+                    _file.close();
+                    return false;
+                }
+                Chunk c;
+                c.data = data + pos;
+                c.bytes = ch.bytes;
+                c.events = ch.events;
+                _chunks.push_back(c);
+                _events += ch.events;
+                pos += ch.bytes;
+            }
+
+            _header = h;
+            return true;
+        }
+
+        bool ExecutionTrace::matches(const TraceIds& ids) const
+        {
+            return _header && ids.matches(*_header);
+        }
+
+        std::size_t ExecutionTrace::getChunkCount() const
+        {
+            return _chunks.size();
+        }
+
+        uint64_t ExecutionTrace::getEventCount() const
+        {
+            return _events;
+        }
+
+        uint64_t ExecutionTrace::getChunkEventCount(std::size_t i) const
+        {
+            return _chunks[i].events;
+        }
+
+        ExecutionTrace::Iterator ExecutionTrace::begin() const
+        {
+            return Iterator(this, 0, _chunks.size());
+        }
+
+        ExecutionTrace::Iterator ExecutionTrace::end() const
+        {
+            return Iterator();
+        }
+
+        ExecutionTrace::Range ExecutionTrace::getChunk(std::size_t i) const
+        {
+            Range r;
+            r.first = Iterator(this, i, i + 1);
+            return r;
+        }
+
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,279 @@
+/**
+ * @file execution_trace.h
+ * @brief Compressed binary traces of emulation streamed to files.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_EXECUTION_TRACE_H
+#define RETDEC_LLVMIR_EMUL_EXECUTION_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Module.h>
+
+#include "mapped_file.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+/**
+ * Trace file layout, all numbers are little-endian:
+ * - header
+ * - chunks: a @c TraceChunkHeader, then @c bytes of events
+ *
+ * An event is one LEB128 varint: the zigzag encoded difference of its value
+ * and the previous value of the same stream, shifted left by three bits,
+ * with the @c TraceEvent kind in the low bits. Instructions, blocks, calls,
+ * memory accesses and global accesses are separate streams -- consecutive
+ * instructions then differ by one and most events take a single byte.
+ * Every chunk starts with all streams at zero, so chunks decode
+ * independently.
+ */
+        struct TraceHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t reserved;
+            /// Sizes of the numbering (see @c TraceIds) of the traced module,
+            /// so that readers can check they resolve ids against the same one.
+            uint32_t instructions;
+            uint32_t blocks;
+            uint32_t globals;
+            uint32_t functions;
+        };
+
+        struct TraceChunkHeader
+        {
+            uint32_t bytes;
+            uint32_t events;
+        };
+
+        enum class TraceEvent : uint8_t
+        {
+            Instruction = 0,
+            Block,
+            MemoryLoad,
+            MemoryStore,
+            GlobalLoad,
+            GlobalStore,
+            Call,
+        };
+
+        /// Delta streams: instructions, blocks, calls, memory, globals.
+        const unsigned TRACE_STREAMS = 5;
+
+/**
+ * Decoded event. @c value is an address for memory accesses, a
+ * @c TraceIds id otherwise.
+ */
+        struct TraceRecord
+        {
+            TraceEvent event = TraceEvent::Instruction;
+            uint64_t value = 0;
+        };
+
+/**
+ * Dense numbering of instructions, blocks, globals and functions of a
+ * module in their module order. Traces store these ids instead of
+ * pointers, a reader resolves them with a numbering of the same module.
+ */
+        class TraceIds
+        {
+        public:
+            /// Id of what is not in the module, e.g. indirect callees.
+            static const uint64_t UNKNOWN = ~uint64_t(0);
+
+        public:
+            explicit TraceIds(const llvm::Module* m);
+
+            uint64_t getId(const llvm::Instruction* i) const;
+            uint64_t getId(const llvm::BasicBlock* bb) const;
+            uint64_t getId(const llvm::GlobalVariable* g) const;
+            uint64_t getId(const llvm::Function* f) const;
+
+/**
+ * @return Object with id @a id, or @c nullptr.
+ */
+            const llvm::Instruction* getInstruction(uint64_t id) const;
+            const llvm::BasicBlock* getBlock(uint64_t id) const;
+            const llvm::GlobalVariable* getGlobal(uint64_t id) const;
+            const llvm::Function* getFunction(uint64_t id) const;
+
+            bool matches(const TraceHeader& header) const;
+            void fill(TraceHeader& header) const;
+
+        private:
+            uint64_t find(const llvm::Value* v) const;
+
+        private:
+            llvm::DenseMap<const llvm::Value*, uint32_t> _ids;
+            std::vector<const llvm::Instruction*> _instructions;
+            std::vector<const llvm::BasicBlock*> _blocks;
+            std::vector<const llvm::GlobalVariable*> _globals;
+            std::vector<const llvm::Function*> _functions;
+        };
+
+/**
+ * Streams events to a trace file. Events are encoded into a buffer of one
+ * chunk, which is written out when full, so memory use does not grow with
+ * the trace. The file is written under a temporary name and renamed by
+ * @c finish().
+ *
+ * Not thread-safe, an emulator traces into its own writer (see
+ * @c LlvmIrEmulator::setTraceWriter()).
+ */
+        class TraceWriter
+        {
+        public:
+            TraceWriter(
+                    const std::string& path,
+                    const llvm::Module* m,
+                    std::size_t chunkBytes = 1 << 16);
+            TraceWriter(const TraceWriter&) = delete;
+            TraceWriter& operator=(const TraceWriter&) = delete;
+/**
+ * Finishes the trace if @c finish() was not called.
+ */
+            ~TraceWriter();
+
+            bool isOpen() const;
+
+            void instruction(const llvm::Instruction* i);
+            void block(const llvm::BasicBlock* bb);
+            void memoryLoad(uint64_t addr);
+            void memoryStore(uint64_t addr);
+            void globalLoad(const llvm::GlobalVariable* g);
+            void globalStore(const llvm::GlobalVariable* g);
+/**
+ * @param callee Called function, @c nullptr if it is not known.
+ */
+            void call(const llvm::Function* callee);
+            void add(TraceEvent event, uint64_t value);
+
+/**
+ * Writes the last chunk and renames the file to its path.
+ * @return @c True if the whole trace was written.
+ */
+            bool finish();
+
+            const TraceIds& getIds() const;
+            uint64_t getEventCount() const;
+            uint64_t getBytesWritten() const;
+
+        private:
+            void flushChunk();
+
+        private:
+            std::string _path;
+            std::FILE* _file = nullptr;
+            bool _ok = false;
+            TraceIds _ids;
+
+            std::size_t _chunkBytes;
+            std::vector<uint8_t> _chunk;
+            uint32_t _chunkEvents = 0;
+            uint64_t _prev[TRACE_STREAMS] = {};
+
+            uint64_t _events = 0;
+            uint64_t _written = 0;
+        };
+
+/**
+ * Zero-copy reader of a trace file. Opening maps the file and validates
+ * the chunk headers; events are decoded by iterators on the fly.
+ */
+        class ExecutionTrace
+        {
+        public:
+/**
+ * Input iterator over events of a range of chunks. A corrupted chunk ends
+ * the iteration.
+ */
+            class Iterator
+            {
+            public:
+                using iterator_category = std::input_iterator_tag;
+                using value_type = TraceRecord;
+                using difference_type = std::ptrdiff_t;
+                using pointer = const TraceRecord*;
+                using reference = const TraceRecord&;
+
+                Iterator() = default;
+
+                const TraceRecord& operator*() const;
+                const TraceRecord* operator->() const;
+                Iterator& operator++();
+                bool operator==(const Iterator& o) const;
+                bool operator!=(const Iterator& o) const;
+
+            private:
+                friend class ExecutionTrace;
+                Iterator(const ExecutionTrace* trace, std::size_t first, std::size_t last);
+
+                void enterChunk();
+
+            private:
+                const ExecutionTrace* _trace = nullptr;
+                std::size_t _chunk = 0;
+                std::size_t _last = 0;
+                const uint8_t* _pos = nullptr;
+                const uint8_t* _end = nullptr;
+                uint64_t _prev[TRACE_STREAMS] = {};
+                TraceRecord _record;
+            };
+
+            struct Range
+            {
+                Iterator first;
+                Iterator last;
+
+                Iterator begin() const
+                {
+                    return first;
+                }
+                Iterator end() const
+                {
+                    return last;
+                }
+            };
+
+        public:
+            bool open(const std::string& path);
+
+            bool matches(const TraceIds& ids) const;
+            std::size_t getChunkCount() const;
+            uint64_t getEventCount() const;
+            uint64_t getChunkEventCount(std::size_t i) const;
+
+            Iterator begin() const;
+            Iterator end() const;
+/**
+ * @return Events of chunk @a i. Ranges of different chunks can be decoded
+ *         by different threads.
+ */
+            Range getChunk(std::size_t i) const;
+
+        private:
+            struct Chunk
+            {
+                const uint8_t* data;
+                uint32_t bytes;
+                uint32_t events;
+            };
+
+        private:
+            MappedFile _file;
+            const TraceHeader* _header = nullptr;
+            std::vector<Chunk> _chunks;
+            uint64_t _events = 0;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
@@ -0,0 +1,238 @@
+/**
+ * @file fusion.cpp
+ * @brief Superinstructions for frequent short idioms of decompiled IR.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+
+#include "fusion.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            bool uses(const Instruction* user, const Instruction* used)
+            {
+                for (auto& op : user->operands())
+                {
+                    if (op.get() == used)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool matchLoadOpStore(
+                    const Instruction* i0,
+                    const Instruction* i1,
+                    const Instruction* i2)
+            {
+                auto* l = dyn_cast<LoadInst>(i0);
+                auto* op = dyn_cast<BinaryOperator>(i1);
+                auto* s = dyn_cast<StoreInst>(i2);
+                return l && op && s
+                        && isa<GlobalVariable>(l->getPointerOperand())
+                        && uses(op, l)
+                        && s->getValueOperand() == op
+                        && s->getPointerOperand() == l->getPointerOperand();
+            }
+
+            bool matchCmpBranch(const Instruction* i0, const Instruction* i1)
+            {
+                auto* br = dyn_cast<BranchInst>(i1);
+                return isa<ICmpInst>(i0)
+                        && br && br->isConditional()
+                        && br->getCondition() == i0;
+            }
+
+            bool matchCmpExt(const Instruction* i0, const Instruction* i1)
+            {
+                return isa<ICmpInst>(i0)
+                        && isa<ZExtInst>(i1)
+                        && i1->getOperand(0) == i0;
+            }
+
+            bool matchExtCmp(const Instruction* i0, const Instruction* i1)
+            {
+                return isa<ZExtInst>(i0)
+                        && isa<ICmpInst>(i1)
+                        && uses(i1, i0);
+            }
+
+            bool fuse(
+                    const std::vector<const Instruction*>& insns,
+                    std::size_t i,
+                    FusedOp& op)
+            {
+                std::size_t left = insns.size() - i;
+                if (left >= 3 && matchLoadOpStore(insns[i], insns[i + 1], insns[i + 2]))
+                {
+                    op = {FusedKind::LoadOpStore, 3};
+                    return true;
+                }
+                if (left < 2)
+                {
+                    return false;
+                }
+                if (matchCmpBranch(insns[i], insns[i + 1]))
+                {
+                    op = {FusedKind::CmpBranch, 2};
+                    return true;
+                }
+                if (matchCmpExt(insns[i], insns[i + 1]))
+                {
+                    op = {FusedKind::CmpExt, 2};
+                    return true;
+                }
+                if (matchExtCmp(insns[i], insns[i + 1]))
+                {
+                    op = {FusedKind::ExtCmp, 2};
+                    return true;
+                }
+                return false;
+            }
+
+        } // anonymous namespace
+
+        FusionTable buildFusionTable(llvm::Function& f)
+        {
+            FusionTable table;
+            std::vector<const Instruction*> insns;
+            for (BasicBlock& bb : f)
+            {
+                insns.clear();
+                for (Instruction& i : bb)
+                {
+                    insns.push_back(&i);
+                }
+
+                // Greedy, left to right -- superinstructions do not overlap.
+                for (std::size_t i = 0; i < insns.size(); )
+                {
+                    FusedOp op;
+                    if (fuse(insns, i, op))
+                    {
+                        table[insns[i]] = op;
+                        i += op.length;
+                    }
+                    else
+                    {
+                        ++i;
+                    }
+                }
+            }
+            return table;
+        }
+
+        const char* fusedKindName(FusedKind k)
+        {
+            switch (k)
+            {
+                case FusedKind::LoadOpStore: return "load-op-store";
+                case FusedKind::CmpBranch: return "icmp-br";
+                case FusedKind::CmpExt: return "icmp-zext";
+                case FusedKind::ExtCmp: return "zext-icmp";
+            }
+            return "unknown";
+        }
+
+//
+//=============================================================================
+// FusionProfile
+//=============================================================================
+//
+
+        void FusionProfile::addFunction(const llvm::Function& f)
+        {
+            std::vector<const Instruction*> insns;
+            for (const BasicBlock& bb : f)
+            {
+                insns.clear();
+                for (const Instruction& i : bb)
+                {
+                    insns.push_back(&i);
+                }
+                _instructions += insns.size();
+
+                for (std::size_t i = 0; i + 1 < insns.size(); ++i)
+                {
+                    if (!uses(insns[i + 1], insns[i]))
+                    {
+                        continue;
+                    }
+                    std::string pair = std::string(insns[i]->getOpcodeName())
+                            + " " + insns[i + 1]->getOpcodeName();
+                    ++_counts[pair];
+
+                    if (i + 2 < insns.size() && uses(insns[i + 2], insns[i + 1]))
+                    {
+                        ++_counts[pair + " " + insns[i + 2]->getOpcodeName()];
+                    }
+                }
+
+                FusedOp op;
+                for (std::size_t i = 0; i < insns.size(); )
+                {
+                    if (fuse(insns, i, op))
+                    {
+                        ++_counts[std::string("[fused ") + fusedKindName(op.kind) + "]"];
+                        i += op.length;
+                    }
+                    else
+                    {
+                        ++i;
+                    }
+                }
+            }
+        }
+
+        void FusionProfile::addModule(const llvm::Module& m)
+        {
+            for (const Function& f : m)
+            {
+                if (!f.isDeclaration())
+                {
+                    addFunction(f);
+                }
+            }
+        }
+
+        void FusionProfile::print(std::ostream& out, std::size_t top) const
+        {
+            std::vector<std::pair<uint64_t, std::string>> sorted;
+            for (auto& p : _counts)
+            {
+                sorted.emplace_back(p.second, p.first);
+            }
+            std::sort(sorted.begin(), sorted.end(), [](
+                    const std::pair<uint64_t, std::string>& a,
+                    const std::pair<uint64_t, std::string>& b) {
+                return a.first != b.first ? a.first > b.first : a.second < b.second;
+            });
+
+            out << "instructions\t" << _instructions << "\n";
+            for (std::size_t i = 0; i < sorted.size() && i < top; ++i)
+            {
+                out << sorted[i].first << "\t" << sorted[i].second << "\n";
+            }
+        }
+
+        const std::map<std::string, uint64_t>& FusionProfile::getCounts() const
+        {
+            return _counts;
+        }
+
+        uint64_t FusionProfile::getInstructionCount() const
+        {
+            return _instructions;
+        }
+
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,88 @@
+/**
+ * @file fusion.h
+ * @brief Superinstructions for frequent short idioms of decompiled IR.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_FUSION_H
+#define RETDEC_LLVMIR_EMUL_FUSION_H
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Module.h>
+
+namespace retdec {
+    namespace llvmir_emul {
+
+/**
+ * Idioms the emulator executes as one superinstruction.
+ */
+        enum class FusedKind : uint8_t
+        {
+            /// load @g; binop (using the load); store (the binop) to @g
+            LoadOpStore,
+            /// icmp; br on the icmp
+            CmpBranch,
+            /// icmp; zext of the icmp
+            CmpExt,
+            /// zext; icmp using the zext
+            ExtCmp,
+        };
+
+        struct FusedOp
+        {
+            FusedKind kind;
+            /// Number of instructions covered, starting with the table key.
+            uint8_t length;
+        };
+
+/**
+ * Superinstructions of one function keyed by their first instruction.
+ */
+        using FusionTable = llvm::DenseMap<const llvm::Instruction*, FusedOp>;
+
+/**
+ * Finds all the fusable idioms in @a f. Instructions of one idiom must be
+ * adjacent in their block and data dependent, so executing them one after
+ * another through the fused path is exactly what the ordinary dispatch
+ * would do. Calls are never fused -- they push frames.
+ */
+        FusionTable buildFusionTable(llvm::Function& f);
+
+        const char* fusedKindName(FusedKind k);
+
+/**
+ * Counts data-dependent sequences of adjacent instructions -- pairs and
+ * triples where every instruction uses its predecessor -- over a corpus.
+ * This tells which idioms are worth a superinstruction.
+ */
+        class FusionProfile
+        {
+        public:
+            void addFunction(const llvm::Function& f);
+            void addModule(const llvm::Module& m);
+
+/**
+ * Prints the @a top most frequent patterns, one per line: count and pattern
+ * (opcode names separated by spaces). Patterns named @c [fused kind] count
+ * superinstructions @c buildFusionTable() would create.
+ */
+            void print(std::ostream& out, std::size_t top = 50) const;
+
+            const std::map<std::string, uint64_t>& getCounts() const;
+            uint64_t getInstructionCount() const;
+
+        private:
+            std::map<std::string, uint64_t> _counts;
+            uint64_t _instructions = 0;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
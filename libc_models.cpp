@@ -0,0 +1,354 @@
+/**
+ * @file libc_models.cpp
+ * @brief Models of external library functions working on emulated memory.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "libc_models.h"
+#include "llvmir-emul.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            /// Bytes gathered from emulated memory at once by scanning models.
+            const std::size_t CHUNK = 256;
+
+            bool kindMatches(LibcKind kind, const Type* t)
+            {
+                switch (kind)
+                {
+                    case LibcKind::Any:
+                        return true;
+                    case LibcKind::Integer:
+                        return t->isIntegerTy();
+                    case LibcKind::Address:
+                        return t->isPointerTy() || t->isIntegerTy();
+                    case LibcKind::Void:
+                        return t->isVoidTy();
+                }
+                return false;
+            }
+
+/**
+* Offset of the first byte equal to @a c in [@a addr, @a addr + @a n), or
+* @a n.
+*/
+            std::size_t scanFor(
+                    GlobalExecutionContext& memory,
+                    uint64_t addr,
+                    int c,
+                    std::size_t n)
+            {
+                uint8_t buf[CHUNK];
+                for (std::size_t off = 0; off < n; off += CHUNK)
+                {
+                    std::size_t len = std::min(CHUNK, n - off);
+                    memory.readBytes(addr + off, buf, len);
+                    if (auto* hit = static_cast<const uint8_t*>(std::memchr(buf, c, len)))
+                    {
+                        return off + (hit - buf);
+                    }
+                }
+                return n;
+            }
+
+/**
+* Compares [@a a, @a a + @a n) with [@a b, @a b + @a n), stopping after
+* a NUL if @a strings is set.
+*/
+            int compare(
+                    GlobalExecutionContext& memory,
+                    uint64_t a,
+                    uint64_t b,
+                    std::size_t n,
+                    bool strings)
+            {
+                uint8_t bufA[CHUNK];
+                uint8_t bufB[CHUNK];
+                for (std::size_t off = 0; off < n; off += CHUNK)
+                {
+                    std::size_t len = std::min(CHUNK, n - off);
+                    memory.readBytes(a + off, bufA, len);
+                    memory.readBytes(b + off, bufB, len);
+                    if (strings)
+                    {
+                        if (auto* nul = static_cast<const uint8_t*>(std::memchr(bufA, 0, len)))
+                        {
+                            len = nul - bufA + 1;
+                            n = off + len;
+                        }
+                    }
+                    if (std::memcmp(bufA, bufB, len) == 0)
+                    {
+                        continue;
+                    }
+                    for (std::size_t k = 0; k < len; ++k)
+                    {
+                        if (bufA[k] != bufB[k])
+                        {
+                            return int(bufA[k]) - int(bufB[k]);
+                        }
+                    }
+                }
+                return 0;
+            }
+
+            std::size_t clampLength(const LibcCall& c, uint64_t n)
+            {
+                return std::min<uint64_t>(n, c.getMaxBytes());
+            }
+
+            LibcSignature signature(std::initializer_list<LibcKind> params, LibcKind result)
+            {
+                LibcSignature s;
+                s.params = params;
+                s.result = result;
+                return s;
+            }
+
+        } // anonymous namespace
+
+        bool LibcSignature::matches(const llvm::CallInst& call) const
+        {
+            if (call.getNumArgOperands() != params.size()
+                    || !kindMatches(result, call.getType()))
+            {
+                return false;
+            }
+            for (unsigned i = 0; i < params.size(); ++i)
+            {
+                if (!kindMatches(params[i], call.getArgOperand(i)->getType()))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+//
+//=============================================================================
+// LibcCall
+//=============================================================================
+//
+
+        LibcCall::LibcCall(
+                GlobalExecutionContext& memory,
+                llvm::CallInst& call,
+                const std::vector<llvm::GenericValue>& args,
+                std::size_t maxBytes) :
+                _memory(memory),
+                _call(call),
+                _args(args),
+                _maxBytes(maxBytes)
+        {
+
+        }
+
+        uint64_t LibcCall::getAddress(unsigned i) const
+        {
+            if (i >= _args.size())
+            {
+                return 0;
+            }
+            if (_call.getArgOperand(i)->getType()->isPointerTy())
+            {
+                return reinterpret_cast<uintptr_t>(_args[i].PointerVal);
+            }
+            return getInteger(i);
+        }
+
+        uint64_t LibcCall::getInteger(unsigned i) const
+        {
+            if (i >= _args.size())
+            {
+                return 0;
+            }
+            const APInt& v = _args[i].IntVal;
+            return v.getBitWidth() > 64 ? v.trunc(64).getZExtValue() : v.getZExtValue();
+        }
+
+        llvm::GenericValue LibcCall::makeResult(uint64_t v) const
+        {
+            GenericValue res;
+            Type* t = _call.getType();
+            if (t->isPointerTy())
+            {
+                res.PointerVal = reinterpret_cast<void*>(uintptr_t(v));
+            }
+            else if (t->isIntegerTy())
+            {
+                res.IntVal = APInt(t->getIntegerBitWidth(), v);
+            }
+            return res;
+        }
+
+        GlobalExecutionContext& LibcCall::getMemory() const
+        {
+            return _memory;
+        }
+
+        llvm::CallInst& LibcCall::getCall() const
+        {
+            return _call;
+        }
+
+        std::size_t LibcCall::getMaxBytes() const
+        {
+            return _maxBytes;
+        }
+
+//
+//=============================================================================
+// LibcModels
+//=============================================================================
+//
+
+        LibcModels::LibcModels()
+        {
+            using K = LibcKind;
+
+            add("strlen", signature({K::Address}, K::Integer),
+                    [](LibcCall& c, GenericValue& res) {
+                res = c.makeResult(scanFor(c.getMemory(), c.getAddress(0), 0, c.getMaxBytes()));
+                return true;
+            });
+            add("strnlen", signature({K::Address, K::Integer}, K::Integer),
+                    [](LibcCall& c, GenericValue& res) {
+                res = c.makeResult(scanFor(c.getMemory(), c.getAddress(0), 0,
+                        clampLength(c, c.getInteger(1))));
+                return true;
+            });
+            add("memchr", signature({K::Address, K::Integer, K::Integer}, K::Address),
+                    [](LibcCall& c, GenericValue& res) {
+                std::size_t n = clampLength(c, c.getInteger(2));
+                std::size_t off = scanFor(c.getMemory(), c.getAddress(0), uint8_t(c.getInteger(1)), n);
+                res = c.makeResult(off < n ? c.getAddress(0) + off : 0);
+                return true;
+            });
+            add("strcmp", signature({K::Address, K::Address}, K::Integer),
+                    [](LibcCall& c, GenericValue& res) {
+                res = c.makeResult(compare(c.getMemory(), c.getAddress(0), c.getAddress(1),
+                        c.getMaxBytes(), true));
+                return true;
+            });
+            add("strncmp", signature({K::Address, K::Address, K::Integer}, K::Integer),
+                    [](LibcCall& c, GenericValue& res) {
+                res = c.makeResult(compare(c.getMemory(), c.getAddress(0), c.getAddress(1),
+                        clampLength(c, c.getInteger(2)), true));
+                return true;
+            });
+            add("memcmp", signature({K::Address, K::Address, K::Integer}, K::Integer),
+                    [](LibcCall& c, GenericValue& res) {
+                res = c.makeResult(compare(c.getMemory(), c.getAddress(0), c.getAddress(1),
+                        clampLength(c, c.getInteger(2)), false));
+                return true;
+            });
+
+            auto copy = [](LibcCall& c, GenericValue& res) {
+                c.getMemory().copyMemory(c.getAddress(0), c.getAddress(1),
+                        clampLength(c, c.getInteger(2)));
+                res = c.makeResult(c.getAddress(0));
+                return true;
+            };
+            add("memcpy", signature({K::Address, K::Address, K::Integer}, K::Any), copy);
+            add("memmove", signature({K::Address, K::Address, K::Integer}, K::Any), copy);
+            add("memset", signature({K::Address, K::Integer, K::Integer}, K::Any),
+                    [](LibcCall& c, GenericValue& res) {
+                c.getMemory().fillMemory(c.getAddress(0), uint8_t(c.getInteger(1)),
+                        clampLength(c, c.getInteger(2)));
+                res = c.makeResult(c.getAddress(0));
+                return true;
+            });
+
+            add("malloc", signature({K::Integer}, K::Address),
+                    [](LibcCall& c, GenericValue& res) {
+                res = c.makeResult(c.getMemory().allocate(c.getInteger(0), c.getMaxBytes()));
+                return true;
+            });
+            add("calloc", signature({K::Integer, K::Integer}, K::Address),
+                    [](LibcCall& c, GenericValue& res) {
+                uint64_t n = c.getInteger(0);
+                uint64_t size = c.getInteger(1);
+                bool overflow = size && n > c.getMaxBytes() / size;
+                // Fresh blocks read as zeros already.
+                res = c.makeResult(overflow ? 0 : c.getMemory().allocate(n * size, c.getMaxBytes()));
+                return true;
+            });
+            add("realloc", signature({K::Address, K::Integer}, K::Address),
+                    [](LibcCall& c, GenericValue& res) {
+                GlobalExecutionContext& m = c.getMemory();
+                uint64_t old = c.getAddress(0);
+                uint64_t size = c.getInteger(1);
+                uint64_t addr = m.allocate(size, c.getMaxBytes());
+                if (addr && old)
+                {
+                    m.copyMemory(addr, old, std::min(size, m.getAllocationSize(old)));
+                    m.release(old);
+                }
+                res = c.makeResult(addr);
+                return true;
+            });
+            add("free", signature({K::Address}, K::Any),
+                    [](LibcCall& c, GenericValue&) {
+                c.getMemory().release(c.getAddress(0));
+                return true;
+            });
+        }
+
+        void LibcModels::add(
+                const std::string& name,
+                const LibcSignature& signature,
+                LibcModel model)
+        {
+            Entry e;
+            e.signature = signature;
+            e.model = std::move(model);
+            _models[name].push_back(std::move(e));
+        }
+
+        void LibcModels::remove(const std::string& name)
+        {
+            _models.erase(name);
+        }
+
+        void LibcModels::clear()
+        {
+            _models.clear();
+        }
+
+        const LibcModel* LibcModels::find(
+                const llvm::Function* callee,
+                const llvm::CallInst& call) const
+        {
+            auto it = _models.find(callee->getName().str());
+            if (it == _models.end())
+            {
+                return nullptr;
+            }
+            for (auto eIt = it->second.rbegin(); eIt != it->second.rend(); ++eIt)
+            {
+                if (eIt->signature.matches(call))
+                {
+                    return &eIt->model;
+                }
+            }
+            return nullptr;
+        }
+
+        void LibcModels::setMaxBytes(std::size_t maxBytes)
+        {
+            _maxBytes = maxBytes;
+        }
+
+        std::size_t LibcModels::getMaxBytes() const
+        {
+            return _maxBytes;
+        }
+
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,140 @@
+/**
+ * @file libc_models.h
+ * @brief Models of external library functions working on emulated memory.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_LIBC_MODELS_H
+#define RETDEC_LLVMIR_EMUL_LIBC_MODELS_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/ExecutionEngine/GenericValue.h>
+#include <llvm/IR/Instructions.h>
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        class GlobalExecutionContext;
+
+/**
+ * What a parameter or the result of a modelled function must be.
+ * @c Address accepts pointers and integers -- decompiled code often passes
+ * addresses as integers.
+ */
+        enum class LibcKind : uint8_t
+        {
+            Any,
+            Integer,
+            Address,
+            Void,
+        };
+
+        struct LibcSignature
+        {
+            std::vector<LibcKind> params;
+            LibcKind result = LibcKind::Any;
+
+/**
+ * Compares with the call site, not the callee's declaration -- calls
+ * through casts and of variadic declarations are common in decompiled
+ * code.
+ */
+            bool matches(const llvm::CallInst& call) const;
+        };
+
+/**
+ * One call of a modelled function: its arguments and the emulated memory.
+ */
+        class LibcCall
+        {
+        public:
+            LibcCall(
+                    GlobalExecutionContext& memory,
+                    llvm::CallInst& call,
+                    const std::vector<llvm::GenericValue>& args,
+                    std::size_t maxBytes);
+
+            uint64_t getAddress(unsigned i) const;
+            uint64_t getInteger(unsigned i) const;
+/**
+ * @return @a v as a value of the call's result type.
+ */
+            llvm::GenericValue makeResult(uint64_t v) const;
+
+            GlobalExecutionContext& getMemory() const;
+            llvm::CallInst& getCall() const;
+/**
+ * Models clamp lengths read from emulated arguments (which may be
+ * garbage) to this.
+ */
+            std::size_t getMaxBytes() const;
+
+        private:
+            GlobalExecutionContext& _memory;
+            llvm::CallInst& _call;
+            const std::vector<llvm::GenericValue>& _args;
+            std::size_t _maxBytes;
+        };
+
+/**
+ * Computes @a result of a call. Returns @c false if it can not, the call
+ * then gets the default zero result.
+ */
+        using LibcModel = std::function<bool(LibcCall& call, llvm::GenericValue& result)>;
+
+/**
+ * Registry of models of external functions, selected by callee name and
+ * the signature of the call. The defaults cover the string and memory
+ * functions that decide control flow most often and the heap:
+ * @c strlen, @c strnlen, @c strcmp, @c strncmp, @c memchr, @c memcmp,
+ * @c memcpy, @c memmove, @c memset, @c malloc, @c calloc, @c realloc and
+ * @c free.
+ *
+ * Emulated memory is a map of values, not a byte array, so scanning models
+ * gather chunks of bytes (see @c GlobalExecutionContext::readBytes()) and
+ * search them with the host's vectorized @c memchr() / @c memcmp(), and
+ * copying models move whole values instead of bytes.
+ */
+        class LibcModels
+        {
+        public:
+            LibcModels();
+
+/**
+ * Adds a model. Models added later take precedence over earlier ones with
+ * the same name and a matching signature, so users can override defaults.
+ */
+            void add(const std::string& name, const LibcSignature& signature, LibcModel model);
+            void remove(const std::string& name);
+            void clear();
+
+/**
+ * @return Model for @a call of @a callee, or @c nullptr.
+ */
+            const LibcModel* find(
+                    const llvm::Function* callee,
+                    const llvm::CallInst& call) const;
+
+            void setMaxBytes(std::size_t maxBytes);
+            std::size_t getMaxBytes() const;
+
+        private:
+            struct Entry
+            {
+                LibcSignature signature;
+                LibcModel model;
+            };
+
+        private:
+            std::unordered_map<std::string, std::vector<Entry>> _models;
+            std::size_t _maxBytes = 1 << 20;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
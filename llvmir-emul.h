@@ -7,10 +7,19 @@
 #ifndef RETDEC_LLVMIR_EMUL_LLVMIR_EMUL_H
 #define RETDEC_LLVMIR_EMUL_LLVMIR_EMUL_H
 
+#include <deque>
+#include <exception>
 #include <list>
 #include <map>
+#include <memory>
+#include <random>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/CodeGen/IntrinsicLowering.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/IR/CallSite.h>
@@ -18,7 +27,12 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Dominators.h>
 
+#include "emulated_heap.h"
 #include "exceptions.h"
+#include "fusion.h"
+#include "libc_models.h"
+#include "log_index.h"
+#include "native_jit.h"
 #include <llvm/Analysis/LoopInfo.h>
 #include <llvm/Analysis/LoopInfoImpl.h>
 #include <llvm/Analysis/DomPrinter.h>
@@ -28,8 +42,8 @@ namespace retdec {
 
 /**
  * AllocaHolder - Object to track all of the blocks of memory allocated by
- * alloca.  When the function returns, this object is popped off the execution
- * stack, which causes the dtor to be run, which frees all the alloca'd memory.
+ * alloca.  When the function returns, the emulator releases them to the
+ * emulated heap (see @c EmulatedHeap).
  */
         class AllocaHolder
         {
@@ -53,25 +67,125 @@ namespace retdec {
                 return *this;
             }
 
-            ~AllocaHolder()
+            void add(uint64_t addr)
             {
-                for (void *Allocation : Allocations)
-                {
-                    Allocation = NULL;
-                    free(Allocation);
-                }
+                Allocations.push_back(addr);
+            }
+
+            const std::vector<uint64_t>& get() const
+            {
+                return Allocations;
             }
 
-            void add(void *Mem)
+            void clear()
             {
-                Allocations.push_back(Mem);
+                Allocations.clear();
             }
 
         private:
-            std::vector<void *> Allocations;
+            std::vector<uint64_t> Allocations;
         };
 
         class LocalExecutionContext;
+        class ProgramImage;
+        class TraceWriter;
+
+/**
+ * Pre-folded getelementptr. All constant indices are folded into a single
+ * byte offset, each variable index is kept together with its scale (size of
+ * the indexed type). Address is then computed as:
+ * base + constantOffset + sum(index * scale).
+ */
+        struct GepPlan
+        {
+            struct VariableIndex
+            {
+                llvm::Value* value = nullptr;
+                uint64_t scale = 0;
+                unsigned bitWidth = 0;
+            };
+
+            uint64_t constantOffset = 0;
+            llvm::SmallVector<VariableIndex, 2> indices;
+        };
+
+/**
+ * Parallel copy performed by PHI nodes of a block when it is entered over
+ * one particular CFG edge.
+ */
+        struct PhiEdgeTable
+        {
+            /// (incoming value, PHI node) pairs in PHI order.
+            llvm::SmallVector<std::pair<llvm::Value*, llvm::PHINode*>, 4> copies;
+            /// The first PHI node that has no entry for the edge's source
+            /// block, or @c nullptr if all have one.
+            llvm::PHINode* missing = nullptr;
+            /// The last PHI node of the destination block.
+            llvm::PHINode* lastPhi = nullptr;
+        };
+
+/**
+ * Emulated memory -- generic values keyed by address, grouped into pages by
+ * address. Copies share pages until one of them writes into a page, so a
+ * copy costs O(pages), not O(values). This is what makes forking emulator
+ * state cheap.
+ */
+        class PagedMemory
+        {
+        public:
+            static const unsigned PAGE_BITS = 12;
+
+        public:
+            const llvm::GenericValue* find(uint64_t addr) const;
+/**
+ * @return The value at the highest address below @a addr (stored to
+ *         @a at), or @c nullptr if there is none.
+ */
+            const llvm::GenericValue* findBefore(uint64_t addr, uint64_t& at) const;
+            void set(uint64_t addr, const llvm::GenericValue& val);
+/**
+ * Removes values at addresses [@a lo, @a hi).
+ */
+            void erase(uint64_t lo, uint64_t hi);
+            std::size_t pageCount() const;
+
+/**
+ * Starts tracking pages changed from now on.
+ */
+            void markClean();
+/**
+ * Makes the memory equal to @a base again. @a base must be a copy taken
+ * when this memory was last marked clean. Costs O(changed pages).
+ */
+            void restore(const PagedMemory& base);
+
+/**
+ * Calls @a fn(address, value) for values at addresses [@a lo, @a hi) in
+ * address order.
+ */
+            template<typename Fn>
+            void forEach(uint64_t lo, uint64_t hi, Fn fn) const
+            {
+                for (auto pIt = _pages.lower_bound(lo >> PAGE_BITS);
+                        pIt != _pages.end() && (pIt->first << PAGE_BITS) < hi;
+                        ++pIt)
+                {
+                    auto& page = *pIt->second;
+                    for (auto vIt = page.lower_bound(lo);
+                            vIt != page.end() && vIt->first < hi;
+                            ++vIt)
+                    {
+                        fn(vIt->first, vIt->second);
+                    }
+                }
+            }
+
+        private:
+            using Page = std::map<uint64_t, llvm::GenericValue>;
+            std::map<uint64_t, std::shared_ptr<Page>> _pages;
+            /// Pages created or copied since @c markClean().
+            std::vector<uint64_t> _dirty;
+        };
 
 /**
  * This is not ideal.
@@ -92,6 +206,43 @@ namespace retdec {
             llvm::GenericValue getMemory(uint64_t addr, bool log = true);
             void setMemory(uint64_t addr, llvm::GenericValue val, bool log = true);
 
+/**
+ * Byte view of the memory for models of library functions. Values are not
+ * stored with their types, so a value's bytes are guessed from it (integers
+ * by bit width, aggregates element by element, anything else as the 8-byte
+ * pointer union). A byte is taken from the value at its address, or from
+ * one of a few values below it that span it; bytes of no value are zero.
+ * Only the first address of a range is logged.
+ */
+            void readBytes(uint64_t addr, uint8_t* out, std::size_t n);
+/**
+ * Stores bytes as 8-bit integers, replacing values in the range.
+ */
+            void writeBytes(uint64_t addr, const uint8_t* data, std::size_t n);
+/**
+ * Copies values (whole, not byte by byte) from [@a src, @a src + @a n) to
+ * @a dst, which may overlap. Costs O(values in the range), not O(n).
+ */
+            void copyMemory(uint64_t dst, uint64_t src, std::size_t n);
+            void fillMemory(uint64_t dst, uint8_t value, std::size_t n);
+
+/**
+ * Blocks of allocas and library function models, see @c EmulatedHeap.
+ * @return Address of a block of @a size bytes, or @c 0 if @a size is
+ *         larger than @a limit or the heap is exhausted.
+ */
+            uint64_t allocate(uint64_t size, uint64_t limit);
+/**
+ * Values stored in the block are dropped, a block reusing its addresses
+ * reads as zeros.
+ * @return @c False if @a addr is not a live block.
+ */
+            bool release(uint64_t addr);
+/**
+ * @return Size of the live block at @a addr, or @c 0.
+ */
+            uint64_t getAllocationSize(uint64_t addr) const;
+
             llvm::GenericValue getGlobal(llvm::GlobalVariable* g, bool log = true);
             void setGlobal(
                     llvm::GlobalVariable* g,
@@ -103,16 +254,101 @@ namespace retdec {
                     llvm::Value* val,
                     LocalExecutionContext& ec);
 
+            const GepPlan& getGepPlan(llvm::User* gep);
+            const PhiEdgeTable& getPhiEdgeTable(
+                    llvm::BasicBlock* from,
+                    llvm::BasicBlock* to);
+            const FusionTable& getFusionTable(llvm::Function* f);
+            void invalidatePlans();
+
+            void addRegister(llvm::GlobalVariable* g);
+            bool isRegister(const llvm::GlobalVariable* g) const;
+            bool wasRegisterLoaded(const llvm::GlobalVariable* g) const;
+            bool wasRegisterStored(const llvm::GlobalVariable* g) const;
+            void appendLoadedRegisters(LogIndex<llvm::GlobalVariable*>& out) const;
+            void appendStoredRegisters(LogIndex<llvm::GlobalVariable*>& out) const;
+
+            void initializeGlobal(llvm::GlobalVariable* g, bool logMemory = true);
+            void deferGlobal(llvm::GlobalVariable* g);
+
+            /// Global whose initializer was not evaluated yet.
+            struct LazyGlobal
+            {
+                llvm::GlobalVariable* global = nullptr;
+                /// Bytes the initializer covers.
+                uint64_t size = 0;
+            };
+
+            /// Everything that emulation changes. Plans and tables derived
+            /// from the IR are not part of it.
+            struct State
+            {
+                PagedMemory memory;
+                std::vector<uint64_t> memoryLoads;
+                std::vector<uint64_t> memoryStores;
+                std::map<llvm::GlobalVariable*, llvm::GenericValue> globals;
+                std::vector<llvm::GlobalVariable*> globalsLoads;
+                std::vector<llvm::GlobalVariable*> globalsStores;
+                std::vector<llvm::GlobalVariable*> globalsUnloggedStores;
+                std::vector<llvm::GlobalVariable*> globalsMaterialized;
+                std::vector<llvm::GenericValue> registers;
+                std::vector<uint8_t> registerAccess;
+                uint64_t registerLoads = 0;
+                uint64_t registerStores = 0;
+                std::map<llvm::Value*, llvm::GenericValue> values;
+                std::map<uint64_t, LazyGlobal> lazyGlobals;
+                EmulatedHeap heap;
+            };
+
+            State saveState() const;
+            void restoreState(State& state);
+
+/**
+ * Remembers the current state as the initial one, see @c reset().
+ */
+            void snapshot();
+/**
+ * Returns to the state of the last @c snapshot() in time proportional to
+ * what changed since. Plans and tables are kept.
+ */
+            void reset();
+
+        private:
+            void materializeGlobal(uint64_t addr);
+            void materializeGlobals(uint64_t addr, uint64_t n);
+            void logMemoryLoad(uint64_t addr);
+            void logMemoryStore(uint64_t addr);
+            void logGlobalLoad(llvm::GlobalVariable* g);
+            void logGlobalStore(llvm::GlobalVariable* g);
+
         public:
             llvm::Module* _module = nullptr;
 
-            std::map<uint64_t, llvm::GenericValue> memory;
-            std::list<uint64_t> memoryLoads;
-            std::list<uint64_t> memoryStores;
+            PagedMemory memory;
+            /// Logs are appended to only, until cleared -- see @c LogIndex.
+            std::vector<uint64_t> memoryLoads;
+            std::vector<uint64_t> memoryStores;
 
             std::map<llvm::GlobalVariable*, llvm::GenericValue> globals;
-            std::list<llvm::GlobalVariable*> globalsLoads;
-            std::list<llvm::GlobalVariable*> globalsStores;
+            std::vector<llvm::GlobalVariable*> globalsLoads;
+            std::vector<llvm::GlobalVariable*> globalsStores;
+            /// Stores not logged in @c globalsStores (initialization and
+            /// user writes), so that @c reset() knows all changed globals.
+            std::vector<llvm::GlobalVariable*> globalsUnloggedStores;
+            /// Deferred globals initialized since the last @c snapshot(),
+            /// registers included, so that @c reset() defers them again.
+            std::vector<llvm::GlobalVariable*> globalsMaterialized;
+
+            /// Globals modelling machine registers and flags live in a flat
+            /// register file instead of @c globals. Their accesses are not
+            /// logged into @c globalsLoads and @c globalsStores, only
+            /// flagged per register and counted.
+            llvm::DenseMap<const llvm::GlobalVariable*, unsigned> registerIds;
+            std::vector<llvm::GlobalVariable*> registerGlobals;
+            std::vector<llvm::GenericValue> registers;
+            std::vector<uint8_t> registerAccess;
+            uint64_t registerLoads = 0;
+            uint64_t registerStores = 0;
 
             /// LLVM values of all emulated objects.
             /// In the original LLVM's interpret implementation, this was in local
@@ -122,6 +358,104 @@ namespace retdec {
             /// emulated objects and not to thorw it away after local frame is left.
             std::map<llvm::Value*, llvm::GenericValue> values;
 
+            /// Globals whose initializers were not evaluated yet, keyed by
+            /// their emulated address. They get initialized on the first
+            /// access through global accessors or the first memory access
+            /// overlapping them.
+            std::map<uint64_t, LazyGlobal> lazyGlobals;
+
+            EmulatedHeap heap;
+
+            /// GEP plans of instructions and constant expressions, computed
+            /// on their first execution.
+            std::unordered_map<const llvm::User*, GepPlan> gepPlans;
+            /// PHI copy tables of CFG edges, computed when the edge is taken
+            /// for the first time.
+            llvm::DenseMap<
+                    std::pair<llvm::BasicBlock*, llvm::BasicBlock*>,
+                    PhiEdgeTable> phiEdges;
+            /// Scratch buffer for PHI values, reused by all edge transitions.
+            std::vector<llvm::GenericValue> phiScratch;
+            /// Superinstructions of functions, built when the function is
+            /// entered for the first time.
+            std::unordered_map<const llvm::Function*, FusionTable> fusionTables;
+
+            /// Shared decoded module, consulted before the tables above.
+            const ProgramImage* image = nullptr;
+
+            /// Receives logged memory and global accesses, if set.
+            TraceWriter* trace = nullptr;
+            /// Append accesses to the log lists. Traced runs may turn this
+            /// off to keep memory use flat.
+            bool keepLogs = true;
+
+        private:
+            /// State restored by @c reset().
+            State _initial;
+        };
+
+/**
+ * How a function is executed, see @c TieringPolicy.
+ */
+        enum class ExecutionTier : uint8_t
+        {
+            /// Plain instruction visitor.
+            Plain,
+            /// Superinstructions from the function's @c FusionTable.
+            Fast,
+            /// Native code from @c NativeJit, interpreted as @c Fast until
+            /// the code is ready.
+            Native,
+        };
+
+/**
+ * Every function starts in the plain visitor, which costs nothing up front.
+ * After enough calls or executed instructions it is promoted to the fast
+ * tier, whose tables are built on promotion, and then -- if the native
+ * backend is enabled -- to native code. Most functions run once or twice
+ * and never pay for translation.
+ *
+ * Promotion takes effect in the running frame for the fast tier, and on the
+ * next call for native code.
+ */
+        struct TieringPolicy
+        {
+            /// Without tiering, functions run fast (if fusion is enabled) and
+            /// native (if the backend is enabled) from the first call.
+            bool enabled = true;
+            uint64_t fastCalls = 2;
+            uint64_t fastInstructions = 1024;
+            uint64_t nativeCalls = 64;
+            uint64_t nativeInstructions = 100000;
+            /// Compile on the backend's thread, the function stays in the
+            /// fast tier meanwhile. Otherwise the promoting call compiles.
+            bool asyncCompile = true;
+        };
+
+/**
+ * Record of a frame that returned or was abandoned.
+ */
+        struct RetiredFrame
+        {
+            llvm::Function* function = nullptr;
+            /// Block the frame was in when it ended.
+            llvm::BasicBlock* block = nullptr;
+            /// Call depth of the frame, 1 for the entry function.
+            std::size_t depth = 0;
+        };
+
+/**
+ * Execution counters and tier of one function.
+ */
+        struct FunctionProfile
+        {
+            uint64_t calls = 0;
+            /// Dispatches -- a superinstruction counts once.
+            uint64_t instructions = 0;
+            ExecutionTier tier = ExecutionTier::Plain;
+            NativeEntry entry = nullptr;
+            /// Native code was requested (or found impossible).
+            bool nativeRequested = false;
         };
 
         class LocalExecutionContext
@@ -129,11 +463,15 @@ namespace retdec {
         public:
             LocalExecutionContext();
             LocalExecutionContext(LocalExecutionContext& o) = default;
-            LocalExecutionContext(LocalExecutionContext&& o);
-            LocalExecutionContext &operator=(LocalExecutionContext&& o);
+            LocalExecutionContext(LocalExecutionContext&& o) = default;
+            LocalExecutionContext &operator=(LocalExecutionContext&& o) = default;
             LocalExecutionContext &operator=(LocalExecutionContext& o) = default;
 
             llvm::Module* getModule() const;
+/**
+ * Resets the frame for another call, keeping its buffers.
+ */
+            void recycle();
 
         public:
             /// The currently executing function
@@ -147,14 +485,113 @@ namespace retdec {
             llvm::CallSite caller;
             /// Track memory allocated by alloca
             AllocaHolder allocas;
-            llvm::LoopInfoBase<llvm::BasicBlock, llvm::Loop>* LoopInfoBase = nullptr;
-            llvm::LoopBase<llvm::BasicBlock, llvm::Loop>* LoopBase = nullptr;
+            /// Loops of @c curFunction, owned by the emulator or its image.
+            const llvm::LoopInfoBase<llvm::BasicBlock, llvm::Loop>* LoopInfoBase = nullptr;
             llvm::Loop* Loop = nullptr;
             bool analyze = false;
             bool flag = 0;
             int loopNums = 0;
             bool PHIorNot = false;
             std::map<llvm::BasicBlock*, int>* visited = nullptr;
+            /// Superinstructions of @c curFunction, set with loop analysis.
+            const FusionTable* fusion = nullptr;
+            /// Counters of @c curFunction.
+            FunctionProfile* profile = nullptr;
+        };
+
+/**
+ * Version of the emulation semantics. Bump it whenever a change to the
+ * emulator alters produced similarity strings, so that persisted results
+ * (see @c SignatureCache) get invalidated.
+ */
+        const uint32_t EMULATOR_VERSION = 5;
+
+/**
+ * @return @c True if @a gv models a machine register or flag.
+ */
+        bool isRegisterGlobal(const llvm::GlobalVariable* gv);
+/**
+ * @return @c True if loads and stores of values named @a n are not written
+ *         into similarity strings.
+ */
+        bool isUntracedName(llvm::StringRef n);
+
+/**
+ * Counters describing what a single emulation run did.
+ */
+        struct RunStats
+        {
+            uint64_t instructions = 0;
+            uint64_t basicBlocks = 0;
+            uint64_t calls = 0;
+            uint64_t memoryLoads = 0;
+            uint64_t memoryStores = 0;
+            uint64_t globalLoads = 0;
+            uint64_t globalStores = 0;
+        };
+
+/**
+ * Set of visited basic blocks -- a bitmap over dense block ids assigned on
+ * the first visit. Unlike the visited block log, it is not cleared by runs,
+ * only by @c clear().
+ */
+        class BlockCoverage
+        {
+        public:
+/**
+ * @return @c True if @a bb was not covered before.
+ */
+            bool mark(const llvm::BasicBlock* bb);
+            bool contains(const llvm::BasicBlock* bb) const;
+            std::size_t count() const;
+            void clear();
+
+        private:
+            llvm::DenseMap<const llvm::BasicBlock*, unsigned> _ids;
+            std::vector<uint64_t> _bits;
+            std::size_t _count = 0;
+        };
+
+/**
+ * What @c LlvmIrEmulator::reset() clears besides the emulation state
+ * (memory, globals, values, heap, frames and all logs), which it always
+ * returns to how it was after construction.
+ */
+        struct ResetPolicy
+        {
+            /// Clear the block coverage accumulated across runs.
+            bool coverage = true;
+            /// Forget function profiles -- reused emulators otherwise keep
+            /// hot functions in their tiers.
+            bool profiles = false;
+        };
+
+        struct ExplorationConfig
+        {
+            enum class Strategy
+            {
+                DFS,
+                BFS
+            };
+
+            Strategy strategy = Strategy::DFS;
+            /// Maximum number of explored paths, the first run included.
+            /// Forks beyond it are dropped.
+            std::size_t maxStates = 64;
+        };
+
+        struct ExplorationResult
+        {
+            /// Feature stream of the first path followed by the suffixes
+            /// the other paths added after their fork points.
+            std::string signature;
+            std::size_t paths = 0;
+            /// Forks dropped because of @c ExplorationConfig::maxStates.
+            std::size_t dropped = 0;
+            /// Paths that threw.
+            std::size_t failed = 0;
+            /// Blocks visited by any of the paths.
+            std::set<llvm::BasicBlock*> blocks;
         };
 
         class LlvmIrEmulator : public llvm::InstVisitor<LlvmIrEmulator>
@@ -168,6 +605,14 @@ namespace retdec {
 
         public:
             LlvmIrEmulator(llvm::Module* m);
+            LlvmIrEmulator(llvm::Module* m, bool lazyGlobals);
+/**
+ * Emulates the module of @a image without modifying it, see
+ * @c ProgramImage.
+ */
+            LlvmIrEmulator(
+                    std::shared_ptr<const ProgramImage> image,
+                    bool lazyGlobals = false);
             ~LlvmIrEmulator();
 
             llvm::GenericValue runFunction(
@@ -178,41 +623,148 @@ namespace retdec {
             // Emulation query methods.
             //
         public:
-            const std::list<llvm::Instruction*>& getVisitedInstructions() const;
-            const std::list<llvm::BasicBlock*>& getVisitedBasicBlocks() const;
+            //
+            // Logs are returned as views of the emulator's storage, valid
+            // until the next run, reset or exploration. Sets and membership
+            // tests use indexes updated incrementally on queries (see
+            // @c LogIndex), so neither copies nor rescans logs. The indexes
+            // are mutable: const queries modify them, so even const queries
+            // of one emulator must not run concurrently.
+            //
+            llvm::ArrayRef<llvm::Instruction*> getVisitedInstructions() const;
+            llvm::ArrayRef<llvm::BasicBlock*> getVisitedBasicBlocks() const;
             bool wasInstructionVisited(llvm::Instruction* i) const;
+/**
+ * @return @c True if the current run visited @a bb. Answered whether or
+ *         not logs are kept (see @c setTraceWriter()), emulation itself
+ *         decides on it.
+ */
             bool wasBasicBlockVisited(llvm::BasicBlock* bb) const;
 
             llvm::GenericValue getExitValue() const;
 
-            const std::list<CallEntry>& getCallEntries() const;
-            std::list<llvm::Value*> getCalledValues() const;
-            std::set<llvm::Value*> getCalledValuesSet() const;
+            llvm::ArrayRef<CallEntry> getCallEntries() const;
+/**
+ * @return Called values of all calls in order, repeated ones included.
+ */
+            llvm::ArrayRef<llvm::Value*> getCalledValues() const;
+/**
+ * @return Called values, each once, in order of their first call.
+ */
+            llvm::ArrayRef<llvm::Value*> getCalledValuesUnique() const;
+            const std::unordered_set<llvm::Value*>& getCalledValuesSet() const;
             bool wasValueCalled(llvm::Value* v) const;
             const CallEntry* getCallEntry(llvm::Value* v, unsigned n = 0) const;
 
-            bool wasGlobalVariableLoaded(llvm::GlobalVariable* gv);
-            bool wasGlobalVariableStored(llvm::GlobalVariable* gv);
-            std::list<llvm::GlobalVariable*> getLoadedGlobalVariables();
-            std::set<llvm::GlobalVariable*> getLoadedGlobalVariablesSet();
-            std::list<llvm::GlobalVariable*> getStoredGlobalVariables();
-            std::set<llvm::GlobalVariable*> getStoredGlobalVariablesSet();
+            bool wasGlobalVariableLoaded(llvm::GlobalVariable* gv) const;
+            bool wasGlobalVariableStored(llvm::GlobalVariable* gv) const;
+/**
+ * @return Globals of all loads in order, repeated ones included. Register
+ *         globals are not logged, only flagged (see
+ *         @c wasGlobalVariableLoaded()), so they are missing here.
+ */
+            llvm::ArrayRef<llvm::GlobalVariable*> getLoadedGlobalVariables() const;
+/**
+ * @return Loaded globals, each once, in order of their first load. Loads of
+ *         register globals are not logged in order, they follow the globals
+ *         loaded before the query.
+ */
+            llvm::ArrayRef<llvm::GlobalVariable*> getLoadedGlobalVariablesUnique() const;
+            const std::unordered_set<llvm::GlobalVariable*>& getLoadedGlobalVariablesSet() const;
+/**
+ * @return Globals of all stores in order, like
+ *         @c getLoadedGlobalVariables().
+ */
+            llvm::ArrayRef<llvm::GlobalVariable*> getStoredGlobalVariables() const;
+/**
+ * @return Stored globals, each once, ordered like
+ *         @c getLoadedGlobalVariablesUnique().
+ */
+            llvm::ArrayRef<llvm::GlobalVariable*> getStoredGlobalVariablesUnique() const;
+            const std::unordered_set<llvm::GlobalVariable*>& getStoredGlobalVariablesSet() const;
             llvm::GenericValue getGlobalVariableValue(llvm::GlobalVariable* gv);
             void setGlobalVariableValue(
                     llvm::GlobalVariable* gv,
                     llvm::GenericValue val);
 
-            bool wasMemoryLoaded(uint64_t addr);
-            bool wasMemoryStored(uint64_t addr);
-            std::list<uint64_t> getLoadedMemory();
-            std::set<uint64_t> getLoadedMemorySet();
-            std::list<uint64_t> getStoredMemory();
-            std::set<uint64_t> getStoredMemorySet();
+            bool wasMemoryLoaded(uint64_t addr) const;
+            bool wasMemoryStored(uint64_t addr) const;
+/**
+ * @return Addresses of all loads in order, repeated ones included.
+ */
+            llvm::ArrayRef<uint64_t> getLoadedMemory() const;
+            const std::unordered_set<uint64_t>& getLoadedMemorySet() const;
+            llvm::ArrayRef<uint64_t> getStoredMemory() const;
+            const std::unordered_set<uint64_t>& getStoredMemorySet() const;
             llvm::GenericValue getMemoryValue(uint64_t addr);
             void setMemoryValue(uint64_t addr, llvm::GenericValue val);
 
             llvm::GenericValue getValueValue(llvm::Value* val);
 
+            RunStats getRunStats() const;
+
+            const BlockCoverage& getBlockCoverage() const;
+            void resetBlockCoverage();
+
+            ExplorationResult explore(
+                    llvm::Function* f,
+                    const llvm::ArrayRef<llvm::GenericValue> argVals = {},
+                    const ExplorationConfig& config = ExplorationConfig());
+            void lowerIntrinsics(llvm::Function* f);
+
+            void setFusionEnabled(bool enabled);
+/**
+ * Runs eligible functions as native code, see @c NativeJit.
+ * @return @c False if the native backend is not built in -- everything is
+ *         then interpreted.
+ */
+            bool setJitEnabled(bool enabled);
+            void setTieringPolicy(const TieringPolicy& policy);
+/**
+ * Seeds choices the emulator makes at random (e.g. the case a switch takes
+ * on its first execution). Runs with equal seeds and arguments are equal.
+ */
+            void setSeed(uint64_t seed);
+/**
+ * Calls of external functions with a model (see @c LibcModels) get its
+ * result and side effects, other calls of declarations return zero.
+ */
+            void setLibcModelsEnabled(bool enabled);
+/**
+ * Replaces the emulated heap with an empty one. Only valid before the first
+ * run.
+ */
+            void setHeapConfig(const HeapConfig& config);
+/**
+ * Returns the emulator to its state after construction, so that it can
+ * emulate another function as if it were new. Costs time proportional to
+ * what the runs since the last reset changed, buffers are kept.
+ */
+            void reset(const ResetPolicy& policy = ResetPolicy());
+/**
+ * Streams visited instructions and blocks, calls and memory and global
+ * accesses to @a trace (see @c TraceWriter), which must outlive the runs.
+ * Without @a keepLogs, they are not logged in memory -- similarity strings
+ * are unaffected, but log accessors and @c getRunStats() then see nothing.
+ * @c nullptr stops tracing.
+ */
+            void setTraceWriter(TraceWriter* trace, bool keepLogs = true);
+            LibcModels& getLibcModels();
+/**
+ * @return Counters of @a f, or @c nullptr if it was never called.
+ */
+            const FunctionProfile* getFunctionProfile(const llvm::Function* f) const;
+/**
+ * Keeps the last @a limit retired frames of each run, see
+ * @c getRetiredFrames(). Zero (the default) keeps only their count.
+ */
+            void setRetiredFrameLimit(std::size_t limit);
+/**
+ * @return The kept retired frames of the last run, oldest first.
+ */
+            std::vector<RetiredFrame> getRetiredFrames() const;
+            uint64_t getRetiredFrameCount() const;
+
             // This needs to be public for LLVM instruction visitor.
             // However, users of this class SHOULD NOT call any of these.
             //
@@ -265,32 +817,166 @@ namespace retdec {
                     llvm::ArrayRef<llvm::GenericValue> argVals);
 
             void logInstruction(llvm::Instruction* i);
+            bool runFused(
+                    const FusedOp& op,
+                    llvm::Instruction& first,
+                    LocalExecutionContext& ec);
 
             void popStackAndReturnValueToCaller(
                     llvm::Type* retT,
                     llvm::GenericValue res);
 
-        public:
-            std::vector<LocalExecutionContext> _ecStackRetired;
+            /// Complete emulation state at a branch, plus the successor the
+            /// forked path takes.
+            struct Fork
+            {
+                std::vector<LocalExecutionContext> frames;
+                GlobalExecutionContext::State global;
+                std::vector<llvm::Instruction*> visitedInsns;
+                std::vector<llvm::BasicBlock*> visitedBbs;
+                BlockCoverage runBlocks;
+                llvm::BasicBlock* lastBlock = nullptr;
+                std::vector<CallEntry> calls;
+                std::vector<llvm::Value*> calledValues;
+                std::string s;
+                llvm::BasicBlock* dest = nullptr;
+            };
+
+            void forkAt(llvm::Instruction* term, unsigned taken);
+            void restoreFork(Fork& fork);
+            void clearIndexes();
+
+            /// State of one native execution, the hooks' frame argument.
+            struct NativeFrame
+            {
+                LlvmIrEmulator* emu = nullptr;
+                /// Block whose instructions are being logged and the next
+                /// one to log.
+                llvm::BasicBlock* block = nullptr;
+                llvm::BasicBlock::iterator logPos;
+                /// Exception thrown by a hook, rethrown once the native
+                /// code returns.
+                std::exception_ptr error;
+                /// Run was abandoned by the loop bailout.
+                bool aborted = false;
+            };
+
+            void updateTier(llvm::Function* f, FunctionProfile& profile);
+            void pushFrame();
+            void popFrame();
+            void popAllFrames();
+            const llvm::LoopInfoBase<llvm::BasicBlock, llvm::Loop>* getLoopInfo(
+                    llvm::Function* f);
+            bool hasUntracedName(const llvm::Value* v) const;
+            void initializeGlobals(bool lazyGlobals);
+            bool callLibcModel(llvm::CallInst& I);
+            bool usesFusion(const LocalExecutionContext& ec) const;
+            void invalidatePlans();
+
+            bool runNative(
+                    llvm::Function* f,
+                    llvm::ArrayRef<llvm::GenericValue> argVals);
+            void logNativeUpTo(
+                    NativeFrame& frame,
+                    llvm::Instruction* i,
+                    bool inclusive);
+            uint64_t nativeExec(
+                    NativeFrame& frame,
+                    llvm::Instruction* i,
+                    const uint64_t* ops);
+            uint64_t nativeBranch(
+                    NativeFrame& frame,
+                    llvm::BranchInst* br,
+                    bool cond,
+                    bool bailout,
+                    unsigned flag);
+
+            static uint64_t nativeExecHook(void* frame, uint64_t site, uint64_t* ops);
+            static uint64_t nativeBranchHook(
+                    void* frame,
+                    uint64_t site,
+                    uint64_t cond,
+                    uint64_t bailout,
+                    uint64_t flag);
+            static uint64_t nativeReturnHook(void* frame, uint64_t site);
 
         private:
             llvm::IntrinsicLowering *IL = nullptr;
             llvm::Module* _module = nullptr;
+            std::shared_ptr<const ProgramImage> _image;
             llvm::GenericValue _exitValue;
             std::vector<LocalExecutionContext> _ecStack;
+            /// Popped frames, reused by later calls.
+            std::vector<LocalExecutionContext> _framePool;
+            /// Ring of the last @c _retiredLimit retired frames.
+            std::vector<RetiredFrame> _retired;
+            std::size_t _retiredLimit = 0;
+            std::size_t _retiredNext = 0;
+            uint64_t _retiredCount = 0;
+            /// Loop analyses of called functions. Intrinsic lowering does
+            /// not change the CFG, so they stay valid.
+            std::unordered_map<
+                    const llvm::Function*,
+                    std::unique_ptr<llvm::LoopInfoBase<llvm::BasicBlock, llvm::Loop>>>
+                    _loopInfos;
             GlobalExecutionContext _globalEc;
 
             /// All visited instruction in order of their visitation.
             /// No cycling checks are performed at the moment -- one instruction
             /// might be visited multiple times.
-            std::list<llvm::Instruction*> _visitedInsns;
+            std::vector<llvm::Instruction*> _visitedInsns;
             /// All visited basic blocks in order of their visitation.
             /// No cycling checks are performed at the moment -- one basic block
             /// might be visited multiple times.
-            std::list<llvm::BasicBlock*> _visitedBbs;
+            std::vector<llvm::BasicBlock*> _visitedBbs;
+            /// Block of the last logged instruction.
+            llvm::BasicBlock* _lastBlock = nullptr;
+            /// Blocks visited by the current run. Unlike @c _visitedBbs it
+            /// is kept without logs, so traced runs take the same paths.
+            BlockCoverage _runBlocks;
 
             /// Intrinsic calls are lowered and not logged here.
-            std::list<CallEntry> _calls;
+            std::vector<CallEntry> _calls;
+            /// Called values of @c _calls.
+            std::vector<llvm::Value*> _calledValues;
+
+            /// Indexes of the logs above and of global ones, see @c LogIndex.
+            mutable LogIndex<llvm::Instruction*> _visitedInsnIndex;
+            mutable LogIndex<llvm::Value*> _calledIndex;
+            mutable LogIndex<llvm::GlobalVariable*> _globalLoadIndex;
+            mutable LogIndex<llvm::GlobalVariable*> _globalStoreIndex;
+            mutable LogIndex<uint64_t> _memoryLoadIndex;
+            mutable LogIndex<uint64_t> _memoryStoreIndex;
+
+            /// Blocks visited by all runs since the last reset.
+            BlockCoverage _coverage;
+
+            /// Execute superinstructions from @c FusionTable.
+            bool _fusion = true;
+
+            /// Native backend, created when first enabled.
+            std::unique_ptr<NativeJit> _jit;
+            bool _jitEnabled = false;
+
+            TieringPolicy _tiering;
+            /// Node based, frames keep pointers to the profiles.
+            std::unordered_map<const llvm::Function*, FunctionProfile> _profiles;
+
+            /// Exploration state, see @c explore().
+            bool _exploring = false;
+            ExplorationConfig _exploration;
+            std::deque<Fork> _forks;
+            std::set<std::pair<llvm::Instruction*, unsigned>> _exploredEdges;
+            std::size_t _states = 0;
+            std::size_t _dropped = 0;
+
+            std::mt19937_64 _rng;
+
+            LibcModels _libc;
+            bool _libcEnabled = true;
+
+            TraceWriter* _trace = nullptr;
+            bool _keepLogs = true;
 
             std::string s;
 
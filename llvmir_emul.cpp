@@ -31,10 +31,14 @@
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/IRReader/IRReader.h>
 
+#include "execution_trace.h"
 #include "llvmir-emul.h"
+#include "program_image.h"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
-#include <time.h>
+#include <limits>
 
 using namespace llvm;
 using namespace std;
@@ -970,6 +974,9 @@ break
 // doing this can cause problems if the PHI nodes depend on other PHI nodes for
 // their inputs.  If the input PHI node is updated before it is read, incorrect
 // results can happen.  Thus we use a two phase approach.
+//
+// Which incoming value belongs to which PHI node is resolved only once per CFG
+// edge (see GlobalExecutionContext::getPhiEdgeTable()).
 //
             void switchToNewBasicBlock(
                     BasicBlock* Dest,
@@ -986,31 +993,30 @@ break
                     return;  // Nothing fancy to do
                 }
 
-                // Loop over all of the PHI nodes in the current block, reading their inputs.
-                std::vector<GenericValue> ResultValues;
-
-                for (; PHINode *PN = dyn_cast<PHINode>(SF.curInst); ++SF.curInst)
+                const PhiEdgeTable& edge = GC.getPhiEdgeTable(PrevBB, Dest);
+                if (edge.missing)
                 {
-                    // Search for the value corresponding to this previous bb...
-                    int i = PN->getBasicBlockIndex(PrevBB);
-                    if(i == -1) {
-                        SF.PHIorNot = true;
-                        return;
-                    }
-                    assert(i != -1 && "PHINode doesn't contain entry for predecessor??");
-                    Value *IncomingValue = PN->getIncomingValue(i);
+                    SF.curInst = BasicBlock::iterator(edge.missing);
+                    SF.PHIorNot = true;
+                    return;
+                }
 
-                    // Save the incoming value for this PHI node...
-                    ResultValues.push_back(GC.getOperandValue(IncomingValue, SF));
+                // Read all the incoming values...
+                auto& ResultValues = GC.phiScratch;
+                ResultValues.clear();
+                for (auto& copy : edge.copies)
+                {
+                    ResultValues.push_back(GC.getOperandValue(copy.first, SF));
                 }
 
-                // Now loop over all of the PHI nodes setting their values...
-                SF.curInst = SF.curBB->begin();
-                for (unsigned i = 0; isa<PHINode>(SF.curInst); ++SF.curInst, ++i)
+                // ...and then set them to the PHI nodes.
+                for (unsigned i = 0; i < edge.copies.size(); ++i)
                 {
-                    PHINode *PN = cast<PHINode>(SF.curInst);
-                    GC.setValue(PN, ResultValues[i]);
+                    GC.setValue(edge.copies[i].second, ResultValues[i]);
                 }
+
+                SF.curInst = BasicBlock::iterator(edge.lastPhi);
+                ++SF.curInst;
             }
 
 //
@@ -1019,53 +1025,84 @@ break
 //=============================================================================
 //
 
+/**
+* Walks indices of getelementptr @a gep once and folds them into a plan.
+*/
+            GepPlan buildGepPlan(User* gep, const DataLayout* DL)
+            {
+                GepPlan plan;
+
+                for (auto I = gep_type_begin(gep), E = gep_type_end(gep); I != E; ++I)
+                {
+                    if (StructType *STy = dyn_cast<StructType>((I.operator*()))) //**** I.getStructTypeOrNull()
+                    {
+                        const StructLayout *SLO = DL->getStructLayout(STy);
+
+                        const ConstantInt *CPU = cast<ConstantInt>(I.getOperand());
+                        unsigned Index = unsigned(CPU->getZExtValue());
+
+                        plan.constantOffset += SLO->getElementOffset(Index);
+                        continue;
+                    }
+
+                    uint64_t scale = DL->getTypeAllocSize(I.getIndexedType());
+                    unsigned BitWidth = cast<IntegerType>(
+                            I.getOperand()->getType())->getBitWidth();
+                    assert((BitWidth == 32 || BitWidth == 64)
+                           && "Invalid index type for getelementptr");
+
+                    if (auto* CI = dyn_cast<ConstantInt>(I.getOperand()))
+                    {
+                        int64_t Idx = BitWidth == 32
+                                ? static_cast<int64_t>(static_cast<int32_t>(CI->getZExtValue()))
+                                : static_cast<int64_t>(CI->getZExtValue());
+                        plan.constantOffset += scale * Idx;
+                    }
+                    else
+                    {
+                        GepPlan::VariableIndex vi;
+                        vi.value = I.getOperand();
+                        vi.scale = scale;
+                        vi.bitWidth = BitWidth;
+                        plan.indices.push_back(vi);
+                    }
+                }
+
+                return plan;
+            }
+
 /**
 * getElementOffset - The workhorse for getelementptr.
+* Address arithmetic is pre-folded by @c buildGepPlan() on the first
+* execution, here it is only a few multiply-adds.
 */
             GenericValue executeGEPOperation(
-                    Value *Ptr,
-                    gep_type_iterator I,
-                    gep_type_iterator E,
+                    User* gep,
                     LocalExecutionContext& SF,
                     GlobalExecutionContext& GC)
             {
+                Value* Ptr = gep->getOperand(0);
                 assert(Ptr->getType()->isPointerTy()
                        && "Cannot getElementOffset of a nonpointer type!");
 
-                const DataLayout *DL = GC.getModule()->getDataLayout(); // **** change auto to const
-
-                uint64_t Total = 0;
+                const GepPlan& plan = GC.getGepPlan(gep);
+                uint64_t Total = plan.constantOffset;
 
-                for (; I != E; ++I)
+                for (auto& vi : plan.indices)
                 {
-                    if (StructType *STy = dyn_cast<StructType>((I.operator*()))) //**** I.getStructTypeOrNull()
-                    {
-                        const StructLayout *SLO = DL->getStructLayout(STy); // **** change . to ->
-
-                        const ConstantInt *CPU = cast<ConstantInt>(I.getOperand());
-                        unsigned Index = unsigned(CPU->getZExtValue());
+                    // Get the index number for the array... which must be long type...
+                    GenericValue IdxGV = GC.getOperandValue(vi.value, SF);
 
-                        Total += SLO->getElementOffset(Index);
+                    int64_t Idx;
+                    if (vi.bitWidth == 32)
+                    {
+                        Idx = static_cast<int64_t>(static_cast<int32_t>(IdxGV.IntVal.getZExtValue()));
                     }
                     else
                     {
-                        // Get the index number for the array... which must be long type...
-                        GenericValue IdxGV = GC.getOperandValue(I.getOperand(), SF);
-
-                        int64_t Idx;
-                        unsigned BitWidth = cast<IntegerType>(
-                                I.getOperand()->getType())->getBitWidth();
-                        if (BitWidth == 32)
-                        {
-                            Idx = static_cast<int64_t>(static_cast<int32_t>(IdxGV.IntVal.getZExtValue()));
-                        }
-                        else
-                        {
-                            assert(BitWidth == 64 && "Invalid index type for getelementptr");
-                            Idx = static_cast<int64_t>(IdxGV.IntVal.getZExtValue());
-                        }
-                        Total += DL->getTypeAllocSize(I.getIndexedType()) * Idx; // **** change . to ->
+                        Idx = static_cast<int64_t>(IdxGV.IntVal.getZExtValue());
                     }
+                    Total += vi.scale * Idx;
                 }
 
                 GenericValue Result;
@@ -1733,8 +1770,7 @@ break
                     case Instruction::BitCast:
                         return executeBitCastInst(CE->getOperand(0), CE->getType(), SF, GC);
                     case Instruction::GetElementPtr:
-                        return executeGEPOperation(CE->getOperand(0), gep_type_begin(CE),
-                                                   gep_type_end(CE), SF, GC);
+                        return executeGEPOperation(CE, SF, GC);
                     case Instruction::FCmp:
                     case Instruction::ICmp:
                         return executeCmpInst(
@@ -2344,193 +2380,1203 @@ break
             }
 
 
-        }
+/**
+* @return @c True if @a cf is an intrinsic that the emulator lowers with
+*         @c IntrinsicLowering before executing it.
+*/
+            bool isLowerableIntrinsic(const Function* cf)
+            {
+                return cf && cf->isDeclaration() && cf->isIntrinsic() &&
+                    !( cf->getIntrinsicID() == Intrinsic::mips_bitrev //bitreverse
+                       || cf->getIntrinsicID() == Intrinsic::xcore_bitrev// **** ConstantInt::get(Ty->getContext(), Op->getValue().reverseBits()
+                       || cf->getIntrinsicID() == Intrinsic::maxnum || cf->getIntrinsicID() == Intrinsic::umul_with_overflow
+                       || cf->getIntrinsicID() == Intrinsic::minnum || cf->getIntrinsicID() == Intrinsic::trap
+                       || cf->getIntrinsicID() == Intrinsic::fabs || cf->getIntrinsicID() == Intrinsic::uadd_with_overflow); // can not lower those functions
+            }
 
+/**
+* Converts between emulator values and the 64-bit integers the native code
+* passes around.
+*/
+            uint64_t toNativeValue(Type* t, const GenericValue& v)
+            {
+                if (t->isPointerTy())
+                {
+                    return reinterpret_cast<uintptr_t>(v.PointerVal);
+                }
+                return v.IntVal.getBitWidth() > 64
+                        ? v.IntVal.trunc(64).getZExtValue()
+                        : v.IntVal.getZExtValue();
+            }
 
-//
-//=============================================================================
-// GlobalExecutionContext
-//=============================================================================
-//
+            GenericValue fromNativeValue(Type* t, uint64_t v)
+            {
+                GenericValue ret;
+                if (t->isPointerTy())
+                {
+                    ret.PointerVal = reinterpret_cast<void*>(uintptr_t(v));
+                }
+                else
+                {
+                    ret.IntVal = APInt(t->getIntegerBitWidth(), v);
+                }
+                return ret;
+            }
 
-        GlobalExecutionContext::GlobalExecutionContext(llvm::Module* m) :
-                _module(m)
-        {
+/**
+* Byte size of a stored value, guessed from the value itself -- see
+* @c GlobalExecutionContext::readBytes().
+*/
+            uint64_t storedSize(const GenericValue& v)
+            {
+                if (!v.AggregateVal.empty())
+                {
+                    return v.AggregateVal.size() * std::max<uint64_t>(1, storedSize(v.AggregateVal[0]));
+                }
+                if (v.IntVal.getBitWidth() > 1 || v.IntVal != 0)
+                {
+                    return (v.IntVal.getBitWidth() + 7) / 8;
+                }
+                return v.PointerVal ? sizeof(uint64_t) : 1;
+            }
 
-        }
+/**
+* Copies bytes [@a skip, @a skip + @a n) of stored value @a v to @a out.
+* @return Number of bytes copied, less than @a n if the value ends sooner.
+*/
+            std::size_t storedBytes(
+                    const GenericValue& v,
+                    uint64_t skip,
+                    uint8_t* out,
+                    std::size_t n)
+            {
+                if (!v.AggregateVal.empty())
+                {
+                    uint64_t es = std::max<uint64_t>(1, storedSize(v.AggregateVal[0]));
+                    std::size_t done = 0;
+                    for (uint64_t i = skip / es; i < v.AggregateVal.size() && done < n; ++i)
+                    {
+                        uint64_t off = i == skip / es ? skip % es : 0;
+                        done += storedBytes(v.AggregateVal[i], off, out + done, n - done);
+                    }
+                    return done;
+                }
+
+                uint64_t size = storedSize(v);
+                std::size_t done = 0;
+                if (v.IntVal.getBitWidth() > 1 || v.IntVal != 0)
+                {
+                    const uint64_t* words = v.IntVal.getRawData();
+                    for (uint64_t k = skip; k < size && done < n; ++k)
+                    {
+                        out[done++] = uint8_t(words[k / 8] >> (8 * (k % 8)));
+                    }
+                }
+                else
+                {
+                    uint64_t raw = reinterpret_cast<uintptr_t>(v.PointerVal);
+                    for (uint64_t k = skip; k < size && done < n; ++k)
+                    {
+                        out[done++] = uint8_t(raw >> (8 * k));
+                    }
+                }
+                return done;
+            }
+
+            /// Values below an address looked at for one that spans it.
+            const unsigned SPANNING_CANDIDATES = 8;
 
-        llvm::Module* GlobalExecutionContext::getModule() const
-        {
-            return _module;
         }
 
-        llvm::GenericValue GlobalExecutionContext::getMemory(uint64_t addr, bool log)
+
+/**
+* Retdec lifts machine registers and flags into global variables named after
+* them (rax, esp, zf, cf, xmm0, st0, ...). Returns @c true if @a gv looks
+* like one of those -- it has a register name and a scalar type.
+*/
+        bool isRegisterGlobal(const GlobalVariable* gv)
         {
-            if (log)
+            Type* ty = gv->getType()->getElementType();
+            if (!ty->isIntegerTy() && !ty->isFloatingPointTy() && !ty->isPointerTy())
             {
-                memoryLoads.push_back(addr);
+                return false;
             }
 
-            auto fIt = memory.find(addr);
-//            cout << "getMemory\t" << (fIt != memory.end()) << endl;
-            return fIt != memory.end() ? fIt->second : GenericValue();
-        }
-
-        void GlobalExecutionContext::setMemory(
-                uint64_t addr,
-                llvm::GenericValue val,
-                bool log)
-        {
-            if (log)
+            static const std::set<std::string> names = {
+                    // 64/32/16/8-bit general purpose registers.
+                    "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rbp", "rsp", "rip",
+                    "eax", "ebx", "ecx", "edx", "esi", "edi", "ebp", "esp", "eip",
+                    "ax", "bx", "cx", "dx", "si", "di", "bp", "sp", "ip",
+                    "al", "bl", "cl", "dl", "sil", "dil", "bpl", "spl",
+                    "ah", "bh", "ch", "dh",
+                    // Flags.
+                    "cf", "pf", "af", "az", "zf", "sf", "tf", "if", "df", "of",
+                    // Segment registers.
+                    "cs", "ds", "es", "fs", "gs", "ss"};
+
+            StringRef n = gv->getName();
+            if (names.count(n.str()))
             {
-                memoryStores.push_back(addr);
+                return true;
             }
 
-            memory[addr] = val;
-        }
+            auto digitsFrom = [&n](std::size_t pos) {
+                if (pos >= n.size())
+                {
+                    return false;
+                }
+                for (std::size_t i = pos; i < n.size(); ++i)
+                {
+                    if (!isdigit(n[i]))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            };
 
-        llvm::GenericValue GlobalExecutionContext::getGlobal(
-                llvm::GlobalVariable* g,
-                bool log)
-        {
-            if (log)
+            // r8 - r15 and their d/w/b sub-registers.
+            StringRef base = n;
+            if (base.size() > 2 && (base.endswith("d") || base.endswith("w") || base.endswith("b")))
             {
-                globalsLoads.push_back(g);
+                base = base.drop_back();
+            }
+            if (base.size() >= 2 && base[0] == 'r')
+            {
+                StringRef num = base.drop_front();
+                bool allDigits = true;
+                for (char c : num)
+                {
+                    allDigits &= isdigit(c) != 0;
+                }
+                if (allDigits)
+                {
+                    return true;
+                }
             }
 
-            auto fIt = globals.find(g);
-            //**** assert(fIt != globals.end());
-            return fIt != globals.end() ? fIt->second : GenericValue();
+            return ((n.startswith("xmm") || n.startswith("ymm") || n.startswith("zmm"))
+                        && digitsFrom(3))
+                    || ((n.startswith("st") || n.startswith("mm")) && digitsFrom(2))
+                    || n.startswith("fpu_");
         }
 
-        void GlobalExecutionContext::setGlobal(
-                llvm::GlobalVariable* g,
-                llvm::GenericValue val,
-                bool log)
+/**
+* Machine state and temporaries of decompiled code. Loads and stores of
+* values named like this are not written into similarity strings.
+*/
+        bool isUntracedName(llvm::StringRef n)
         {
-            if (log)
+            static const char* const prefixes[] = {
+                    "stack_var", "arg", "tmp", "r",
+                    "pf", "zf", "sf", "of", "cf", "az"};
+            for (const char* p : prefixes)
             {
-                globalsStores.push_back(g);
+                if (n.startswith(p))
+                {
+                    return true;
+                }
             }
-
-            globals[g] = val;
+            return false;
         }
 
-        void GlobalExecutionContext::setValue(llvm::Value* v, llvm::GenericValue val)
+
+//
+//=============================================================================
+// PagedMemory
+//=============================================================================
+//
+
+        const llvm::GenericValue* PagedMemory::find(uint64_t addr) const
         {
-            values[v] = val;
+            auto pIt = _pages.find(addr >> PAGE_BITS);
+            if (pIt == _pages.end())
+            {
+                return nullptr;
+            }
+            auto vIt = pIt->second->find(addr);
+            return vIt != pIt->second->end() ? &vIt->second : nullptr;
         }
 
-        llvm::GenericValue GlobalExecutionContext::getOperandValue(
-                llvm::Value* val,
-                LocalExecutionContext& ec)
+/**
+* Page that is shared with another copy is cloned before the write.
+*/
+        void PagedMemory::set(uint64_t addr, const llvm::GenericValue& val)
         {
-            if (ConstantExpr* ce = dyn_cast<ConstantExpr>(val))
+            auto& page = _pages[addr >> PAGE_BITS];
+            if (!page)
             {
-                return getConstantExprValue(ce, ec, *this);
+                page = std::make_shared<Page>();
+                _dirty.push_back(addr >> PAGE_BITS);
             }
-            else if (Constant* cpv = dyn_cast<Constant>(val))
+            else if (page.use_count() > 1)
             {
-                return  getConstantValue(cpv, getModule());
+                page = std::make_shared<Page>(*page);
+                _dirty.push_back(addr >> PAGE_BITS);
             }
-            else if (isa<GlobalValue>(val))
+            (*page)[addr] = val;
+        }
+
+        const llvm::GenericValue* PagedMemory::findBefore(uint64_t addr, uint64_t& at) const
+        {
+            auto pIt = _pages.upper_bound(addr >> PAGE_BITS);
+            while (pIt != _pages.begin())
             {
-                assert(false && "get pointer to global variable, how?");
-                throw LlvmIrEmulatorError("not implemented");
+                --pIt;
+                auto& page = *pIt->second;
+                auto vIt = page.lower_bound(addr);
+                if (vIt != page.begin())
+                {
+                    --vIt;
+                    at = vIt->first;
+                    return &vIt->second;
+                }
             }
-            else
+            return nullptr;
+        }
+
+        void PagedMemory::erase(uint64_t lo, uint64_t hi)
+        {
+            auto pIt = _pages.lower_bound(lo >> PAGE_BITS);
+            while (pIt != _pages.end() && (pIt->first << PAGE_BITS) < hi)
             {
-                return values[val];
+                auto& page = pIt->second;
+                auto vIt = page->lower_bound(lo);
+                if (vIt == page->end() || vIt->first >= hi)
+                {
+                    ++pIt;
+                    continue;
+                }
+                if (page.use_count() > 1)
+                {
+                    page = std::make_shared<Page>(*page);
+                    vIt = page->lower_bound(lo);
+                    _dirty.push_back(pIt->first);
+                }
+                page->erase(vIt, page->lower_bound(hi));
+                pIt = page->empty() ? _pages.erase(pIt) : std::next(pIt);
             }
         }
-//
-//=============================================================================
-// ExecutionContext
-//=============================================================================
-//
-
-        LocalExecutionContext::LocalExecutionContext() :
-                curInst(nullptr) {
 
+        std::size_t PagedMemory::pageCount() const
+        {
+            return _pages.size();
         }
 
-        LocalExecutionContext::LocalExecutionContext(LocalExecutionContext &&o) :
-                curFunction(o.curFunction),
-                curBB(o.curBB),
-                curInst(o.curInst),
-                caller(o.caller),
-                allocas(std::move(o.allocas)) {
-
+        void PagedMemory::markClean()
+        {
+            _dirty.clear();
         }
 
-        LocalExecutionContext &LocalExecutionContext::operator=(LocalExecutionContext &&o) {
-            curFunction = o.curFunction;
-            curBB = o.curBB;
-            curInst = o.curInst;
-            caller = o.caller;
-            allocas = std::move(o.allocas);
-            return *this;
+/**
+* Pages of @a base are shared again, not copied. A page created and then
+* emptied is listed but already gone.
+*/
+        void PagedMemory::restore(const PagedMemory& base)
+        {
+            for (uint64_t p : _dirty)
+            {
+                auto bIt = base._pages.find(p);
+                if (bIt != base._pages.end())
+                {
+                    _pages[p] = bIt->second;
+                }
+                else
+                {
+                    _pages.erase(p);
+                }
+            }
+            _dirty.clear();
         }
 
-        llvm::Module *LocalExecutionContext::getModule() const {
-            return curFunction->getParent();
-        }
 //
 //=============================================================================
-// LlvmIrEmulator
+// BlockCoverage
 //=============================================================================
 //
 
-        LlvmIrEmulator::LlvmIrEmulator(llvm::Module* m) :
-                _module(m),
-                _globalEc(_module)
+        bool BlockCoverage::mark(const llvm::BasicBlock* bb)
         {
-            for (GlobalVariable& gv : _module->globals())
+            auto res = _ids.insert(std::make_pair(bb, unsigned(_ids.size())));
+            unsigned id = res.first->second;
+            if (id / 64 >= _bits.size())
             {
-                if(!gv.isDeclaration()) {
-                    auto val = getConstantValue(gv.getInitializer(), _module);
-//                    auto cda = dyn_cast<ConstantDataArray>(gv.getInitializer());
-//                    if (cda) {
-//                        cout << cda->getAsCString().str() << " str value" << endl;
-//                    }
-                    setGlobalVariableValue(&gv, val);
-                    uint64_t ptrVal = reinterpret_cast<uint64_t>(&gv);
-                    _globalEc.setMemory(ptrVal, val);
-                }
+                _bits.resize(id / 64 + 1, 0);
             }
-            IL = new IntrinsicLowering(*(_module->getDataLayout())); // **** add *
+            uint64_t bit = uint64_t(1) << (id % 64);
+            if (_bits[id / 64] & bit)
+            {
+                return false;
+            }
+            _bits[id / 64] |= bit;
+            ++_count;
+            return true;
         }
 
-        LlvmIrEmulator::~LlvmIrEmulator()
+        bool BlockCoverage::contains(const llvm::BasicBlock* bb) const
         {
-            delete IL;
+            auto it = _ids.find(bb);
+            if (it == _ids.end())
+            {
+                return false;
+            }
+            return _bits[it->second / 64] & (uint64_t(1) << (it->second % 64));
         }
 
-        llvm::GenericValue LlvmIrEmulator::runFunction(
-                llvm::Function* f,
-                const llvm::ArrayRef<llvm::GenericValue> argVals,
-                bool outside)
+        std::size_t BlockCoverage::count() const
         {
-            assert(_module == f->getParent());
-
-            if(outside) {
-                _visitedBbs.clear();
-                _exitValue = GenericValue();
-                _ecStack.clear();
-                _visitedInsns.clear();
-                _visitedInsns.clear();
-                _ecStackRetired.clear();
-            }
-            const size_t ac = f->getFunctionType()->getNumParams();
-            ArrayRef<GenericValue> aargs = argVals.slice(
-                    0,
-                    std::min(argVals.size(), ac));
+            return _count;
+        }
 
-            callFunction(f, aargs);
+/**
+* Clears coverage, block ids stay assigned.
+*/
+        void BlockCoverage::clear()
+        {
+            std::fill(_bits.begin(), _bits.end(), 0);
+            _count = 0;
+        }
 
-//            clock_t start, end;
-//            start = clock();
+//
+//=============================================================================
+// GlobalExecutionContext
+//=============================================================================
+//
+
+        GlobalExecutionContext::GlobalExecutionContext(llvm::Module* m) :
+                _module(m)
+        {
+
+        }
+
+        llvm::Module* GlobalExecutionContext::getModule() const
+        {
+            return _module;
+        }
+
+/**
+* Gives global @a g a slot in the register file. Must be called before the
+* global is initialized.
+*/
+        void GlobalExecutionContext::addRegister(llvm::GlobalVariable* g)
+        {
+            if (registerIds.count(g))
+            {
+                return;
+            }
+            registerIds[g] = registers.size();
+            registerGlobals.push_back(g);
+            registers.emplace_back();
+            registerAccess.push_back(0);
+        }
+
+        bool GlobalExecutionContext::isRegister(const llvm::GlobalVariable* g) const
+        {
+            return registerIds.count(g);
+        }
+
+        bool GlobalExecutionContext::wasRegisterLoaded(const llvm::GlobalVariable* g) const
+        {
+            auto rIt = registerIds.find(g);
+            return rIt != registerIds.end() && (registerAccess[rIt->second] & 1);
+        }
+
+        bool GlobalExecutionContext::wasRegisterStored(const llvm::GlobalVariable* g) const
+        {
+            auto rIt = registerIds.find(g);
+            return rIt != registerIds.end() && (registerAccess[rIt->second] & 2);
+        }
+
+/**
+* Appends every register that was loaded at least once. Unlike other globals,
+* register accesses are not logged in order, so each such register appears
+* only once.
+*/
+        void GlobalExecutionContext::appendLoadedRegisters(
+                LogIndex<llvm::GlobalVariable*>& out) const
+        {
+            for (unsigned i = 0; i < registerGlobals.size(); ++i)
+            {
+                if (registerAccess[i] & 1)
+                {
+                    out.insert(registerGlobals[i]);
+                }
+            }
+        }
+
+        void GlobalExecutionContext::appendStoredRegisters(
+                LogIndex<llvm::GlobalVariable*>& out) const
+        {
+            for (unsigned i = 0; i < registerGlobals.size(); ++i)
+            {
+                if (registerAccess[i] & 2)
+                {
+                    out.insert(registerGlobals[i]);
+                }
+            }
+        }
+
+        const GepPlan& GlobalExecutionContext::getGepPlan(llvm::User* gep)
+        {
+            if (image)
+            {
+                if (const GepPlan* plan = image->getGepPlan(gep))
+                {
+                    return *plan;
+                }
+            }
+            auto fIt = gepPlans.find(gep);
+            if (fIt != gepPlans.end())
+            {
+                return fIt->second;
+            }
+            return gepPlans.emplace(
+                    gep,
+                    buildGepPlan(gep, getModule()->getDataLayout())).first->second;
+        }
+
+        const PhiEdgeTable& GlobalExecutionContext::getPhiEdgeTable(
+                llvm::BasicBlock* from,
+                llvm::BasicBlock* to)
+        {
+            if (image)
+            {
+                if (const PhiEdgeTable* edge = image->getPhiEdgeTable(from, to))
+                {
+                    return *edge;
+                }
+            }
+            auto key = std::make_pair(from, to);
+            auto fIt = phiEdges.find(key);
+            if (fIt != phiEdges.end())
+            {
+                return fIt->second;
+            }
+
+            PhiEdgeTable& edge = phiEdges[key];
+            for (auto it = to->begin(); PHINode* PN = dyn_cast<PHINode>(it); ++it)
+            {
+                edge.lastPhi = PN;
+                if (edge.missing)
+                {
+                    continue;
+                }
+                int i = PN->getBasicBlockIndex(from);
+                if (i == -1)
+                {
+                    edge.missing = PN;
+                    continue;
+                }
+                edge.copies.push_back(std::make_pair(PN->getIncomingValue(i), PN));
+            }
+            return edge;
+        }
+
+        GlobalExecutionContext::State GlobalExecutionContext::saveState() const
+        {
+            State s;
+            s.memory = memory;
+            s.memoryLoads = memoryLoads;
+            s.memoryStores = memoryStores;
+            s.globals = globals;
+            s.globalsLoads = globalsLoads;
+            s.globalsStores = globalsStores;
+            s.globalsUnloggedStores = globalsUnloggedStores;
+            s.globalsMaterialized = globalsMaterialized;
+            s.registers = registers;
+            s.registerAccess = registerAccess;
+            s.registerLoads = registerLoads;
+            s.registerStores = registerStores;
+            s.values = values;
+            s.lazyGlobals = lazyGlobals;
+            s.heap = heap;
+            return s;
+        }
+
+/**
+* Replaces the current state with @a state, which is consumed.
+*/
+        void GlobalExecutionContext::restoreState(State& state)
+        {
+            memory = std::move(state.memory);
+            memoryLoads = std::move(state.memoryLoads);
+            memoryStores = std::move(state.memoryStores);
+            globals = std::move(state.globals);
+            globalsLoads = std::move(state.globalsLoads);
+            globalsStores = std::move(state.globalsStores);
+            globalsUnloggedStores = std::move(state.globalsUnloggedStores);
+            globalsMaterialized = std::move(state.globalsMaterialized);
+            registers = std::move(state.registers);
+            registerAccess = std::move(state.registerAccess);
+            registerLoads = state.registerLoads;
+            registerStores = state.registerStores;
+            values = std::move(state.values);
+            lazyGlobals = std::move(state.lazyGlobals);
+            heap = std::move(state.heap);
+        }
+
+        void GlobalExecutionContext::snapshot()
+        {
+            _initial = saveState();
+            memory.markClean();
+            globalsUnloggedStores.clear();
+            globalsMaterialized.clear();
+            _initial.globalsUnloggedStores.clear();
+            _initial.globalsMaterialized.clear();
+        }
+
+/**
+* Changed globals are the logged and unlogged stores. Globals initialized
+* lazily since the snapshot are deferred again -- memory and registers are
+* restored to before their initialization.
+*/
+        void GlobalExecutionContext::reset()
+        {
+            memory.restore(_initial.memory);
+
+            auto restoreGlobal = [this](llvm::GlobalVariable* g) {
+                auto iIt = _initial.globals.find(g);
+                if (iIt != _initial.globals.end())
+                {
+                    globals[g] = iIt->second;
+                    return;
+                }
+                globals.erase(g);
+                uint64_t addr = reinterpret_cast<uint64_t>(g);
+                auto lIt = _initial.lazyGlobals.find(addr);
+                if (lIt != _initial.lazyGlobals.end())
+                {
+                    lazyGlobals[addr] = lIt->second;
+                }
+            };
+            for (auto* g : globalsStores)
+            {
+                restoreGlobal(g);
+            }
+            for (auto* g : globalsUnloggedStores)
+            {
+                restoreGlobal(g);
+            }
+            // Register globals are not in globals, so stores of their
+            // initializers are not in the lists above.
+            for (auto* g : globalsMaterialized)
+            {
+                restoreGlobal(g);
+            }
+
+            for (unsigned i = 0; i < registers.size(); ++i)
+            {
+                registers[i] = _initial.registers[i];
+            }
+            std::fill(registerAccess.begin(), registerAccess.end(), 0);
+            registerLoads = 0;
+            registerStores = 0;
+
+            memoryLoads.clear();
+            memoryStores.clear();
+            globalsLoads.clear();
+            globalsStores.clear();
+            globalsUnloggedStores.clear();
+            globalsMaterialized.clear();
+            values.clear();
+            heap = _initial.heap;
+        }
+
+        const FusionTable& GlobalExecutionContext::getFusionTable(llvm::Function* f)
+        {
+            if (image)
+            {
+                if (const FusionTable* table = image->getFusionTable(f))
+                {
+                    return *table;
+                }
+            }
+            auto fIt = fusionTables.find(f);
+            if (fIt == fusionTables.end())
+            {
+                fIt = fusionTables.emplace(f, buildFusionTable(*f)).first;
+            }
+            return fIt->second;
+        }
+
+/**
+* Drops all the pre-decoded plans, fusion tables included. They refer to IR
+* values, so this must be called whenever the IR is modified (e.g. by
+* intrinsic lowering). Frames pointing to fusion tables must be re-bound, see
+* @c LlvmIrEmulator::invalidatePlans().
+*/
+        void GlobalExecutionContext::invalidatePlans()
+        {
+            gepPlans.clear();
+            phiEdges.clear();
+            fusionTables.clear();
+        }
+
+/**
+* Evaluates initializer of global @a g and stores it both as the global's
+* value and to memory at the global's address.
+*/
+        void GlobalExecutionContext::initializeGlobal(
+                llvm::GlobalVariable* g,
+                bool logMemory)
+        {
+            const GenericValue* pooled = image ? image->getInitializer(g) : nullptr;
+            auto val = pooled ? *pooled : getConstantValue(g->getInitializer(), _module);
+            setGlobal(g, val, false);
+            uint64_t ptrVal = reinterpret_cast<uint64_t>(g);
+            setMemory(ptrVal, val, logMemory);
+        }
+
+/**
+* Registers global @a g to be initialized on its first access.
+*/
+        void GlobalExecutionContext::deferGlobal(llvm::GlobalVariable* g)
+        {
+            LazyGlobal lazy;
+            lazy.global = g;
+            Type* t = g->getType()->getElementType();
+            lazy.size = t->isSized()
+                    ? std::max<uint64_t>(_module->getDataLayout()->getTypeAllocSize(t), 1)
+                    : 1;
+            lazyGlobals[reinterpret_cast<uint64_t>(g)] = lazy;
+        }
+
+/**
+* Initializes the deferred global at @a addr, the one accessed through
+* global accessors.
+*/
+        void GlobalExecutionContext::materializeGlobal(uint64_t addr)
+        {
+            auto fIt = lazyGlobals.find(addr);
+            if (fIt == lazyGlobals.end())
+            {
+                return;
+            }
+            llvm::GlobalVariable* g = fIt->second.global;
+            lazyGlobals.erase(fIt);
+            globalsMaterialized.push_back(g);
+            // Lazy initialization is not an emulated store, do not log it.
+            initializeGlobal(g, false);
+        }
+
+/**
+* Initializes all deferred globals overlapping [@a addr, @a addr + @a n),
+* so that accesses into their interior see their initializers too.
+*/
+        void GlobalExecutionContext::materializeGlobals(uint64_t addr, uint64_t n)
+        {
+            if (n == 0)
+            {
+                return;
+            }
+            uint64_t end = n > ~addr ? ~uint64_t(0) : addr + n;
+            auto it = lazyGlobals.upper_bound(addr);
+            if (it != lazyGlobals.begin())
+            {
+                auto pIt = std::prev(it);
+                if (addr - pIt->first < pIt->second.size)
+                {
+                    it = pIt;
+                }
+            }
+
+            // Initialization accesses memory itself, so the range is taken
+            // out of the map before any global is initialized.
+            llvm::SmallVector<llvm::GlobalVariable*, 4> found;
+            while (it != lazyGlobals.end() && it->first < end)
+            {
+                found.push_back(it->second.global);
+                it = lazyGlobals.erase(it);
+            }
+            for (auto* g : found)
+            {
+                globalsMaterialized.push_back(g);
+                // Lazy initialization is not an emulated store, do not log it.
+                initializeGlobal(g, false);
+            }
+        }
+
+        void GlobalExecutionContext::logMemoryLoad(uint64_t addr)
+        {
+            if (keepLogs)
+            {
+                memoryLoads.push_back(addr);
+            }
+            if (trace)
+            {
+                trace->memoryLoad(addr);
+            }
+        }
+
+        void GlobalExecutionContext::logMemoryStore(uint64_t addr)
+        {
+            if (keepLogs)
+            {
+                memoryStores.push_back(addr);
+            }
+            if (trace)
+            {
+                trace->memoryStore(addr);
+            }
+        }
+
+        void GlobalExecutionContext::logGlobalLoad(llvm::GlobalVariable* g)
+        {
+            if (keepLogs)
+            {
+                globalsLoads.push_back(g);
+            }
+            if (trace)
+            {
+                trace->globalLoad(g);
+            }
+        }
+
+        void GlobalExecutionContext::logGlobalStore(llvm::GlobalVariable* g)
+        {
+            if (keepLogs)
+            {
+                globalsStores.push_back(g);
+            }
+            if (trace)
+            {
+                trace->globalStore(g);
+            }
+        }
+
+        llvm::GenericValue GlobalExecutionContext::getMemory(uint64_t addr, bool log)
+        {
+            if (!lazyGlobals.empty())
+            {
+                materializeGlobals(addr, 1);
+            }
+
+            if (log)
+            {
+                logMemoryLoad(addr);
+            }
+
+            auto* val = memory.find(addr);
+//            cout << "getMemory\t" << (fIt != memory.end()) << endl;
+            return val ? *val : GenericValue();
+        }
+
+        void GlobalExecutionContext::setMemory(
+                uint64_t addr,
+                llvm::GenericValue val,
+                bool log)
+        {
+            if (!lazyGlobals.empty())
+            {
+                materializeGlobals(addr, 1);
+            }
+
+            if (log)
+            {
+                logMemoryStore(addr);
+            }
+
+            memory.set(addr, val);
+        }
+
+/**
+* Values below @a addr are painted first, from the farthest, then values in
+* the range in address order -- a value at a higher address wins.
+*/
+        void GlobalExecutionContext::readBytes(
+                uint64_t addr,
+                uint8_t* out,
+                std::size_t n)
+        {
+            if (!lazyGlobals.empty())
+            {
+                materializeGlobals(addr, n);
+            }
+            logMemoryLoad(addr);
+            std::memset(out, 0, n);
+            n = std::min<uint64_t>(n, ~addr);
+
+            std::pair<uint64_t, const GenericValue*> before[SPANNING_CANDIDATES];
+            unsigned count = 0;
+            uint64_t at = addr;
+            while (count < SPANNING_CANDIDATES)
+            {
+                const GenericValue* v = memory.findBefore(at, at);
+                if (v == nullptr)
+                {
+                    break;
+                }
+                before[count++] = std::make_pair(at, v);
+            }
+            while (count--)
+            {
+                uint64_t skip = addr - before[count].first;
+                if (skip < storedSize(*before[count].second))
+                {
+                    storedBytes(*before[count].second, skip, out, n);
+                }
+            }
+
+            memory.forEach(addr, addr + n, [&](uint64_t a, const GenericValue& v) {
+                storedBytes(v, 0, out + (a - addr), n - (a - addr));
+            });
+        }
+
+        void GlobalExecutionContext::writeBytes(
+                uint64_t addr,
+                const uint8_t* data,
+                std::size_t n)
+        {
+            if (!lazyGlobals.empty())
+            {
+                materializeGlobals(addr, n);
+            }
+            logMemoryStore(addr);
+            n = std::min<uint64_t>(n, ~addr);
+            memory.erase(addr, addr + n);
+            GenericValue b;
+            for (std::size_t k = 0; k < n; ++k)
+            {
+                b.IntVal = APInt(8, data[k]);
+                memory.set(addr + k, b);
+            }
+        }
+
+/**
+* Bytes at the start of the source that belong to values below it are
+* copied as bytes, the values in the range as they are.
+*/
+        void GlobalExecutionContext::copyMemory(
+                uint64_t dst,
+                uint64_t src,
+                std::size_t n)
+        {
+            if (dst == src || n == 0)
+            {
+                return;
+            }
+            n = std::min<uint64_t>(n, std::min(~dst, ~src));
+            if (!lazyGlobals.empty())
+            {
+                materializeGlobals(src, n);
+                materializeGlobals(dst, n);
+            }
+
+            std::vector<std::pair<uint64_t, GenericValue>> values;
+            memory.forEach(src, src + n, [&](uint64_t a, const GenericValue& v) {
+                values.emplace_back(a - src, v);
+            });
+            std::size_t prefix = values.empty() ? n : values.front().first;
+            std::vector<uint8_t> head;
+            uint64_t at = 0;
+            const GenericValue* spanning = memory.findBefore(src, at);
+            if (prefix && spanning && src - at < storedSize(*spanning))
+            {
+                head.resize(std::min<uint64_t>(prefix, storedSize(*spanning) - (src - at)));
+                readBytes(src, head.data(), head.size());
+            }
+
+            memory.erase(dst, dst + n);
+            if (!head.empty())
+            {
+                writeBytes(dst, head.data(), head.size());
+            }
+            for (auto& v : values)
+            {
+                memory.set(dst + v.first, v.second);
+            }
+            logMemoryLoad(src);
+            logMemoryStore(dst);
+        }
+
+        void GlobalExecutionContext::fillMemory(
+                uint64_t dst,
+                uint8_t value,
+                std::size_t n)
+        {
+            n = std::min<uint64_t>(n, ~dst);
+            if (!lazyGlobals.empty())
+            {
+                materializeGlobals(dst, n);
+            }
+            if (value)
+            {
+                std::vector<uint8_t> bytes(n, value);
+                writeBytes(dst, bytes.data(), n);
+                return;
+            }
+
+            // Zero is the default, only bytes of values spanning into the
+            // range need explicit zeros.
+            uint64_t end = dst;
+            uint64_t at = dst;
+            for (unsigned k = 0; k < SPANNING_CANDIDATES; ++k)
+            {
+                const GenericValue* v = memory.findBefore(at, at);
+                if (v == nullptr)
+                {
+                    break;
+                }
+                end = std::max(end, at + storedSize(*v));
+            }
+            memory.erase(dst, dst + n);
+            std::vector<uint8_t> zeros(std::min<uint64_t>(end - dst, n), 0);
+            writeBytes(dst, zeros.data(), zeros.size());
+        }
+
+        uint64_t GlobalExecutionContext::allocate(uint64_t size, uint64_t limit)
+        {
+            return size > limit ? 0 : heap.allocate(size);
+        }
+
+        bool GlobalExecutionContext::release(uint64_t addr)
+        {
+            uint64_t slot = heap.release(addr);
+            if (slot == 0)
+            {
+                return false;
+            }
+            memory.erase(addr, addr + slot);
+            return true;
+        }
+
+        uint64_t GlobalExecutionContext::getAllocationSize(uint64_t addr) const
+        {
+            return heap.getSize(addr);
+        }
+
+        llvm::GenericValue GlobalExecutionContext::getGlobal(
+                llvm::GlobalVariable* g,
+                bool log)
+        {
+            if (!lazyGlobals.empty())
+            {
+                materializeGlobal(reinterpret_cast<uint64_t>(g));
+            }
+
+            auto rIt = registerIds.find(g);
+            if (rIt != registerIds.end())
+            {
+                if (log)
+                {
+                    registerAccess[rIt->second] |= 1;
+                    ++registerLoads;
+                }
+                return registers[rIt->second];
+            }
+
+            if (log)
+            {
+                logGlobalLoad(g);
+            }
+
+            auto fIt = globals.find(g);
+            //**** assert(fIt != globals.end());
+            return fIt != globals.end() ? fIt->second : GenericValue();
+        }
+
+        void GlobalExecutionContext::setGlobal(
+                llvm::GlobalVariable* g,
+                llvm::GenericValue val,
+                bool log)
+        {
+            if (!lazyGlobals.empty())
+            {
+                materializeGlobal(reinterpret_cast<uint64_t>(g));
+            }
+
+            auto rIt = registerIds.find(g);
+            if (rIt != registerIds.end())
+            {
+                if (log)
+                {
+                    registerAccess[rIt->second] |= 2;
+                    ++registerStores;
+                }
+                registers[rIt->second] = val;
+                return;
+            }
+
+            if (log)
+            {
+                logGlobalStore(g);
+            }
+            else
+            {
+                globalsUnloggedStores.push_back(g);
+            }
+
+            globals[g] = val;
+        }
+
+        void GlobalExecutionContext::setValue(llvm::Value* v, llvm::GenericValue val)
+        {
+            values[v] = val;
+        }
+
+        llvm::GenericValue GlobalExecutionContext::getOperandValue(
+                llvm::Value* val,
+                LocalExecutionContext& ec)
+        {
+            if (image && isa<Constant>(val))
+            {
+                if (const GenericValue* pooled = image->getConstant(cast<Constant>(val)))
+                {
+                    return *pooled;
+                }
+            }
+            if (ConstantExpr* ce = dyn_cast<ConstantExpr>(val))
+            {
+                return getConstantExprValue(ce, ec, *this);
+            }
+            else if (Constant* cpv = dyn_cast<Constant>(val))
+            {
+                return  getConstantValue(cpv, getModule());
+            }
+            else if (isa<GlobalValue>(val))
+            {
+                assert(false && "get pointer to global variable, how?");
+                throw LlvmIrEmulatorError("not implemented");
+            }
+            else
+            {
+                return values[val];
+            }
+        }
+//
+//=============================================================================
+// ExecutionContext
+//=============================================================================
+//
+
+        LocalExecutionContext::LocalExecutionContext() :
+                curInst(nullptr) {
+
+        }
+
+        llvm::Module *LocalExecutionContext::getModule() const {
+            return curFunction->getParent();
+        }
+
+        void LocalExecutionContext::recycle()
+        {
+            AllocaHolder a = std::move(allocas);
+            a.clear();
+            *this = LocalExecutionContext();
+            allocas = std::move(a);
+        }
+//
+//=============================================================================
+// LlvmIrEmulator
+//=============================================================================
+//
+
+        LlvmIrEmulator::LlvmIrEmulator(llvm::Module* m) :
+                LlvmIrEmulator(m, false)
+        {
+
+        }
+
+/**
+* @param m Module to emulate. It may be lazily loaded (e.g. by
+*          @c getLazyIRFileModule()), function bodies are materialized when
+*          they are called for the first time.
+* @param lazyGlobals If @c true, global variable initializers are not
+*          evaluated here, but on the first access to each global. This
+*          makes construction cheap when only a few functions of a large
+*          module are emulated.
+*/
+        LlvmIrEmulator::LlvmIrEmulator(llvm::Module* m, bool lazyGlobals) :
+                _module(m),
+                _globalEc(_module)
+        {
+            for (GlobalVariable& gv : _module->globals())
+            {
+                if (isRegisterGlobal(&gv))
+                {
+                    _globalEc.addRegister(&gv);
+                }
+            }
+            initializeGlobals(lazyGlobals);
+            _globalEc.snapshot();
+            IL = new IntrinsicLowering(*(_module->getDataLayout())); // **** add *
+        }
+
+/**
+* There is no intrinsic lowering -- the image has lowered everything.
+*/
+        LlvmIrEmulator::LlvmIrEmulator(
+                std::shared_ptr<const ProgramImage> image,
+                bool lazyGlobals) :
+                _module(image->getModule()),
+                _image(std::move(image)),
+                _globalEc(_module)
+        {
+            _globalEc.image = _image.get();
+            for (GlobalVariable* gv : _image->getRegisters())
+            {
+                _globalEc.addRegister(gv);
+            }
+            initializeGlobals(lazyGlobals);
+            _globalEc.snapshot();
+        }
+
+        void LlvmIrEmulator::initializeGlobals(bool lazyGlobals)
+        {
+            for (GlobalVariable& gv : _module->globals())
+            {
+                if (gv.isDeclaration())
+                {
+                    continue;
+                }
+                if (lazyGlobals)
+                {
+                    _globalEc.deferGlobal(&gv);
+                }
+                else
+                {
+                    _globalEc.initializeGlobal(&gv);
+                }
+            }
+        }
+
+        LlvmIrEmulator::~LlvmIrEmulator()
+        {
+            delete IL;
+        }
+
+        llvm::GenericValue LlvmIrEmulator::runFunction(
+                llvm::Function* f,
+                const llvm::ArrayRef<llvm::GenericValue> argVals,
+                bool outside)
+        {
+            assert(_module == f->getParent());
+
+            if(outside) {
+                _visitedBbs.clear();
+                _lastBlock = nullptr;
+                _runBlocks.clear();
+                _visitedInsnIndex.clear();
+                _exitValue = GenericValue();
+                popAllFrames();
+                _visitedInsns.clear();
+                _retired.clear();
+                _retiredNext = 0;
+                _retiredCount = 0;
+            }
+            const size_t ac = f->getFunctionType()->getNumParams();
+            ArrayRef<GenericValue> aargs = argVals.slice(
+                    0,
+                    std::min(argVals.size(), ac));
+
+            callFunction(f, aargs);
+
+//            clock_t start, end;
+//            start = clock();
 //            cout << "begin running" << endl;
+            // After a native body returns, run() continues the caller's
+            // frames just as it would after an interpreted one.
+            runNative(f, aargs);
             run();
 //            end = clock();
 //            if (double(end-start)/CLOCKS_PER_SEC>5){
@@ -2548,12 +3594,23 @@ break
                 llvm::Function* f,
                 llvm::ArrayRef<llvm::GenericValue> argVals)
         {
-            _ecStack.emplace_back();
+            pushFrame();
             auto& ec = _ecStack.back();
             ec.curFunction = f;
             ec.loopNums = 0;
             ec.flag = false;
 
+            FunctionProfile& profile = _profiles[f];
+            ++profile.calls;
+            ec.profile = &profile;
+            updateTier(f, profile);
+
+            // Lazily loaded module -- read the body on the first call.
+            if (f->isMaterializable())
+            {
+                f->materialize();
+            }
+
             if (f->isDeclaration())
             {
                 assert(false && "external call unhandled");
@@ -2579,22 +3636,40 @@ break
                 Instruction &i = *ec.curInst++;
                 // i.dump();
                 if(ec.analyze == false) {
-                    llvm::DominatorTree DT = llvm::DominatorTree();
-                    DT.recalculate(*ec.curFunction);
-                    ec.LoopInfoBase = new llvm::LoopInfoBase<llvm::BasicBlock, llvm::Loop>();
-                    ec.LoopBase = new llvm::LoopBase<llvm::BasicBlock, llvm::Loop>();
-                    ec.LoopInfoBase->Analyze(DT);
-                    string os;
-                    llvm::raw_string_ostream *OS = new llvm::raw_string_ostream(os);
-                    ec.LoopInfoBase->print(*OS);
+                    ec.LoopInfoBase = getLoopInfo(ec.curFunction);
                     ec.analyze = true;
+                    ec.fusion = usesFusion(ec)
+                            ? &_globalEc.getFusionTable(ec.curFunction)
+                            : nullptr;
+                }
+
+                if (ec.profile
+                        && (++ec.profile->instructions & 1023) == 0
+                        && ec.profile->tier == ExecutionTier::Plain)
+                {
+                    updateTier(ec.curFunction, *ec.profile);
+                    if (usesFusion(ec))
+                    {
+                        ec.fusion = &_globalEc.getFusionTable(ec.curFunction);
+                    }
+                }
+
+                // Loop bookkeeping below only acts on terminators unless
+                // the loop bailout is active, so it can be skipped for
+                // superinstructions that start with a non-terminator.
+                if (ec.fusion && ec.loopNums < 2 && !ec.fusion->empty())
+                {
+                    auto fIt = ec.fusion->find(&i);
+                    if (fIt != ec.fusion->end() && runFused(fIt->second, i, ec))
+                    {
+                        continue;
+                    }
                 }
 
                 ec.Loop = ec.LoopInfoBase->getLoopFor(ec.curBB);
 
                 if(ec.Loop != nullptr && ((ec.Loop->isLoopExiting(ec.curBB))|| ec.Loop->getHeader() == ec.curBB)) //  || ec.Loop->getHeader() == ec.curBB
                 {
-                    string os;
                     BasicBlock* bb = ec.curBB;
 
 //                    if (ec.visited->find(ec.curBB) != ec.visited->end())
@@ -2607,7 +3682,6 @@ break
 //                    else {
 //                        ec.visited->emplace(ec.curBB, 0);
 //                    }
-                    raw_string_ostream *rso = new raw_string_ostream(os);
                     if(ec.curInst == ec.curBB->end()) {
                         ec.loopNums++;
 //                        cout << "loopNums" <<  ec.loopNums << endl;
@@ -2637,10 +3711,7 @@ break
                                 else{
                                     if(_ecStack.size() > 0) {
 //                                        cout << "quit" << endl;
-                                        int length = _ecStack.size();
-                                        while(length--) {
-                                            _ecStack.pop_back();
-                                        }
+                                        popAllFrames();
                                         continue;
                                     }
                                 }
@@ -2651,7 +3722,7 @@ break
                     if(_ecStack.size() > 1) {
                         if(ReturnInst* ri = dyn_cast<llvm::ReturnInst>(&i))
                             break;
-                        _ecStack.pop_back();
+                        popFrame();
                     }
 //                    if(_ecStack.size() > 0) {
 ////                      cout << "quit" << endl;
@@ -2666,47 +3737,439 @@ break
             }
         }
 
-        void LlvmIrEmulator::logInstruction(llvm::Instruction* i)
+/**
+* Executes superinstruction @a op whose first instruction @a first was already
+* taken from @a ec. Member instructions are logged and visited exactly as the
+* ordinary loop in @c run() would do it, only without the per-instruction
+* dispatch and loop bookkeeping.
+* @return @c False if nothing was executed and @a first must go through the
+*         ordinary path.
+*/
+        bool LlvmIrEmulator::runFused(
+                const FusedOp& op,
+                llvm::Instruction& first,
+                LocalExecutionContext& ec)
+        {
+            switch (op.kind)
+            {
+                case FusedKind::LoadOpStore:
+                {
+                    auto& bo = cast<BinaryOperator>(*ec.curInst++);
+                    auto& st = cast<StoreInst>(*ec.curInst++);
+                    logInstruction(&first);
+                    visitLoadInst(cast<LoadInst>(first));
+                    logInstruction(&bo);
+                    switch (bo.getOpcode())
+                    {
+                        case Instruction::Shl: visitShl(bo); break;
+                        case Instruction::LShr: visitLShr(bo); break;
+                        case Instruction::AShr: visitAShr(bo); break;
+                        default: visitBinaryOperator(bo); break;
+                    }
+                    logInstruction(&st);
+                    visitStoreInst(st);
+                    return true;
+                }
+                case FusedKind::CmpExt:
+                {
+                    auto& ext = cast<ZExtInst>(*ec.curInst++);
+                    logInstruction(&first);
+                    visitICmpInst(cast<ICmpInst>(first));
+                    logInstruction(&ext);
+                    visitZExtInst(ext);
+                    return true;
+                }
+                case FusedKind::ExtCmp:
+                {
+                    auto& cmp = cast<ICmpInst>(*ec.curInst++);
+                    logInstruction(&first);
+                    visitZExtInst(cast<ZExtInst>(first));
+                    logInstruction(&cmp);
+                    visitICmpInst(cmp);
+                    return true;
+                }
+                case FusedKind::CmpBranch:
+                {
+                    logInstruction(&first);
+                    visitICmpInst(cast<ICmpInst>(first));
+
+                    // The branch is a terminator, do its loop bookkeeping.
+                    // If it would trigger the loop bailout, leave it to run().
+                    auto& br = cast<BranchInst>(*ec.curInst);
+                    ec.Loop = ec.LoopInfoBase->getLoopFor(ec.curBB);
+                    bool counted = ec.Loop != nullptr
+                            && (ec.Loop->isLoopExiting(ec.curBB)
+                            || ec.Loop->getHeader() == ec.curBB);
+                    if (ec.loopNums + (counted ? 1 : 0) >= 2)
+                    {
+                        return true;
+                    }
+                    ++ec.curInst;
+                    if (counted)
+                    {
+                        ec.loopNums++;
+                    }
+                    logInstruction(&br);
+                    visitBranchInst(br);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+/**
+* Superinstructions change only how fast the emulator runs, not what it
+* computes. Disabling them is useful to compare the two paths.
+*/
+        void LlvmIrEmulator::setFusionEnabled(bool enabled)
         {
-            _visitedInsns.push_back(i);
-            if (_visitedBbs.empty() || i->getParent() != _visitedBbs.back())
+            _fusion = enabled;
+            for (auto& ec : _ecStack)
             {
-                _visitedBbs.push_back(i->getParent());
+                ec.fusion = ec.analyze && usesFusion(ec)
+                        ? &_globalEc.getFusionTable(ec.curFunction)
+                        : nullptr;
             }
         }
 
-        const std::list<llvm::Instruction*>& LlvmIrEmulator::getVisitedInstructions() const
+/**
+* Drops plans built for the IR before it was modified, live frames get
+* fusion tables of the modified one.
+*/
+        void LlvmIrEmulator::invalidatePlans()
         {
-            return _visitedInsns;
+            _globalEc.invalidatePlans();
+            setFusionEnabled(_fusion);
         }
 
-        const std::list<llvm::BasicBlock*>& LlvmIrEmulator::getVisitedBasicBlocks() const
+        bool LlvmIrEmulator::usesFusion(const LocalExecutionContext& ec) const
         {
-            return _visitedBbs;
+            return _fusion
+                    && (!_tiering.enabled
+                        || (ec.profile && ec.profile->tier != ExecutionTier::Plain));
         }
 
-        bool LlvmIrEmulator::wasInstructionVisited(llvm::Instruction* i) const
+        void LlvmIrEmulator::pushFrame()
+        {
+            if (_framePool.empty())
+            {
+                _ecStack.emplace_back();
+                return;
+            }
+            _ecStack.push_back(std::move(_framePool.back()));
+            _framePool.pop_back();
+            _ecStack.back().recycle();
+        }
+
+/**
+* Releases allocas of the top frame, records it as retired and keeps it for
+* reuse by @c pushFrame().
+*/
+        void LlvmIrEmulator::popFrame()
         {
-            for (auto* vi : getVisitedInstructions())
+            auto& ec = _ecStack.back();
+            for (uint64_t a : ec.allocas.get())
+            {
+                _globalEc.release(a);
+            }
+
+            ++_retiredCount;
+            if (_retiredLimit)
             {
-                if (vi == i)
+                RetiredFrame r;
+                r.function = ec.curFunction;
+                r.block = ec.curBB;
+                r.depth = _ecStack.size();
+                if (_retired.size() < _retiredLimit)
                 {
-                    return true;
+                    _retired.push_back(r);
+                }
+                else
+                {
+                    _retired[_retiredNext] = r;
+                    _retiredNext = (_retiredNext + 1) % _retiredLimit;
                 }
             }
-            return false;
+
+            _framePool.push_back(std::move(ec));
+            _ecStack.pop_back();
+        }
+
+        void LlvmIrEmulator::popAllFrames()
+        {
+            while (!_ecStack.empty())
+            {
+                popFrame();
+            }
+        }
+
+        const llvm::LoopInfoBase<llvm::BasicBlock, llvm::Loop>* LlvmIrEmulator::getLoopInfo(
+                llvm::Function* f)
+        {
+            if (_image)
+            {
+                if (auto* li = _image->getLoopInfo(f))
+                {
+                    return li;
+                }
+            }
+            auto& li = _loopInfos[f];
+            if (!li)
+            {
+                llvm::DominatorTree DT = llvm::DominatorTree();
+                DT.recalculate(*f);
+                li.reset(new llvm::LoopInfoBase<llvm::BasicBlock, llvm::Loop>());
+                li->Analyze(DT);
+            }
+            return li.get();
+        }
+
+        bool LlvmIrEmulator::hasUntracedName(const llvm::Value* v) const
+        {
+            return _image ? _image->hasUntracedName(v) : isUntracedName(v->getName());
+        }
+
+        void LlvmIrEmulator::setRetiredFrameLimit(std::size_t limit)
+        {
+            _retiredLimit = limit;
+            _retiredNext = 0;
+            _retired.clear();
+            _retired.reserve(limit);
+        }
+
+        std::vector<RetiredFrame> LlvmIrEmulator::getRetiredFrames() const
+        {
+            if (_retired.size() < _retiredLimit)
+            {
+                return _retired;
+            }
+            std::vector<RetiredFrame> out;
+            out.reserve(_retired.size());
+            out.insert(out.end(), _retired.begin() + _retiredNext, _retired.end());
+            out.insert(out.end(), _retired.begin(), _retired.begin() + _retiredNext);
+            return out;
+        }
+
+        uint64_t LlvmIrEmulator::getRetiredFrameCount() const
+        {
+            return _retiredCount;
+        }
+
+        void LlvmIrEmulator::setTieringPolicy(const TieringPolicy& policy)
+        {
+            _tiering = policy;
+        }
+
+        void LlvmIrEmulator::setSeed(uint64_t seed)
+        {
+            _rng.seed(seed);
+        }
+
+        void LlvmIrEmulator::setHeapConfig(const HeapConfig& config)
+        {
+            _globalEc.heap = EmulatedHeap(config);
+            _globalEc.snapshot();
+        }
+
+/**
+* Exploration and profiles are per emulator, not per run, so they are
+* handled here and not by @c GlobalExecutionContext::reset().
+*/
+        void LlvmIrEmulator::reset(const ResetPolicy& policy)
+        {
+            popAllFrames();
+            _globalEc.reset();
+
+            _exitValue = GenericValue();
+            _visitedInsns.clear();
+            _visitedBbs.clear();
+            _lastBlock = nullptr;
+            _runBlocks.clear();
+            _calls.clear();
+            _calledValues.clear();
+            clearIndexes();
+            s.clear();
+            _retired.clear();
+            _retiredNext = 0;
+            _retiredCount = 0;
+
+            _exploring = false;
+            _forks.clear();
+            _exploredEdges.clear();
+            _states = 0;
+            _dropped = 0;
+
+            if (policy.coverage)
+            {
+                _coverage.clear();
+            }
+            if (policy.profiles)
+            {
+                _profiles.clear();
+            }
+        }
+
+        void LlvmIrEmulator::setLibcModelsEnabled(bool enabled)
+        {
+            _libcEnabled = enabled;
+        }
+
+        void LlvmIrEmulator::setTraceWriter(TraceWriter* trace, bool keepLogs)
+        {
+            _trace = trace;
+            _keepLogs = keepLogs || trace == nullptr;
+            _globalEc.trace = _trace;
+            _globalEc.keepLogs = _keepLogs;
+        }
+
+        LibcModels& LlvmIrEmulator::getLibcModels()
+        {
+            return _libc;
+        }
+
+        const FunctionProfile* LlvmIrEmulator::getFunctionProfile(
+                const llvm::Function* f) const
+        {
+            auto it = _profiles.find(f);
+            return it != _profiles.end() ? &it->second : nullptr;
+        }
+
+/**
+* Called on every call of @a f and every 1024 instructions of its frames
+* while it is in the plain tier. Once native code is requested, every call
+* polls for it.
+*/
+        void LlvmIrEmulator::updateTier(llvm::Function* f, FunctionProfile& profile)
+        {
+            if (!_tiering.enabled)
+            {
+                return;
+            }
+
+            if (profile.tier == ExecutionTier::Plain
+                    && (profile.calls >= _tiering.fastCalls
+                        || profile.instructions >= _tiering.fastInstructions))
+            {
+                profile.tier = ExecutionTier::Fast;
+            }
+
+            if (profile.tier == ExecutionTier::Native || !_jitEnabled)
+            {
+                return;
+            }
+            if (profile.nativeRequested)
+            {
+                if (_tiering.asyncCompile && (profile.entry = _jit->poll(f)))
+                {
+                    profile.tier = ExecutionTier::Native;
+                }
+                return;
+            }
+            if (profile.calls < _tiering.nativeCalls
+                    && profile.instructions < _tiering.nativeInstructions)
+            {
+                return;
+            }
+
+            profile.nativeRequested = true;
+            if (_tiering.asyncCompile)
+            {
+                _jit->request(f);
+            }
+            else if ((profile.entry = _jit->getEntry(f)))
+            {
+                profile.tier = ExecutionTier::Native;
+            }
+        }
+
+        bool LlvmIrEmulator::setJitEnabled(bool enabled)
+        {
+            if (enabled && (_image || !NativeJit::isAvailable()))
+            {
+                return false;
+            }
+            if (enabled && !_jit)
+            {
+                NativeHooks hooks;
+                hooks.exec = reinterpret_cast<uint64_t>(&LlvmIrEmulator::nativeExecHook);
+                hooks.branch = reinterpret_cast<uint64_t>(&LlvmIrEmulator::nativeBranchHook);
+                hooks.ret = reinterpret_cast<uint64_t>(&LlvmIrEmulator::nativeReturnHook);
+                _jit.reset(new NativeJit(_globalEc, hooks));
+            }
+            _jitEnabled = enabled;
+            return true;
+        }
+
+        void LlvmIrEmulator::logInstruction(llvm::Instruction* i)
+        {
+            if (_keepLogs)
+            {
+                _visitedInsns.push_back(i);
+            }
+            if (_trace)
+            {
+                _trace->instruction(i);
+            }
+
+            BasicBlock* bb = i->getParent();
+            if (bb != _lastBlock)
+            {
+                _lastBlock = bb;
+                if (_keepLogs)
+                {
+                    _visitedBbs.push_back(bb);
+                }
+                if (_trace)
+                {
+                    _trace->block(bb);
+                }
+                _runBlocks.mark(bb);
+                _coverage.mark(bb);
+            }
+        }
+
+        const BlockCoverage& LlvmIrEmulator::getBlockCoverage() const
+        {
+            return _coverage;
+        }
+
+        void LlvmIrEmulator::resetBlockCoverage()
+        {
+            _coverage.clear();
+        }
+
+/**
+* Must follow every change of the logs other than appending.
+*/
+        void LlvmIrEmulator::clearIndexes()
+        {
+            _visitedInsnIndex.clear();
+            _calledIndex.clear();
+            _globalLoadIndex.clear();
+            _globalStoreIndex.clear();
+            _memoryLoadIndex.clear();
+            _memoryStoreIndex.clear();
+        }
+
+        llvm::ArrayRef<llvm::Instruction*> LlvmIrEmulator::getVisitedInstructions() const
+        {
+            return _visitedInsns;
+        }
+
+        llvm::ArrayRef<llvm::BasicBlock*> LlvmIrEmulator::getVisitedBasicBlocks() const
+        {
+            return _visitedBbs;
+        }
+
+        bool LlvmIrEmulator::wasInstructionVisited(llvm::Instruction* i) const
+        {
+            _visitedInsnIndex.update(_visitedInsns);
+            return _visitedInsnIndex.contains(i);
         }
 
         bool LlvmIrEmulator::wasBasicBlockVisited(llvm::BasicBlock* bb) const
         {
-            for (auto* vbb : getVisitedBasicBlocks())
-            {
-                if (vbb == bb)
-                {
-                    return true;
-                }
-            }
-            return false;
+            return _runBlocks.contains(bb);
         }
 
         llvm::GenericValue LlvmIrEmulator::getExitValue() const
@@ -2714,29 +4177,26 @@ break
             return _exitValue;
         }
 
-        const std::list<LlvmIrEmulator::CallEntry>& LlvmIrEmulator::getCallEntries() const
+        llvm::ArrayRef<LlvmIrEmulator::CallEntry> LlvmIrEmulator::getCallEntries() const
         {
             return _calls;
         }
 
-        std::list<llvm::Value*> LlvmIrEmulator::getCalledValues() const
+        llvm::ArrayRef<llvm::Value*> LlvmIrEmulator::getCalledValues() const
         {
-            std::list<llvm::Value*> ret;
-            for (auto& ce : _calls)
-            {
-                ret.push_back(ce.calledValue);
-            }
-            return ret;
+            return _calledValues;
         }
 
-        std::set<llvm::Value*> LlvmIrEmulator::getCalledValuesSet() const
+        llvm::ArrayRef<llvm::Value*> LlvmIrEmulator::getCalledValuesUnique() const
         {
-            std::set<llvm::Value*> ret;
-            for (auto& ce : _calls)
-            {
-                ret.insert(ce.calledValue);
-            }
-            return ret;
+            _calledIndex.update(_calledValues);
+            return _calledIndex.getUnique();
+        }
+
+        const std::unordered_set<llvm::Value*>& LlvmIrEmulator::getCalledValuesSet() const
+        {
+            getCalledValuesUnique();
+            return _calledIndex.getSet();
         }
 
 /**
@@ -2744,15 +4204,7 @@ break
 */
         bool LlvmIrEmulator::wasValueCalled(llvm::Value* v) const
         {
-            for (auto& ce : _calls)
-            {
-                if (ce.calledValue == v)
-                {
-                    return true;
-                }
-            }
-
-            return false;
+            return getCalledValuesSet().count(v);
         }
 
 /**
@@ -2763,6 +4215,11 @@ break
                 llvm::Value* v,
                 unsigned n) const
         {
+            if (!wasValueCalled(v))
+            {
+                return nullptr;
+            }
+
             unsigned cntr = 0;
             for (auto& ce : _calls)
             {
@@ -2782,38 +4239,63 @@ break
             return nullptr;
         }
 
-        bool LlvmIrEmulator::wasGlobalVariableLoaded(llvm::GlobalVariable* gv)
+        bool LlvmIrEmulator::wasGlobalVariableLoaded(llvm::GlobalVariable* gv) const
         {
-            auto& c = _globalEc.globalsLoads;
-            return std::find(c.begin(), c.end(), gv) != c.end();
+            if (_globalEc.isRegister(gv))
+            {
+                return _globalEc.wasRegisterLoaded(gv);
+            }
+            _globalLoadIndex.update(_globalEc.globalsLoads);
+            return _globalLoadIndex.contains(gv);
         }
 
-        bool LlvmIrEmulator::wasGlobalVariableStored(llvm::GlobalVariable* gv)
+        bool LlvmIrEmulator::wasGlobalVariableStored(llvm::GlobalVariable* gv) const
         {
-            auto& c = _globalEc.globalsStores;
-            return std::find(c.begin(), c.end(), gv) != c.end();
+            if (_globalEc.isRegister(gv))
+            {
+                return _globalEc.wasRegisterStored(gv);
+            }
+            _globalStoreIndex.update(_globalEc.globalsStores);
+            return _globalStoreIndex.contains(gv);
         }
 
-        std::list<llvm::GlobalVariable*> LlvmIrEmulator::getLoadedGlobalVariables()
+        llvm::ArrayRef<llvm::GlobalVariable*> LlvmIrEmulator::getLoadedGlobalVariables() const
         {
             return _globalEc.globalsLoads;
         }
 
-        std::set<llvm::GlobalVariable*> LlvmIrEmulator::getLoadedGlobalVariablesSet()
+/**
+* Registers are re-checked on every query, there are only tens of them.
+*/
+        llvm::ArrayRef<llvm::GlobalVariable*> LlvmIrEmulator::getLoadedGlobalVariablesUnique() const
+        {
+            _globalLoadIndex.update(_globalEc.globalsLoads);
+            _globalEc.appendLoadedRegisters(_globalLoadIndex);
+            return _globalLoadIndex.getUnique();
+        }
+
+        const std::unordered_set<llvm::GlobalVariable*>& LlvmIrEmulator::getLoadedGlobalVariablesSet() const
         {
-            auto& l = _globalEc.globalsLoads;
-            return std::set<GlobalVariable*>(l.begin(), l.end());
+            getLoadedGlobalVariablesUnique();
+            return _globalLoadIndex.getSet();
         }
 
-        std::list<llvm::GlobalVariable*> LlvmIrEmulator::getStoredGlobalVariables()
+        llvm::ArrayRef<llvm::GlobalVariable*> LlvmIrEmulator::getStoredGlobalVariables() const
         {
             return _globalEc.globalsStores;
         }
 
-        std::set<llvm::GlobalVariable*> LlvmIrEmulator::getStoredGlobalVariablesSet()
+        llvm::ArrayRef<llvm::GlobalVariable*> LlvmIrEmulator::getStoredGlobalVariablesUnique() const
         {
-            auto& l = _globalEc.globalsStores;
-            return std::set<GlobalVariable*>(l.begin(), l.end());
+            _globalStoreIndex.update(_globalEc.globalsStores);
+            _globalEc.appendStoredRegisters(_globalStoreIndex);
+            return _globalStoreIndex.getUnique();
+        }
+
+        const std::unordered_set<llvm::GlobalVariable*>& LlvmIrEmulator::getStoredGlobalVariablesSet() const
+        {
+            getStoredGlobalVariablesUnique();
+            return _globalStoreIndex.getSet();
         }
 
         llvm::GenericValue LlvmIrEmulator::getGlobalVariableValue(
@@ -2829,38 +4311,38 @@ break
             _globalEc.setGlobal(gv, val, false);
         }
 
-        bool LlvmIrEmulator::wasMemoryLoaded(uint64_t addr)
+        bool LlvmIrEmulator::wasMemoryLoaded(uint64_t addr) const
         {
-            auto& c = _globalEc.memoryLoads;
-            return std::find(c.begin(), c.end(), addr) != c.end();
+            _memoryLoadIndex.update(_globalEc.memoryLoads);
+            return _memoryLoadIndex.contains(addr);
         }
 
-        bool LlvmIrEmulator::wasMemoryStored(uint64_t addr)
+        bool LlvmIrEmulator::wasMemoryStored(uint64_t addr) const
         {
-            auto& c = _globalEc.memoryStores;
-            return std::find(c.begin(), c.end(), addr) != c.end();
+            _memoryStoreIndex.update(_globalEc.memoryStores);
+            return _memoryStoreIndex.contains(addr);
         }
 
-        std::list<uint64_t> LlvmIrEmulator::getLoadedMemory()
+        llvm::ArrayRef<uint64_t> LlvmIrEmulator::getLoadedMemory() const
         {
             return _globalEc.memoryLoads;
         }
 
-        std::set<uint64_t> LlvmIrEmulator::getLoadedMemorySet()
+        const std::unordered_set<uint64_t>& LlvmIrEmulator::getLoadedMemorySet() const
         {
-            auto& l = _globalEc.memoryLoads;
-            return std::set<uint64_t>(l.begin(), l.end());
+            _memoryLoadIndex.update(_globalEc.memoryLoads);
+            return _memoryLoadIndex.getSet();
         }
 
-        std::list<uint64_t> LlvmIrEmulator::getStoredMemory()
+        llvm::ArrayRef<uint64_t> LlvmIrEmulator::getStoredMemory() const
         {
             return _globalEc.memoryStores;
         }
 
-        std::set<uint64_t> LlvmIrEmulator::getStoredMemorySet()
+        const std::unordered_set<uint64_t>& LlvmIrEmulator::getStoredMemorySet() const
         {
-            auto& l = _globalEc.memoryStores;
-            return std::set<uint64_t>(l.begin(), l.end());
+            _memoryStoreIndex.update(_globalEc.memoryStores);
+            return _memoryStoreIndex.getSet();
         }
 
         llvm::GenericValue LlvmIrEmulator::getMemoryValue(uint64_t addr)
@@ -2873,6 +4355,225 @@ break
             _globalEc.setMemory(addr, val, false);
         }
 
+/**
+* Summarize the current emulation state into counters. All the counted
+* containers know their size, so this is cheap.
+*/
+        RunStats LlvmIrEmulator::getRunStats() const
+        {
+            RunStats stats;
+            stats.instructions = _visitedInsns.size();
+            stats.basicBlocks = _visitedBbs.size();
+            stats.calls = _calls.size();
+            stats.memoryLoads = _globalEc.memoryLoads.size();
+            stats.memoryStores = _globalEc.memoryStores.size();
+            stats.globalLoads = _globalEc.globalsLoads.size() + _globalEc.registerLoads;
+            stats.globalStores = _globalEc.globalsStores.size() + _globalEc.registerStores;
+            return stats;
+        }
+
+/**
+* Lowers all the intrinsic calls the emulator would lower on the fly in
+* @a f and, transitively, in the defined functions it calls. Lowering
+* changes the IR, so doing it up front keeps instruction iterators in saved
+* states valid.
+*/
+        void LlvmIrEmulator::lowerIntrinsics(llvm::Function* f)
+        {
+            if (_image)
+            {
+                return;
+            }
+            std::set<Function*> seen;
+            std::vector<Function*> worklist = {f};
+            std::vector<CallInst*> calls;
+            bool lowered = false;
+            while (!worklist.empty())
+            {
+                Function* fnc = worklist.back();
+                worklist.pop_back();
+                if (!seen.insert(fnc).second)
+                {
+                    continue;
+                }
+                if (fnc->isMaterializable())
+                {
+                    fnc->materialize();
+                }
+
+                calls.clear();
+                for (auto& bb : *fnc)
+                {
+                    for (auto& i : bb)
+                    {
+                        auto* call = dyn_cast<CallInst>(&i);
+                        Function* cf = call ? call->getCalledFunction() : nullptr;
+                        if (isLowerableIntrinsic(cf))
+                        {
+                            calls.push_back(call);
+                        }
+                        else if (cf && !cf->isIntrinsic())
+                        {
+                            worklist.push_back(cf);
+                        }
+                    }
+                }
+                for (auto* call : calls)
+                {
+                    IL->LowerIntrinsicCall(call);
+                    lowered = true;
+                }
+            }
+            if (lowered)
+            {
+                invalidatePlans();
+            }
+        }
+
+/**
+* Saves the current state for every successor of @a term other than the
+* @a taken one whose edge was not explored yet.
+*/
+        void LlvmIrEmulator::forkAt(llvm::Instruction* term, unsigned taken)
+        {
+            _exploredEdges.insert(std::make_pair(term, taken));
+            for (unsigned i = 0; i < term->getNumSuccessors(); ++i)
+            {
+                if (_exploredEdges.count(std::make_pair(term, i)))
+                {
+                    continue;
+                }
+                if (_states >= _exploration.maxStates)
+                {
+                    ++_dropped;
+                    continue;
+                }
+                _exploredEdges.insert(std::make_pair(term, i));
+                ++_states;
+
+                Fork fork;
+                // Frames are copied one by one, vector copy would need a
+                // const copy constructor.
+                fork.frames.reserve(_ecStack.size());
+                for (auto& ec : _ecStack)
+                {
+                    fork.frames.emplace_back(ec);
+                }
+                fork.global = _globalEc.saveState();
+                fork.visitedInsns = _visitedInsns;
+                fork.visitedBbs = _visitedBbs;
+                fork.runBlocks = _runBlocks;
+                fork.lastBlock = _lastBlock;
+                fork.calls = _calls;
+                fork.calledValues = _calledValues;
+                fork.s = s;
+                fork.dest = term->getSuccessor(i);
+                _forks.push_back(std::move(fork));
+            }
+        }
+
+        void LlvmIrEmulator::restoreFork(Fork& fork)
+        {
+            _ecStack.clear();
+            _ecStack.reserve(fork.frames.size());
+            for (auto& ec : fork.frames)
+            {
+                _ecStack.emplace_back(ec);
+            }
+            _globalEc.restoreState(fork.global);
+            _visitedInsns = std::move(fork.visitedInsns);
+            _visitedBbs = std::move(fork.visitedBbs);
+            _runBlocks = std::move(fork.runBlocks);
+            _lastBlock = fork.lastBlock;
+            _calls = std::move(fork.calls);
+            _calledValues = std::move(fork.calledValues);
+            clearIndexes();
+            s = std::move(fork.s);
+        }
+
+/**
+* Explores paths of @a f. The first run follows the ordinary semantics and
+* every conditional branch or switch with an unexplored successor forks the
+* state -- frames, values and copy-on-write memory pages. Forked states are
+* resumed at their successor in DFS or BFS order until there are none or
+* @c ExplorationConfig::maxStates paths ran.
+*
+* Paths resumed from a fork do not run the rest of calls that were in
+* progress at the fork point on the host stack, so these calls are not
+* logged by @c getCallEntries() on such paths.
+*
+* After this, the emulator holds the state of the last explored path.
+*/
+        ExplorationResult LlvmIrEmulator::explore(
+                llvm::Function* f,
+                const llvm::ArrayRef<llvm::GenericValue> argVals,
+                const ExplorationConfig& config)
+        {
+            lowerIntrinsics(f);
+
+            _exploring = true;
+            _exploration = config;
+            _forks.clear();
+            _exploredEdges.clear();
+            _states = 1;
+            _dropped = 0;
+
+            ExplorationResult res;
+            auto finishPath = [this, &res](std::size_t prefix)
+            {
+                if (prefix < s.size())
+                {
+                    res.signature.append(s, prefix, std::string::npos);
+                }
+                res.blocks.insert(_visitedBbs.begin(), _visitedBbs.end());
+                ++res.paths;
+            };
+
+            std::size_t prefix = s.size();
+            try
+            {
+                runFunction(f, argVals, true);
+            }
+            catch (const std::exception&)
+            {
+                ++res.failed;
+            }
+            finishPath(prefix);
+
+            while (!_forks.empty())
+            {
+                Fork fork;
+                if (config.strategy == ExplorationConfig::Strategy::DFS)
+                {
+                    fork = std::move(_forks.back());
+                    _forks.pop_back();
+                }
+                else
+                {
+                    fork = std::move(_forks.front());
+                    _forks.pop_front();
+                }
+
+                prefix = fork.s.size();
+                BasicBlock* dest = fork.dest;
+                restoreFork(fork);
+                try
+                {
+                    switchToNewBasicBlock(dest, _ecStack.back(), _globalEc);
+                    run();
+                }
+                catch (const std::exception&)
+                {
+                    ++res.failed;
+                }
+                finishPath(prefix);
+            }
+
+            _exploring = false;
+            res.dropped = _dropped;
+            return res;
+        }
+
 /**
 * Get generic value for the passed LLVM value @a val.
 * If @c val is a global variable, result of @c getGlobalVariableValue() is
@@ -2891,6 +4592,223 @@ break
             }
         }
 
+//
+//=============================================================================
+// Native Execution
+//=============================================================================
+//
+
+/**
+* Executes the frame @c callFunction() pushed for @a f as native code and
+* returns from it.
+* @return @c False if @a f has no native code, the frame is then untouched
+*         and must be interpreted.
+*/
+        bool LlvmIrEmulator::runNative(
+                llvm::Function* f,
+                llvm::ArrayRef<llvm::GenericValue> argVals)
+        {
+            if (!_jitEnabled || _exploring)
+            {
+                return false;
+            }
+            NativeEntry entry = nullptr;
+            if (_tiering.enabled)
+            {
+                FunctionProfile* profile = _ecStack.back().profile;
+                if (profile && profile->tier == ExecutionTier::Native)
+                {
+                    entry = profile->entry;
+                }
+            }
+            else
+            {
+                entry = _jit->getEntry(f);
+            }
+            if (entry == nullptr)
+            {
+                return false;
+            }
+
+            std::vector<uint64_t> args;
+            unsigned i = 0;
+            for (auto ai = f->arg_begin(), e = f->arg_end(); ai != e; ++ai, ++i)
+            {
+                args.push_back(i < argVals.size() ? toNativeValue(ai->getType(), argVals[i]) : 0);
+            }
+
+            NativeFrame frame;
+            frame.emu = this;
+            uint64_t res = entry(&frame, args.data());
+            if (frame.error)
+            {
+                std::rethrow_exception(frame.error);
+            }
+            if (frame.aborted)
+            {
+                return true;
+            }
+
+            Type* retTy = f->getReturnType();
+            popStackAndReturnValueToCaller(
+                    retTy,
+                    retTy->isVoidTy() ? GenericValue() : fromNativeValue(retTy, res));
+            return true;
+        }
+
+/**
+* Logs instructions of @a i's block that the native code executed since the
+* last hook, the way run() would have logged them one by one. PHIs are
+* skipped, run() never dispatches them either.
+*/
+        void LlvmIrEmulator::logNativeUpTo(
+                NativeFrame& frame,
+                llvm::Instruction* i,
+                bool inclusive)
+        {
+            if (i->getParent() != frame.block)
+            {
+                frame.block = i->getParent();
+                frame.logPos = BasicBlock::iterator(frame.block->getFirstNonPHI());
+            }
+            while (&*frame.logPos != i)
+            {
+                logInstruction(&*frame.logPos++);
+            }
+            if (inclusive)
+            {
+                logInstruction(i);
+                ++frame.logPos;
+            }
+        }
+
+        uint64_t LlvmIrEmulator::nativeExec(
+                NativeFrame& frame,
+                llvm::Instruction* i,
+                const uint64_t* ops)
+        {
+            logNativeUpTo(frame, i, true);
+            for (unsigned k = 0; k < i->getNumOperands(); ++k)
+            {
+                Value* op = i->getOperand(k);
+                if (isa<Instruction>(op) || isa<Argument>(op))
+                {
+                    _globalEc.setValue(op, fromNativeValue(op->getType(), ops[k]));
+                }
+            }
+
+            visit(*i);
+
+            if (i->getType()->isVoidTy())
+            {
+                return 0;
+            }
+            return toNativeValue(i->getType(), _globalEc.getOperandValue(i, _ecStack.back()));
+        }
+
+/**
+* The bailout half mirrors run(): the bounded branch itself is not logged,
+* the successor alternates by @a flag unless only one of them is unvisited,
+* and if both are visited the whole run ends.
+*/
+        uint64_t LlvmIrEmulator::nativeBranch(
+                NativeFrame& frame,
+                llvm::BranchInst* br,
+                bool cond,
+                bool bailout,
+                unsigned flag)
+        {
+            if (!bailout)
+            {
+                logNativeUpTo(frame, br, true);
+                frame.block = nullptr;
+                return br->isUnconditional() || cond ? 0 : 1;
+            }
+
+            logNativeUpTo(frame, br, false);
+            frame.block = nullptr;
+            if (br->isUnconditional())
+            {
+                return 0;
+            }
+
+            bool visited1 = wasBasicBlockVisited(br->getSuccessor(flag));
+            bool visited2 = wasBasicBlockVisited(br->getSuccessor(1 - flag));
+            if (!visited1)
+            {
+                return flag;
+            }
+            if (!visited2)
+            {
+                return 1 - flag;
+            }
+
+            popAllFrames();
+            frame.aborted = true;
+            return uint64_t(-1);
+        }
+
+/**
+* Hooks do not let exceptions through the native frames. The first one is
+* kept, later hooks do nothing and the next block end abandons the run.
+*/
+        uint64_t LlvmIrEmulator::nativeExecHook(void* frame, uint64_t site, uint64_t* ops)
+        {
+            auto& nf = *static_cast<NativeFrame*>(frame);
+            if (nf.error)
+            {
+                return 0;
+            }
+            try
+            {
+                return nf.emu->nativeExec(nf, reinterpret_cast<Instruction*>(site), ops);
+            }
+            catch (...)
+            {
+                nf.error = std::current_exception();
+                return 0;
+            }
+        }
+
+        uint64_t LlvmIrEmulator::nativeBranchHook(
+                void* frame,
+                uint64_t site,
+                uint64_t cond,
+                uint64_t bailout,
+                uint64_t flag)
+        {
+            auto& nf = *static_cast<NativeFrame*>(frame);
+            if (nf.error)
+            {
+                return uint64_t(-1);
+            }
+            try
+            {
+                return nf.emu->nativeBranch(
+                        nf,
+                        reinterpret_cast<BranchInst*>(site),
+                        cond != 0,
+                        bailout != 0,
+                        unsigned(flag));
+            }
+            catch (...)
+            {
+                nf.error = std::current_exception();
+                return uint64_t(-1);
+            }
+        }
+
+        uint64_t LlvmIrEmulator::nativeReturnHook(void* frame, uint64_t site)
+        {
+            auto& nf = *static_cast<NativeFrame*>(frame);
+            if (!nf.error)
+            {
+                nf.emu->logNativeUpTo(nf, reinterpret_cast<Instruction*>(site), true);
+                nf.block = nullptr;
+            }
+            return 0;
+        }
+
 //
 //=============================================================================
 // Terminator Instruction Implementations
@@ -2901,8 +4819,7 @@ break
                 llvm::Type* retT,
                 llvm::GenericValue res)
         {
-            _ecStackRetired.emplace_back(_ecStack.back());
-            _ecStack.pop_back();
+            popFrame();
 
             // Finished main. Put result into exit code...
             //
@@ -2974,9 +4891,15 @@ break
             if (!I.isUnconditional())
             {
                 Value* cond = I.getCondition();
+                unsigned taken = 0;
                 if (_globalEc.getOperandValue(cond, ec).IntVal == false)
                 {
                     dest = I.getSuccessor(1);
+                    taken = 1;
+                }
+                if (_exploring)
+                {
+                    forkAt(&I, taken);
                 }
             }
             switchToNewBasicBlock(dest, ec, _globalEc);
@@ -2997,10 +4920,10 @@ break
                 if (executeICMP_EQ(condVal, caseVal, elTy).IntVal != 0)
                 {
                     dest = cast<BasicBlock>(Case.getCaseSuccessor());
-                    if(ec.loopNums == 0){
+                    // Exploration forks to the other cases instead.
+                    if(ec.loopNums == 0 && !_exploring){
                         int num = I.cases().end().getCaseIndex() - I.cases().begin().getCaseIndex();
-                        srand((unsigned)time(NULL));
-                        int add = rand()%num;
+                        int add = _rng() % num;
                         for(int i=0; i<add ;i++){
                             Case ++ ;
                             if(Case == I.cases().end())
@@ -3015,8 +4938,22 @@ break
             {
                 dest = I.getDefaultDest();   // No cases matched: use default
             }
+            if (_exploring)
+            {
+                for (unsigned i = 0; i < I.getNumSuccessors(); ++i)
+                {
+                    if (I.getSuccessor(i) == dest)
+                    {
+                        forkAt(&I, i);
+                        break;
+                    }
+                }
+            }
             if (wasBasicBlockVisited(dest)) {
-                    _ecStack.pop_back();
+                // Abandons the function, the caller resumes after the call.
+                // The frame goes to the pool, ec must not be used after this.
+                popFrame();
+                return;
             }
             switchToNewBasicBlock(dest, ec, _globalEc);
         }
@@ -3316,14 +5253,16 @@ break
             unsigned elemN = _globalEc.getOperandValue(I.getOperand(0), ec).IntVal.getZExtValue();
             unsigned tySz = static_cast<size_t>(_module->getDataLayout()->getTypeAllocSize(ty)); // ****
 
-            // Avoid malloc-ing zero bytes, use max()...
-            unsigned memToAlloc = std::max(1U, elemN * tySz);
-
             // Allocate enough memory to hold the type...
-            void *mem = malloc(memToAlloc);
+            uint64_t mem = _globalEc.allocate(
+                    uint64_t(elemN) * tySz,
+                    std::numeric_limits<uint64_t>::max());
+            if (mem == 0)
+            {
+                throw LlvmIrEmulatorError("Emulated heap exhausted.");
+            }
 
-            GenericValue res = PTOGV(mem);
-            assert(res.PointerVal && "Null pointer returned by malloc!");
+            GenericValue res = PTOGV(reinterpret_cast<void*>(uintptr_t(mem)));
             _globalEc.setValue(&I, res);
 
             if (I.getOpcode() == Instruction::Alloca)
@@ -3335,14 +5274,7 @@ break
         void LlvmIrEmulator::visitGetElementPtrInst(llvm::GetElementPtrInst& I)
         {
             LocalExecutionContext& ec = _ecStack.back();
-            _globalEc.setValue(
-                    &I,
-                    executeGEPOperation(
-                            I.getPointerOperand(),
-                            gep_type_begin(I),
-                            gep_type_end(I),
-                            ec,
-                            _globalEc));
+            _globalEc.setValue(&I, executeGEPOperation(&I, ec, _globalEc));
         }
 
         void LlvmIrEmulator::visitLoadInst(llvm::LoadInst& I)
@@ -3357,13 +5289,7 @@ break
                 res = _globalEc.getGlobal(gv);
                 Value *op0 = I.getPointerOperand();
                 StringRef ref = I.getPointerOperand()->getName();
-                if((ref.startswith("stack_var") || ref.startswith("pf") ||
-                   ref.startswith("rsp") || ref.startswith("zf") || ref.startswith("arg") ||
-                   ref.startswith("rbp") || ref.startswith("sf") ||
-                   ref.startswith("rdx") || ref.startswith("of") || ref.startswith("tmp") ||
-                   ref.startswith("rsi") || ref.startswith("cf") || ref.startswith("r") ||
-                   ref.startswith("rdi") || ref.startswith("az") || ref.startswith("rbx") ||
-                   ref.startswith("rax") || ref.startswith("rcx"))) {
+                if(hasUntracedName(op0)) {
                 }
                 else if (isa<ConstantExpr>(op0)){
                     auto constExpr = dyn_cast<ConstantExpr>(op0);
@@ -3401,13 +5327,7 @@ break
 
                 Value *op0 = I.getPointerOperand();
                 StringRef ref = I.getPointerOperand()->getName();
-                if((ref.startswith("stack_var") || ref.startswith("pf") ||
-                   ref.startswith("rsp") || ref.startswith("zf") || ref.startswith("arg") ||
-                   ref.startswith("rbp") || ref.startswith("sf") ||
-                   ref.startswith("rdx") || ref.startswith("of") || ref.startswith("tmp") ||
-                   ref.startswith("rsi") || ref.startswith("cf") || ref.startswith("r") ||
-                   ref.startswith("rdi") || ref.startswith("az") || ref.startswith("rbx") ||
-                   ref.startswith("rax") || ref.startswith("rcx"))) {
+                if(hasUntracedName(op0)) {
                 }
                 else if (isa<ConstantExpr>(op0)){
                     auto constExpr = dyn_cast<ConstantExpr>(op0);
@@ -3450,20 +5370,8 @@ break
                 Value *op1 = I.getOperand(1);
                 StringRef ref = I.getOperand(0)->getName();
                 StringRef ref1 = I.getOperand(1)->getName();
-                if(ref.startswith("stack_var") || ref.startswith("pf") ||
-                   ref.startswith("rsp") || ref.startswith("zf") ||
-                   ref.startswith("rbp") || ref.startswith("sf") || ref.startswith("arg") ||
-                   ref.startswith("rdx") || ref.startswith("of") || ref.startswith("tmp") ||
-                   ref.startswith("rsi") || ref.startswith("cf") || ref.startswith("r") ||
-                   ref.startswith("rdi") || ref.startswith("az") || ref.startswith("rbx") ||
-                   ref.startswith("rax") || ref.startswith("rcx")) {
-                    if(ref1.startswith("stack_var") || ref1.startswith("pf") ||
-                       ref1.startswith("rsp") || ref1.startswith("zf") ||
-                       ref1.startswith("rbp") || ref1.startswith("sf") || ref1.startswith("arg") ||
-                       ref1.startswith("rdx") || ref1.startswith("of") || ref1.startswith("tmp") ||
-                       ref1.startswith("rsi") || ref1.startswith("cf") || ref1.startswith("r") ||
-                       ref1.startswith("rdi") || ref1.startswith("az") || ref1.startswith("rbx") ||
-                       ref1.startswith("rax") || ref1.startswith("rcx")) {
+                if(hasUntracedName(op0)) {
+                    if(hasUntracedName(op1)) {
                         return;
                     }
                     else{
@@ -3493,13 +5401,7 @@ break
 //                        s += val.IntVal.toString(10, 0) + ";";
                         s += tmp.IntVal.toString(10, 0) + ";";
                     }
-                    if(ref1.startswith("stack_var") || ref1.startswith("pf") ||
-                       ref1.startswith("rsp") || ref1.startswith("zf") ||
-                       ref1.startswith("rbp") || ref1.startswith("sf") || ref1.startswith("arg") ||
-                       ref1.startswith("rdx") || ref1.startswith("of") || ref1.startswith("tmp") ||
-                       ref1.startswith("rsi") || ref1.startswith("cf") || ref1.startswith("r") ||
-                       ref1.startswith("rdi") || ref1.startswith("az") || ref1.startswith("rbx") ||
-                       ref1.startswith("rax") || ref1.startswith("rcx")) {
+                    if(hasUntracedName(op1)) {
                     }
                     else{
                         if (isa<ConstantExpr>(op1)){
@@ -3520,13 +5422,7 @@ break
                 }
                 else {
                     s += val.IntVal.toString(10, 0) + ";";
-                    if(ref1.startswith("stack_var") || ref1.startswith("pf") ||
-                       ref1.startswith("rsp") || ref1.startswith("zf") ||
-                       ref1.startswith("rbp") || ref1.startswith("sf") || ref1.startswith("arg") ||
-                       ref1.startswith("rdx") || ref1.startswith("of") || ref1.startswith("tmp") ||
-                       ref1.startswith("rsi") || ref1.startswith("cf") || ref1.startswith("r") ||
-                       ref1.startswith("rdi") || ref1.startswith("az") || ref1.startswith("rbx") ||
-                       ref1.startswith("rax") || ref1.startswith("rcx")) {
+                    if(hasUntracedName(op1)) {
                     }
                     else{
                         if (isa<ConstantExpr>(op1)){
@@ -3561,20 +5457,8 @@ break
                 Value *op1 = I.getOperand(1);
                 StringRef ref = I.getOperand(0)->getName();
                 StringRef ref1 = I.getOperand(1)->getName();
-                if(ref.startswith("stack_var") || ref.startswith("pf") ||
-                   ref.startswith("rsp") || ref.startswith("zf") ||
-                   ref.startswith("rbp") || ref.startswith("sf") || ref.startswith("arg") ||
-                   ref.startswith("rdx") || ref.startswith("of") || ref.startswith("tmp") ||
-                   ref.startswith("rsi") || ref.startswith("cf") || ref.startswith("r") ||
-                   ref.startswith("rdi") || ref.startswith("az") || ref.startswith("rbx") ||
-                   ref.startswith("rax") || ref.startswith("rcx")) {
-                    if(ref1.startswith("stack_var") || ref1.startswith("pf") ||
-                       ref1.startswith("rsp") || ref1.startswith("zf") ||
-                       ref1.startswith("rbp") || ref1.startswith("sf") || ref1.startswith("arg") ||
-                       ref1.startswith("rdx") || ref1.startswith("of") || ref1.startswith("tmp") ||
-                       ref1.startswith("rsi") || ref1.startswith("cf") || ref1.startswith("r") ||
-                       ref1.startswith("rdi") || ref1.startswith("az") || ref1.startswith("rbx") ||
-                       ref1.startswith("rax") || ref1.startswith("rcx")) {
+                if(hasUntracedName(op0)) {
+                    if(hasUntracedName(op1)) {
                         return;
                     }
                     else{
@@ -3607,13 +5491,7 @@ break
                         _globalEc.setGlobal(gv, val2);
 //                        val = val1;
                     }
-                    if(ref1.startswith("stack_var") || ref1.startswith("pf") ||
-                       ref1.startswith("rsp") || ref1.startswith("zf") ||
-                       ref1.startswith("rbp") || ref1.startswith("sf") || ref1.startswith("arg") ||
-                       ref1.startswith("rdx") || ref1.startswith("of") || ref1.startswith("tmp") ||
-                       ref1.startswith("rsi") || ref1.startswith("cf") || ref1.startswith("r") ||
-                       ref1.startswith("rdi") || ref1.startswith("az") || ref1.startswith("rbx") ||
-                       ref1.startswith("rax") || ref1.startswith("rcx")) {
+                    if(hasUntracedName(op1)) {
                     }
                     else{
                         if (isa<ConstantExpr>(op1)){
@@ -3636,13 +5514,7 @@ break
                 }
                 else {
                     s += val.IntVal.toString(10, 0) + ";";
-                    if(ref1.startswith("stack_var") || ref1.startswith("pf") ||
-                       ref1.startswith("rsp") || ref1.startswith("zf") ||
-                       ref1.startswith("rbp") || ref1.startswith("sf") || ref1.startswith("arg") ||
-                       ref1.startswith("rdx") || ref1.startswith("of") || ref1.startswith("tmp") ||
-                       ref1.startswith("rsi") || ref1.startswith("cf") || ref1.startswith("r") ||
-                       ref1.startswith("rdi") || ref1.startswith("az") || ref1.startswith("rbx") ||
-                       ref1.startswith("rax") || ref1.startswith("rcx")) {
+                    if(hasUntracedName(op1)) {
                     }
                     else{
                         if (isa<ConstantExpr>(op1)){
@@ -3833,6 +5705,45 @@ break
 //=============================================================================
 //
 
+/**
+* Callee is resolved through casts -- decompiled code often calls library
+* functions with a type different from their declaration.
+* @return @c True if a model computed the result of @a I.
+*/
+        bool LlvmIrEmulator::callLibcModel(llvm::CallInst& I)
+        {
+            if (!_libcEnabled)
+            {
+                return false;
+            }
+            auto* callee = dyn_cast<Function>(I.getCalledValue()->stripPointerCasts());
+            if (callee == nullptr || !callee->isDeclaration() || callee->isIntrinsic())
+            {
+                return false;
+            }
+            const LibcModel* model = _libc.find(callee, I);
+            if (model == nullptr)
+            {
+                return false;
+            }
+
+            LocalExecutionContext& ec = _ecStack.back();
+            std::vector<GenericValue> args;
+            args.reserve(I.getNumArgOperands());
+            for (unsigned i = 0; i < I.getNumArgOperands(); ++i)
+            {
+                args.push_back(_globalEc.getOperandValue(I.getArgOperand(i), ec));
+            }
+            LibcCall call(_globalEc, I, args, _libc.getMaxBytes());
+            GenericValue res;
+            if (!(*model)(call, res))
+            {
+                return false;
+            }
+            _globalEc.setValue(&I, res);
+            return true;
+        }
+
         void LlvmIrEmulator::visitCallInst(llvm::CallInst& I)
         {
             LocalExecutionContext& ec = _ecStack.back();
@@ -3840,12 +5751,7 @@ break
             if (cf && cf->isDeclaration() && !cf->isIntrinsic()) {
                 this->s += I.getCalledFunction()->getName().str() + ";";
             }
-            if (cf && cf->isDeclaration() && cf->isIntrinsic() &&
-                !( cf->getIntrinsicID() == Intrinsic::mips_bitrev //bitreverse
-                   || cf->getIntrinsicID() == Intrinsic::xcore_bitrev// **** ConstantInt::get(Ty->getContext(), Op->getValue().reverseBits()
-                   || cf->getIntrinsicID() == Intrinsic::maxnum || cf->getIntrinsicID() == Intrinsic::umul_with_overflow
-                   || cf->getIntrinsicID() == Intrinsic::minnum || cf->getIntrinsicID() == Intrinsic::trap
-                   || cf->getIntrinsicID() == Intrinsic::fabs || cf->getIntrinsicID() == Intrinsic::uadd_with_overflow)) // can not lower those functions
+            if (IL && isLowerableIntrinsic(cf))
             {
                 assert(cf->getIntrinsicID() != Intrinsic::vastart
                        && cf->getIntrinsicID() != Intrinsic::vaend
@@ -3859,6 +5765,7 @@ break
                     --me;
                 }
                 IL->LowerIntrinsicCall(cast<CallInst>(&I));
+                invalidatePlans();
 
                 // Restore the CurInst pointer to the first instruction newly inserted,
                 // if any.
@@ -3900,7 +5807,7 @@ break
 //                    _globalEc.setValue(&I, res);
                 }
             }
-            else {
+            else if (!callLibcModel(I)) {
                 GenericValue res;
 //                this->s += I.getCalledFunction()->getName().str() + ";";
                 if(cf && cf->getReturnType()->isIntegerTy()) {
@@ -3916,7 +5823,15 @@ break
                 ce.calledArguments.push_back(_globalEc.getOperandValue(val, ec));
             }
             // **** call i64 bitcast (i32 (i8*)* @strlen to i64 (i8*)*)(i8* %tmp240) could not deal with
-            _calls.push_back(ce);
+            if (_trace)
+            {
+                _trace->call(dyn_cast<Function>(ce.calledValue->stripPointerCasts()));
+            }
+            if (_keepLogs)
+            {
+                _calls.push_back(ce);
+                _calledValues.push_back(ce.calledValue);
+            }
         }
 
         void LlvmIrEmulator::visitInvokeInst(llvm::InvokeInst& I)
@@ -4175,8 +6090,8 @@ break
         void LlvmIrEmulator::visitPHINode(llvm::PHINode& PN)
         {
 //             throw LlvmIrEmulatorError("PHI nodes already handled!");
-            if(_ecStack.back().PHIorNot && _ecStack.size() >=1){
-                _ecStack.pop_back();
+            if(!_ecStack.empty() && _ecStack.back().PHIorNot){
+                popFrame();
             }
 //            cout << "PHI nodes already handled!" <<endl;
         }
@@ -0,0 +1,100 @@
+/**
+ * @file log_index.h
+ * @brief Membership index of an append-only emulation log.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_LOG_INDEX_H
+#define RETDEC_LLVMIR_EMUL_LOG_INDEX_H
+
+#include <cstddef>
+#include <unordered_set>
+#include <vector>
+
+#include <llvm/ADT/ArrayRef.h>
+
+namespace retdec {
+    namespace llvmir_emul {
+
+/**
+ * Distinct entries of a log, in order of their first appearance, and a hash
+ * set of them. Emulation only appends to logs, so the index is brought up
+ * to date on queries by indexing the entries appended since the last one --
+ * runs pay nothing for it and repeated queries pay only for the new tail.
+ *
+ * Whoever clears or replaces the log must @c clear() the index.
+ */
+        template<typename T>
+        class LogIndex
+        {
+        public:
+/**
+ * Indexes @c key(e) of entries @a e of @a log appended since the last
+ * update.
+ */
+            template<typename E, typename Key>
+            void update(const std::vector<E>& log, Key key)
+            {
+                if (log.size() < _indexed)
+                {
+                    clear();
+                }
+                for (std::size_t i = _indexed; i < log.size(); ++i)
+                {
+                    insert(key(log[i]));
+                }
+                _indexed = log.size();
+            }
+
+            void update(const std::vector<T>& log)
+            {
+                update(log, [](const T& e) {
+                    return e;
+                });
+            }
+
+/**
+ * Adds @a v, which is not an entry of the log (e.g. a flagged register).
+ */
+            void insert(const T& v)
+            {
+                if (_set.insert(v).second)
+                {
+                    _unique.push_back(v);
+                }
+            }
+
+            bool contains(const T& v) const
+            {
+                return _set.count(v);
+            }
+
+            llvm::ArrayRef<T> getUnique() const
+            {
+                return _unique;
+            }
+
+            const std::unordered_set<T>& getSet() const
+            {
+                return _set;
+            }
+
+/**
+ * Forgets everything, buffers are kept.
+ */
+            void clear()
+            {
+                _set.clear();
+                _unique.clear();
+                _indexed = 0;
+            }
+
+        private:
+            std::unordered_set<T> _set;
+            std::vector<T> _unique;
+            std::size_t _indexed = 0;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ * @file mapped_file.cpp
+ * @brief Read-only memory mapping of a whole file.
+ */
+
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        MappedFile::MappedFile(MappedFile&& o) :
+                _data(o._data),
+                _size(o._size),
+                _open(o._open)
+        {
+            o._data = nullptr;
+            o._size = 0;
+            o._open = false;
+        }
+
+        MappedFile& MappedFile::operator=(MappedFile&& o)
+        {
+            if (this != &o)
+            {
+                close();
+                std::swap(_data, o._data);
+                std::swap(_size, o._size);
+                std::swap(_open, o._open);
+            }
+            return *this;
+        }
+
+        MappedFile::~MappedFile()
+        {
+            close();
+        }
+
+/**
+* Maps file at @a path. Empty files can be opened too, their @c data() is
+* @c nullptr.
+*/
+        bool MappedFile::open(const std::string& path)
+        {
+            close();
+
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+            {
+                return false;
+            }
+
+            struct stat st;
+            if (fstat(fd, &st) != 0)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            if (st.st_size > 0)
+            {
+                void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                if (m == MAP_FAILED)
+                {
+                    ::close(fd);
+                    return false;
+                }
+                _data = static_cast<const char*>(m);
+                _size = st.st_size;
+            }
+            // Mapping stays valid after the descriptor is closed.
+            ::close(fd);
+            _open = true;
+            return true;
+        }
+
+        void MappedFile::close()
+        {
+            if (_data)
+            {
+                munmap(const_cast<char*>(_data), _size);
+            }
+            _data = nullptr;
+            _size = 0;
+            _open = false;
+        }
+
+        bool MappedFile::isOpen() const
+        {
+            return _open;
+        }
+
+        const char* MappedFile::data() const
+        {
+            return _data;
+        }
+
+        uint64_t MappedFile::size() const
+        {
+            return _size;
+        }
+
+    } // llvmir_emul
+} // retdec
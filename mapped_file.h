@@ -0,0 +1,45 @@
+/**
+ * @file mapped_file.h
+ * @brief Read-only memory mapping of a whole file.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_MAPPED_FILE_H
+#define RETDEC_LLVMIR_EMUL_MAPPED_FILE_H
+
+#include <cstdint>
+#include <string>
+
+namespace retdec {
+    namespace llvmir_emul {
+
+/**
+ * Maps a file for reading. The mapping lives as long as the object, so
+ * pointers into @c data() must not outlive it.
+ */
+        class MappedFile
+        {
+        public:
+            MappedFile() = default;
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+            MappedFile(MappedFile&& o);
+            MappedFile& operator=(MappedFile&& o);
+            ~MappedFile();
+
+            bool open(const std::string& path);
+            void close();
+            bool isOpen() const;
+
+            const char* data() const;
+            uint64_t size() const;
+
+        private:
+            const char* _data = nullptr;
+            uint64_t _size = 0;
+            bool _open = false;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
@@ -0,0 +1,637 @@
+/**
+ * @file native_jit.cpp
+ * @brief Optional native backend -- instrumented functions compiled by MCJIT.
+ */
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/LoopInfoImpl.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Verifier.h>
+
+#ifdef LLVMIR_EMUL_JIT
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Transforms/Scalar.h>
+#endif
+
+#include "llvmir-emul.h"
+#include "native_jit.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            enum class Lowering
+            {
+                /// Cloned into the native function.
+                Native,
+                /// Executed by the interpreter through the exec hook.
+                Hook,
+                /// Not supported, the function is interpreted.
+                None,
+            };
+
+            bool isScalarType(Type* t)
+            {
+                return t->isPointerTy()
+                        || (t->isIntegerTy() && t->getIntegerBitWidth() <= 64);
+            }
+
+            bool isRuntimeValue(const Value* v)
+            {
+                return isa<Instruction>(v) || isa<Argument>(v);
+            }
+
+/**
+* Constants the native code can use as they are. Anything else (globals,
+* constant expressions, undef) is evaluated by the interpreter.
+*/
+            bool isPlainConstant(const Value* v)
+            {
+                return isa<ConstantInt>(v) || isa<ConstantPointerNull>(v);
+            }
+
+            bool hasPlainOperands(const Instruction& i)
+            {
+                for (auto& op : i.operands())
+                {
+                    if (!isRuntimeValue(op) && !isPlainConstant(op) && !isa<BasicBlock>(op))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            Lowering classify(const Instruction& i)
+            {
+                if (!i.getType()->isVoidTy() && !isScalarType(i.getType()))
+                {
+                    return Lowering::None;
+                }
+                for (auto& op : i.operands())
+                {
+                    if (isRuntimeValue(op) && !isScalarType(op->getType()))
+                    {
+                        return Lowering::None;
+                    }
+                    if (!isRuntimeValue(op) && !isa<Constant>(op) && !isa<BasicBlock>(op))
+                    {
+                        return Lowering::None;
+                    }
+                }
+
+                switch (i.getOpcode())
+                {
+                    case Instruction::Br:
+                    case Instruction::Ret:
+                    case Instruction::PHI:
+                        return hasPlainOperands(i) ? Lowering::Native : Lowering::None;
+
+                    case Instruction::Add:
+                    case Instruction::Sub:
+                    case Instruction::Mul:
+                    case Instruction::And:
+                    case Instruction::Or:
+                    case Instruction::Xor:
+                    case Instruction::ICmp:
+                    case Instruction::Select:
+                    case Instruction::Trunc:
+                    case Instruction::ZExt:
+                    case Instruction::SExt:
+                    case Instruction::PtrToInt:
+                    case Instruction::IntToPtr:
+                    case Instruction::BitCast:
+                        return hasPlainOperands(i) ? Lowering::Native : Lowering::Hook;
+
+                    case Instruction::GetElementPtr:
+                    {
+                        // The interpreter only knows 32 and 64-bit indices.
+                        for (unsigned k = 1; k < i.getNumOperands(); ++k)
+                        {
+                            auto* it = dyn_cast<IntegerType>(i.getOperand(k)->getType());
+                            if (it == nullptr)
+                            {
+                                return Lowering::None;
+                            }
+                            if (it->getBitWidth() != 32 && it->getBitWidth() != 64)
+                            {
+                                return Lowering::Hook;
+                            }
+                        }
+                        return hasPlainOperands(i) ? Lowering::Native : Lowering::Hook;
+                    }
+
+                    case Instruction::UDiv:
+                    case Instruction::SDiv:
+                    case Instruction::URem:
+                    case Instruction::SRem:
+                    case Instruction::Shl:
+                    case Instruction::LShr:
+                    case Instruction::AShr:
+                    case Instruction::Load:
+                    case Instruction::Store:
+                    case Instruction::Alloca:
+                        return Lowering::Hook;
+
+                    case Instruction::Call:
+                    {
+                        auto* cf = cast<CallInst>(i).getCalledFunction();
+                        return cf && cf->isDeclaration() && !cf->isIntrinsic()
+                                ? Lowering::Hook
+                                : Lowering::None;
+                    }
+
+                    default:
+                        return Lowering::None;
+                }
+            }
+
+#ifdef LLVMIR_EMUL_JIT
+            Value* toNative(IRBuilder<>& b, Value* v)
+            {
+                Type* i64 = b.getInt64Ty();
+                if (v->getType()->isPointerTy())
+                {
+                    return b.CreatePtrToInt(v, i64);
+                }
+                return v->getType() == i64 ? v : b.CreateZExt(v, i64);
+            }
+
+            Value* fromNative(IRBuilder<>& b, Value* v, Type* t)
+            {
+                if (t->isPointerTy())
+                {
+                    return b.CreateIntToPtr(v, t);
+                }
+                return t == v->getType() ? v : b.CreateTrunc(v, t);
+            }
+
+/**
+* Blocks where the interpreter counts loop iterations -- loop headers and
+* exiting blocks.
+*/
+            std::set<const BasicBlock*> getCountedBlocks(Function& f)
+            {
+                std::set<const BasicBlock*> ret;
+                DominatorTree dt;
+                dt.recalculate(f);
+                LoopInfoBase<BasicBlock, Loop> li;
+                li.Analyze(dt);
+                for (auto& bb : f)
+                {
+                    Loop* l = li.getLoopFor(&bb);
+                    if (l && (l->isLoopExiting(&bb) || l->getHeader() == &bb))
+                    {
+                        ret.insert(&bb);
+                    }
+                }
+                return ret;
+            }
+
+/**
+* Builds @c i64 name(i8* frame, i64* args) that does what @a f does, with
+* hooks for everything that is not executed natively.
+*
+* Instructions are emitted block by block with operands still pointing into
+* @a f, and remapped once all the values exist -- @a f's block order need
+* not be a dominance order.
+*/
+            Function* buildNativeFunction(
+                    Function& f,
+                    Module& out,
+                    GlobalExecutionContext& globalEc,
+                    const NativeHooks& hooks,
+                    const std::string& name)
+            {
+                LLVMContext& ctx = f.getContext();
+                Type* i64 = Type::getInt64Ty(ctx);
+                Type* i8p = Type::getInt8PtrTy(ctx);
+                Type* i64p = PointerType::getUnqual(i64);
+
+                auto* fty = FunctionType::get(i64, {i8p, i64p}, false);
+                Function* nf = Function::Create(fty, GlobalValue::ExternalLinkage, name, &out);
+                auto aIt = nf->arg_begin();
+                Value* frame = &*aIt++;
+                Value* args = &*aIt;
+
+                auto hook = [&](FunctionType* ty, uint64_t addr) {
+                    return ConstantExpr::getIntToPtr(
+                            ConstantInt::get(i64, addr),
+                            PointerType::getUnqual(ty));
+                };
+                Constant* execHook = hook(
+                        FunctionType::get(i64, {i8p, i64, i64p}, false),
+                        hooks.exec);
+                Constant* branchHook = hook(
+                        FunctionType::get(i64, {i8p, i64, i64, i64, i64}, false),
+                        hooks.branch);
+                Constant* retHook = hook(
+                        FunctionType::get(i64, {i8p, i64}, false),
+                        hooks.ret);
+
+                std::set<const BasicBlock*> counted = getCountedBlocks(f);
+                unsigned maxOps = 1;
+                for (auto& bb : f)
+                for (auto& i : bb)
+                {
+                    maxOps = std::max(maxOps, i.getNumOperands());
+                }
+
+                BasicBlock* entry = BasicBlock::Create(ctx, "jit.entry", nf);
+                IRBuilder<> b(entry);
+                Value* ops = b.CreateAlloca(i64, b.getInt32(maxOps), "jit.ops");
+                Value* loopNums = b.CreateAlloca(i64, nullptr, "jit.loopNums");
+                Value* flag = b.CreateAlloca(i64, nullptr, "jit.flag");
+                b.CreateStore(b.getInt64(0), loopNums);
+                b.CreateStore(b.getInt64(0), flag);
+
+                DenseMap<const Value*, Value*> vmap;
+                unsigned argNo = 0;
+                for (auto ai = f.arg_begin(), e = f.arg_end(); ai != e; ++ai, ++argNo)
+                {
+                    Value* raw = b.CreateLoad(b.CreateConstGEP1_32(args, argNo));
+                    vmap[&*ai] = fromNative(b, raw, ai->getType());
+                }
+
+                DenseMap<const BasicBlock*, BasicBlock*> bmap;
+                for (auto& bb : f)
+                {
+                    bmap[&bb] = BasicBlock::Create(ctx, bb.getName(), nf);
+                }
+                BasicBlock* abort = BasicBlock::Create(ctx, "jit.abort", nf);
+                b.CreateBr(bmap[&f.front()]);
+                b.SetInsertPoint(abort);
+                b.CreateRet(b.getInt64(0));
+
+                for (auto& bb : f)
+                {
+                    b.SetInsertPoint(bmap[&bb]);
+                    for (auto& i : bb)
+                    {
+                        Value* site = b.getInt64(reinterpret_cast<uint64_t>(&i));
+                        Lowering lowering = classify(i);
+
+                        if (auto* br = dyn_cast<BranchInst>(&i))
+                        {
+                            Value* cond = br->isConditional()
+                                    ? toNative(b, br->getCondition())
+                                    : b.getInt64(1);
+                            Value* bailout = b.getInt64(0);
+                            Value* fl = b.getInt64(0);
+                            if (counted.count(&bb))
+                            {
+                                Value* n = b.CreateAdd(b.CreateLoad(loopNums), b.getInt64(1));
+                                Value* bail = b.CreateICmpSGE(n, b.getInt64(2));
+                                b.CreateStore(b.CreateSelect(bail, b.getInt64(0), n), loopNums);
+                                fl = b.CreateLoad(flag);
+                                if (br->isConditional())
+                                {
+                                    b.CreateStore(
+                                            b.CreateSelect(bail, b.CreateSub(b.getInt64(1), fl), fl),
+                                            flag);
+                                }
+                                bailout = b.CreateZExt(bail, i64);
+                            }
+                            Value* idx = b.CreateCall(
+                                    branchHook,
+                                    {frame, site, cond, bailout, fl});
+                            SwitchInst* sw = b.CreateSwitch(idx, abort, br->getNumSuccessors());
+                            for (unsigned s = 0; s < br->getNumSuccessors(); ++s)
+                            {
+                                sw->addCase(b.getInt64(s), bmap[br->getSuccessor(s)]);
+                            }
+                        }
+                        else if (auto* ret = dyn_cast<ReturnInst>(&i))
+                        {
+                            b.CreateCall(retHook, {frame, site});
+                            b.CreateRet(ret->getReturnValue()
+                                    ? toNative(b, ret->getReturnValue())
+                                    : b.getInt64(0));
+                        }
+                        else if (lowering == Lowering::Native && isa<GetElementPtrInst>(i))
+                        {
+                            auto* gep = cast<GetElementPtrInst>(&i);
+                            // The interpreter's address arithmetic, not the
+                            // target's -- layouts of the two may differ.
+                            const GepPlan& plan = globalEc.getGepPlan(gep);
+                            Value* addr = b.CreateAdd(
+                                    toNative(b, gep->getPointerOperand()),
+                                    b.getInt64(plan.constantOffset));
+                            for (auto& vi : plan.indices)
+                            {
+                                Value* idx = vi.bitWidth == 32
+                                        ? b.CreateSExt(vi.value, i64)
+                                        : vi.value;
+                                addr = b.CreateAdd(addr, b.CreateMul(idx, b.getInt64(vi.scale)));
+                            }
+                            vmap[&i] = b.CreateIntToPtr(addr, i.getType());
+                        }
+                        else if (lowering == Lowering::Native)
+                        {
+                            Instruction* c = i.clone();
+                            c->setName(i.getName());
+                            b.Insert(c);
+                            vmap[&i] = c;
+                        }
+                        else
+                        {
+                            for (unsigned k = 0; k < i.getNumOperands(); ++k)
+                            {
+                                Value* op = i.getOperand(k);
+                                if (isRuntimeValue(op))
+                                {
+                                    b.CreateStore(toNative(b, op), b.CreateConstGEP1_32(ops, k));
+                                }
+                            }
+                            Value* res = b.CreateCall(execHook, {frame, site, ops});
+                            if (!i.getType()->isVoidTy())
+                            {
+                                vmap[&i] = fromNative(b, res, i.getType());
+                            }
+                        }
+                    }
+                }
+
+                for (auto& bb : *nf)
+                for (auto& i : bb)
+                {
+                    for (unsigned k = 0; k < i.getNumOperands(); ++k)
+                    {
+                        auto it = vmap.find(i.getOperand(k));
+                        if (it != vmap.end())
+                        {
+                            i.setOperand(k, it->second);
+                        }
+                    }
+                    if (auto* phi = dyn_cast<PHINode>(&i))
+                    {
+                        for (unsigned k = 0; k < phi->getNumIncomingValues(); ++k)
+                        {
+                            phi->setIncomingBlock(k, bmap[phi->getIncomingBlock(k)]);
+                        }
+                    }
+                }
+
+                if (verifyFunction(*nf))
+                {
+                    nf->eraseFromParent();
+                    return nullptr;
+                }
+                return nf;
+            }
+
+/**
+* Optimizes @a m's function @a name, adds @a m to @a engine (created on the
+* first use) and returns the function's native code.
+*/
+            NativeEntry emitNative(
+                    std::unique_ptr<ExecutionEngine>& engine,
+                    std::unique_ptr<Module> m,
+                    const std::string& name)
+            {
+                static bool targetReady = !InitializeNativeTarget()
+                        && !InitializeNativeTargetAsmPrinter();
+                if (!targetReady)
+                {
+                    return nullptr;
+                }
+
+                legacy::FunctionPassManager fpm(m.get());
+                fpm.add(createPromoteMemoryToRegisterPass());
+                fpm.doInitialization();
+                fpm.run(*m->getFunction(name));
+                fpm.doFinalization();
+
+                if (!engine)
+                {
+                    std::string error;
+                    engine.reset(EngineBuilder(std::move(m))
+                            .setEngineKind(EngineKind::JIT)
+                            .setErrorStr(&error)
+                            .create());
+                    if (!engine)
+                    {
+                        return nullptr;
+                    }
+                }
+                else
+                {
+                    engine->addModule(std::move(m));
+                }
+                return reinterpret_cast<NativeEntry>(engine->getFunctionAddress(name));
+            }
+#endif
+
+        } // anonymous namespace
+
+        NativeJit::NativeJit(GlobalExecutionContext& globalEc, const NativeHooks& hooks) :
+                _globalEc(globalEc),
+                _hooks(hooks)
+        {
+
+        }
+
+        NativeJit::~NativeJit()
+        {
+            _jobs.close();
+            if (_compiler.joinable())
+            {
+                _compiler.join();
+            }
+        }
+
+        bool NativeJit::isAvailable()
+        {
+#ifdef LLVMIR_EMUL_JIT
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        bool NativeJit::isEligible(const llvm::Function* f, std::string* reason)
+        {
+            auto fail = [reason](const std::string& r) {
+                if (reason)
+                {
+                    *reason = r;
+                }
+                return false;
+            };
+
+            if (f->isDeclaration())
+            {
+                return fail("declaration");
+            }
+            if (f->isVarArg())
+            {
+                return fail("variadic");
+            }
+            if (f->getParent()->getDataLayout()->getPointerSizeInBits() != 64)
+            {
+                return fail("pointers are not 64-bit");
+            }
+            if (!f->getReturnType()->isVoidTy() && !isScalarType(f->getReturnType()))
+            {
+                return fail("return type");
+            }
+            for (auto ai = f->arg_begin(), e = f->arg_end(); ai != e; ++ai)
+            {
+                if (!isScalarType(ai->getType()))
+                {
+                    return fail("argument type");
+                }
+            }
+            for (auto& bb : *f)
+            for (auto& i : bb)
+            {
+                if (classify(i) == Lowering::None)
+                {
+                    return fail(std::string("instruction ") + i.getOpcodeName());
+                }
+            }
+            return true;
+        }
+
+        NativeEntry NativeJit::getEntry(llvm::Function* f)
+        {
+            auto it = _entries.find(f);
+            if (it != _entries.end())
+            {
+                return it->second;
+            }
+            NativeEntry e = compile(f);
+            _entries[f] = e;
+            return e;
+        }
+
+        bool NativeJit::request(llvm::Function* f)
+        {
+#ifdef LLVMIR_EMUL_JIT
+            if (!isEligible(f))
+            {
+                return false;
+            }
+
+            Job job;
+            job.function = f;
+            job.name = nextName();
+            Module out(job.name, f->getContext());
+            out.setDataLayout(f->getParent()->getDataLayoutStr());
+            out.setTargetTriple(sys::getProcessTriple());
+            if (buildNativeFunction(*f, out, _globalEc, _hooks, job.name) == nullptr)
+            {
+                return false;
+            }
+            raw_string_ostream os(job.bitcode);
+            WriteBitcodeToFile(&out, os);
+            os.flush();
+
+            if (!_compiler.joinable())
+            {
+                _compiler = std::thread(&NativeJit::compileThread, this);
+            }
+            return _jobs.push(std::move(job));
+#else
+            (void) f;
+            return false;
+#endif
+        }
+
+        NativeEntry NativeJit::poll(const llvm::Function* f)
+        {
+            std::lock_guard<std::mutex> lock(_readyMutex);
+            auto it = _ready.find(f);
+            return it != _ready.end() ? it->second : nullptr;
+        }
+
+        std::size_t NativeJit::getCompiledCount() const
+        {
+            return _compiled;
+        }
+
+        std::string NativeJit::nextName()
+        {
+            return "llvmir_emul_jit_" + std::to_string(_names++);
+        }
+
+        NativeEntry NativeJit::compile(llvm::Function* f)
+        {
+#ifdef LLVMIR_EMUL_JIT
+            if (!isEligible(f))
+            {
+                return nullptr;
+            }
+
+            std::string name = nextName();
+            std::unique_ptr<Module> out(new Module(name, f->getContext()));
+            out->setDataLayout(f->getParent()->getDataLayoutStr());
+            out->setTargetTriple(sys::getProcessTriple());
+            if (buildNativeFunction(*f, *out, _globalEc, _hooks, name) == nullptr)
+            {
+                return nullptr;
+            }
+
+            NativeEntry e = emitNative(_engine, std::move(out), name);
+            if (e)
+            {
+                ++_compiled;
+            }
+            return e;
+#else
+            (void) f;
+            return nullptr;
+#endif
+        }
+
+/**
+* Everything here lives in the thread's own context. The engine, and with it
+* the native code, lives until the queue is closed.
+*/
+        void NativeJit::compileThread()
+        {
+#ifdef LLVMIR_EMUL_JIT
+            LLVMContext ctx;
+            std::unique_ptr<ExecutionEngine> engine;
+            Job job;
+            while (_jobs.pop(job))
+            {
+                NativeEntry e = nullptr;
+                auto buffer = MemoryBuffer::getMemBuffer(job.bitcode, job.name, false);
+                ErrorOr<Module*> m = parseBitcodeFile(buffer->getMemBufferRef(), ctx);
+                if (m)
+                {
+                    e = emitNative(engine, std::unique_ptr<Module>(m.get()), job.name);
+                }
+                if (e)
+                {
+                    ++_compiled;
+                }
+
+                std::lock_guard<std::mutex> lock(_readyMutex);
+                _ready[job.function] = e;
+            }
+            // The engine must go before the context it was built in.
+            engine.reset();
+#endif
+        }
+
+    } // llvmir_emul
+} // retdec
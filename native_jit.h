@@ -0,0 +1,145 @@
+/**
+ * @file native_jit.h
+ * @brief Optional native backend -- instrumented functions compiled by MCJIT.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_NATIVE_JIT_H
+#define RETDEC_LLVMIR_EMUL_NATIVE_JIT_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Function.h>
+
+#include "bounded_queue.h"
+
+namespace llvm {
+    class ExecutionEngine;
+} // llvm
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        class GlobalExecutionContext;
+
+/**
+ * Emulator callbacks the compiled code calls. All of them get the opaque
+ * frame pointer passed to @c NativeEntry and the address of the original
+ * instruction they stand for.
+ * - @c exec(frame, site, operands) -- executes @a site by the interpreter;
+ *   @a operands holds values of its non-constant operands by operand index.
+ *   Returns the instruction's value.
+ * - @c branch(frame, site, condition, bailout, flag) -- logs the block
+ *   ending with branch @a site and returns the successor index, or -1 to
+ *   abandon the run. @a bailout is set when the frame's loop counter hit
+ *   the bound, @a flag is the frame's alternation flag.
+ * - @c ret(frame, site) -- logs the block ending with return @a site.
+ *
+ * Values of all types are passed as 64-bit integers -- integers zero
+ * extended, pointers as addresses.
+ */
+        struct NativeHooks
+        {
+            uint64_t exec = 0;
+            uint64_t branch = 0;
+            uint64_t ret = 0;
+        };
+
+        using NativeEntry = uint64_t (*)(void* frame, const uint64_t* args);
+
+/**
+ * Compiles functions to native code. Only computations with no effect on
+ * the signature run natively -- integer arithmetic, comparisons, casts,
+ * address arithmetic, PHIs, and control flow. Everything with an effect
+ * (loads, stores, allocas, external calls) and everything whose semantics
+ * the interpreter defines its own way (division, shifts) is replaced by an
+ * @c exec hook, so the emulator's memory model, logs and signature see
+ * exactly what interpretation would produce. Every block ends with
+ * a hook that logs the block's instructions, and loop headers and exiting
+ * blocks count iterations in a native counter that enforces the same
+ * bound the interpreter applies.
+ *
+ * Functions with anything else -- floating point, vectors, aggregates,
+ * calls of defined functions or intrinsics, switches -- are not compiled;
+ * @c getEntry() returns @c nullptr for them and the caller interprets.
+ *
+ * Compilation is either synchronous (@c getEntry()) or done by a background
+ * thread (@c request() and @c poll()). The background thread has its own
+ * @c LLVMContext -- the instrumented function is built on the caller's
+ * thread and handed over as bitcode, so the thread never touches the
+ * emulated module's context.
+ *
+ * MCJIT is used because the targeted LLVM has no ORC. The backend is only
+ * built with @c LLVMIR_EMUL_JIT; without it @c isAvailable() is @c false
+ * and nothing is compiled.
+ */
+        class NativeJit
+        {
+        public:
+            NativeJit(GlobalExecutionContext& globalEc, const NativeHooks& hooks);
+            NativeJit(const NativeJit&) = delete;
+            NativeJit& operator=(const NativeJit&) = delete;
+            ~NativeJit();
+
+            static bool isAvailable();
+/**
+ * @return @c True if @a f can be compiled, otherwise @c false and (if not
+ *         null) @a reason says why.
+ */
+            static bool isEligible(const llvm::Function* f, std::string* reason = nullptr);
+
+/**
+ * Compiles @a f on the first request.
+ * @return Native entry, or @c nullptr if @a f is not eligible or the
+ *         backend is not available.
+ */
+            NativeEntry getEntry(llvm::Function* f);
+
+/**
+ * Queues @a f for compilation on the background thread.
+ * @return @c False if @a f will never have native code.
+ */
+            bool request(llvm::Function* f);
+/**
+ * @return Entry of a requested function once it is compiled, @c nullptr
+ *         until then (or forever if compilation failed).
+ */
+            NativeEntry poll(const llvm::Function* f);
+
+            std::size_t getCompiledCount() const;
+
+        private:
+            struct Job
+            {
+                const llvm::Function* function = nullptr;
+                std::string name;
+                std::string bitcode;
+            };
+
+            NativeEntry compile(llvm::Function* f);
+            std::string nextName();
+            void compileThread();
+
+        private:
+            GlobalExecutionContext& _globalEc;
+            NativeHooks _hooks;
+            std::unique_ptr<llvm::ExecutionEngine> _engine;
+            llvm::DenseMap<const llvm::Function*, NativeEntry> _entries;
+            unsigned _names = 0;
+
+            BoundedQueue<Job> _jobs{4096};
+            std::thread _compiler;
+            mutable std::mutex _readyMutex;
+            llvm::DenseMap<const llvm::Function*, NativeEntry> _ready;
+            std::atomic<std::size_t> _compiled{0};
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file parallel_for.h
+ * @brief Minimal chunked parallel loop.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_PARALLEL_FOR_H
+#define RETDEC_LLVMIR_EMUL_PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace retdec {
+    namespace llvmir_emul {
+
+/**
+ * Runs @a fn(begin, end) over [0, n) in chunks of @a chunk on @a threads
+ * threads (the calling thread included). Chunks are handed out dynamically,
+ * so uneven work per item balances itself.
+ */
+        template<typename Fn>
+        void parallelFor(
+                std::size_t n,
+                unsigned threads,
+                Fn fn,
+                std::size_t chunk = 256)
+        {
+            chunk = std::max<std::size_t>(chunk, 1);
+            if (threads <= 1 || n <= chunk)
+            {
+                fn(std::size_t(0), n);
+                return;
+            }
+
+            std::atomic<std::size_t> next(0);
+            auto worker = [&]()
+            {
+                for (;;)
+                {
+                    std::size_t b = next.fetch_add(chunk);
+                    if (b >= n)
+                    {
+                        return;
+                    }
+                    fn(b, std::min(n, b + chunk));
+                }
+            };
+
+            std::vector<std::thread> pool;
+            for (unsigned i = 1; i < threads; ++i)
+            {
+                pool.emplace_back(worker);
+            }
+            worker();
+            for (auto& t : pool)
+            {
+                t.join();
+            }
+        }
+
+    } // llvmir_emul
+} // retdec
+
+#endif
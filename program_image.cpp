@@ -0,0 +1,271 @@
+/**
+ * @file program_image.cpp
+ * @brief Read-only decoded module shared by emulators on any threads.
+ */
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Instructions.h>
+
+#include "program_image.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+/**
+* Constants the emulator evaluates without touching anything but the
+* constant itself. Vectors and exotic expressions are left to run time.
+*/
+            bool isPoolable(const Constant* c)
+            {
+                if (auto* ce = dyn_cast<ConstantExpr>(c))
+                {
+                    unsigned op = ce->getOpcode();
+                    if (!ce->isCast()
+                            && !ce->isCompare()
+                            && op != Instruction::GetElementPtr
+                            && op != Instruction::Select
+                            && !Instruction::isBinaryOp(op))
+                    {
+                        return false;
+                    }
+                    for (auto& o : ce->operands())
+                    {
+                        if (!isPoolable(cast<Constant>(o.get())))
+                        {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+
+                Type* t = c->getType();
+                if (isa<UndefValue>(c))
+                {
+                    return !t->isVectorTy();
+                }
+                if (t->isPointerTy())
+                {
+                    return isa<ConstantPointerNull>(c)
+                            || isa<Function>(c)
+                            || isa<GlobalVariable>(c);
+                }
+                return t->isIntegerTy() || t->isFloatingPointTy();
+            }
+
+/**
+* Data layout caches struct layouts on first use. Touching every type the
+* emulator asks about leaves it with lookups only.
+*/
+            void layoutType(const DataLayout* DL, Type* t)
+            {
+                if (t->isSized())
+                {
+                    DL->getTypeAllocSize(t);
+                }
+            }
+
+        } // anonymous namespace
+
+        ProgramImage::ProgramImage(llvm::Module* m) :
+                _module(m)
+        {
+
+        }
+
+        std::shared_ptr<const ProgramImage> ProgramImage::build(llvm::Module* m)
+        {
+            std::shared_ptr<ProgramImage> image(new ProgramImage(m));
+            const DataLayout* DL = m->getDataLayout();
+
+            {
+                LlvmIrEmulator lowering(m, true);
+                for (Function& f : *m)
+                {
+                    if (f.isMaterializable() && f.materialize())
+                    {
+                        return nullptr;
+                    }
+                    if (!f.isDeclaration())
+                    {
+                        lowering.lowerIntrinsics(&f);
+                    }
+                }
+            }
+
+            // Plans and constants are computed by the very code that would
+            // compute them at run time.
+            GlobalExecutionContext scratch(m);
+            LocalExecutionContext ec;
+            auto pool = [&](Constant* c) {
+                if (image->_constantIds.count(c) || !isPoolable(c))
+                {
+                    return;
+                }
+                GenericValue v = scratch.getOperandValue(c, ec);
+                image->_constantIds[c] = image->_constants.size();
+                image->_constants.push_back(v);
+            };
+            auto classify = [&](const Value* v) {
+                if (v->hasName() && isUntracedName(v->getName()))
+                {
+                    image->_untraced.insert(v);
+                }
+            };
+
+            for (GlobalVariable& gv : m->globals())
+            {
+                classify(&gv);
+                layoutType(DL, gv.getType()->getElementType());
+                if (isRegisterGlobal(&gv))
+                {
+                    image->_registers.push_back(&gv);
+                }
+                if (!gv.isDeclaration())
+                {
+                    scratch.initializeGlobal(&gv, false);
+                    image->_initializerIds[&gv] = image->_constants.size();
+                    image->_constants.push_back(scratch.getGlobal(&gv, false));
+                }
+            }
+
+            for (Function& f : *m)
+            {
+                if (f.isDeclaration())
+                {
+                    continue;
+                }
+                for (Argument& a : f.getArgumentList())
+                {
+                    classify(&a);
+                }
+
+                FunctionInfo info;
+                info.fusion = buildFusionTable(f);
+                DominatorTree DT;
+                DT.recalculate(f);
+                info.loops.reset(new LoopInfo());
+                info.loops->Analyze(DT);
+                image->_functionIds[&f] = image->_functions.size();
+                image->_functions.push_back(std::move(info));
+
+                for (BasicBlock& bb : f)
+                {
+                    TerminatorInst* term = bb.getTerminator();
+                    for (unsigned i = 0; term && i < term->getNumSuccessors(); ++i)
+                    {
+                        scratch.getPhiEdgeTable(&bb, term->getSuccessor(i));
+                    }
+                    for (Instruction& i : bb)
+                    {
+                        classify(&i);
+                        layoutType(DL, i.getType());
+                        if (auto* a = dyn_cast<AllocaInst>(&i))
+                        {
+                            layoutType(DL, a->getAllocatedType());
+                        }
+                        if (isa<GetElementPtrInst>(i))
+                        {
+                            scratch.getGepPlan(&i);
+                        }
+                        for (auto& o : i.operands())
+                        {
+                            if (auto* pt = dyn_cast<PointerType>(o->getType()))
+                            {
+                                layoutType(DL, pt->getElementType());
+                            }
+                            if (auto* c = dyn_cast<Constant>(o.get()))
+                            {
+                                pool(c);
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Constant GEP expressions got their plans while being pooled.
+            for (auto& p : scratch.gepPlans)
+            {
+                image->_gepPlanIds[p.first] = image->_gepPlans.size();
+                image->_gepPlans.push_back(p.second);
+            }
+            for (auto& p : scratch.phiEdges)
+            {
+                image->_phiEdgeIds[p.first] = image->_phiEdges.size();
+                image->_phiEdges.push_back(p.second);
+            }
+
+            return image;
+        }
+
+        llvm::Module* ProgramImage::getModule() const
+        {
+            return _module;
+        }
+
+        const ProgramImage::LoopInfo* ProgramImage::getLoopInfo(
+                const llvm::Function* f) const
+        {
+            auto it = _functionIds.find(f);
+            return it != _functionIds.end() ? _functions[it->second].loops.get() : nullptr;
+        }
+
+        const FusionTable* ProgramImage::getFusionTable(const llvm::Function* f) const
+        {
+            auto it = _functionIds.find(f);
+            return it != _functionIds.end() ? &_functions[it->second].fusion : nullptr;
+        }
+
+        const PhiEdgeTable* ProgramImage::getPhiEdgeTable(
+                llvm::BasicBlock* from,
+                llvm::BasicBlock* to) const
+        {
+            auto it = _phiEdgeIds.find(std::make_pair(from, to));
+            return it != _phiEdgeIds.end() ? &_phiEdges[it->second] : nullptr;
+        }
+
+        const GepPlan* ProgramImage::getGepPlan(const llvm::User* gep) const
+        {
+            auto it = _gepPlanIds.find(gep);
+            return it != _gepPlanIds.end() ? &_gepPlans[it->second] : nullptr;
+        }
+
+        const llvm::GenericValue* ProgramImage::getConstant(const llvm::Constant* c) const
+        {
+            auto it = _constantIds.find(c);
+            return it != _constantIds.end() ? &_constants[it->second] : nullptr;
+        }
+
+        const llvm::GenericValue* ProgramImage::getInitializer(
+                const llvm::GlobalVariable* g) const
+        {
+            auto it = _initializerIds.find(g);
+            return it != _initializerIds.end() ? &_constants[it->second] : nullptr;
+        }
+
+        const std::vector<llvm::GlobalVariable*>& ProgramImage::getRegisters() const
+        {
+            return _registers;
+        }
+
+        bool ProgramImage::hasUntracedName(const llvm::Value* v) const
+        {
+            return _untraced.count(v);
+        }
+
+        std::size_t ProgramImage::getFunctionCount() const
+        {
+            return _functions.size();
+        }
+
+        std::size_t ProgramImage::getConstantCount() const
+        {
+            return _constants.size();
+        }
+
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,111 @@
+/**
+ * @file program_image.h
+ * @brief Read-only decoded module shared by emulators on any threads.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_PROGRAM_IMAGE_H
+#define RETDEC_LLVMIR_EMUL_PROGRAM_IMAGE_H
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/ExecutionEngine/GenericValue.h>
+#include <llvm/IR/Module.h>
+
+#include "fusion.h"
+#include "llvmir-emul.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+/**
+ * Everything the emulator derives from the IR, computed once: loop
+ * analyses and superinstructions of functions, PHI copy tables of CFG
+ * edges, GEP plans, values of constant operands and global initializers,
+ * the register file layout and name classification.
+ *
+ * Emulators created from an image (see @c LlvmIrEmulator) only read the IR
+ * and the image, they never modify the module (intrinsics are lowered by
+ * @c build()) and never create constants or types in its context. Any
+ * number of them can thus run concurrently on any threads; each one holds
+ * only its mutable state (memory, values, logs).
+ *
+ * The module must outlive the image and must not be modified meanwhile.
+ * The native backend compiles into the module's context and is not
+ * available to emulators sharing an image.
+ */
+        class ProgramImage
+        {
+        public:
+            using LoopInfo = llvm::LoopInfoBase<llvm::BasicBlock, llvm::Loop>;
+
+        public:
+/**
+ * Materializes all functions of @a m, lowers their intrinsics and decodes
+ * the module. Not thread-safe with respect to @a m.
+ * @return The image, or @c nullptr if a function of @a m can not be
+ *         materialized (e.g. its lazily loaded body is corrupt).
+ */
+            static std::shared_ptr<const ProgramImage> build(llvm::Module* m);
+
+            llvm::Module* getModule() const;
+
+            const LoopInfo* getLoopInfo(const llvm::Function* f) const;
+            const FusionTable* getFusionTable(const llvm::Function* f) const;
+            const PhiEdgeTable* getPhiEdgeTable(
+                    llvm::BasicBlock* from,
+                    llvm::BasicBlock* to) const;
+            const GepPlan* getGepPlan(const llvm::User* gep) const;
+/**
+ * @return Value of constant @a c, or @c nullptr if it is not pooled (it is
+ *         not an operand in the module, or it is an expression the emulator
+ *         can not evaluate up front).
+ */
+            const llvm::GenericValue* getConstant(const llvm::Constant* c) const;
+            const llvm::GenericValue* getInitializer(const llvm::GlobalVariable* g) const;
+
+            const std::vector<llvm::GlobalVariable*>& getRegisters() const;
+            bool hasUntracedName(const llvm::Value* v) const;
+
+            std::size_t getFunctionCount() const;
+            std::size_t getConstantCount() const;
+
+        private:
+            explicit ProgramImage(llvm::Module* m);
+
+            struct FunctionInfo
+            {
+                FusionTable fusion;
+                std::unique_ptr<LoopInfo> loops;
+            };
+
+        private:
+            llvm::Module* _module = nullptr;
+
+            std::vector<FunctionInfo> _functions;
+            llvm::DenseMap<const llvm::Function*, unsigned> _functionIds;
+
+            std::vector<PhiEdgeTable> _phiEdges;
+            llvm::DenseMap<
+                    std::pair<llvm::BasicBlock*, llvm::BasicBlock*>,
+                    unsigned> _phiEdgeIds;
+
+            std::vector<GepPlan> _gepPlans;
+            llvm::DenseMap<const llvm::User*, unsigned> _gepPlanIds;
+
+            std::vector<llvm::GenericValue> _constants;
+            llvm::DenseMap<const llvm::Constant*, unsigned> _constantIds;
+            llvm::DenseMap<const llvm::GlobalVariable*, unsigned> _initializerIds;
+
+            std::vector<llvm::GlobalVariable*> _registers;
+            llvm::DenseSet<const llvm::Value*> _untraced;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
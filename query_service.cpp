@@ -0,0 +1,377 @@
+/**
+ * @file query_service.cpp
+ * @brief Long-running nearest-function query service on a Unix socket.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "query_service.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            bool sendAll(int fd, const std::string& data)
+            {
+                const char* p = data.data();
+                std::size_t left = data.size();
+                while (left)
+                {
+                    ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+                    if (n < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    if (n <= 0)
+                    {
+                        return false;
+                    }
+                    p += n;
+                    left -= n;
+                }
+                return true;
+            }
+
+        } // anonymous namespace
+
+        QueryService::QueryService(const QueryServiceConfig& config) :
+                _config(config)
+        {
+            // Results of BC requests go back to the client, not to a corpus.
+            _config.emulation.corpus = nullptr;
+        }
+
+        QueryService::~QueryService()
+        {
+            stop();
+            if (_batcher.joinable())
+            {
+                _batcher.join();
+            }
+            if (_listenFd >= 0)
+            {
+                close(_listenFd);
+                unlink(_config.socketPath.c_str());
+            }
+        }
+
+        bool QueryService::start(std::string& error)
+        {
+            if (!_corpus.open(_config.corpusPath))
+            {
+                error = "can not open corpus " + _config.corpusPath;
+                return false;
+            }
+
+            // The index is built once, this is the start-up cost the service
+            // saves every later query.
+            MinHashConfig mh = _corpus.getMinHashConfig();
+            _hasher.reset(new MinHasher(mh));
+            _engine.reset(new SimilarityEngine(mh, _config.threads));
+            if (!_engine->build(_corpus.getSketches()))
+            {
+                error = "sketches of corpus " + _config.corpusPath
+                        + " do not match its MinHash config";
+                return false;
+            }
+
+            sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (_config.socketPath.size() >= sizeof(addr.sun_path))
+            {
+                error = "socket path too long";
+                return false;
+            }
+            strcpy(addr.sun_path, _config.socketPath.c_str());
+
+            _listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (_listenFd < 0)
+            {
+                error = std::string("socket: ") + strerror(errno);
+                return false;
+            }
+            unlink(_config.socketPath.c_str());
+            if (bind(_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+                    || listen(_listenFd, 64) != 0)
+            {
+                error = std::string("bind: ") + strerror(errno);
+                close(_listenFd);
+                _listenFd = -1;
+                return false;
+            }
+
+            _batcher = std::thread(&QueryService::batcher, this);
+            return true;
+        }
+
+        void QueryService::run()
+        {
+            while (!_stopping)
+            {
+                int fd = accept4(_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd < 0)
+                {
+                    if (errno == EINTR || errno == ECONNABORTED)
+                    {
+                        continue;
+                    }
+                    break;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(_connectionsMutex);
+                    _connectionFds.insert(fd);
+                }
+                std::thread(&QueryService::serveConnection, this, fd).detach();
+            }
+
+            std::unique_lock<std::mutex> lock(_connectionsMutex);
+            _idleCv.wait(lock, [this]() { return _connectionFds.empty(); });
+        }
+
+        void QueryService::stop()
+        {
+            if (_stopping.exchange(true))
+            {
+                return;
+            }
+            if (_listenFd >= 0)
+            {
+                shutdown(_listenFd, SHUT_RDWR);
+            }
+            {
+                std::lock_guard<std::mutex> lock(_connectionsMutex);
+                for (int fd : _connectionFds)
+                {
+                    shutdown(fd, SHUT_RDWR);
+                }
+            }
+            _pending.close();
+        }
+
+        void QueryService::serveConnection(int fd)
+        {
+            std::string buffer;
+            char chunk[4096];
+            for (;;)
+            {
+                ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    break;
+                }
+                buffer.append(chunk, n);
+
+                bool ok = true;
+                std::size_t nl;
+                while (ok && (nl = buffer.find('\n')) != std::string::npos)
+                {
+                    std::string line = buffer.substr(0, nl);
+                    buffer.erase(0, nl + 1);
+                    ok = sendAll(fd, handleRequest(line));
+                }
+                if (!ok)
+                {
+                    break;
+                }
+            }
+
+            close(fd);
+            std::lock_guard<std::mutex> lock(_connectionsMutex);
+            _connectionFds.erase(fd);
+            _idleCv.notify_all();
+        }
+
+/**
+* Turns a request into queries, waits for the batcher to answer all of them
+* and formats the response.
+*/
+        std::string QueryService::handleRequest(const std::string& line)
+        {
+            std::istringstream in(line);
+            std::string cmd;
+            in >> cmd;
+
+            std::vector<std::shared_ptr<Query>> queries;
+            std::vector<std::string> names;
+            const unsigned n = _corpus.getMinHashConfig().numHashes;
+
+            if (cmd == "BC")
+            {
+                std::string path;
+                std::size_t k = _config.defaultK;
+                in >> path;
+                if (!(in >> k))
+                {
+                    k = _config.defaultK;
+                }
+                if (path.empty())
+                {
+                    return "error missing module path\n";
+                }
+
+                BatchPipeline pipeline(_config.emulation);
+                bool parsed = true;
+                pipeline.run({path}, [&](const FunctionResult& r) {
+                    if (r.functionName.empty())
+                    {
+                        parsed = false;
+                        return;
+                    }
+                    if (r.failed)
+                    {
+                        return;
+                    }
+                    auto q = std::make_shared<Query>();
+                    q->k = k;
+                    q->sketch = _hasher->sketch(r.signature);
+                    queries.push_back(q);
+                    names.push_back(r.functionName);
+                });
+                if (!parsed)
+                {
+                    return "error can not parse " + path + "\n";
+                }
+            }
+            else if (cmd == "SIG")
+            {
+                auto q = std::make_shared<Query>();
+                std::string sig;
+                if (!(in >> q->k) || !(in >> sig))
+                {
+                    return "error usage: SIG <k> <signature>\n";
+                }
+                q->sketch = _hasher->sketch(sig);
+                queries.push_back(q);
+                names.push_back("-");
+            }
+            else if (cmd == "SKETCH")
+            {
+                auto q = std::make_shared<Query>();
+                q->sketch.resize(n);
+                bool ok = bool(in >> q->k);
+                for (unsigned i = 0; ok && i < n; ++i)
+                {
+                    ok = bool(in >> q->sketch[i]);
+                }
+                if (!ok)
+                {
+                    return "error usage: SKETCH <k> <" + std::to_string(n) + " values>\n";
+                }
+                queries.push_back(q);
+                names.push_back("-");
+            }
+            else
+            {
+                return "error unknown request\n";
+            }
+
+            for (auto& q : queries)
+            {
+                if (!_pending.push(q))
+                {
+                    return "error shutting down\n";
+                }
+            }
+            {
+                std::unique_lock<std::mutex> lock(_doneMutex);
+                _doneCv.wait(lock, [&]() {
+                    return _stopping || std::all_of(queries.begin(), queries.end(),
+                            [](const std::shared_ptr<Query>& q) { return q->done; });
+                });
+            }
+
+            std::ostringstream out;
+            for (std::size_t i = 0; i < queries.size(); ++i)
+            {
+                unsigned rank = 0;
+                for (auto& m : queries[i]->result)
+                {
+                    out << "match\t" << names[i] << "\t" << rank++ << "\t"
+                            << _corpus.getModuleName(m.item) << "\t"
+                            << _corpus.getFunctionName(m.item) << "\t"
+                            << m.similarity << "\n";
+                }
+            }
+            out << "end\n";
+            return out.str();
+        }
+
+/**
+* Collects queries of all connections and answers them with one engine call
+* per batch.
+*/
+        void QueryService::batcher()
+        {
+            std::shared_ptr<Query> q;
+            while (_pending.pop(q))
+            {
+                std::vector<std::shared_ptr<Query>> batch;
+                batch.push_back(std::move(q));
+
+                auto deadline = std::chrono::steady_clock::now()
+                        + std::chrono::milliseconds(_config.batchWindowMs);
+                while (batch.size() < _config.maxBatch)
+                {
+                    if (_pending.tryPop(q))
+                    {
+                        batch.push_back(std::move(q));
+                    }
+                    else if (std::chrono::steady_clock::now() < deadline)
+                    {
+                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    }
+                    else
+                    {
+                        break;
+                    }
+                }
+                answer(batch);
+            }
+
+            std::lock_guard<std::mutex> lock(_doneMutex);
+            _doneCv.notify_all();
+        }
+
+        void QueryService::answer(std::vector<std::shared_ptr<Query>>& queries)
+        {
+            const unsigned n = _corpus.getMinHashConfig().numHashes;
+            std::vector<uint32_t> sketches(queries.size() * n);
+            std::size_t k = 0;
+            for (std::size_t i = 0; i < queries.size(); ++i)
+            {
+                std::copy(queries[i]->sketch.begin(), queries[i]->sketch.end(), &sketches[i * n]);
+                k = std::max(k, queries[i]->k);
+            }
+
+            SketchView view;
+            view.data = sketches.data();
+            view.count = queries.size();
+            view.numHashes = n;
+            auto results = _engine->topKBatch(view, k);
+
+            std::lock_guard<std::mutex> lock(_doneMutex);
+            for (std::size_t i = 0; i < queries.size(); ++i)
+            {
+                results[i].resize(std::min(results[i].size(), queries[i]->k));
+                queries[i]->result = std::move(results[i]);
+                queries[i]->done = true;
+            }
+            _doneCv.notify_all();
+        }
+
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,115 @@
+/**
+ * @file query_service.h
+ * @brief Long-running nearest-function query service on a Unix socket.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_QUERY_SERVICE_H
+#define RETDEC_LLVMIR_EMUL_QUERY_SERVICE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch_pipeline.h"
+#include "bounded_queue.h"
+#include "signature_corpus.h"
+#include "similarity_engine.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        struct QueryServiceConfig
+        {
+            std::string socketPath;
+            /// Corpus file that is the searched index.
+            std::string corpusPath;
+            /// Matches per query if the request does not say.
+            std::size_t defaultK = 10;
+            /// Queries answered by one engine call at most.
+            std::size_t maxBatch = 256;
+            /// How long the batcher waits for more queries after the first
+            /// one arrives.
+            unsigned batchWindowMs = 2;
+            /// Search threads, 0 means hardware concurrency.
+            unsigned threads = 0;
+            /// Emulation settings for @c BC requests.
+            BatchConfig emulation;
+        };
+
+/**
+ * Keeps a corpus mapped and its LSH index built, and answers queries over a
+ * Unix stream socket. Every connection is served by its own thread, queries
+ * from all connections are collected by a batcher and answered together.
+ *
+ * Requests and responses are text lines:
+ * - @c "BC <path> [k]" -- emulate all defined functions of the module and
+ *   query each of them
+ * - @c "SIG <k> <similarity string>" -- sketch the string and query it
+ * - @c "SKETCH <k> <v0> ... <vN-1>" -- query a precomputed sketch of
+ *   the corpus's width
+ *
+ * Every match is answered with
+ * @c "match <query> <rank> <module> <function> <similarity>" (tab separated),
+ * the request with @c "end", and a malformed request with @c "error <text>".
+ */
+        class QueryService
+        {
+        public:
+            explicit QueryService(const QueryServiceConfig& config);
+            ~QueryService();
+
+/**
+ * Opens the corpus, builds the index and binds the socket.
+ */
+            bool start(std::string& error);
+/**
+ * Serves connections until @c stop() is called.
+ */
+            void run();
+            void stop();
+
+        private:
+            struct Query
+            {
+                std::vector<uint32_t> sketch;
+                std::size_t k = 0;
+                std::vector<SimilarItem> result;
+                bool done = false;
+            };
+
+            void serveConnection(int fd);
+            std::string handleRequest(const std::string& line);
+            void answer(std::vector<std::shared_ptr<Query>>& queries);
+            void batcher();
+
+        private:
+            QueryServiceConfig _config;
+            SignatureCorpus _corpus;
+            std::unique_ptr<MinHasher> _hasher;
+            std::unique_ptr<SimilarityEngine> _engine;
+
+            int _listenFd = -1;
+            std::atomic<bool> _stopping{false};
+
+            BoundedQueue<std::shared_ptr<Query>> _pending{64 * 1024};
+            std::mutex _doneMutex;
+            std::condition_variable _doneCv;
+            std::thread _batcher;
+
+            /// Connection threads are detached, these track them so that
+            /// shutdown can interrupt and wait for them.
+            std::mutex _connectionsMutex;
+            std::condition_variable _idleCv;
+            std::set<int> _connectionFds;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
@@ -0,0 +1,680 @@
+/**
+ * @file shard_batch.cpp
+ * @brief Batch emulation sharded across processes and machines through
+ *        a shared directory.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include "shard_batch.h"
+#include "signature_cache.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            struct ManifestUnit
+            {
+                std::string module;
+                std::vector<std::string> functions;
+                uint64_t cost = 0;
+            };
+
+/**
+* Unit file name in @c pending/ or @c leased/ split to its parts.
+*/
+            struct UnitFile
+            {
+                std::string name;
+                std::size_t unit = 0;
+                unsigned attempt = 0;
+            };
+
+            std::string unitName(std::size_t unit)
+            {
+                char buf[32];
+                std::snprintf(buf, sizeof(buf), "%08zu", unit);
+                return buf;
+            }
+
+            bool parseUnitFile(const std::string& name, UnitFile& file)
+            {
+                // <unit>.<attempt>[.<worker>]
+                char* end = nullptr;
+                file.name = name;
+                file.unit = std::strtoull(name.c_str(), &end, 10);
+                if (end == name.c_str() || *end != '.')
+                {
+                    return false;
+                }
+                const char* attempt = end + 1;
+                file.attempt = std::strtoul(attempt, &end, 10);
+                return end != attempt && (*end == '\0' || *end == '.');
+            }
+
+            bool listDirectory(const std::string& path, std::vector<std::string>& names)
+            {
+                names.clear();
+                DIR* dir = opendir(path.c_str());
+                if (dir == nullptr)
+                {
+                    return false;
+                }
+                while (dirent* e = readdir(dir))
+                {
+                    if (e->d_name[0] != '.')
+                    {
+                        names.push_back(e->d_name);
+                    }
+                }
+                closedir(dir);
+                return true;
+            }
+
+            bool readFile(const std::string& path, std::string& data)
+            {
+                std::FILE* f = std::fopen(path.c_str(), "rb");
+                if (f == nullptr)
+                {
+                    return false;
+                }
+                data.clear();
+                char buf[1 << 16];
+                std::size_t n;
+                while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0)
+                {
+                    data.append(buf, n);
+                }
+                bool ok = !std::ferror(f);
+                std::fclose(f);
+                return ok;
+            }
+
+/**
+* Writes @a data to a temporary file next to @a path and renames it over
+* @a path, so readers see the whole file or nothing.
+*/
+            bool writeFileAtomic(
+                    const std::string& path,
+                    const std::string& data,
+                    const std::string& writer)
+            {
+                std::string tmp = path + "." + writer + ".tmp";
+                std::FILE* f = std::fopen(tmp.c_str(), "wb");
+                if (f == nullptr)
+                {
+                    return false;
+                }
+                bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+                ok = std::fflush(f) == 0 && ok;
+                ok = fsync(fileno(f)) == 0 && ok;
+                ok = std::fclose(f) == 0 && ok;
+                ok = ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+                if (!ok)
+                {
+                    std::remove(tmp.c_str());
+                }
+                return ok;
+            }
+
+            bool makeDirectory(const std::string& path)
+            {
+                return mkdir(path.c_str(), 0777) == 0 || errno == EEXIST;
+            }
+
+            bool readManifest(
+                    const std::string& dir,
+                    std::vector<ManifestUnit>& units,
+                    std::string& error)
+            {
+                std::string data;
+                if (!readFile(dir + "/manifest.tsv", data))
+                {
+                    error = "can not read manifest in " + dir;
+                    return false;
+                }
+
+                units.clear();
+                std::istringstream in(data);
+                std::string line;
+                while (std::getline(in, line))
+                {
+                    std::size_t t1 = line.find('\t');
+                    std::size_t t2 = t1 == std::string::npos ? t1 : line.find('\t', t1 + 1);
+                    std::size_t t3 = t2 == std::string::npos ? t2 : line.find('\t', t2 + 1);
+                    if (t3 == std::string::npos)
+                    {
+                        error = "malformed manifest line: " + line;
+                        return false;
+                    }
+                    std::size_t unit = std::stoull(line.substr(0, t1));
+                    if (unit != units.size() && unit + 1 != units.size())
+                    {
+                        error = "manifest units out of order";
+                        return false;
+                    }
+                    if (unit == units.size())
+                    {
+                        units.emplace_back();
+                        units.back().module = line.substr(t2 + 1, t3 - t2 - 1);
+                    }
+                    units.back().functions.push_back(line.substr(t3 + 1));
+                    units.back().cost += std::stoull(line.substr(t1 + 1, t2 - t1 - 1));
+                }
+                return true;
+            }
+
+            std::string formatResult(const FunctionResult& r)
+            {
+                const RunStats& s = r.stats;
+                std::ostringstream out;
+                out << r.functionName << "\t" << (r.failed ? 1 : 0) << "\t"
+                        << s.instructions << " " << s.basicBlocks << " " << s.calls << " "
+                        << s.memoryLoads << " " << s.memoryStores << " "
+                        << s.globalLoads << " " << s.globalStores << "\t"
+                        << r.signature << "\n";
+                return out.str();
+            }
+
+            bool parseResults(
+                    const std::string& data,
+                    std::unordered_map<std::string, FunctionResult>& results)
+            {
+                std::istringstream in(data);
+                std::string line;
+                while (std::getline(in, line))
+                {
+                    std::size_t t1 = line.find('\t');
+                    std::size_t t2 = t1 == std::string::npos ? t1 : line.find('\t', t1 + 1);
+                    std::size_t t3 = t2 == std::string::npos ? t2 : line.find('\t', t2 + 1);
+                    if (t3 == std::string::npos)
+                    {
+                        return false;
+                    }
+                    FunctionResult r;
+                    r.functionName = line.substr(0, t1);
+                    r.failed = line.compare(t1 + 1, t2 - t1 - 1, "1") == 0;
+                    RunStats& s = r.stats;
+                    std::istringstream stats(line.substr(t2 + 1, t3 - t2 - 1));
+                    stats >> s.instructions >> s.basicBlocks >> s.calls
+                            >> s.memoryLoads >> s.memoryStores
+                            >> s.globalLoads >> s.globalStores;
+                    r.signature = line.substr(t3 + 1);
+                    results[r.functionName] = std::move(r);
+                }
+                return true;
+            }
+
+            std::string failedResults(const ManifestUnit& unit)
+            {
+                std::string data;
+                for (auto& name : unit.functions)
+                {
+                    FunctionResult r;
+                    r.functionName = name;
+                    r.failed = true;
+                    data += formatResult(r);
+                }
+                return data;
+            }
+
+            std::size_t countFinished(const std::string& dir)
+            {
+                std::vector<std::string> names;
+                listDirectory(dir + "/results", names);
+                return std::count_if(names.begin(), names.end(), [](const std::string& n) {
+                    return n.size() > 4 && n.compare(n.size() - 4, 4, ".tsv") == 0;
+                });
+            }
+
+/**
+* Returns leases whose heartbeat is older than the limit to pending, or
+* fails their units after too many attempts. Any number of processes may
+* do this at once -- only one rename of a lease succeeds.
+*/
+            void reclaimExpired(
+                    const ShardConfig& config,
+                    const std::vector<ManifestUnit>& units)
+            {
+                const std::string& dir = config.directory;
+                std::vector<std::string> names;
+                listDirectory(dir + "/leased", names);
+                const time_t now = std::time(nullptr);
+                for (auto& name : names)
+                {
+                    UnitFile file;
+                    struct stat st;
+                    std::string path = dir + "/leased/" + name;
+                    if (!parseUnitFile(name, file)
+                            || file.unit >= units.size()
+                            || stat(path.c_str(), &st) != 0
+                            || now - st.st_mtime <= time_t(config.leaseSeconds))
+                    {
+                        continue;
+                    }
+
+                    if (file.attempt + 1 < config.maxAttempts)
+                    {
+                        std::string to = dir + "/pending/" + unitName(file.unit)
+                                + "." + std::to_string(file.attempt + 1);
+                        std::rename(path.c_str(), to.c_str());
+                        continue;
+                    }
+
+                    std::string result = dir + "/results/" + unitName(file.unit) + ".tsv";
+                    if (access(result.c_str(), F_OK) != 0)
+                    {
+                        writeFileAtomic(result, failedResults(units[file.unit]), config.workerId);
+                    }
+                    unlink(path.c_str());
+                }
+            }
+
+/**
+* Touches the lease file periodically while a unit is being emulated.
+*/
+            class Heartbeat
+            {
+            public:
+                Heartbeat(const std::string& path, unsigned leaseSeconds) :
+                        _path(path),
+                        _period(std::max(1u, leaseSeconds / 4))
+                {
+                    _thread = std::thread([this]() {
+                        std::unique_lock<std::mutex> lock(_mutex);
+                        while (!_cv.wait_for(lock, _period, [this]() { return _stopping; }))
+                        {
+                            utimes(_path.c_str(), nullptr);
+                        }
+                    });
+                }
+
+                ~Heartbeat()
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(_mutex);
+                        _stopping = true;
+                    }
+                    _cv.notify_all();
+                    _thread.join();
+                }
+
+            private:
+                std::string _path;
+                std::chrono::seconds _period;
+                std::mutex _mutex;
+                std::condition_variable _cv;
+                bool _stopping = false;
+                std::thread _thread;
+            };
+
+            struct LoadedModule
+            {
+                std::string path;
+                // Declaration order matters -- emulator must die before the
+                // module and module before its context.
+                std::unique_ptr<LLVMContext> context;
+                std::unique_ptr<Module> module;
+                std::unique_ptr<LlvmIrEmulator> emulator;
+            };
+
+        } // anonymous namespace
+
+        uint64_t estimateCost(const llvm::Function* f)
+        {
+            uint64_t cost = 0;
+            for (auto& bb : *f)
+            {
+                cost += bb.size();
+            }
+            return cost;
+        }
+
+//
+//=============================================================================
+// ShardCoordinator
+//=============================================================================
+//
+
+        ShardCoordinator::ShardCoordinator(const ShardConfig& config) :
+                _config(config)
+        {
+            if (_config.workerId.empty())
+            {
+                _config.workerId = "coordinator-" + std::to_string(getpid());
+            }
+        }
+
+        bool ShardCoordinator::plan(
+                const std::vector<std::string>& modulePaths,
+                std::string& error)
+        {
+            const std::string& dir = _config.directory;
+            std::string manifest = dir + "/manifest.tsv";
+            if (!makeDirectory(dir))
+            {
+                error = "can not create " + dir;
+                return false;
+            }
+            if (access(manifest.c_str(), F_OK) == 0)
+            {
+                error = dir + " already has a manifest";
+                return false;
+            }
+
+            std::ostringstream out;
+            std::size_t unit = 0;
+            for (auto& path : modulePaths)
+            {
+                LLVMContext context;
+                SMDiagnostic err;
+                std::unique_ptr<Module> module = parseIRFile(path, err, context);
+                if (!module)
+                {
+                    // Worker fails to parse it too and reports one failed
+                    // result, like BatchPipeline does.
+                    out << unit++ << "\t0\t" << path << "\t\n";
+                    continue;
+                }
+
+                uint64_t unitCost = 0;
+                bool empty = true;
+                for (Function& f : *module)
+                {
+                    if (f.isDeclaration())
+                    {
+                        continue;
+                    }
+                    uint64_t cost = std::max<uint64_t>(1, estimateCost(&f));
+                    if (!empty && unitCost + cost > _config.unitCost)
+                    {
+                        ++unit;
+                        unitCost = 0;
+                    }
+                    out << unit << "\t" << cost << "\t" << path << "\t"
+                            << f.getName().str() << "\n";
+                    unitCost += cost;
+                    empty = false;
+                }
+                if (!empty)
+                {
+                    ++unit;
+                }
+            }
+
+            if (!makeDirectory(dir + "/pending")
+                    || !makeDirectory(dir + "/leased")
+                    || !makeDirectory(dir + "/results")
+                    || !writeFileAtomic(manifest, out.str(), _config.workerId))
+            {
+                error = "can not write manifest in " + dir;
+                return false;
+            }
+            // Units become visible only after the manifest that describes
+            // them.
+            for (std::size_t i = 0; i < unit; ++i)
+            {
+                std::string path = dir + "/pending/" + unitName(i) + ".0";
+                std::FILE* f = std::fopen(path.c_str(), "wb");
+                if (f == nullptr)
+                {
+                    error = "can not create " + path;
+                    return false;
+                }
+                std::fclose(f);
+            }
+            return true;
+        }
+
+        bool ShardCoordinator::status(ShardStatus& status, std::string& error) const
+        {
+            std::vector<ManifestUnit> units;
+            if (!readManifest(_config.directory, units, error))
+            {
+                return false;
+            }
+            std::vector<std::string> names;
+            status.units = units.size();
+            listDirectory(_config.directory + "/pending", names);
+            status.pending = names.size();
+            listDirectory(_config.directory + "/leased", names);
+            status.leased = names.size();
+            status.finished = countFinished(_config.directory);
+            return true;
+        }
+
+        bool ShardCoordinator::merge(BatchPipeline::Sink sink, std::string& error)
+        {
+            const std::string& dir = _config.directory;
+            std::vector<ManifestUnit> units;
+            if (!readManifest(dir, units, error))
+            {
+                return false;
+            }
+            while (countFinished(dir) < units.size())
+            {
+                reclaimExpired(_config, units);
+                std::this_thread::sleep_for(std::chrono::milliseconds(_config.pollMs));
+            }
+
+            for (std::size_t i = 0; i < units.size(); ++i)
+            {
+                std::string data;
+                std::unordered_map<std::string, FunctionResult> results;
+                if (!readFile(dir + "/results/" + unitName(i) + ".tsv", data)
+                        || !parseResults(data, results))
+                {
+                    error = "malformed results of unit " + unitName(i);
+                    return false;
+                }
+                for (auto& name : units[i].functions)
+                {
+                    FunctionResult r;
+                    auto it = results.find(name);
+                    if (it != results.end())
+                    {
+                        r = std::move(it->second);
+                    }
+                    else
+                    {
+                        r.functionName = name;
+                        r.failed = true;
+                    }
+                    r.modulePath = units[i].module;
+                    sink(r);
+                }
+            }
+            return true;
+        }
+
+//
+//=============================================================================
+// ShardWorker
+//=============================================================================
+//
+
+        ShardWorker::ShardWorker(const ShardConfig& config) :
+                _config(config)
+        {
+            if (_config.workerId.empty())
+            {
+                char host[256] = {};
+                gethostname(host, sizeof(host) - 1);
+                _config.workerId = std::string(host) + "-" + std::to_string(getpid());
+            }
+        }
+
+        std::size_t ShardWorker::getFinishedUnits() const
+        {
+            return _finished;
+        }
+
+        bool ShardWorker::run(std::string& error)
+        {
+            const std::string& dir = _config.directory;
+            const BatchConfig& ec = _config.emulation;
+            std::vector<ManifestUnit> units;
+            if (!readManifest(dir, units, error))
+            {
+                return false;
+            }
+
+            LoadedModule loaded;
+            std::vector<std::string> names;
+            std::vector<UnitFile> pending;
+            for (;;)
+            {
+                listDirectory(dir + "/pending", names);
+                pending.clear();
+                for (auto& name : names)
+                {
+                    UnitFile file;
+                    if (parseUnitFile(name, file) && file.unit < units.size())
+                    {
+                        pending.push_back(file);
+                    }
+                }
+                if (pending.empty())
+                {
+                    if (countFinished(dir) >= units.size())
+                    {
+                        return true;
+                    }
+                    reclaimExpired(_config, units);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(_config.pollMs));
+                    continue;
+                }
+
+                // Expensive units first, so that the last ones to finish
+                // are short.
+                std::sort(pending.begin(), pending.end(), [&](const UnitFile& a, const UnitFile& b) {
+                    uint64_t ca = units[a.unit].cost;
+                    uint64_t cb = units[b.unit].cost;
+                    return ca != cb ? ca > cb : a.unit < b.unit;
+                });
+
+                bool claimed = false;
+                for (auto& file : pending)
+                {
+                    std::string from = dir + "/pending/" + file.name;
+                    std::string lease = dir + "/leased/" + file.name + "." + _config.workerId;
+                    std::string result = dir + "/results/" + unitName(file.unit) + ".tsv";
+                    if (access(result.c_str(), F_OK) == 0)
+                    {
+                        // Finished by a worker whose lease had expired.
+                        unlink(from.c_str());
+                        continue;
+                    }
+                    if (std::rename(from.c_str(), lease.c_str()) != 0)
+                    {
+                        continue;
+                    }
+                    // Rename keeps the old time, the lease counts from now.
+                    // If that fails, the lease expired meanwhile and was taken
+                    // back.
+                    if (utimes(lease.c_str(), nullptr) != 0)
+                    {
+                        continue;
+                    }
+
+                    const ManifestUnit& unit = units[file.unit];
+                    Heartbeat heartbeat(lease, _config.leaseSeconds);
+                    if (loaded.path != unit.module || !loaded.module)
+                    {
+                        loaded.emulator.reset();
+                        loaded.module.reset();
+                        loaded.context.reset(new LLVMContext);
+                        loaded.path = unit.module;
+                        SMDiagnostic err;
+                        loaded.module = ec.lazy
+                                ? getLazyIRFileModule(unit.module, err, *loaded.context)
+                                : parseIRFile(unit.module, err, *loaded.context);
+                        if (loaded.module)
+                        {
+                            loaded.emulator.reset(new LlvmIrEmulator(loaded.module.get(), ec.lazy));
+                            loaded.emulator->setJitEnabled(ec.jit);
+                            loaded.emulator->setTieringPolicy(ec.tiering);
+                        }
+                    }
+
+                    std::string data;
+                    for (auto& name : unit.functions)
+                    {
+                        Function* f = loaded.module ? loaded.module->getFunction(name) : nullptr;
+                        FunctionResult r;
+                        if (f == nullptr || f->isDeclaration())
+                        {
+                            r.functionName = name;
+                            r.failed = true;
+                            data += formatResult(r);
+                            continue;
+                        }
+
+                        SignatureCacheKey key;
+                        CachedSignature cs;
+                        if (ec.cache)
+                        {
+                            key = signatureCacheKey(f, ec);
+                        }
+                        if (ec.cache && ec.cache->lookup(key, cs))
+                        {
+                            r.functionName = name;
+                            r.signature = std::move(cs.signature);
+                            r.stats = cs.stats;
+                        }
+                        else
+                        {
+                            r = emulateFunction(*loaded.emulator, f, ec);
+                            if (ec.cache && !r.failed)
+                            {
+                                cs.signature = r.signature;
+                                cs.stats = r.stats;
+                                ec.cache->insert(key, cs);
+                            }
+                        }
+                        data += formatResult(r);
+                    }
+
+                    if (!writeFileAtomic(result, data, _config.workerId))
+                    {
+                        error = "can not write " + result;
+                        return false;
+                    }
+                    unlink(lease.c_str());
+                    ++_finished;
+                    claimed = true;
+                    // Pending units may have changed meanwhile.
+                    break;
+                }
+                if (!claimed)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(_config.pollMs));
+                }
+            }
+        }
+
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,118 @@
+/**
+ * @file shard_batch.h
+ * @brief Batch emulation sharded across processes and machines through
+ *        a shared directory.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_SHARD_BATCH_H
+#define RETDEC_LLVMIR_EMUL_SHARD_BATCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "batch_pipeline.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+/**
+ * Shared directory layout:
+ * - @c manifest.tsv -- one line per function: unit id, estimated cost,
+ *   module path, function name (tab separated). Functions of one unit
+ *   are consecutive and come from one module.
+ * - @c pending/<unit>.<attempt> -- unit waiting for a worker.
+ * - @c leased/<unit>.<attempt>.<worker> -- unit claimed by a worker. Its
+ *   modification time is the worker's heartbeat.
+ * - @c results/<unit>.tsv -- results of a finished unit, one line per
+ *   function: name, failed flag, 7 run stats, signature.
+ *
+ * Every state change is a @c rename(), which is atomic, so workers on any
+ * number of machines need nothing but the directory (and the modules at
+ * the same paths) -- exactly one claim of a pending unit succeeds, and
+ * a result file is either complete or missing.
+ */
+        struct ShardConfig
+        {
+            std::string directory;
+            /// Units are filled with functions of one module up to this
+            /// many IR instructions.
+            uint64_t unitCost = 50000;
+            /// Lease whose heartbeat is older is returned to pending.
+            unsigned leaseSeconds = 600;
+            /// Unit whose lease expired this many times fails as a whole.
+            unsigned maxAttempts = 3;
+            /// How often idle workers and the merging coordinator look for
+            /// expired leases and finished units.
+            unsigned pollMs = 500;
+            /// Unique among workers, defaults to host name and pid.
+            std::string workerId;
+            /// Emulation settings of workers.
+            BatchConfig emulation;
+        };
+
+        struct ShardStatus
+        {
+            std::size_t units = 0;
+            std::size_t pending = 0;
+            std::size_t leased = 0;
+            std::size_t finished = 0;
+        };
+
+/**
+ * Estimated cost of emulating @a f -- its IR instruction count.
+ */
+        uint64_t estimateCost(const llvm::Function* f);
+
+/**
+ * Plans the work and merges the results.
+ */
+        class ShardCoordinator
+        {
+        public:
+            explicit ShardCoordinator(const ShardConfig& config);
+
+/**
+ * Parses all the modules, writes the manifest and makes all units
+ * pending. The directory must not hold a manifest already.
+ */
+            bool plan(const std::vector<std::string>& modulePaths, std::string& error);
+
+            bool status(ShardStatus& status, std::string& error) const;
+
+/**
+ * Waits until all units are finished (returning expired leases to pending
+ * meanwhile) and passes results to @a sink in manifest order.
+ */
+            bool merge(BatchPipeline::Sink sink, std::string& error);
+
+        private:
+            ShardConfig _config;
+        };
+
+/**
+ * Claims pending units, the most expensive first, and emulates them. Units
+ * of the same module claimed in a row share one parsed module.
+ */
+        class ShardWorker
+        {
+        public:
+            explicit ShardWorker(const ShardConfig& config);
+
+/**
+ * Works until every unit is finished. While units are leased by others,
+ * the worker waits for them to finish or expire.
+ */
+            bool run(std::string& error);
+
+            std::size_t getFinishedUnits() const;
+
+        private:
+            ShardConfig _config;
+            std::size_t _finished = 0;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
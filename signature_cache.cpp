@@ -0,0 +1,793 @@
+/**
+ * @file signature_cache.cpp
+ * @brief Persistent content-addressed cache of emulation results.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+
+#include "signature_cache.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            const char DATA_MAGIC[8] = {'L', 'L', 'E', 'M', 'S', 'I', 'G', 'D'};
+            const char INDEX_MAGIC[8] = {'L', 'L', 'E', 'M', 'S', 'I', 'G', 'I'};
+            const uint32_t FORMAT_VERSION = 1;
+
+            struct FileHeader
+            {
+                char magic[8];
+                uint32_t version;
+                uint32_t reserved;
+            };
+
+            struct RecordHeader
+            {
+                uint64_t functionHash;
+                uint64_t seed;
+                uint64_t configHash;
+                uint32_t emulatorVersion;
+                uint32_t signatureSize;
+                uint64_t stats[7];
+            };
+
+            struct IndexEntry
+            {
+                uint64_t functionHash;
+                uint64_t seed;
+                uint64_t configHash;
+                uint32_t emulatorVersion;
+                uint32_t reserved;
+                uint64_t offset;
+            };
+
+            static_assert(sizeof(FileHeader) == 16, "unexpected padding");
+            static_assert(sizeof(RecordHeader) == 88, "unexpected padding");
+            static_assert(sizeof(IndexEntry) == 40, "unexpected padding");
+
+            uint64_t alignTo8(uint64_t v)
+            {
+                return (v + 7) & ~uint64_t(7);
+            }
+
+            uint64_t recordSize(uint32_t signatureSize)
+            {
+                return alignTo8(sizeof(RecordHeader) + signatureSize);
+            }
+
+            SignatureCacheKey keyOf(const RecordHeader& h)
+            {
+                SignatureCacheKey k;
+                k.functionHash = h.functionHash;
+                k.seed = h.seed;
+                k.configHash = h.configHash;
+                k.emulatorVersion = h.emulatorVersion;
+                return k;
+            }
+
+            void statsToArray(const RunStats& s, uint64_t* a)
+            {
+                a[0] = s.instructions;
+                a[1] = s.basicBlocks;
+                a[2] = s.calls;
+                a[3] = s.memoryLoads;
+                a[4] = s.memoryStores;
+                a[5] = s.globalLoads;
+                a[6] = s.globalStores;
+            }
+
+            RunStats statsFromArray(const uint64_t* a)
+            {
+                RunStats s;
+                s.instructions = a[0];
+                s.basicBlocks = a[1];
+                s.calls = a[2];
+                s.memoryLoads = a[3];
+                s.memoryStores = a[4];
+                s.globalLoads = a[5];
+                s.globalStores = a[6];
+                return s;
+            }
+
+            bool preadAll(int fd, void* buf, std::size_t size, uint64_t offset)
+            {
+                char* p = static_cast<char*>(buf);
+                while (size)
+                {
+                    ssize_t r = ::pread(fd, p, size, offset);
+                    if (r <= 0)
+                    {
+                        return false;
+                    }
+                    p += r;
+                    size -= r;
+                    offset += r;
+                }
+                return true;
+            }
+
+            bool pwriteAll(int fd, const void* buf, std::size_t size, uint64_t offset)
+            {
+                const char* p = static_cast<const char*>(buf);
+                while (size)
+                {
+                    ssize_t r = ::pwrite(fd, p, size, offset);
+                    if (r <= 0)
+                    {
+                        return false;
+                    }
+                    p += r;
+                    size -= r;
+                    offset += r;
+                }
+                return true;
+            }
+
+/**
+* Holds an @c flock() of a file while in scope.
+*/
+            class FileLock
+            {
+            public:
+                FileLock(int fd, int operation) :
+                        _fd(fd)
+                {
+                    while (flock(_fd, operation) != 0 && errno == EINTR)
+                    {
+                    }
+                }
+                ~FileLock()
+                {
+                    flock(_fd, LOCK_UN);
+                }
+                FileLock(const FileLock&) = delete;
+                FileLock& operator=(const FileLock&) = delete;
+
+            private:
+                int _fd;
+            };
+
+/**
+* Opens (or creates) a file starting with @c FileHeader with @a magic.
+* @return File descriptor, or -1 if file can not be used.
+*/
+            int openWithHeader(const std::string& path, const char* magic, uint64_t& size)
+            {
+                int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+                if (fd < 0)
+                {
+                    return -1;
+                }
+
+                struct stat st;
+                if (fstat(fd, &st) != 0)
+                {
+                    ::close(fd);
+                    return -1;
+                }
+
+                FileHeader h;
+                if (st.st_size == 0)
+                {
+                    memcpy(h.magic, magic, sizeof(h.magic));
+                    h.version = FORMAT_VERSION;
+                    h.reserved = 0;
+                    if (!pwriteAll(fd, &h, sizeof(h), 0))
+                    {
+                        ::close(fd);
+                        return -1;
+                    }
+                    size = sizeof(h);
+                    return fd;
+                }
+
+                if (uint64_t(st.st_size) < sizeof(h)
+                        || !preadAll(fd, &h, sizeof(h), 0)
+                        || memcmp(h.magic, magic, sizeof(h.magic)) != 0
+                        || h.version != FORMAT_VERSION)
+                {
+                    ::close(fd);
+                    return -1;
+                }
+
+                size = st.st_size;
+                return fd;
+            }
+
+//
+//=============================================================================
+// Structural hashing
+//=============================================================================
+//
+
+            uint64_t mix64(uint64_t v)
+            {
+                v ^= v >> 33;
+                v *= 0xff51afd7ed558ccdULL;
+                v ^= v >> 33;
+                v *= 0xc4ceb9fe1a85ec53ULL;
+                v ^= v >> 33;
+                return v;
+            }
+
+            uint64_t hashBytes(const char* data, std::size_t size)
+            {
+                uint64_t h = 0xcbf29ce484222325ULL;
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    h ^= static_cast<unsigned char>(data[i]);
+                    h *= 0x100000001b3ULL;
+                }
+                return h;
+            }
+
+            class StructuralHasher
+            {
+            public:
+                uint64_t hashFunction(const Function* f)
+                {
+                    _worklist.push_back(f);
+                    _queued.insert(f);
+                    while (!_worklist.empty())
+                    {
+                        const Function* fnc = _worklist.back();
+                        _worklist.pop_back();
+                        addFunction(fnc);
+                    }
+                    return _h;
+                }
+
+            private:
+                void add(uint64_t v)
+                {
+                    _h = (_h ^ mix64(v)) * 0x100000001b3ULL;
+                }
+
+                void addString(StringRef str)
+                {
+                    add(str.size());
+                    add(hashBytes(str.data(), str.size()));
+                }
+
+                void addType(Type* t, unsigned depth = 0)
+                {
+                    add(t->getTypeID());
+                    if (depth > 4)
+                    {
+                        return;
+                    }
+                    if (auto* it = dyn_cast<IntegerType>(t))
+                    {
+                        add(it->getBitWidth());
+                    }
+                    else if (auto* st = dyn_cast<StructType>(t))
+                    {
+                        if (st->hasName())
+                        {
+                            addString(st->getName());
+                        }
+                        add(st->getNumElements());
+                        for (auto eIt = st->element_begin(); eIt != st->element_end(); ++eIt)
+                        {
+                            addType(*eIt, depth + 1);
+                        }
+                    }
+                    else if (t->getNumContainedTypes())
+                    {
+                        if (auto* at = dyn_cast<ArrayType>(t))
+                        {
+                            add(at->getNumElements());
+                        }
+                        else if (auto* vt = dyn_cast<VectorType>(t))
+                        {
+                            add(vt->getNumElements());
+                        }
+                        for (unsigned i = 0; i < t->getNumContainedTypes(); ++i)
+                        {
+                            addType(t->getContainedType(i), depth + 1);
+                        }
+                    }
+                }
+
+                void addConstant(const Constant* c)
+                {
+                    addType(c->getType());
+                    add(c->getValueID());
+
+                    if (auto* ci = dyn_cast<ConstantInt>(c))
+                    {
+                        const APInt& v = ci->getValue();
+                        for (unsigned i = 0; i < v.getNumWords(); ++i)
+                        {
+                            add(v.getRawData()[i]);
+                        }
+                    }
+                    else if (auto* cf = dyn_cast<ConstantFP>(c))
+                    {
+                        APInt v = cf->getValueAPF().bitcastToAPInt();
+                        for (unsigned i = 0; i < v.getNumWords(); ++i)
+                        {
+                            add(v.getRawData()[i]);
+                        }
+                    }
+                    else if (auto* cds = dyn_cast<ConstantDataSequential>(c))
+                    {
+                        addString(cds->getRawDataValues());
+                    }
+                    else if (auto* gv = dyn_cast<GlobalVariable>(c))
+                    {
+                        addString(gv->getName());
+                        if (_globals.insert(gv).second && gv->hasInitializer())
+                        {
+                            addConstant(gv->getInitializer());
+                        }
+                    }
+                    else if (auto* fnc = dyn_cast<Function>(c))
+                    {
+                        addString(fnc->getName());
+                        if (!fnc->isDeclaration() && _queued.insert(fnc).second)
+                        {
+                            _worklist.push_back(fnc);
+                        }
+                    }
+                    else if (auto* ce = dyn_cast<ConstantExpr>(c))
+                    {
+                        add(ce->getOpcode());
+                        if (ce->isCompare())
+                        {
+                            add(ce->getPredicate());
+                        }
+                        for (const Use& op : ce->operands())
+                        {
+                            addConstant(cast<Constant>(op.get()));
+                        }
+                    }
+                    else
+                    {
+                        add(c->getNumOperands());
+                        for (const Use& op : c->operands())
+                        {
+                            if (auto* oc = dyn_cast<Constant>(op.get()))
+                            {
+                                addConstant(oc);
+                            }
+                        }
+                    }
+                }
+
+                void addOperand(const Value* v)
+                {
+                    auto fIt = _locals.find(v);
+                    if (fIt != _locals.end())
+                    {
+                        add(fIt->second);
+                    }
+                    else if (auto* c = dyn_cast<Constant>(v))
+                    {
+                        addConstant(c);
+                    }
+                    else
+                    {
+                        add(v->getValueID());
+                    }
+                    // Similarity string depends on operand names.
+                    addString(v->getName());
+                }
+
+                void addFunction(const Function* f)
+                {
+                    if (f->isMaterializable())
+                    {
+                        const_cast<Function*>(f)->materialize();
+                    }
+
+                    // Number locals first, PHIs may reference values defined
+                    // later in the function.
+                    _locals.clear();
+                    unsigned n = 0;
+                    for (auto aIt = f->arg_begin(); aIt != f->arg_end(); ++aIt)
+                    {
+                        _locals[&*aIt] = n++;
+                    }
+                    for (const BasicBlock& bb : *f)
+                    {
+                        _locals[&bb] = n++;
+                        for (const Instruction& i : bb)
+                        {
+                            _locals[&i] = n++;
+                        }
+                    }
+
+                    addString(f->getName());
+                    addType(f->getFunctionType());
+                    for (const BasicBlock& bb : *f)
+                    {
+                        add(bb.size());
+                        for (const Instruction& i : bb)
+                        {
+                            add(i.getOpcode());
+                            addType(i.getType());
+                            addString(i.getName());
+                            if (auto* cmp = dyn_cast<CmpInst>(&i))
+                            {
+                                add(cmp->getPredicate());
+                            }
+                            else if (auto* li = dyn_cast<LoadInst>(&i))
+                            {
+                                add(li->isVolatile());
+                            }
+                            else if (auto* si = dyn_cast<StoreInst>(&i))
+                            {
+                                add(si->isVolatile());
+                            }
+                            add(i.getNumOperands());
+                            for (const Use& op : i.operands())
+                            {
+                                addOperand(op.get());
+                            }
+                        }
+                    }
+                }
+
+            private:
+                uint64_t _h = 0xcbf29ce484222325ULL;
+                std::vector<const Function*> _worklist;
+                std::set<const Function*> _queued;
+                std::set<const GlobalVariable*> _globals;
+                DenseMap<const Value*, unsigned> _locals;
+            };
+
+        } // anonymous namespace
+
+        uint64_t functionStructuralHash(const llvm::Function* f)
+        {
+            StructuralHasher h;
+            return h.hashFunction(f);
+        }
+
+        uint64_t configurationHash(const std::string& config)
+        {
+            return mix64(hashBytes(config.data(), config.size()));
+        }
+
+        std::size_t SignatureCacheKeyHash::operator()(const SignatureCacheKey& k) const
+        {
+            uint64_t h = mix64(k.functionHash);
+            h = mix64(h ^ k.seed);
+            h = mix64(h ^ k.configHash);
+            h = mix64(h ^ k.emulatorVersion);
+            return static_cast<std::size_t>(h);
+        }
+
+//
+//=============================================================================
+// SignatureCache
+//=============================================================================
+//
+
+        SignatureCache::~SignatureCache()
+        {
+            close();
+        }
+
+/**
+* Any number of processes may use the cache at once. Files are created, cut
+* and appended to only under an exclusive lock of @c path.lock, so a process
+* opening the cache never takes another one's record in flight for a torn
+* one.
+*/
+        bool SignatureCache::open(const std::string& path)
+        {
+            close();
+            std::lock_guard<std::mutex> lock(_mutex);
+
+            _lockFd = ::open((path + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (_lockFd < 0)
+            {
+                return false;
+            }
+            FileLock fileLock(_lockFd, LOCK_EX);
+
+            uint64_t indexSize = 0;
+            _dataFd = openWithHeader(path, DATA_MAGIC, _dataSize);
+            _indexFd = openWithHeader(path + ".idx", INDEX_MAGIC, indexSize);
+            if (_dataFd < 0 || _indexFd < 0)
+            {
+                if (_dataFd >= 0) ::close(_dataFd);
+                if (_indexFd >= 0) ::close(_indexFd);
+                ::close(_lockFd);
+                _dataFd = _indexFd = _lockFd = -1;
+                return false;
+            }
+
+            if (_dataSize > sizeof(FileHeader))
+            {
+                void* m = mmap(nullptr, _dataSize, PROT_READ, MAP_SHARED, _dataFd, 0);
+                if (m != MAP_FAILED)
+                {
+                    _mapped = static_cast<const char*>(m);
+                    _mappedSize = _dataSize;
+                }
+            }
+
+            // A torn trailing index entry is ignored and overwritten.
+            uint64_t entries = (indexSize - sizeof(FileHeader)) / sizeof(IndexEntry);
+            if (ftruncate(_indexFd, sizeof(FileHeader) + entries * sizeof(IndexEntry)) != 0)
+            {
+                // Not fatal, next append just writes after the torn entry.
+            }
+            _indexSize = sizeof(FileHeader);
+            uint64_t lastIndexed = readIndex();
+
+            // Records are appended in order, so everything after the last
+            // indexed one may be missing from the index.
+            uint64_t indexedEnd = sizeof(FileHeader);
+            RecordHeader h;
+            if (lastIndexed && preadAll(_dataFd, &h, sizeof(h), lastIndexed))
+            {
+                indexedEnd = lastIndexed + recordSize(h.signatureSize);
+            }
+            recoverTail(indexedEnd);
+
+            return true;
+        }
+
+/**
+* Indexes entries of the index file after @c _indexSize, e.g. those other
+* processes appended since. The caller holds a lock of the files.
+* @return The highest offset indexed, @c 0 if there was none.
+*/
+        uint64_t SignatureCache::readIndex()
+        {
+            struct stat st;
+            if (fstat(_indexFd, &st) != 0 || uint64_t(st.st_size) <= _indexSize)
+            {
+                return 0;
+            }
+            uint64_t entries = (st.st_size - _indexSize) / sizeof(IndexEntry);
+            std::vector<IndexEntry> index(entries);
+            if (entries == 0 || !preadAll(
+                    _indexFd,
+                    index.data(),
+                    entries * sizeof(IndexEntry),
+                    _indexSize))
+            {
+                return 0;
+            }
+            _indexSize += entries * sizeof(IndexEntry);
+
+            if (fstat(_dataFd, &st) == 0)
+            {
+                _dataSize = std::max<uint64_t>(_dataSize, st.st_size);
+            }
+            uint64_t lastIndexed = 0;
+            for (auto& e : index)
+            {
+                if (e.offset + sizeof(RecordHeader) > _dataSize)
+                {
+                    continue;
+                }
+                SignatureCacheKey k;
+                k.functionHash = e.functionHash;
+                k.seed = e.seed;
+                k.configHash = e.configHash;
+                k.emulatorVersion = e.emulatorVersion;
+                _index[k] = e.offset;
+                lastIndexed = std::max(lastIndexed, e.offset);
+            }
+            return lastIndexed;
+        }
+
+        void SignatureCache::close()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            unmapData();
+            if (_dataFd >= 0)
+            {
+                ::close(_dataFd);
+            }
+            if (_indexFd >= 0)
+            {
+                ::close(_indexFd);
+            }
+            if (_lockFd >= 0)
+            {
+                ::close(_lockFd);
+            }
+            _dataFd = _indexFd = _lockFd = -1;
+            _dataSize = 0;
+            _indexSize = 0;
+            _index.clear();
+        }
+
+        bool SignatureCache::isOpen() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _dataFd >= 0;
+        }
+
+        std::size_t SignatureCache::size() const
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _index.size();
+        }
+
+        void SignatureCache::unmapData()
+        {
+            if (_mapped)
+            {
+                munmap(const_cast<char*>(_mapped), _mappedSize);
+            }
+            _mapped = nullptr;
+            _mappedSize = 0;
+        }
+
+/**
+* Indexes records after @a from that did not make it into the index file.
+* A torn record at the end of data file is cut off.
+*/
+        void SignatureCache::recoverTail(uint64_t from)
+        {
+            uint64_t off = std::max<uint64_t>(from, sizeof(FileHeader));
+            while (off + sizeof(RecordHeader) <= _dataSize)
+            {
+                RecordHeader h;
+                if (!preadAll(_dataFd, &h, sizeof(h), off)
+                        || off + recordSize(h.signatureSize) > _dataSize)
+                {
+                    break;
+                }
+                SignatureCacheKey k = keyOf(h);
+                _index[k] = off;
+                appendIndexEntry(k, off);
+                off += recordSize(h.signatureSize);
+            }
+
+            if (off < _dataSize && ftruncate(_dataFd, off) == 0)
+            {
+                _dataSize = off;
+            }
+        }
+
+        bool SignatureCache::appendIndexEntry(
+                const SignatureCacheKey& key,
+                uint64_t offset)
+        {
+            struct stat st;
+            if (fstat(_indexFd, &st) != 0)
+            {
+                return false;
+            }
+
+            IndexEntry e;
+            e.functionHash = key.functionHash;
+            e.seed = key.seed;
+            e.configHash = key.configHash;
+            e.emulatorVersion = key.emulatorVersion;
+            e.reserved = 0;
+            e.offset = offset;
+            if (!pwriteAll(_indexFd, &e, sizeof(e), st.st_size))
+            {
+                return false;
+            }
+            // Entries of other processes before this one are read on the
+            // next miss.
+            if (uint64_t(st.st_size) == _indexSize)
+            {
+                _indexSize += sizeof(e);
+            }
+            return true;
+        }
+
+        bool SignatureCache::readRecord(uint64_t offset, CachedSignature& result)
+        {
+            RecordHeader h;
+            if (offset + sizeof(h) <= _mappedSize)
+            {
+                memcpy(&h, _mapped + offset, sizeof(h));
+            }
+            else if (!preadAll(_dataFd, &h, sizeof(h), offset))
+            {
+                return false;
+            }
+
+            uint64_t sigOffset = offset + sizeof(h);
+            result.stats = statsFromArray(h.stats);
+            result.signature.resize(h.signatureSize);
+            if (sigOffset + h.signatureSize <= _mappedSize)
+            {
+                result.signature.assign(_mapped + sigOffset, h.signatureSize);
+                return true;
+            }
+            return h.signatureSize == 0 || preadAll(
+                    _dataFd,
+                    &result.signature[0],
+                    h.signatureSize,
+                    sigOffset);
+        }
+
+        bool SignatureCache::lookup(
+                const SignatureCacheKey& key,
+                CachedSignature& result)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto fIt = _index.find(key);
+            if (fIt == _index.end() && _indexFd >= 0)
+            {
+                // Another process may have inserted it since.
+                FileLock fileLock(_lockFd, LOCK_SH);
+                readIndex();
+                fIt = _index.find(key);
+            }
+            if (fIt == _index.end())
+            {
+                return false;
+            }
+            return readRecord(fIt->second, result);
+        }
+
+        bool SignatureCache::insert(
+                const SignatureCacheKey& key,
+                const CachedSignature& value)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_dataFd < 0)
+            {
+                return false;
+            }
+
+            RecordHeader h;
+            h.functionHash = key.functionHash;
+            h.seed = key.seed;
+            h.configHash = key.configHash;
+            h.emulatorVersion = key.emulatorVersion;
+            h.signatureSize = value.signature.size();
+            statsToArray(value.stats, h.stats);
+
+            std::vector<char> buf(recordSize(h.signatureSize), 0);
+            memcpy(buf.data(), &h, sizeof(h));
+            memcpy(buf.data() + sizeof(h), value.signature.data(), value.signature.size());
+
+            // Other processes may have appended since, the record goes to
+            // the real end of the file.
+            FileLock fileLock(_lockFd, LOCK_EX);
+            struct stat st;
+            if (fstat(_dataFd, &st) != 0)
+            {
+                return false;
+            }
+            uint64_t offset = st.st_size;
+            if (!pwriteAll(_dataFd, buf.data(), buf.size(), offset))
+            {
+                return false;
+            }
+            _dataSize = offset + buf.size();
+            _index[key] = offset;
+
+            // If this fails, the record is recovered on next open.
+            appendIndexEntry(key, offset);
+            return true;
+        }
+
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,134 @@
+/**
+ * @file signature_cache.h
+ * @brief Persistent content-addressed cache of emulation results.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_SIGNATURE_CACHE_H
+#define RETDEC_LLVMIR_EMUL_SIGNATURE_CACHE_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <llvm/IR/Function.h>
+
+#include "llvmir-emul.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+/**
+ * Hash of everything in the module that influences emulation of @a f:
+ * its instructions, operand names (similarity string depends on them),
+ * constants, initializers of referenced globals and, transitively, the
+ * bodies of defined functions it calls.
+ * Two functions with the same hash produce the same similarity string for
+ * the same inputs.
+ */
+        uint64_t functionStructuralHash(const llvm::Function* f);
+
+/**
+ * Hashes an arbitrary configuration string (command line flags, ...) into
+ * a value usable in @c SignatureCacheKey.
+ */
+        uint64_t configurationHash(const std::string& config);
+
+/**
+ * Identity of one emulation result. All the parts are stored in the cache,
+ * so there are no false hits on a hash collision of the key itself.
+ */
+        struct SignatureCacheKey
+        {
+            uint64_t functionHash = 0;
+            uint64_t seed = 0;
+            uint64_t configHash = 0;
+            uint32_t emulatorVersion = EMULATOR_VERSION;
+
+            bool operator==(const SignatureCacheKey& o) const
+            {
+                return functionHash == o.functionHash
+                        && seed == o.seed
+                        && configHash == o.configHash
+                        && emulatorVersion == o.emulatorVersion;
+            }
+        };
+
+        struct SignatureCacheKeyHash
+        {
+            std::size_t operator()(const SignatureCacheKey& k) const;
+        };
+
+        struct CachedSignature
+        {
+            std::string signature;
+            RunStats stats;
+        };
+
+/**
+ * On-disk cache of similarity signatures.
+ *
+ * Data live in two append-only files:
+ * - @c path holds records (key, run stats, signature bytes), each aligned to
+ *   8 bytes so that the file can be used through @c mmap directly.
+ * - @c path.idx holds fixed-width (key, offset) entries pointing to records.
+ *
+ * Opening the cache reads only the index. If the process died between the
+ * two appends, records missing from the index are recovered by scanning the
+ * data file tail. Records are never rewritten -- inserting an existing key
+ * again just makes the index point to the newer record.
+ *
+ * All the methods are thread safe, and any number of processes may use the
+ * same files at once: they are appended to under an @c flock() of
+ * @c path.lock, and records other processes inserted are found by lookups.
+ */
+        class SignatureCache
+        {
+        public:
+            SignatureCache() = default;
+            SignatureCache(const SignatureCache&) = delete;
+            SignatureCache& operator=(const SignatureCache&) = delete;
+            ~SignatureCache();
+
+            bool open(const std::string& path);
+            void close();
+            bool isOpen() const;
+
+            bool lookup(const SignatureCacheKey& key, CachedSignature& result);
+            bool insert(const SignatureCacheKey& key, const CachedSignature& value);
+
+            std::size_t size() const;
+
+        private:
+            bool readRecord(uint64_t offset, CachedSignature& result);
+            uint64_t readIndex();
+            void recoverTail(uint64_t from);
+            bool appendIndexEntry(const SignatureCacheKey& key, uint64_t offset);
+            void unmapData();
+
+        private:
+            mutable std::mutex _mutex;
+
+            int _dataFd = -1;
+            int _indexFd = -1;
+            int _lockFd = -1;
+
+            /// Data file as it was mapped on open. Records appended later
+            /// are read with @c pread().
+            const char* _mapped = nullptr;
+            uint64_t _mappedSize = 0;
+            /// End of the data file as last seen.
+            uint64_t _dataSize = 0;
+            /// Bytes of the index file read into @c _index.
+            uint64_t _indexSize = 0;
+
+            std::unordered_map<
+                    SignatureCacheKey,
+                    uint64_t,
+                    SignatureCacheKeyHash> _index;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
@@ -0,0 +1,503 @@
+/**
+ * @file signature_corpus.cpp
+ * @brief Binary, memory-mappable corpus of emulation signatures.
+ */
+
+#include <cstring>
+
+#include <unistd.h>
+
+#include "signature_corpus.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            const char CORPUS_MAGIC[8] = {'L', 'L', 'E', 'M', 'C', 'O', 'R', 'P'};
+            const uint32_t CORPUS_VERSION = 1;
+            const unsigned STATS_FIELDS = 7;
+
+            static_assert(sizeof(CorpusHeader) == 128, "unexpected padding");
+            static_assert(sizeof(CorpusEntry) == 24, "unexpected padding");
+
+            enum Column
+            {
+                ENTRIES = 0,
+                SKETCHES,
+                TOKENS,
+                STATS,
+                COLUMNS
+            };
+
+            const char* COLUMN_SUFFIX[COLUMNS] = {
+                    ".part.entries", ".part.sketches", ".part.tokens", ".part.stats"};
+
+            uint64_t alignTo8(uint64_t v)
+            {
+                return (v + 7) & ~uint64_t(7);
+            }
+
+            bool writeAll(std::FILE* f, const void* data, std::size_t size)
+            {
+                return size == 0 || std::fwrite(data, 1, size, f) == size;
+            }
+
+            bool pad(std::FILE* f, uint64_t& pos)
+            {
+                static const char zeros[8] = {};
+                uint64_t aligned = alignTo8(pos);
+                bool ok = writeAll(f, zeros, aligned - pos);
+                pos = aligned;
+                return ok;
+            }
+
+            bool copyColumn(std::FILE* from, std::FILE* to, uint64_t& pos)
+            {
+                if (std::fflush(from) != 0 || std::fseek(from, 0, SEEK_SET) != 0)
+                {
+                    return false;
+                }
+                char buf[1 << 16];
+                std::size_t n;
+                while ((n = std::fread(buf, 1, sizeof(buf), from)) > 0)
+                {
+                    if (!writeAll(to, buf, n))
+                    {
+                        return false;
+                    }
+                    pos += n;
+                }
+                return !std::ferror(from) && pad(to, pos);
+            }
+
+/**
+* Writes a string table: offsets relative to the table start, then the
+* NUL-terminated strings.
+*/
+            template<typename Get>
+            bool writeStringTable(std::FILE* f, uint64_t count, Get get, uint64_t& pos)
+            {
+                uint64_t offset = count * sizeof(uint64_t);
+                for (uint64_t i = 0; i < count; ++i)
+                {
+                    if (!writeAll(f, &offset, sizeof(offset)))
+                    {
+                        return false;
+                    }
+                    offset += get(i).size() + 1;
+                }
+                for (uint64_t i = 0; i < count; ++i)
+                {
+                    const std::string& s = get(i);
+                    if (!writeAll(f, s.c_str(), s.size() + 1))
+                    {
+                        return false;
+                    }
+                }
+                pos += offset;
+                return pad(f, pos);
+            }
+
+        } // anonymous namespace
+
+//
+//=============================================================================
+// CorpusWriter::Appender
+//=============================================================================
+//
+
+        CorpusWriter::Appender::Appender(CorpusWriter& writer) :
+                _writer(writer),
+                _hasher(writer._config)
+        {
+
+        }
+
+        CorpusWriter::Appender::~Appender()
+        {
+            flush();
+        }
+
+        void CorpusWriter::Appender::add(const FunctionResult& result)
+        {
+            add(result.modulePath,
+                    result.functionName,
+                    result.signature,
+                    result.stats,
+                    result.failed);
+        }
+
+/**
+* Sketches the signature right away -- that is the expensive part and it
+* runs in the calling thread, outside of the writer's lock.
+*/
+        void CorpusWriter::Appender::add(
+                const std::string& module,
+                const std::string& function,
+                const std::string& signature,
+                const RunStats& stats,
+                bool failed)
+        {
+            Record r;
+            r.module = module;
+            r.function = function;
+            r.signature = signature;
+            r.stats = stats;
+            r.failed = failed;
+            _records.push_back(std::move(r));
+
+            const unsigned n = _writer._config.numHashes;
+            _sketches.resize(_records.size() * n);
+            _hasher.sketch(signature, &_sketches[(_records.size() - 1) * n]);
+
+            if (_records.size() >= _writer._batchSize)
+            {
+                flush();
+            }
+        }
+
+        void CorpusWriter::Appender::flush()
+        {
+            if (!_records.empty())
+            {
+                _writer.append(_records, _sketches);
+                _records.clear();
+                _sketches.clear();
+            }
+        }
+
+//
+//=============================================================================
+// CorpusWriter
+//=============================================================================
+//
+
+        CorpusWriter::CorpusWriter(
+                const std::string& path,
+                const MinHashConfig& config,
+                std::size_t batchSize) :
+                _path(path),
+                _config(config),
+                _batchSize(batchSize ? batchSize : 1)
+        {
+            _ok = true;
+            for (unsigned c = 0; c < COLUMNS; ++c)
+            {
+                _columns[c] = std::fopen((_path + COLUMN_SUFFIX[c]).c_str(), "w+b");
+                _ok &= _columns[c] != nullptr;
+            }
+            if (!_ok)
+            {
+                cleanup();
+            }
+        }
+
+        CorpusWriter::~CorpusWriter()
+        {
+            cleanup();
+        }
+
+        bool CorpusWriter::isOpen() const
+        {
+            return _ok;
+        }
+
+        std::unique_ptr<CorpusWriter::Appender> CorpusWriter::makeAppender()
+        {
+            return std::unique_ptr<Appender>(new Appender(*this));
+        }
+
+        uint32_t CorpusWriter::internName(const std::string& name)
+        {
+            auto res = _nameIds.emplace(name, _names.size());
+            if (res.second)
+            {
+                _names.push_back(name);
+            }
+            return res.first->second;
+        }
+
+        void CorpusWriter::append(
+                std::vector<Appender::Record>& records,
+                const std::vector<uint32_t>& sketches)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_ok)
+            {
+                return;
+            }
+
+            for (auto& r : records)
+            {
+                TokenSequence tokens = _tokens.tokenize(r.signature);
+
+                CorpusEntry e;
+                e.module = internName(r.module);
+                e.function = internName(r.function);
+                e.tokenCount = tokens.size();
+                e.flags = r.failed ? CORPUS_ENTRY_FAILED : 0;
+                e.tokenOffset = _tokenCount;
+
+                uint64_t stats[STATS_FIELDS] = {
+                        r.stats.instructions,
+                        r.stats.basicBlocks,
+                        r.stats.calls,
+                        r.stats.memoryLoads,
+                        r.stats.memoryStores,
+                        r.stats.globalLoads,
+                        r.stats.globalStores};
+
+                _ok &= writeAll(_columns[ENTRIES], &e, sizeof(e));
+                _ok &= writeAll(_columns[TOKENS], tokens.data(), tokens.size() * sizeof(uint32_t));
+                _ok &= writeAll(_columns[STATS], stats, sizeof(stats));
+                _tokenCount += tokens.size();
+                ++_functions;
+            }
+            _ok &= writeAll(
+                    _columns[SKETCHES],
+                    sketches.data(),
+                    sketches.size() * sizeof(uint32_t));
+        }
+
+        bool CorpusWriter::finish()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!_ok)
+            {
+                cleanup();
+                return false;
+            }
+
+            std::string tmp = _path + ".tmp";
+            std::FILE* out = std::fopen(tmp.c_str(), "wb");
+            if (out == nullptr)
+            {
+                cleanup();
+                return false;
+            }
+
+            CorpusHeader h;
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, CORPUS_MAGIC, sizeof(h.magic));
+            h.version = CORPUS_VERSION;
+            h.numHashes = _config.numHashes;
+            h.bands = _config.bands;
+            h.shingle = _config.shingle;
+            h.minHashSeed = _config.seed;
+            h.functionCount = _functions;
+            h.nameCount = _names.size();
+            h.tokenStringCount = _tokens.size();
+            h.tokenCount = _tokenCount;
+
+            // Header is written twice -- now to reserve the space, and at
+            // the end with section offsets filled in.
+            uint64_t pos = sizeof(h);
+            bool ok = writeAll(out, &h, sizeof(h));
+
+            h.namesOffset = pos;
+            ok = ok && writeStringTable(out, _names.size(), [this](uint64_t i) -> const std::string& {
+                return _names[i];
+            }, pos);
+            h.tokenStringsOffset = pos;
+            ok = ok && writeStringTable(out, _tokens.size(), [this](uint64_t i) -> const std::string& {
+                return _tokens.getToken(i);
+            }, pos);
+            h.entriesOffset = pos;
+            ok = ok && copyColumn(_columns[ENTRIES], out, pos);
+            h.sketchesOffset = pos;
+            ok = ok && copyColumn(_columns[SKETCHES], out, pos);
+            h.tokensOffset = pos;
+            ok = ok && copyColumn(_columns[TOKENS], out, pos);
+            h.statsOffset = pos;
+            ok = ok && copyColumn(_columns[STATS], out, pos);
+            h.fileSize = pos;
+
+            ok = ok && std::fseek(out, 0, SEEK_SET) == 0 && writeAll(out, &h, sizeof(h));
+            ok = std::fflush(out) == 0 && ok;
+            ok = fsync(fileno(out)) == 0 && ok;
+            ok = std::fclose(out) == 0 && ok;
+            ok = ok && std::rename(tmp.c_str(), _path.c_str()) == 0;
+            if (!ok)
+            {
+                std::remove(tmp.c_str());
+            }
+
+            cleanup();
+            return ok;
+        }
+
+        void CorpusWriter::cleanup()
+        {
+            for (unsigned c = 0; c < COLUMNS; ++c)
+            {
+                if (_columns[c])
+                {
+                    std::fclose(_columns[c]);
+                    std::remove((_path + COLUMN_SUFFIX[c]).c_str());
+                    _columns[c] = nullptr;
+                }
+            }
+            _ok = false;
+        }
+
+//
+//=============================================================================
+// SignatureCorpus
+//=============================================================================
+//
+
+        bool SignatureCorpus::open(const std::string& path)
+        {
+            _header = nullptr;
+            _entries = nullptr;
+            if (!_file.open(path) || _file.size() < sizeof(CorpusHeader))
+            {
+                return false;
+            }
+
+            auto* h = reinterpret_cast<const CorpusHeader*>(_file.data());
+            uint64_t size = _file.size();
+            auto fits = [size](uint64_t offset, uint64_t count, uint64_t width) {
+                return offset <= size
+                        && (width == 0 || count <= (size - offset) / width);
+            };
+
+            bool ok = memcmp(h->magic, CORPUS_MAGIC, sizeof(h->magic)) == 0
+                    && h->version == CORPUS_VERSION
+                    && h->fileSize == size
+                    && fits(h->namesOffset, h->nameCount, sizeof(uint64_t))
+                    && fits(h->tokenStringsOffset, h->tokenStringCount, sizeof(uint64_t))
+                    && fits(h->entriesOffset, h->functionCount, sizeof(CorpusEntry))
+                    && fits(h->sketchesOffset, h->functionCount, uint64_t(h->numHashes) * sizeof(uint32_t))
+                    && fits(h->tokensOffset, h->tokenCount, sizeof(uint32_t))
+                    && fits(h->statsOffset, h->functionCount, STATS_FIELDS * sizeof(uint64_t));
+            if (!ok)
+            {
+                _file.close();
+                return false;
+            }
+
+            _header = h;
+            _entries = reinterpret_cast<const CorpusEntry*>(_file.data() + h->entriesOffset);
+            return true;
+        }
+
+        std::size_t SignatureCorpus::size() const
+        {
+            return _header ? _header->functionCount : 0;
+        }
+
+        MinHashConfig SignatureCorpus::getMinHashConfig() const
+        {
+            MinHashConfig c;
+            if (_header)
+            {
+                c.numHashes = _header->numHashes;
+                c.bands = _header->bands;
+                c.shingle = _header->shingle;
+                c.seed = _header->minHashSeed;
+            }
+            return c;
+        }
+
+/**
+* @return String @a id of the table at @a tableOffset, or an empty string
+*         if the id or its offset is out of bounds.
+*/
+        const char* SignatureCorpus::getString(
+                uint64_t tableOffset,
+                uint64_t count,
+                uint64_t id) const
+        {
+            if (id >= count)
+            {
+                return "";
+            }
+            const char* table = _file.data() + tableOffset;
+            uint64_t offset;
+            memcpy(&offset, table + id * sizeof(uint64_t), sizeof(offset));
+            if (offset >= _file.size() - tableOffset)
+            {
+                return "";
+            }
+            return table + offset;
+        }
+
+        const char* SignatureCorpus::getModuleName(std::size_t i) const
+        {
+            return getString(_header->namesOffset, _header->nameCount, _entries[i].module);
+        }
+
+        const char* SignatureCorpus::getFunctionName(std::size_t i) const
+        {
+            return getString(_header->namesOffset, _header->nameCount, _entries[i].function);
+        }
+
+        bool SignatureCorpus::isFailed(std::size_t i) const
+        {
+            return _entries[i].flags & CORPUS_ENTRY_FAILED;
+        }
+
+        SketchView SignatureCorpus::getSketches() const
+        {
+            SketchView v;
+            if (_header)
+            {
+                v.data = reinterpret_cast<const uint32_t*>(
+                        _file.data() + _header->sketchesOffset);
+                v.count = _header->functionCount;
+                v.numHashes = _header->numHashes;
+            }
+            return v;
+        }
+
+        const uint32_t* SignatureCorpus::getSketch(std::size_t i) const
+        {
+            return getSketches()[i];
+        }
+
+        const uint32_t* SignatureCorpus::getTokens(std::size_t i, std::size_t& count) const
+        {
+            const CorpusEntry& e = _entries[i];
+            if (e.tokenOffset > _header->tokenCount
+                    || e.tokenCount > _header->tokenCount - e.tokenOffset)
+            {
+                count = 0;
+                return nullptr;
+            }
+            count = e.tokenCount;
+            return reinterpret_cast<const uint32_t*>(_file.data() + _header->tokensOffset)
+                    + e.tokenOffset;
+        }
+
+        TokenSequence SignatureCorpus::getTokenSequence(std::size_t i) const
+        {
+            std::size_t count = 0;
+            const uint32_t* t = getTokens(i, count);
+            return TokenSequence(t, t + count);
+        }
+
+        const char* SignatureCorpus::getTokenString(uint32_t id) const
+        {
+            return getString(_header->tokenStringsOffset, _header->tokenStringCount, id);
+        }
+
+        RunStats SignatureCorpus::getRunStats(std::size_t i) const
+        {
+            uint64_t s[STATS_FIELDS];
+            memcpy(s,
+                    _file.data() + _header->statsOffset + i * sizeof(s),
+                    sizeof(s));
+            RunStats r;
+            r.instructions = s[0];
+            r.basicBlocks = s[1];
+            r.calls = s[2];
+            r.memoryLoads = s[3];
+            r.memoryStores = s[4];
+            r.globalLoads = s[5];
+            r.globalStores = s[6];
+            return r;
+        }
+
+    } // llvmir_emul
+} // retdec
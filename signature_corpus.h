@@ -0,0 +1,193 @@
+/**
+ * @file signature_corpus.h
+ * @brief Binary, memory-mappable corpus of emulation signatures.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_SIGNATURE_CORPUS_H
+#define RETDEC_LLVMIR_EMUL_SIGNATURE_CORPUS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "batch_pipeline.h"
+#include "mapped_file.h"
+#include "similarity_engine.h"
+#include "token_align.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+/**
+ * Corpus file layout. All sections start at 8-byte aligned offsets stored
+ * in the header, all numbers are little-endian:
+ * - header
+ * - name table: @c nameCount uint64 offsets, then NUL-terminated strings
+ * - token table: the same for token strings, indexed by token id
+ * - function entries: @c functionCount @c CorpusEntry
+ * - sketches: @c functionCount x @c numHashes uint32 (a @c SketchView)
+ * - tokens: token ids of all functions, @c CorpusEntry::tokenOffset
+ *   indexes into this array
+ * - run stats: @c functionCount x 7 uint64, in @c RunStats field order
+ */
+        struct CorpusHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t numHashes;
+            uint32_t bands;
+            uint32_t shingle;
+            uint64_t minHashSeed;
+            uint64_t functionCount;
+            uint64_t nameCount;
+            uint64_t tokenStringCount;
+            uint64_t tokenCount;
+            uint64_t namesOffset;
+            uint64_t tokenStringsOffset;
+            uint64_t entriesOffset;
+            uint64_t sketchesOffset;
+            uint64_t tokensOffset;
+            uint64_t statsOffset;
+            uint64_t fileSize;
+            uint64_t reserved;
+        };
+
+        struct CorpusEntry
+        {
+            uint32_t module;
+            uint32_t function;
+            uint32_t tokenCount;
+            uint32_t flags;
+            uint64_t tokenOffset;
+        };
+
+        const uint32_t CORPUS_ENTRY_FAILED = 1;
+
+/**
+ * Builds a corpus file. Functions are added through @c Appender objects --
+ * one per thread. An appender sketches signatures in its own thread and
+ * hands complete batches to the writer, which spills every column into
+ * its own temporary file. @c finish() concatenates the columns behind the
+ * header and atomically renames the result to the target path, so memory
+ * use does not grow with the corpus (except for the name and token
+ * dictionaries).
+ *
+ * Functions appear in the corpus in the order their batches were flushed.
+ */
+        class CorpusWriter
+        {
+        public:
+            class Appender
+            {
+            public:
+                ~Appender();
+
+                void add(const FunctionResult& result);
+                void add(
+                        const std::string& module,
+                        const std::string& function,
+                        const std::string& signature,
+                        const RunStats& stats,
+                        bool failed = false);
+                void flush();
+
+            private:
+                friend class CorpusWriter;
+                explicit Appender(CorpusWriter& writer);
+
+                struct Record
+                {
+                    std::string module;
+                    std::string function;
+                    std::string signature;
+                    RunStats stats;
+                    bool failed = false;
+                };
+
+            private:
+                CorpusWriter& _writer;
+                MinHasher _hasher;
+                std::vector<Record> _records;
+                std::vector<uint32_t> _sketches;
+            };
+
+        public:
+            CorpusWriter(
+                    const std::string& path,
+                    const MinHashConfig& config = MinHashConfig(),
+                    std::size_t batchSize = 256);
+            CorpusWriter(const CorpusWriter&) = delete;
+            CorpusWriter& operator=(const CorpusWriter&) = delete;
+            ~CorpusWriter();
+
+            bool isOpen() const;
+            std::unique_ptr<Appender> makeAppender();
+
+/**
+ * Writes the corpus. All appenders must be flushed or destroyed before.
+ */
+            bool finish();
+
+        private:
+            void append(
+                    std::vector<Appender::Record>& records,
+                    const std::vector<uint32_t>& sketches);
+            uint32_t internName(const std::string& name);
+            void cleanup();
+
+        private:
+            std::string _path;
+            MinHashConfig _config;
+            std::size_t _batchSize;
+
+            std::mutex _mutex;
+            bool _ok = false;
+            std::unordered_map<std::string, uint32_t> _nameIds;
+            std::vector<std::string> _names;
+            TokenInterner _tokens;
+            uint64_t _functions = 0;
+            uint64_t _tokenCount = 0;
+
+            /// Column spill files: entries, sketches, tokens, stats.
+            std::FILE* _columns[4] = {nullptr, nullptr, nullptr, nullptr};
+        };
+
+/**
+ * Zero-copy reader. Opening validates the header and section bounds and
+ * maps the file; all accessors point into the mapping.
+ */
+        class SignatureCorpus
+        {
+        public:
+            bool open(const std::string& path);
+
+            std::size_t size() const;
+            MinHashConfig getMinHashConfig() const;
+
+            const char* getModuleName(std::size_t i) const;
+            const char* getFunctionName(std::size_t i) const;
+            bool isFailed(std::size_t i) const;
+            SketchView getSketches() const;
+            const uint32_t* getSketch(std::size_t i) const;
+            const uint32_t* getTokens(std::size_t i, std::size_t& count) const;
+            TokenSequence getTokenSequence(std::size_t i) const;
+            const char* getTokenString(uint32_t id) const;
+            RunStats getRunStats(std::size_t i) const;
+
+        private:
+            const char* getString(uint64_t tableOffset, uint64_t count, uint64_t id) const;
+
+        private:
+            MappedFile _file;
+            const CorpusHeader* _header = nullptr;
+            const CorpusEntry* _entries = nullptr;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
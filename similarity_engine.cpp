@@ -0,0 +1,441 @@
+/**
+ * @file similarity_engine.cpp
+ * @brief MinHash sketches and LSH search over similarity strings.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+#include "parallel_for.h"
+#include "similarity_engine.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            const char SKETCH_MAGIC[8] = {'L', 'L', 'E', 'M', 'S', 'K', 'C', 'H'};
+            const uint32_t SKETCH_VERSION = 1;
+
+            struct SketchFileHeader
+            {
+                char magic[8];
+                uint32_t version;
+                uint32_t numHashes;
+                uint64_t count;
+                uint64_t seed;
+            };
+
+            static_assert(sizeof(SketchFileHeader) == 32, "unexpected padding");
+
+            uint64_t mix64(uint64_t x)
+            {
+                x ^= x >> 33;
+                x *= 0xff51afd7ed558ccdULL;
+                x ^= x >> 33;
+                x *= 0xc4ceb9fe1a85ec53ULL;
+                x ^= x >> 33;
+                return x;
+            }
+
+            uint64_t hashToken(const char* b, const char* e)
+            {
+                // FNV-1a, finalized with mix64 for better low bits.
+                uint64_t h = 0xcbf29ce484222325ULL;
+                for (; b != e; ++b)
+                {
+                    h ^= static_cast<unsigned char>(*b);
+                    h *= 0x100000001b3ULL;
+                }
+                return mix64(h);
+            }
+
+            bool isEmptySketch(const uint32_t* s, unsigned n)
+            {
+                for (unsigned i = 0; i < n; ++i)
+                {
+                    if (s[i] != EMPTY_SKETCH_VALUE)
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+        } // anonymous namespace
+
+//
+//=============================================================================
+// MinHasher
+//=============================================================================
+//
+
+        MinHasher::MinHasher(const MinHashConfig& config) :
+                _config(config)
+        {
+            if (_config.shingle == 0)
+            {
+                _config.shingle = 1;
+            }
+            for (unsigned i = 0; i < _config.numHashes; ++i)
+            {
+                _salts.push_back(mix64(_config.seed + i * 0x9e3779b97f4a7c15ULL));
+            }
+        }
+
+        bool MinHasher::sketch(const std::string& signature, uint32_t* out) const
+        {
+            const unsigned n = _config.numHashes;
+            std::fill(out, out + n, EMPTY_SKETCH_VALUE);
+
+            // Hashes of the last `shingle` tokens, as a ring.
+            std::vector<uint64_t> window(_config.shingle, 0);
+            std::size_t tokens = 0;
+            bool any = false;
+
+            const char* p = signature.data();
+            const char* end = p + signature.size();
+            while (p < end)
+            {
+                const char* e = static_cast<const char*>(
+                        memchr(p, ';', end - p));
+                if (e == nullptr)
+                {
+                    e = end;
+                }
+                if (e != p)
+                {
+                    window[tokens % _config.shingle] = hashToken(p, e);
+                    ++tokens;
+                    if (tokens >= _config.shingle)
+                    {
+                        // Combine the window in sequence order.
+                        uint64_t sh = 0;
+                        for (unsigned k = 0; k < _config.shingle; ++k)
+                        {
+                            sh = mix64(sh ^ window[(tokens + k) % _config.shingle]);
+                        }
+                        for (unsigned i = 0; i < n; ++i)
+                        {
+                            uint32_t v = static_cast<uint32_t>(mix64(sh ^ _salts[i]));
+                            // Keep EMPTY_SKETCH_VALUE reserved.
+                            v = std::min(v, EMPTY_SKETCH_VALUE - 1);
+                            out[i] = std::min(out[i], v);
+                        }
+                        any = true;
+                    }
+                }
+                p = e + 1;
+            }
+
+            // Signatures shorter than a shingle are sketched from the
+            // tokens they have.
+            if (!any && tokens > 0)
+            {
+                uint64_t sh = 0;
+                for (std::size_t k = 0; k < tokens; ++k)
+                {
+                    sh = mix64(sh ^ window[k]);
+                }
+                for (unsigned i = 0; i < n; ++i)
+                {
+                    out[i] = std::min(
+                            static_cast<uint32_t>(mix64(sh ^ _salts[i])),
+                            EMPTY_SKETCH_VALUE - 1);
+                }
+                any = true;
+            }
+            return any;
+        }
+
+        std::vector<uint32_t> MinHasher::sketch(const std::string& signature) const
+        {
+            std::vector<uint32_t> ret(_config.numHashes);
+            sketch(signature, ret.data());
+            return ret;
+        }
+
+        const MinHashConfig& MinHasher::getConfig() const
+        {
+            return _config;
+        }
+
+        double sketchSimilarity(
+                const uint32_t* a,
+                const uint32_t* b,
+                unsigned numHashes)
+        {
+            if (numHashes == 0)
+            {
+                return 0.0;
+            }
+            unsigned eq = 0;
+            for (unsigned i = 0; i < numHashes; ++i)
+            {
+                eq += a[i] == b[i];
+            }
+            return double(eq) / numHashes;
+        }
+
+//
+//=============================================================================
+// SketchFile
+//=============================================================================
+//
+
+        bool SketchFile::write(
+                const std::string& path,
+                const SketchView& sketches,
+                uint64_t seed)
+        {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            if (!out)
+            {
+                return false;
+            }
+
+            SketchFileHeader h;
+            memcpy(h.magic, SKETCH_MAGIC, sizeof(h.magic));
+            h.version = SKETCH_VERSION;
+            h.numHashes = sketches.numHashes;
+            h.count = sketches.count;
+            h.seed = seed;
+            out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            out.write(
+                    reinterpret_cast<const char*>(sketches.data),
+                    sketches.count * sketches.numHashes * sizeof(uint32_t));
+            return bool(out.flush());
+        }
+
+        bool SketchFile::open(const std::string& path)
+        {
+            _view = SketchView();
+            if (!_file.open(path) || _file.size() < sizeof(SketchFileHeader))
+            {
+                return false;
+            }
+
+            SketchFileHeader h;
+            memcpy(&h, _file.data(), sizeof(h));
+            if (memcmp(h.magic, SKETCH_MAGIC, sizeof(h.magic)) != 0
+                    || h.version != SKETCH_VERSION
+                    || h.numHashes == 0
+                    || (_file.size() - sizeof(h)) / (h.numHashes * sizeof(uint32_t)) < h.count)
+            {
+                _file.close();
+                return false;
+            }
+
+            _view.data = reinterpret_cast<const uint32_t*>(_file.data() + sizeof(h));
+            _view.count = h.count;
+            _view.numHashes = h.numHashes;
+            _seed = h.seed;
+            return true;
+        }
+
+        SketchView SketchFile::getSketches() const
+        {
+            return _view;
+        }
+
+        uint64_t SketchFile::getSeed() const
+        {
+            return _seed;
+        }
+
+//
+//=============================================================================
+// SimilarityEngine
+//=============================================================================
+//
+
+        SimilarityEngine::SimilarityEngine(
+                const MinHashConfig& config,
+                unsigned threads) :
+                _config(config),
+                _threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency()))
+        {
+            if (_config.bands == 0 || _config.bands > _config.numHashes)
+            {
+                _config.bands = std::max(1u, _config.numHashes);
+            }
+            _rows = _config.numHashes / _config.bands;
+        }
+
+        uint64_t SimilarityEngine::bandHash(const uint32_t* sketch, unsigned band) const
+        {
+            uint64_t h = mix64(band + 1);
+            const uint32_t* r = sketch + band * _rows;
+            for (unsigned i = 0; i < _rows; ++i)
+            {
+                h = mix64(h ^ r[i]);
+            }
+            return h;
+        }
+
+        bool SimilarityEngine::build(const SketchView& sketches)
+        {
+            _bands.assign(_config.bands, std::vector<Entry>());
+            if (sketches.numHashes != _config.numHashes)
+            {
+                _sketches = SketchView();
+                return false;
+            }
+            _sketches = sketches;
+
+            // Bands are independent, build them in parallel.
+            parallelFor(_config.bands, std::min(_threads, _config.bands),
+                    [this](std::size_t b, std::size_t e)
+            {
+                for (std::size_t band = b; band < e; ++band)
+                {
+                    auto& entries = _bands[band];
+                    entries.reserve(_sketches.count);
+                    for (std::size_t i = 0; i < _sketches.count; ++i)
+                    {
+                        const uint32_t* s = _sketches[i];
+                        if (!isEmptySketch(s, _config.numHashes))
+                        {
+                            entries.push_back({bandHash(s, band), uint32_t(i)});
+                        }
+                    }
+                    std::sort(entries.begin(), entries.end());
+                }
+            });
+            return true;
+        }
+
+        void SimilarityEngine::candidates(
+                const uint32_t* sketch,
+                std::size_t maxBucket,
+                std::vector<uint32_t>& out) const
+        {
+            out.clear();
+            for (unsigned band = 0; band < _bands.size(); ++band)
+            {
+                auto& entries = _bands[band];
+                uint64_t h = bandHash(sketch, band);
+                auto b = std::lower_bound(entries.begin(), entries.end(), Entry{h, 0});
+                auto e = b;
+                while (e != entries.end() && e->hash == h)
+                {
+                    ++e;
+                }
+                if (std::size_t(e - b) > maxBucket)
+                {
+                    continue;
+                }
+                for (; b != e; ++b)
+                {
+                    out.push_back(b->item);
+                }
+            }
+            std::sort(out.begin(), out.end());
+            out.erase(std::unique(out.begin(), out.end()), out.end());
+        }
+
+        std::vector<SimilarPair> SimilarityEngine::allPairsAbove(
+                double threshold,
+                std::size_t maxBucket) const
+        {
+            std::mutex mutex;
+            std::vector<SimilarPair> ret;
+            const unsigned n = _config.numHashes;
+
+            parallelFor(_sketches.count, _threads,
+                    [&](std::size_t b, std::size_t e)
+            {
+                std::vector<uint32_t> cands;
+                std::vector<SimilarPair> local;
+                for (std::size_t i = b; i < e; ++i)
+                {
+                    const uint32_t* s = _sketches[i];
+                    if (isEmptySketch(s, n))
+                    {
+                        continue;
+                    }
+                    candidates(s, maxBucket, cands);
+                    // Candidates are sorted, report every pair from its
+                    // smaller item only.
+                    auto cIt = std::upper_bound(cands.begin(), cands.end(), uint32_t(i));
+                    for (; cIt != cands.end(); ++cIt)
+                    {
+                        double sim = sketchSimilarity(s, _sketches[*cIt], n);
+                        if (sim >= threshold)
+                        {
+                            local.push_back({uint32_t(i), *cIt, sim});
+                        }
+                    }
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                ret.insert(ret.end(), local.begin(), local.end());
+            });
+
+            std::sort(ret.begin(), ret.end(), [](const SimilarPair& x, const SimilarPair& y) {
+                return x.a != y.a ? x.a < y.a : x.b < y.b;
+            });
+            return ret;
+        }
+
+        std::vector<SimilarItem> SimilarityEngine::topK(
+                const uint32_t* query,
+                std::size_t k,
+                uint32_t exclude) const
+        {
+            std::vector<SimilarItem> ret;
+            if (k == 0 || isEmptySketch(query, _config.numHashes))
+            {
+                return ret;
+            }
+
+            std::vector<uint32_t> cands;
+            candidates(query, std::numeric_limits<std::size_t>::max(), cands);
+            for (uint32_t c : cands)
+            {
+                if (c != exclude)
+                {
+                    ret.push_back({c, sketchSimilarity(query, _sketches[c], _config.numHashes)});
+                }
+            }
+
+            auto better = [](const SimilarItem& x, const SimilarItem& y) {
+                return x.similarity != y.similarity
+                        ? x.similarity > y.similarity
+                        : x.item < y.item;
+            };
+            if (ret.size() > k)
+            {
+                std::partial_sort(ret.begin(), ret.begin() + k, ret.end(), better);
+                ret.resize(k);
+            }
+            else
+            {
+                std::sort(ret.begin(), ret.end(), better);
+            }
+            return ret;
+        }
+
+        std::vector<std::vector<SimilarItem>> SimilarityEngine::topKBatch(
+                const SketchView& queries,
+                std::size_t k) const
+        {
+            std::vector<std::vector<SimilarItem>> ret(queries.count);
+            if (queries.numHashes != _config.numHashes)
+            {
+                return ret;
+            }
+            parallelFor(queries.count, _threads, [&](std::size_t b, std::size_t e)
+            {
+                for (std::size_t i = b; i < e; ++i)
+                {
+                    ret[i] = topK(queries[i], k);
+                }
+            });
+            return ret;
+        }
+
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,192 @@
+/**
+ * @file similarity_engine.h
+ * @brief MinHash sketches and LSH search over similarity strings.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_SIMILARITY_ENGINE_H
+#define RETDEC_LLVMIR_EMUL_SIMILARITY_ENGINE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        struct MinHashConfig
+        {
+            /// Sketch width. Must be a multiple of @c bands.
+            unsigned numHashes = 128;
+            /// LSH bands, each made of @c numHashes / @c bands rows. With
+            /// @c b bands of @c r rows, pairs of similarity @c s become
+            /// candidates with probability 1 - (1 - s^r)^b.
+            unsigned bands = 32;
+            /// Tokens per shingle. Similarity strings are sequences, so
+            /// shingles longer than one keep some of the order.
+            unsigned shingle = 2;
+            uint64_t seed = 0x5eed;
+        };
+
+/**
+ * Turns similarity strings (tokens separated by @c ';') into MinHash
+ * sketches of their shingle sets. Sketch values are truncated to 32 bits.
+ */
+        class MinHasher
+        {
+        public:
+            explicit MinHasher(const MinHashConfig& config);
+
+/**
+ * Writes @c numHashes values to @a out.
+ * @return @c false if @a signature has no tokens. The sketch is then all
+ *         @c EMPTY_SKETCH_VALUE and such items are never indexed.
+ */
+            bool sketch(const std::string& signature, uint32_t* out) const;
+            std::vector<uint32_t> sketch(const std::string& signature) const;
+
+            const MinHashConfig& getConfig() const;
+
+        private:
+            MinHashConfig _config;
+            std::vector<uint64_t> _salts;
+        };
+
+        const uint32_t EMPTY_SKETCH_VALUE = 0xffffffff;
+
+/**
+ * Fraction of equal positions -- estimate of Jaccard similarity.
+ */
+        double sketchSimilarity(
+                const uint32_t* a,
+                const uint32_t* b,
+                unsigned numHashes);
+
+/**
+ * Non-owning view of @c count sketches stored one after another.
+ */
+        struct SketchView
+        {
+            const uint32_t* data = nullptr;
+            std::size_t count = 0;
+            unsigned numHashes = 0;
+
+            const uint32_t* operator[](std::size_t i) const
+            {
+                return data + i * numHashes;
+            }
+        };
+
+/**
+ * File of sketches for @c SimilarityEngine. Layout: 32-byte header (magic
+ * @c LLEMSKCH, version, numHashes, count, MinHash seed), then @c count
+ * sketches of @c numHashes little-endian @c uint32_t values. Opening maps
+ * the file, the sketches are used in place.
+ */
+        class SketchFile
+        {
+        public:
+            static bool write(
+                    const std::string& path,
+                    const SketchView& sketches,
+                    uint64_t seed);
+
+            bool open(const std::string& path);
+            SketchView getSketches() const;
+            uint64_t getSeed() const;
+
+        private:
+            MappedFile _file;
+            SketchView _view;
+            uint64_t _seed = 0;
+        };
+
+        struct SimilarPair
+        {
+            uint32_t a = 0;
+            uint32_t b = 0;
+            double similarity = 0.0;
+        };
+
+        struct SimilarItem
+        {
+            uint32_t item = 0;
+            double similarity = 0.0;
+        };
+
+/**
+ * Banded LSH index over a set of sketches. Items are identified by their
+ * position in the indexed @c SketchView, which must outlive the engine.
+ *
+ * Every band is a sorted array of (band hash, item) pairs, so a lookup is
+ * a binary search and a bucket is a contiguous run. Searches only score
+ * candidates sharing at least one bucket, which is what makes them
+ * sub-quadratic -- and approximate: pairs that share no bucket are missed.
+ */
+        class SimilarityEngine
+        {
+        public:
+            SimilarityEngine(const MinHashConfig& config, unsigned threads = 0);
+
+/**
+ * Indexes @a sketches.
+ * @return @c False if they have a different number of hashes than the
+ *         config of the engine -- nothing is indexed then.
+ */
+            bool build(const SketchView& sketches);
+
+/**
+ * All pairs (a < b) whose estimated similarity is at least @a threshold,
+ * sorted by @c a and @c b.
+ * @param maxBucket Buckets bigger than this are not expanded into
+ *        pairs -- they are typically made of trivial functions and would
+ *        make the search quadratic again.
+ */
+            std::vector<SimilarPair> allPairsAbove(
+                    double threshold,
+                    std::size_t maxBucket = 1000) const;
+
+/**
+ * Up to @a k most similar items to @a query, best first.
+ * @param exclude Item not to report (e.g. the query itself).
+ */
+            std::vector<SimilarItem> topK(
+                    const uint32_t* query,
+                    std::size_t k,
+                    uint32_t exclude = UINT32_MAX) const;
+
+            std::vector<std::vector<SimilarItem>> topKBatch(
+                    const SketchView& queries,
+                    std::size_t k) const;
+
+        private:
+            struct Entry
+            {
+                uint64_t hash;
+                uint32_t item;
+
+                bool operator<(const Entry& o) const
+                {
+                    return hash != o.hash ? hash < o.hash : item < o.item;
+                }
+            };
+
+            uint64_t bandHash(const uint32_t* sketch, unsigned band) const;
+            void candidates(
+                    const uint32_t* sketch,
+                    std::size_t maxBucket,
+                    std::vector<uint32_t>& out) const;
+
+        private:
+            MinHashConfig _config;
+            unsigned _rows;
+            unsigned _threads;
+            SketchView _sketches;
+            std::vector<std::vector<Entry>> _bands;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif
@@ -0,0 +1,169 @@
+/**
+ * @file stable_signature.cpp
+ * @brief Signatures of features that are stable across emulation seeds.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+
+#include "batch_pipeline.h"
+#include "parallel_for.h"
+#include "stable_signature.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            struct FeatureCount
+            {
+                std::size_t token = 0;
+                uint32_t occurrence = 0;
+                unsigned runs = 0;
+            };
+
+/**
+* Features are numbered in the order they are first seen -- the order of
+* the first successful run, followed by features new in each later run.
+*/
+            StableSignatureResult combineRuns(
+                    const std::vector<FunctionResult>& runs,
+                    const StabilityConfig& config)
+            {
+                StableSignatureResult res;
+
+                std::vector<std::string> tokens;
+                std::unordered_map<std::string, std::size_t> tokenIds;
+                // Feature ids by token id and occurrence.
+                std::vector<std::vector<std::size_t>> featureIds;
+                std::vector<FeatureCount> features;
+                // Occurrences of every token in the current run.
+                std::vector<uint32_t> occurrences;
+
+                for (auto& r : runs)
+                {
+                    ++res.runs;
+                    if (r.failed)
+                    {
+                        ++res.failedRuns;
+                        continue;
+                    }
+                    if (res.runs - res.failedRuns == 1)
+                    {
+                        res.stats = r.stats;
+                    }
+
+                    occurrences.assign(tokens.size(), 0);
+                    const std::string& sig = r.signature;
+                    std::size_t begin = 0;
+                    while (begin < sig.size())
+                    {
+                        std::size_t end = sig.find(';', begin);
+                        if (end == std::string::npos)
+                        {
+                            end = sig.size();
+                        }
+                        auto ins = tokenIds.emplace(sig.substr(begin, end - begin), tokens.size());
+                        if (ins.second)
+                        {
+                            tokens.push_back(ins.first->first);
+                            featureIds.emplace_back();
+                            occurrences.push_back(0);
+                        }
+                        std::size_t token = ins.first->second;
+                        uint32_t occurrence = occurrences[token]++;
+
+                        auto& ids = featureIds[token];
+                        if (occurrence == ids.size())
+                        {
+                            ids.push_back(features.size());
+                            FeatureCount fc;
+                            fc.token = token;
+                            fc.occurrence = occurrence;
+                            features.push_back(fc);
+                        }
+                        ++features[ids[occurrence]].runs;
+                        begin = end + 1;
+                    }
+                }
+
+                res.featuresSeen = features.size();
+                unsigned ok = res.runs - res.failedRuns;
+                if (ok == 0)
+                {
+                    return res;
+                }
+                for (auto& fc : features)
+                {
+                    double weight = double(fc.runs) / ok;
+                    if (weight < config.threshold)
+                    {
+                        continue;
+                    }
+                    StableFeature sf;
+                    sf.token = tokens[fc.token];
+                    sf.occurrence = fc.occurrence;
+                    sf.weight = weight;
+                    res.signature += sf.token + ";";
+                    res.features.push_back(std::move(sf));
+                }
+                return res;
+            }
+
+        } // anonymous namespace
+
+        StableSignatureResult stableSignature(
+                LlvmIrEmulator& emu,
+                llvm::Function* f,
+                const StabilityConfig& config)
+        {
+            std::vector<FunctionResult> runs;
+            for (unsigned k = 0; k < config.seeds; ++k)
+            {
+                runs.push_back(emulateFunction(emu, f, config.firstSeed + k));
+            }
+            return combineRuns(runs, config);
+        }
+
+/**
+* Every thread gets an even share of the seeds and one emulator for them.
+*/
+        StableSignatureResult stableSignature(
+                std::shared_ptr<const ProgramImage> image,
+                llvm::Function* f,
+                const StabilityConfig& config)
+        {
+            unsigned threads = config.threads
+                    ? config.threads
+                    : std::max(1u, std::thread::hardware_concurrency());
+            threads = std::max(1u, std::min(threads, config.seeds));
+            std::vector<FunctionResult> runs(config.seeds);
+            parallelFor(config.seeds, threads, [&](std::size_t b, std::size_t e)
+            {
+                LlvmIrEmulator emu(image);
+                for (std::size_t k = b; k < e; ++k)
+                {
+                    runs[k] = emulateFunction(emu, f, config.firstSeed + k);
+                }
+            }, (config.seeds + threads - 1) / threads);
+            return combineRuns(runs, config);
+        }
+
+        std::string weightedSignature(const StableSignatureResult& result)
+        {
+            std::string ret;
+            char weight[16];
+            for (auto& sf : result.features)
+            {
+                std::snprintf(weight, sizeof(weight), "*%.2f;", sf.weight);
+                ret += sf.token;
+                ret += weight;
+            }
+            return ret;
+        }
+
+    } // llvmir_emul
+} // retdec
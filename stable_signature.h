@@ -0,0 +1,97 @@
+/**
+ * @file stable_signature.h
+ * @brief Signatures of features that are stable across emulation seeds.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_STABLE_SIGNATURE_H
+#define RETDEC_LLVMIR_EMUL_STABLE_SIGNATURE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/Function.h>
+
+#include "llvmir-emul.h"
+#include "program_image.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        struct StabilityConfig
+        {
+            /// Runs, seeded @c firstSeed, @c firstSeed + 1, ...
+            unsigned seeds = 5;
+            uint64_t firstSeed = 1;
+            /// Fraction of successful runs a feature must appear in to be
+            /// kept.
+            double threshold = 0.8;
+            /// Threads running seeds concurrently when emulating from a
+            /// @c ProgramImage. 0 means hardware concurrency.
+            unsigned threads = 1;
+        };
+
+/**
+ * Feature is the @c occurrence-th (from 0) appearance of @c token in a
+ * similarity string, so a token repeated by a loop is as many features as
+ * it has repetitions in most runs.
+ */
+        struct StableFeature
+        {
+            std::string token;
+            uint32_t occurrence = 0;
+            /// Fraction of successful runs the feature appeared in.
+            double weight = 0.0;
+        };
+
+        struct StableSignatureResult
+        {
+            /// Kept features, in the order they appear in the runs.
+            std::vector<StableFeature> features;
+            /// Tokens of @c features separated by @c ';', usable wherever
+            /// a similarity string is.
+            std::string signature;
+            /// Distinct features of all runs, kept or not.
+            std::size_t featuresSeen = 0;
+            unsigned runs = 0;
+            unsigned failedRuns = 0;
+            /// Stats of the first successful run.
+            RunStats stats;
+        };
+
+/**
+ * Runs @a f once per seed (see @c emulateFunction()), counts in how many
+ * runs every feature appears and keeps the features above the threshold.
+ * Features that depend on the pseudo-random arguments -- values derived
+ * from them, branches they decide -- appear in few runs and are dropped.
+ *
+ * Runs share @a emu one after another, because an emulator and its module
+ * may only be used by one thread. See the overload below for concurrent
+ * runs.
+ */
+        StableSignatureResult stableSignature(
+                LlvmIrEmulator& emu,
+                llvm::Function* f,
+                const StabilityConfig& config = StabilityConfig());
+
+/**
+ * Runs the seeds of @a f concurrently on @c config.threads threads, each
+ * with its own emulator of @a image. Results of runs are combined in seed
+ * order, so the result equals that of the overload above.
+ */
+        StableSignatureResult stableSignature(
+                std::shared_ptr<const ProgramImage> image,
+                llvm::Function* f,
+                const StabilityConfig& config = StabilityConfig());
+
+/**
+ * @return Features as @c "token*weight;" with weights rounded to two
+ *         decimals.
+ */
+        std::string weightedSignature(const StableSignatureResult& result);
+
+    } // llvmir_emul
+} // retdec
+
+#endif
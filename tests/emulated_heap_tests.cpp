@@ -0,0 +1,91 @@
+/**
+ * @file tests/emulated_heap_tests.cpp
+ * @brief Tests of the allocator of emulated blocks.
+ */
+
+#include <gtest/gtest.h>
+
+#include "emulated_heap.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            TEST(EmulatedHeapTests, blocksAreAlignedAndDoNotOverlap)
+            {
+                EmulatedHeap heap;
+                uint64_t a = heap.allocate(1);
+                uint64_t b = heap.allocate(20);
+                uint64_t c = heap.allocate(100000);
+
+                EXPECT_EQ(heap.getConfig().base, a);
+                EXPECT_EQ(0u, a % 16);
+                EXPECT_EQ(0u, b % 16);
+                EXPECT_EQ(0u, c % 4096);
+                EXPECT_LE(a + 1, b);
+                EXPECT_LE(b + 20, c);
+                EXPECT_EQ(20u, heap.getSize(b));
+                EXPECT_EQ(3u, heap.getLiveBlocks());
+            }
+
+            TEST(EmulatedHeapTests, freedBlocksAreReusedLastInFirstOut)
+            {
+                EmulatedHeap heap;
+                uint64_t a = heap.allocate(24);
+                uint64_t b = heap.allocate(24);
+                uint64_t used = heap.getUsedBytes();
+
+                EXPECT_EQ(32u, heap.release(a));
+                EXPECT_EQ(32u, heap.release(b));
+                EXPECT_EQ(b, heap.allocate(30));
+                EXPECT_EQ(a, heap.allocate(17));
+                EXPECT_EQ(used, heap.getUsedBytes());
+            }
+
+            TEST(EmulatedHeapTests, releaseOfNoBlockFails)
+            {
+                EmulatedHeap heap;
+                uint64_t a = heap.allocate(64);
+
+                EXPECT_EQ(0u, heap.release(a + 16));
+                EXPECT_NE(0u, heap.release(a));
+                EXPECT_EQ(0u, heap.release(a));
+                EXPECT_EQ(0u, heap.getSize(a));
+                EXPECT_EQ(0u, heap.getLiveBlocks());
+            }
+
+            TEST(EmulatedHeapTests, allocationsBeyondLimitFail)
+            {
+                HeapConfig config;
+                config.limit = 8192;
+                EmulatedHeap heap(config);
+
+                EXPECT_EQ(0u, heap.allocate(8193));
+                EXPECT_NE(0u, heap.allocate(8192));
+                EXPECT_EQ(0u, heap.allocate(1));
+            }
+
+            TEST(EmulatedHeapTests, guardBytesSeparateBlocks)
+            {
+                HeapConfig config;
+                config.guardBytes = 16;
+                EmulatedHeap heap(config);
+                uint64_t a = heap.allocate(16);
+                uint64_t b = heap.allocate(16);
+
+                EXPECT_LE(a + 32, b);
+            }
+
+            TEST(EmulatedHeapTests, addressesDependOnCallsOnly)
+            {
+                EmulatedHeap h1;
+                EmulatedHeap h2;
+                for (uint64_t size : {8, 300, 70000, 8, 1})
+                {
+                    EXPECT_EQ(h1.allocate(size), h2.allocate(size));
+                }
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
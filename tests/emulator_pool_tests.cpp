@@ -0,0 +1,108 @@
+/**
+ * @file tests/emulator_pool_tests.cpp
+ * @brief Tests of the per-thread emulator pool.
+ */
+
+#include <memory>
+
+#include <gtest/gtest.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include "emulator_pool.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            class EmulatorPoolTests : public ::testing::Test
+            {
+            protected:
+                void SetUp() override
+                {
+                    SMDiagnostic err;
+                    _module = parseAssemblyString(
+                            "@g = global i32 7\n"
+                            "\n"
+                            "define i32 @inc() {\n"
+                            "entry:\n"
+                            "  %v = load i32* @g\n"
+                            "  %w = add i32 %v, 1\n"
+                            "  store i32 %w, i32* @g\n"
+                            "  ret i32 %w\n"
+                            "}\n",
+                            err,
+                            _context);
+                    ASSERT_TRUE(_module != nullptr);
+                    _inc = _module->getFunction("inc");
+                }
+
+                uint64_t runInc(LlvmIrEmulator& emu)
+                {
+                    return emu.runFunction(_inc, {}, true).IntVal.getZExtValue();
+                }
+
+            protected:
+                LLVMContext _context;
+                std::unique_ptr<Module> _module;
+                Function* _inc = nullptr;
+            };
+
+            TEST_F(EmulatorPoolTests, returnedEmulatorIsResetAndReused)
+            {
+                EmulatorPool pool;
+                LlvmIrEmulator* first = nullptr;
+                {
+                    auto lease = pool.acquire(_module.get());
+                    first = lease.get();
+                    EXPECT_EQ(8u, runInc(*lease));
+                    EXPECT_EQ(9u, runInc(*lease));
+                }
+                EXPECT_EQ(1u, pool.getIdleCount());
+
+                auto lease = pool.acquire(_module.get());
+                EXPECT_EQ(first, lease.get());
+                EXPECT_EQ(0u, pool.getIdleCount());
+                EXPECT_EQ(8u, runInc(*lease));
+            }
+
+            TEST_F(EmulatorPoolTests, emulatorsAreNotSharedAcrossLazyGlobals)
+            {
+                EmulatorPool pool;
+                LlvmIrEmulator* eager = nullptr;
+                {
+                    auto lease = pool.acquire(_module.get(), false);
+                    eager = lease.get();
+                }
+                {
+                    auto lease = pool.acquire(_module.get(), true);
+                    EXPECT_NE(eager, lease.get());
+                    EXPECT_EQ(8u, runInc(*lease));
+                }
+                EXPECT_EQ(2u, pool.getIdleCount());
+
+                pool.evict(_module.get());
+                EXPECT_EQ(0u, pool.getIdleCount());
+            }
+
+            TEST_F(EmulatorPoolTests, capacityBoundsIdleEmulators)
+            {
+                EmulatorPool pool(1);
+                {
+                    auto a = pool.acquire(_module.get());
+                    auto b = pool.acquire(_module.get());
+                    EXPECT_NE(a.get(), b.get());
+                }
+                EXPECT_EQ(1u, pool.getIdleCount());
+
+                pool.setCapacity(0);
+                EXPECT_EQ(0u, pool.getIdleCount());
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
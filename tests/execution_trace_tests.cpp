@@ -0,0 +1,211 @@
+/**
+ * @file tests/execution_trace_tests.cpp
+ * @brief Round trips of binary execution traces.
+ */
+
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include "execution_trace.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            class ExecutionTraceTests : public ::testing::Test
+            {
+            protected:
+                void SetUp() override
+                {
+                    SMDiagnostic err;
+                    _module = parseAssemblyString(
+                            "@g = global i32 0\n"
+                            "@h = global i32 1\n"
+                            "define i32 @f(i32 %a) {\n"
+                            "entry:\n"
+                            "  %b = add i32 %a, 1\n"
+                            "  br label %exit\n"
+                            "exit:\n"
+                            "  ret i32 %b\n"
+                            "}\n",
+                            err,
+                            _context);
+                    ASSERT_TRUE(_module != nullptr);
+                    _path = ::testing::TempDir() + "execution_trace_tests.trace";
+                }
+
+                void TearDown() override
+                {
+                    std::remove(_path.c_str());
+                }
+
+                static std::vector<TraceRecord> decode(const ExecutionTrace::Range& r)
+                {
+                    std::vector<TraceRecord> ret;
+                    for (auto& rec : r)
+                    {
+                        ret.push_back(rec);
+                    }
+                    return ret;
+                }
+
+                static void expectEqual(
+                        const std::vector<TraceRecord>& expected,
+                        const std::vector<TraceRecord>& actual)
+                {
+                    ASSERT_EQ(expected.size(), actual.size());
+                    for (std::size_t i = 0; i < expected.size(); ++i)
+                    {
+                        EXPECT_EQ(expected[i].event, actual[i].event) << "event " << i;
+                        EXPECT_EQ(expected[i].value, actual[i].value) << "event " << i;
+                    }
+                }
+
+            protected:
+                LLVMContext _context;
+                std::unique_ptr<Module> _module;
+                std::string _path;
+            };
+
+            TEST_F(ExecutionTraceTests, eventsOfModuleRoundTrip)
+            {
+                Function* f = _module->getFunction("f");
+                BasicBlock* entry = &f->front();
+                BasicBlock* exit = &f->back();
+                GlobalVariable* h = _module->getNamedGlobal("h");
+
+                TraceWriter writer(_path, _module.get());
+                ASSERT_TRUE(writer.isOpen());
+                writer.call(f);
+                writer.block(entry);
+                writer.instruction(&entry->front());
+                writer.memoryStore(0x100000000000);
+                writer.memoryLoad(0x10);
+                writer.globalLoad(h);
+                writer.instruction(&entry->back());
+                writer.block(exit);
+                writer.instruction(&exit->front());
+                writer.globalStore(h);
+                writer.call(nullptr);
+                EXPECT_EQ(11u, writer.getEventCount());
+                ASSERT_TRUE(writer.finish());
+
+                ExecutionTrace trace;
+                ASSERT_TRUE(trace.open(_path));
+                EXPECT_TRUE(trace.matches(writer.getIds()));
+                EXPECT_EQ(11u, trace.getEventCount());
+
+                const TraceIds& ids = writer.getIds();
+                std::vector<TraceRecord> recs(trace.begin(), trace.end());
+                ASSERT_EQ(11u, recs.size());
+                EXPECT_EQ(TraceEvent::Call, recs[0].event);
+                EXPECT_EQ(f, ids.getFunction(recs[0].value));
+                EXPECT_EQ(entry, ids.getBlock(recs[1].value));
+                EXPECT_EQ(&entry->front(), ids.getInstruction(recs[2].value));
+                EXPECT_EQ(TraceEvent::MemoryStore, recs[3].event);
+                EXPECT_EQ(0x100000000000u, recs[3].value);
+                EXPECT_EQ(TraceEvent::MemoryLoad, recs[4].event);
+                EXPECT_EQ(0x10u, recs[4].value);
+                EXPECT_EQ(TraceEvent::GlobalLoad, recs[5].event);
+                EXPECT_EQ(h, ids.getGlobal(recs[5].value));
+                EXPECT_EQ(&entry->back(), ids.getInstruction(recs[6].value));
+                EXPECT_EQ(exit, ids.getBlock(recs[7].value));
+                EXPECT_EQ(&exit->front(), ids.getInstruction(recs[8].value));
+                EXPECT_EQ(TraceEvent::GlobalStore, recs[9].event);
+                EXPECT_EQ(h, ids.getGlobal(recs[9].value));
+                EXPECT_EQ(TraceEvent::Call, recs[10].event);
+                EXPECT_EQ(uint64_t(TraceIds::UNKNOWN), recs[10].value);
+            }
+
+            TEST_F(ExecutionTraceTests, chunksDecodeIndependently)
+            {
+                std::mt19937_64 rng(1);
+                std::vector<TraceRecord> expected;
+                {
+                    TraceWriter writer(_path, _module.get(), 64);
+                    for (unsigned i = 0; i < 5000; ++i)
+                    {
+                        TraceRecord r;
+                        r.event = TraceEvent(rng() % 7);
+                        r.value = rng() % 3 ? rng() % 1000 : rng();
+                        writer.add(r.event, r.value);
+                        expected.push_back(r);
+                    }
+                    // Destructor finishes the trace.
+                }
+
+                ExecutionTrace trace;
+                ASSERT_TRUE(trace.open(_path));
+                EXPECT_EQ(expected.size(), trace.getEventCount());
+                EXPECT_LT(1u, trace.getChunkCount());
+                expectEqual(expected, std::vector<TraceRecord>(trace.begin(), trace.end()));
+
+                std::vector<TraceRecord> chunked;
+                for (std::size_t i = 0; i < trace.getChunkCount(); ++i)
+                {
+                    auto recs = decode(trace.getChunk(i));
+                    EXPECT_EQ(trace.getChunkEventCount(i), recs.size());
+                    chunked.insert(chunked.end(), recs.begin(), recs.end());
+                }
+                expectEqual(expected, chunked);
+            }
+
+            TEST_F(ExecutionTraceTests, truncatedTraceIsRejected)
+            {
+                {
+                    TraceWriter writer(_path, _module.get(), 16);
+                    for (unsigned i = 0; i < 100; ++i)
+                    {
+                        writer.memoryLoad(i * 8);
+                    }
+                    ASSERT_TRUE(writer.finish());
+                }
+                std::FILE* f = std::fopen(_path.c_str(), "rb");
+                ASSERT_TRUE(f != nullptr);
+                std::vector<char> data(1 << 16);
+                data.resize(std::fread(data.data(), 1, data.size(), f));
+                std::fclose(f);
+
+                f = std::fopen(_path.c_str(), "wb");
+                ASSERT_TRUE(f != nullptr);
+                std::fwrite(data.data(), 1, data.size() - 1, f);
+                std::fclose(f);
+
+                ExecutionTrace trace;
+                EXPECT_FALSE(trace.open(_path));
+            }
+
+            TEST_F(ExecutionTraceTests, traceOfOtherModuleDoesNotMatch)
+            {
+                {
+                    TraceWriter writer(_path, _module.get());
+                    ASSERT_TRUE(writer.finish());
+                }
+                SMDiagnostic err;
+                std::unique_ptr<Module> other = parseAssemblyString(
+                        "@g = global i32 0\n",
+                        err,
+                        _context);
+                ASSERT_TRUE(other != nullptr);
+
+                ExecutionTrace trace;
+                ASSERT_TRUE(trace.open(_path));
+                EXPECT_EQ(0u, trace.getEventCount());
+                EXPECT_TRUE(trace.matches(TraceIds(_module.get())));
+                EXPECT_FALSE(trace.matches(TraceIds(other.get())));
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,293 @@
+/**
+ * @file tests/libc_models_tests.cpp
+ * @brief Tests of library function models on emulated memory.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include "llvmir-emul.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            class LibcModelsTests : public ::testing::Test
+            {
+            protected:
+                static const uint64_t A = 0x1000;
+                static const uint64_t B = 0x2000;
+
+                void SetUp() override
+                {
+                    SMDiagnostic err;
+                    _module = parseAssemblyString(
+                            "declare i64 @strlen(i8*)\n"
+                            "declare i32 @strcmp(i8*, i8*)\n"
+                            "declare i32 @memcmp(i8*, i8*, i64)\n"
+                            "declare i8* @memcpy(i8*, i8*, i64)\n"
+                            "declare i8* @memmove(i8*, i8*, i64)\n"
+                            "declare i8* @malloc(i64)\n"
+                            "declare i8* @calloc(i64, i64)\n"
+                            "declare i8* @realloc(i8*, i64)\n"
+                            "declare void @free(i8*)\n"
+                            "\n"
+                            "define i64 @len(i64 %a) {\n"
+                            "entry:\n"
+                            "  %p = inttoptr i64 %a to i8*\n"
+                            "  %r = call i64 @strlen(i8* %p)\n"
+                            "  ret i64 %r\n"
+                            "}\n"
+                            "\n"
+                            "define i32 @cmp(i64 %a, i64 %b) {\n"
+                            "entry:\n"
+                            "  %p = inttoptr i64 %a to i8*\n"
+                            "  %q = inttoptr i64 %b to i8*\n"
+                            "  %r = call i32 @strcmp(i8* %p, i8* %q)\n"
+                            "  ret i32 %r\n"
+                            "}\n"
+                            "\n"
+                            "define i32 @mcmp(i64 %a, i64 %b, i64 %n) {\n"
+                            "entry:\n"
+                            "  %p = inttoptr i64 %a to i8*\n"
+                            "  %q = inttoptr i64 %b to i8*\n"
+                            "  %r = call i32 @memcmp(i8* %p, i8* %q, i64 %n)\n"
+                            "  ret i32 %r\n"
+                            "}\n"
+                            "\n"
+                            "define i64 @cpy(i64 %a, i64 %b, i64 %n) {\n"
+                            "entry:\n"
+                            "  %p = inttoptr i64 %a to i8*\n"
+                            "  %q = inttoptr i64 %b to i8*\n"
+                            "  %r = call i8* @memcpy(i8* %p, i8* %q, i64 %n)\n"
+                            "  %i = ptrtoint i8* %r to i64\n"
+                            "  ret i64 %i\n"
+                            "}\n"
+                            "\n"
+                            "define i64 @move(i64 %a, i64 %b, i64 %n) {\n"
+                            "entry:\n"
+                            "  %p = inttoptr i64 %a to i8*\n"
+                            "  %q = inttoptr i64 %b to i8*\n"
+                            "  %r = call i8* @memmove(i8* %p, i8* %q, i64 %n)\n"
+                            "  %i = ptrtoint i8* %r to i64\n"
+                            "  ret i64 %i\n"
+                            "}\n"
+                            "\n"
+                            "define i64 @mal(i64 %n) {\n"
+                            "entry:\n"
+                            "  %r = call i8* @malloc(i64 %n)\n"
+                            "  %i = ptrtoint i8* %r to i64\n"
+                            "  ret i64 %i\n"
+                            "}\n"
+                            "\n"
+                            "define i64 @cal(i64 %n, i64 %size) {\n"
+                            "entry:\n"
+                            "  %r = call i8* @calloc(i64 %n, i64 %size)\n"
+                            "  %i = ptrtoint i8* %r to i64\n"
+                            "  ret i64 %i\n"
+                            "}\n"
+                            "\n"
+                            "define i64 @re(i64 %a, i64 %n) {\n"
+                            "entry:\n"
+                            "  %p = inttoptr i64 %a to i8*\n"
+                            "  %r = call i8* @realloc(i8* %p, i64 %n)\n"
+                            "  %i = ptrtoint i8* %r to i64\n"
+                            "  ret i64 %i\n"
+                            "}\n"
+                            "\n"
+                            "define void @fr(i64 %a) {\n"
+                            "entry:\n"
+                            "  %p = inttoptr i64 %a to i8*\n"
+                            "  call void @free(i8* %p)\n"
+                            "  ret void\n"
+                            "}\n",
+                            err,
+                            _context);
+                    ASSERT_TRUE(_module != nullptr);
+                    _emu.reset(new LlvmIrEmulator(_module.get()));
+                }
+
+                void TearDown() override
+                {
+                    _emu.reset();
+                }
+
+                GenericValue call(
+                        const std::string& name,
+                        std::initializer_list<uint64_t> args)
+                {
+                    std::vector<GenericValue> vals;
+                    for (uint64_t a : args)
+                    {
+                        GenericValue gv;
+                        gv.IntVal = APInt(64, a);
+                        vals.push_back(gv);
+                    }
+                    return _emu->runFunction(_module->getFunction(name), vals, true);
+                }
+
+                uint64_t callInt(const std::string& name, std::initializer_list<uint64_t> args)
+                {
+                    return call(name, args).IntVal.getZExtValue();
+                }
+
+                int64_t callSigned(const std::string& name, std::initializer_list<uint64_t> args)
+                {
+                    return call(name, args).IntVal.getSExtValue();
+                }
+
+                void put(uint64_t addr, const std::string& bytes)
+                {
+                    for (std::size_t i = 0; i < bytes.size(); ++i)
+                    {
+                        GenericValue gv;
+                        gv.IntVal = APInt(8, uint8_t(bytes[i]));
+                        _emu->setMemoryValue(addr + i, gv);
+                    }
+                }
+
+                std::string get(uint64_t addr, std::size_t size)
+                {
+                    std::string ret;
+                    for (std::size_t i = 0; i < size; ++i)
+                    {
+                        ret += char(_emu->getMemoryValue(addr + i).IntVal.getZExtValue());
+                    }
+                    return ret;
+                }
+
+            protected:
+                LLVMContext _context;
+                std::unique_ptr<Module> _module;
+                std::unique_ptr<LlvmIrEmulator> _emu;
+            };
+
+            TEST_F(LibcModelsTests, strlenCountsUpToNul)
+            {
+                put(A, std::string("hello\0xy", 8));
+                EXPECT_EQ(5u, callInt("len", {A}));
+                EXPECT_EQ(2u, callInt("len", {A + 3}));
+                EXPECT_EQ(0u, callInt("len", {A + 5}));
+                // Untouched memory reads as zeros.
+                EXPECT_EQ(0u, callInt("len", {B}));
+            }
+
+            TEST_F(LibcModelsTests, strcmpSignFollowsFirstDifference)
+            {
+                put(A, std::string("abc\0", 4));
+                put(B, std::string("abd\0", 4));
+                EXPECT_LT(callSigned("cmp", {A, B}), 0);
+                EXPECT_GT(callSigned("cmp", {B, A}), 0);
+                EXPECT_EQ(0, callSigned("cmp", {A, A}));
+
+                // Bytes after the NUL do not matter, a shorter prefix is
+                // smaller.
+                put(B, std::string("abc\0z", 5));
+                EXPECT_EQ(0, callSigned("cmp", {A, B}));
+                put(B, "abcd");
+                EXPECT_LT(callSigned("cmp", {A, B}), 0);
+            }
+
+            TEST_F(LibcModelsTests, memcmpComparesUnsignedBytesOfLength)
+            {
+                put(A, std::string("ab\x01\0q", 5));
+                put(B, std::string("ab\xff\0r", 5));
+                EXPECT_EQ(0, callSigned("mcmp", {A, B, 2}));
+                EXPECT_LT(callSigned("mcmp", {A, B, 3}), 0);
+                EXPECT_GT(callSigned("mcmp", {B, A, 3}), 0);
+                EXPECT_EQ(0, callSigned("mcmp", {A, B, 0}));
+
+                // Unlike strcmp, a NUL does not stop it.
+                put(B, std::string("ab\x01\0r", 5));
+                EXPECT_LT(callSigned("mcmp", {A, B, 5}), 0);
+            }
+
+            TEST_F(LibcModelsTests, overlappingCopiesBehaveLikeMemmove)
+            {
+                put(A, "abcdef");
+                EXPECT_EQ(uint64_t(A + 2), callInt("move", {A + 2, A, 4}));
+                EXPECT_EQ("ababcd", get(A, 6));
+
+                put(A, "abcdef");
+                EXPECT_EQ(uint64_t(A), callInt("move", {A, A + 2, 4}));
+                EXPECT_EQ("cdefef", get(A, 6));
+
+                put(A, "abcdef");
+                EXPECT_EQ(uint64_t(A + 1), callInt("cpy", {A + 1, A, 5}));
+                EXPECT_EQ("aabcde", get(A, 6));
+
+                put(B, "xyz");
+                callInt("cpy", {A, B, 3});
+                EXPECT_EQ("xyzcde", get(A, 6));
+            }
+
+            TEST_F(LibcModelsTests, callocRejectsOverflowingSizes)
+            {
+                EXPECT_EQ(0u, callInt("cal", {uint64_t(1) << 62, 16}));
+                EXPECT_EQ(0u, callInt("cal", {uint64_t(1) << 33, uint64_t(1) << 33}));
+
+                uint64_t p = callInt("cal", {4, 4});
+                ASSERT_NE(0u, p);
+                EXPECT_EQ(0u, callInt("len", {p}));
+                EXPECT_EQ(0, callSigned("mcmp", {p, B, 16}));
+            }
+
+            TEST_F(LibcModelsTests, reallocCopiesAndFreesOldBlock)
+            {
+                uint64_t p = callInt("mal", {8});
+                ASSERT_NE(0u, p);
+                put(p, std::string("1234567\0", 8));
+
+                uint64_t q = callInt("re", {p, 64});
+                ASSERT_NE(0u, q);
+                EXPECT_NE(p, q);
+                EXPECT_EQ(7u, callInt("len", {q}));
+                EXPECT_EQ("1234567", get(q, 7));
+
+                // Freed blocks are reused last-in first-out.
+                EXPECT_EQ(p, callInt("mal", {8}));
+                call("fr", {q});
+                EXPECT_EQ(q, callInt("mal", {64}));
+
+                // Null grows into a fresh block.
+                EXPECT_NE(0u, callInt("re", {0, 8}));
+            }
+
+            TEST_F(LibcModelsTests, userModelsOverrideBuiltins)
+            {
+                put(A, std::string("hello\0", 6));
+                LibcSignature sig;
+                sig.params = {LibcKind::Address};
+                sig.result = LibcKind::Integer;
+                _emu->getLibcModels().add("strlen", sig, [](LibcCall& c, GenericValue& res) {
+                    res = c.makeResult(c.getAddress(0) + 1);
+                    return true;
+                });
+                EXPECT_EQ(uint64_t(A + 1), callInt("len", {A}));
+
+                // A model that gives up leaves the default zero result.
+                _emu->getLibcModels().add("strlen", sig, [](LibcCall&, GenericValue&) {
+                    return false;
+                });
+                EXPECT_EQ(0u, callInt("len", {A}));
+
+                _emu->getLibcModels().remove("strlen");
+                EXPECT_EQ(0u, callInt("len", {A}));
+
+                _emu->setLibcModelsEnabled(false);
+                put(B, "abc");
+                EXPECT_EQ(0, callSigned("mcmp", {A, B, 3}));
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
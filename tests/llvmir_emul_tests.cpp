@@ -0,0 +1,393 @@
+/**
+ * @file tests/llvmir_emul_tests.cpp
+ * @brief Tests of the emulator.
+ */
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include "execution_trace.h"
+#include "llvmir-emul.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            class LlvmIrEmulatorTests : public ::testing::Test
+            {
+            protected:
+                static const uint64_t ADDR = 0x1000;
+
+                void SetUp() override
+                {
+                    SMDiagnostic err;
+                    _module = parseAssemblyString(
+                            "%pair = type { i8, i16, i32 }\n"
+                            "\n"
+                            "@g = global i32 7\n"
+                            "@eax = global i32 0\n"
+                            "\n"
+                            "define i32 @inc() {\n"
+                            "entry:\n"
+                            "  %v = load i32* @g\n"
+                            "  %w = add i32 %v, 1\n"
+                            "  store i32 %w, i32* @g\n"
+                            "  store i32 %w, i32* @eax\n"
+                            "  store i32 %w, i32* inttoptr (i64 4096 to i32*)\n"
+                            "  ret i32 %w\n"
+                            "}\n"
+                            "\n"
+                            "define i32 @acc() {\n"
+                            "entry:\n"
+                            "  %v = load i32* @eax\n"
+                            "  %w = add i32 %v, 3\n"
+                            "  store i32 %w, i32* @eax\n"
+                            "  ret i32 %w\n"
+                            "}\n"
+                            "\n"
+                            "define i32 @branch(i32 %a) {\n"
+                            "entry:\n"
+                            "  store i32 1, i32* @g\n"
+                            "  store i32 1, i32* inttoptr (i64 4096 to i32*)\n"
+                            "  %c = icmp eq i32 %a, 0\n"
+                            "  br i1 %c, label %taken, label %other\n"
+                            "taken:\n"
+                            "  store i32 5, i32* @g\n"
+                            "  store i32 5, i32* inttoptr (i64 4096 to i32*)\n"
+                            "  ret i32 5\n"
+                            "other:\n"
+                            "  ret i32 1\n"
+                            "}\n"
+                            "\n"
+                            "define i32 @loop(i32 %n) {\n"
+                            "entry:\n"
+                            "  br label %head\n"
+                            "head:\n"
+                            "  %i = phi i32 [ 0, %entry ], [ %j, %body ]\n"
+                            "  %c = icmp slt i32 %i, %n\n"
+                            "  br i1 %c, label %body, label %exit\n"
+                            "body:\n"
+                            "  %j = add i32 %i, 1\n"
+                            "  store i32 %j, i32* @g\n"
+                            "  br label %head\n"
+                            "exit:\n"
+                            "  ret i32 %i\n"
+                            "}\n"
+                            "\n"
+                            "define void @gep(i32 %i) {\n"
+                            "entry:\n"
+                            "  %p = getelementptr [4 x %pair]* inttoptr (i64 4096 to [4 x %pair]*), i32 0, i32 %i, i32 2\n"
+                            "  store i32 %i, i32* %p\n"
+                            "  %q = getelementptr %pair* inttoptr (i64 4096 to %pair*), i32 %i, i32 1\n"
+                            "  store i16 9, i16* %q\n"
+                            "  store i32 42, i32* getelementptr ([4 x %pair]* inttoptr (i64 4096 to [4 x %pair]*), i64 0, i64 3, i32 2)\n"
+                            "  ret void\n"
+                            "}\n"
+                            "\n"
+                            "define i32 @swap(i32 %n) {\n"
+                            "entry:\n"
+                            "  br label %head\n"
+                            "head:\n"
+                            "  %a = phi i32 [ 1, %entry ], [ %b, %body ]\n"
+                            "  %b = phi i32 [ 2, %entry ], [ %a, %body ]\n"
+                            "  %i = phi i32 [ 0, %entry ], [ %j, %body ]\n"
+                            "  %c = icmp slt i32 %i, %n\n"
+                            "  br i1 %c, label %body, label %exit\n"
+                            "body:\n"
+                            "  %j = add i32 %i, 1\n"
+                            "  br label %head\n"
+                            "exit:\n"
+                            "  %r = mul i32 %a, 10\n"
+                            "  %s = add i32 %r, %b\n"
+                            "  ret i32 %s\n"
+                            "}\n"
+                            "\n"
+                            "define i32 @flags(i32 %a) {\n"
+                            "entry:\n"
+                            "  %v = load i32* @eax\n"
+                            "  %w = add i32 %v, %a\n"
+                            "  store i32 %w, i32* @eax\n"
+                            "  %z = icmp eq i32 %w, 0\n"
+                            "  %zf = zext i1 %z to i32\n"
+                            "  store i32 %zf, i32* @g\n"
+                            "  %b = trunc i32 %a to i8\n"
+                            "  %e = zext i8 %b to i32\n"
+                            "  %c = icmp ult i32 %e, 16\n"
+                            "  br i1 %c, label %small, label %big\n"
+                            "small:\n"
+                            "  store i32 %e, i32* inttoptr (i64 4096 to i32*)\n"
+                            "  ret i32 %zf\n"
+                            "big:\n"
+                            "  ret i32 %e\n"
+                            "}\n",
+                            err,
+                            _context);
+                    ASSERT_TRUE(_module != nullptr);
+                    _inc = _module->getFunction("inc");
+                    _acc = _module->getFunction("acc");
+                    _branch = _module->getFunction("branch");
+                    _loop = _module->getFunction("loop");
+                    _gep = _module->getFunction("gep");
+                    _swap = _module->getFunction("swap");
+                    _flags = _module->getFunction("flags");
+                    _g = _module->getNamedGlobal("g");
+                    _eax = _module->getNamedGlobal("eax");
+                }
+
+                static uint64_t intOf(const GenericValue& gv)
+                {
+                    return gv.IntVal.getZExtValue();
+                }
+
+                static GenericValue i32(uint64_t v)
+                {
+                    GenericValue gv;
+                    gv.IntVal = APInt(32, v);
+                    return gv;
+                }
+
+            protected:
+                LLVMContext _context;
+                std::unique_ptr<Module> _module;
+                Function* _inc = nullptr;
+                Function* _acc = nullptr;
+                Function* _branch = nullptr;
+                Function* _loop = nullptr;
+                Function* _gep = nullptr;
+                Function* _swap = nullptr;
+                Function* _flags = nullptr;
+                GlobalVariable* _g = nullptr;
+                GlobalVariable* _eax = nullptr;
+            };
+
+            TEST_F(LlvmIrEmulatorTests, resetRestoresInitialState)
+            {
+                LlvmIrEmulator emu(_module.get());
+                EXPECT_EQ(8u, intOf(emu.runFunction(_inc, {}, true)));
+                std::string first = emu.similairtyString();
+                EXPECT_EQ(9u, intOf(emu.runFunction(_inc, {}, true)));
+
+                emu.reset();
+                EXPECT_EQ(7u, intOf(emu.getGlobalVariableValue(_g)));
+                EXPECT_EQ(0u, intOf(emu.getGlobalVariableValue(_eax)));
+                EXPECT_TRUE(emu.getVisitedInstructions().empty());
+                EXPECT_TRUE(emu.similairtyString().empty());
+
+                EXPECT_EQ(8u, intOf(emu.runFunction(_inc, {}, true)));
+                EXPECT_EQ(8u, intOf(emu.getGlobalVariableValue(_eax)));
+                EXPECT_EQ(8u, intOf(emu.getMemoryValue(ADDR)));
+                EXPECT_EQ(first, emu.similairtyString());
+            }
+
+            TEST_F(LlvmIrEmulatorTests, lazyGlobalsAreDeferredAgainOnReset)
+            {
+                LlvmIrEmulator emu(_module.get(), true);
+                EXPECT_EQ(8u, intOf(emu.runFunction(_inc, {}, true)));
+                EXPECT_EQ(11u, intOf(emu.runFunction(_acc, {}, true)));
+                std::string first = emu.similairtyString();
+
+                // Both the ordinary global and the register were
+                // materialized by the first run.
+                emu.reset();
+                EXPECT_EQ(8u, intOf(emu.runFunction(_inc, {}, true)));
+                EXPECT_EQ(11u, intOf(emu.runFunction(_acc, {}, true)));
+                EXPECT_EQ(first, emu.similairtyString());
+
+                emu.reset();
+                EXPECT_EQ(7u, intOf(emu.getGlobalVariableValue(_g)));
+                EXPECT_EQ(0u, intOf(emu.getGlobalVariableValue(_eax)));
+            }
+
+            TEST_F(LlvmIrEmulatorTests, resetKeepsCoverageIfAsked)
+            {
+                LlvmIrEmulator emu(_module.get());
+                emu.runFunction(_inc, {}, true);
+                EXPECT_EQ(1u, emu.getBlockCoverage().count());
+
+                ResetPolicy policy;
+                policy.coverage = false;
+                emu.reset(policy);
+                EXPECT_EQ(1u, emu.getBlockCoverage().count());
+
+                emu.reset();
+                EXPECT_EQ(0u, emu.getBlockCoverage().count());
+            }
+
+            TEST_F(LlvmIrEmulatorTests, forkedPathsDoNotSeeWritesOfEachOther)
+            {
+                LlvmIrEmulator emu(_module.get());
+                auto res = emu.explore(_branch, {i32(0)});
+
+                EXPECT_EQ(2u, res.paths);
+                EXPECT_EQ(0u, res.failed);
+                EXPECT_EQ(3u, res.blocks.size());
+                // The emulator holds the state of the last path, which was
+                // forked before the first one stored 5.
+                EXPECT_EQ(1u, intOf(emu.getGlobalVariableValue(_g)));
+                EXPECT_EQ(1u, intOf(emu.getMemoryValue(ADDR)));
+            }
+
+
+            TEST_F(LlvmIrEmulatorTests, tracingWithoutLogsKeepsSignatures)
+            {
+                LlvmIrEmulator logged(_module.get());
+                GenericValue ret = logged.runFunction(_loop, {i32(5)}, true);
+
+                std::string path = ::testing::TempDir() + "llvmir_emul_tests.trace";
+                TraceWriter trace(path, _module.get());
+                LlvmIrEmulator traced(_module.get());
+                traced.setTraceWriter(&trace, false);
+                GenericValue tracedRet = traced.runFunction(_loop, {i32(5)}, true);
+                traced.setTraceWriter(nullptr);
+                trace.finish();
+                std::remove(path.c_str());
+
+                EXPECT_TRUE(traced.getVisitedBasicBlocks().empty());
+                EXPECT_FALSE(logged.similairtyString().empty());
+                EXPECT_EQ(logged.similairtyString(), traced.similairtyString());
+                EXPECT_EQ(intOf(ret), intOf(tracedRet));
+                EXPECT_EQ(
+                        logged.wasBasicBlockVisited(&_loop->back()),
+                        traced.wasBasicBlockVisited(&_loop->back()));
+            }
+
+            TEST_F(LlvmIrEmulatorTests, gepPlansAddStructAndArrayOffsets)
+            {
+                // %pair is 8 bytes, its i16 at 2 and its i32 at 4.
+                LlvmIrEmulator emu(_module.get());
+                emu.runFunction(_gep, {i32(2)}, true);
+                EXPECT_EQ(2u, intOf(emu.getMemoryValue(ADDR + 2 * 8 + 4)));
+                EXPECT_EQ(9u, intOf(emu.getMemoryValue(ADDR + 2 * 8 + 2)));
+                EXPECT_EQ(42u, intOf(emu.getMemoryValue(ADDR + 3 * 8 + 4)));
+                EXPECT_EQ(3u, emu.getStoredMemorySet().size());
+
+                // Plans are reused by later runs, with other indices.
+                emu.runFunction(_gep, {i32(1)}, true);
+                EXPECT_EQ(1u, intOf(emu.getMemoryValue(ADDR + 8 + 4)));
+                EXPECT_EQ(9u, intOf(emu.getMemoryValue(ADDR + 8 + 2)));
+
+                // 32-bit indices are signed.
+                emu.runFunction(_gep, {i32(uint32_t(-1))}, true);
+                EXPECT_TRUE(emu.wasMemoryStored(ADDR - 8 + 4));
+                EXPECT_TRUE(emu.wasMemoryStored(ADDR - 8 + 2));
+            }
+
+            TEST_F(LlvmIrEmulatorTests, phiCopiesOfAnEdgeAreParallel)
+            {
+                // The back edge swaps %a and %b, copying them one by one
+                // would make both equal.
+                LlvmIrEmulator emu(_module.get());
+                EXPECT_EQ(12u, intOf(emu.runFunction(_swap, {i32(0)}, true)));
+                EXPECT_EQ(21u, intOf(emu.runFunction(_swap, {i32(1)}, true)));
+                EXPECT_EQ(12u, intOf(emu.runFunction(_swap, {i32(2)}, true)));
+                EXPECT_EQ(21u, intOf(emu.runFunction(_swap, {i32(5)}, true)));
+            }
+
+            TEST_F(LlvmIrEmulatorTests, registerGlobalsAreQueriedLikeGlobals)
+            {
+                ASSERT_TRUE(isRegisterGlobal(_eax));
+                ASSERT_FALSE(isRegisterGlobal(_g));
+
+                LlvmIrEmulator emu(_module.get());
+                EXPECT_EQ(3u, intOf(emu.runFunction(_acc, {}, true)));
+                EXPECT_TRUE(emu.wasGlobalVariableLoaded(_eax));
+                EXPECT_TRUE(emu.wasGlobalVariableStored(_eax));
+                EXPECT_FALSE(emu.wasGlobalVariableLoaded(_g));
+                EXPECT_EQ(1u, emu.getLoadedGlobalVariablesSet().count(_eax));
+                EXPECT_EQ(1u, emu.getStoredGlobalVariablesSet().count(_eax));
+                EXPECT_EQ(3u, intOf(emu.getGlobalVariableValue(_eax)));
+
+                emu.setGlobalVariableValue(_eax, i32(10));
+                EXPECT_EQ(13u, intOf(emu.runFunction(_acc, {}, true)));
+                EXPECT_EQ(13u, intOf(emu.getGlobalVariableValue(_eax)));
+
+                // An ordinary global and a register stored by one run.
+                EXPECT_EQ(8u, intOf(emu.runFunction(_inc, {}, true)));
+                EXPECT_TRUE(emu.wasGlobalVariableStored(_g));
+                EXPECT_EQ(8u, intOf(emu.getGlobalVariableValue(_eax)));
+
+                emu.reset();
+                EXPECT_FALSE(emu.wasGlobalVariableLoaded(_eax));
+                EXPECT_FALSE(emu.wasGlobalVariableStored(_eax));
+                EXPECT_EQ(0u, intOf(emu.getGlobalVariableValue(_eax)));
+            }
+
+            TEST_F(LlvmIrEmulatorTests, globalLogsKeepRepeatedAccesses)
+            {
+                LlvmIrEmulator emu(_module.get());
+                emu.runFunction(_loop, {i32(3)}, true);
+                ASSERT_EQ(3u, emu.getStoredGlobalVariables().size());
+                for (auto* gv : emu.getStoredGlobalVariables())
+                {
+                    EXPECT_EQ(_g, gv);
+                }
+                ASSERT_EQ(1u, emu.getStoredGlobalVariablesUnique().size());
+                EXPECT_EQ(_g, emu.getStoredGlobalVariablesUnique()[0]);
+                EXPECT_TRUE(emu.getLoadedGlobalVariables().empty());
+
+                // Registers are only in the deduplicated views.
+                emu.reset();
+                emu.runFunction(_inc, {}, true);
+                EXPECT_EQ(1u, emu.getLoadedGlobalVariables().size());
+                ASSERT_EQ(1u, emu.getStoredGlobalVariables().size());
+                EXPECT_EQ(_g, emu.getStoredGlobalVariables()[0]);
+                ASSERT_EQ(2u, emu.getStoredGlobalVariablesUnique().size());
+                EXPECT_EQ(_eax, emu.getStoredGlobalVariablesUnique()[1]);
+                EXPECT_EQ(1u, emu.getStoredGlobalVariablesSet().count(_eax));
+            }
+
+            TEST_F(LlvmIrEmulatorTests, fusedRunsEqualUnfusedOnes)
+            {
+                // @flags has all the fused idioms, @loop and @acc some.
+                LlvmIrEmulator fused(_module.get());
+                LlvmIrEmulator plain(_module.get());
+                plain.setFusionEnabled(false);
+
+                auto runBoth = [&](Function* f, uint64_t arg)
+                {
+                    std::vector<GenericValue> args;
+                    if (!f->arg_empty())
+                    {
+                        args.push_back(i32(arg));
+                    }
+                    EXPECT_EQ(
+                            intOf(plain.runFunction(f, args, true)),
+                            intOf(fused.runFunction(f, args, true)));
+                };
+                for (uint64_t a : {0u, 5u, 300u, 0xfffffffbu})
+                {
+                    runBoth(_flags, a);
+                }
+                runBoth(_loop, 5);
+                runBoth(_acc, 0);
+
+                EXPECT_FALSE(plain.similairtyString().empty());
+                EXPECT_EQ(plain.similairtyString(), fused.similairtyString());
+                EXPECT_TRUE(plain.getVisitedInstructions() == fused.getVisitedInstructions());
+                EXPECT_TRUE(plain.getVisitedBasicBlocks() == fused.getVisitedBasicBlocks());
+                EXPECT_TRUE(plain.getLoadedMemory() == fused.getLoadedMemory());
+                EXPECT_TRUE(plain.getStoredMemory() == fused.getStoredMemory());
+                EXPECT_EQ(
+                        plain.getStoredGlobalVariablesSet(),
+                        fused.getStoredGlobalVariablesSet());
+                EXPECT_EQ(
+                        intOf(plain.getGlobalVariableValue(_eax)),
+                        intOf(fused.getGlobalVariableValue(_eax)));
+                EXPECT_EQ(
+                        intOf(plain.getMemoryValue(ADDR)),
+                        intOf(fused.getMemoryValue(ADDR)));
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
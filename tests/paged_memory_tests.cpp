@@ -0,0 +1,131 @@
+/**
+ * @file tests/paged_memory_tests.cpp
+ * @brief Tests of the copy-on-write emulated memory.
+ */
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "llvmir-emul.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            class PagedMemoryTests : public ::testing::Test
+            {
+            protected:
+                static const uint64_t PAGE = uint64_t(1) << PagedMemory::PAGE_BITS;
+
+                static GenericValue value(uint64_t v)
+                {
+                    GenericValue gv;
+                    gv.IntVal = APInt(64, v);
+                    return gv;
+                }
+
+                static uint64_t valueAt(const PagedMemory& mem, uint64_t addr)
+                {
+                    const GenericValue* gv = mem.find(addr);
+                    return gv ? gv->IntVal.getZExtValue() : ~uint64_t(0);
+                }
+            };
+
+            TEST_F(PagedMemoryTests, copyIsNotChangedByWritesOfOriginal)
+            {
+                PagedMemory mem;
+                mem.set(0x1000, value(1));
+                mem.set(0x1008, value(2));
+                mem.set(5 * PAGE, value(3));
+
+                PagedMemory fork = mem;
+                mem.set(0x1000, value(10));
+                mem.erase(5 * PAGE, 6 * PAGE);
+                mem.set(9 * PAGE, value(4));
+
+                EXPECT_EQ(1u, valueAt(fork, 0x1000));
+                EXPECT_EQ(2u, valueAt(fork, 0x1008));
+                EXPECT_EQ(3u, valueAt(fork, 5 * PAGE));
+                EXPECT_EQ(nullptr, fork.find(9 * PAGE));
+                EXPECT_EQ(2u, fork.pageCount());
+
+                EXPECT_EQ(10u, valueAt(mem, 0x1000));
+                EXPECT_EQ(2u, valueAt(mem, 0x1008));
+                EXPECT_EQ(nullptr, mem.find(5 * PAGE));
+                EXPECT_EQ(4u, valueAt(mem, 9 * PAGE));
+            }
+
+            TEST_F(PagedMemoryTests, originalIsNotChangedByWritesOfCopy)
+            {
+                PagedMemory mem;
+                mem.set(0x1000, value(1));
+
+                PagedMemory fork = mem;
+                fork.set(0x1000, value(2));
+                fork.set(0x1010, value(3));
+
+                EXPECT_EQ(1u, valueAt(mem, 0x1000));
+                EXPECT_EQ(nullptr, mem.find(0x1010));
+                EXPECT_EQ(2u, valueAt(fork, 0x1000));
+            }
+
+            TEST_F(PagedMemoryTests, restoreUndoesChangesSinceMarkClean)
+            {
+                PagedMemory mem;
+                mem.set(0x1000, value(1));
+                mem.set(3 * PAGE + 8, value(2));
+                PagedMemory base = mem;
+                mem.markClean();
+
+                mem.set(0x1000, value(10));
+                mem.set(0x1000, value(11));
+                mem.erase(3 * PAGE, 4 * PAGE);
+                mem.set(7 * PAGE, value(5));
+                mem.restore(base);
+
+                EXPECT_EQ(1u, valueAt(mem, 0x1000));
+                EXPECT_EQ(2u, valueAt(mem, 3 * PAGE + 8));
+                EXPECT_EQ(nullptr, mem.find(7 * PAGE));
+                EXPECT_EQ(base.pageCount(), mem.pageCount());
+
+                // Restored memory can be changed and restored again.
+                mem.set(3 * PAGE + 8, value(20));
+                mem.restore(base);
+                EXPECT_EQ(2u, valueAt(mem, 3 * PAGE + 8));
+                EXPECT_EQ(2u, valueAt(base, 3 * PAGE + 8));
+            }
+
+            TEST_F(PagedMemoryTests, findBeforeCrossesPages)
+            {
+                PagedMemory mem;
+                mem.set(PAGE - 8, value(1));
+                mem.set(4 * PAGE, value(2));
+
+                uint64_t at = 0;
+                const GenericValue* gv = mem.findBefore(4 * PAGE, at);
+                ASSERT_NE(nullptr, gv);
+                EXPECT_EQ(PAGE - 8, at);
+                EXPECT_EQ(nullptr, mem.findBefore(PAGE - 8, at));
+            }
+
+            TEST_F(PagedMemoryTests, forEachVisitsRangeInAddressOrder)
+            {
+                PagedMemory mem;
+                mem.set(2 * PAGE, value(3));
+                mem.set(PAGE + 8, value(2));
+                mem.set(PAGE, value(1));
+                mem.set(3 * PAGE, value(4));
+
+                std::vector<uint64_t> seen;
+                mem.forEach(PAGE, 3 * PAGE, [&](uint64_t, const GenericValue& gv) {
+                    seen.push_back(gv.IntVal.getZExtValue());
+                });
+                EXPECT_EQ(std::vector<uint64_t>({1, 2, 3}), seen);
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
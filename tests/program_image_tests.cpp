@@ -0,0 +1,212 @@
+/**
+ * @file tests/program_image_tests.cpp
+ * @brief Tests of emulators sharing a program image across threads.
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include "batch_pipeline.h"
+#include "program_image.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            const char* const IMAGE_MODULE =
+                    "%pair = type { i8, i16, i32 }\n"
+                    "\n"
+                    "@g = global i32 7\n"
+                    "@eax = global i32 0\n"
+                    "@table = global [4 x %pair] zeroinitializer\n"
+                    "\n"
+                    "declare i64 @strlen(i8*)\n"
+                    "\n"
+                    "define i32 @loop(i32 %n) {\n"
+                    "entry:\n"
+                    "  %m = and i32 %n, 15\n"
+                    "  br label %head\n"
+                    "head:\n"
+                    "  %a = phi i32 [ 1, %entry ], [ %b, %body ]\n"
+                    "  %b = phi i32 [ 2, %entry ], [ %a, %body ]\n"
+                    "  %i = phi i32 [ 0, %entry ], [ %j, %body ]\n"
+                    "  %c = icmp slt i32 %i, %m\n"
+                    "  br i1 %c, label %body, label %exit\n"
+                    "body:\n"
+                    "  %j = add i32 %i, 1\n"
+                    "  %v = load i32* @eax\n"
+                    "  %w = add i32 %v, %a\n"
+                    "  store i32 %w, i32* @eax\n"
+                    "  br label %head\n"
+                    "exit:\n"
+                    "  %r = load i32* @eax\n"
+                    "  ret i32 %r\n"
+                    "}\n"
+                    "\n"
+                    "define i32 @fill(i32 %i) {\n"
+                    "entry:\n"
+                    "  %k = and i32 %i, 3\n"
+                    "  %p = getelementptr [4 x %pair]* @table, i32 0, i32 %k, i32 2\n"
+                    "  store i32 %i, i32* %p\n"
+                    "  %v = load i32* @g\n"
+                    "  %w = add i32 %v, %i\n"
+                    "  store i32 %w, i32* @g\n"
+                    "  store i32 %w, i32* inttoptr (i64 4096 to i32*)\n"
+                    "  %s = call i64 @strlen(i8* inttoptr (i64 4096 to i8*))\n"
+                    "  %t = trunc i64 %s to i32\n"
+                    "  ret i32 %t\n"
+                    "}\n"
+                    "\n"
+                    "define i32 @calls(i32 %n) {\n"
+                    "entry:\n"
+                    "  %a = call i32 @loop(i32 %n)\n"
+                    "  %b = call i32 @fill(i32 %a)\n"
+                    "  %c = add i32 %a, %b\n"
+                    "  ret i32 %c\n"
+                    "}\n";
+
+            class ProgramImageTests : public ::testing::Test
+            {
+            protected:
+                static const unsigned SEEDS = 6;
+
+                void SetUp() override
+                {
+                    SMDiagnostic err;
+                    _module = parseAssemblyString(IMAGE_MODULE, err, _context);
+                    ASSERT_TRUE(_module != nullptr);
+                    for (Function& f : *_module)
+                    {
+                        if (!f.isDeclaration())
+                        {
+                            _functions.push_back(&f);
+                        }
+                    }
+                }
+
+                // Results of every function and seed, in this order.
+                std::vector<FunctionResult> runAll(LlvmIrEmulator& emu)
+                {
+                    std::vector<FunctionResult> ret;
+                    for (auto* f : _functions)
+                    {
+                        for (unsigned seed = 0; seed < SEEDS; ++seed)
+                        {
+                            ret.push_back(emulateFunction(emu, f, seed));
+                        }
+                    }
+                    return ret;
+                }
+
+                static bool equal(const FunctionResult& a, const FunctionResult& b)
+                {
+                    return a.signature == b.signature
+                            && a.failed == b.failed
+                            && a.stats.instructions == b.stats.instructions
+                            && a.stats.memoryStores == b.stats.memoryStores
+                            && a.stats.globalStores == b.stats.globalStores;
+                }
+
+            protected:
+                LLVMContext _context;
+                std::unique_ptr<Module> _module;
+                std::vector<Function*> _functions;
+            };
+
+            TEST_F(ProgramImageTests, threadsSharingImageMatchSingleThreadedRuns)
+            {
+                auto image = ProgramImage::build(_module.get());
+                ASSERT_TRUE(image != nullptr);
+
+                LlvmIrEmulator single(_module.get());
+                auto expected = runAll(single);
+                for (auto& r : expected)
+                {
+                    ASSERT_FALSE(r.failed);
+                    ASSERT_FALSE(r.signature.empty());
+                }
+
+                const unsigned THREADS = 4;
+                const unsigned ROUNDS = 20;
+                std::atomic<unsigned> mismatches(0);
+                std::vector<std::thread> threads;
+                for (unsigned t = 0; t < THREADS; ++t)
+                {
+                    threads.emplace_back([&]()
+                    {
+                        LlvmIrEmulator emu(image);
+                        for (unsigned round = 0; round < ROUNDS; ++round)
+                        {
+                            auto got = runAll(emu);
+                            for (std::size_t i = 0; i < got.size(); ++i)
+                            {
+                                if (!equal(expected[i], got[i]))
+                                {
+                                    ++mismatches;
+                                }
+                            }
+                        }
+                    });
+                }
+                for (auto& t : threads)
+                {
+                    t.join();
+                }
+                EXPECT_EQ(0u, mismatches.load());
+            }
+
+            TEST_F(ProgramImageTests, pipelineWithImagesMatchesPipelineWithout)
+            {
+                std::vector<std::string> paths;
+                for (unsigned i = 0; i < 3; ++i)
+                {
+                    paths.push_back(::testing::TempDir()
+                            + "program_image_tests_" + std::to_string(i) + ".ll");
+                    std::ofstream(paths.back()) << IMAGE_MODULE;
+                }
+
+                auto run = [&](bool images)
+                {
+                    BatchConfig config;
+                    config.emulationThreads = 4;
+                    config.images = images;
+                    config.seed = 3;
+                    std::vector<FunctionResult> ret;
+                    BatchPipeline(config).run(paths, [&](const FunctionResult& r) {
+                        ret.push_back(r);
+                    });
+                    return ret;
+                };
+                auto plain = run(false);
+                auto shared = run(true);
+                for (auto& p : paths)
+                {
+                    std::remove(p.c_str());
+                }
+
+                ASSERT_EQ(3 * _functions.size(), plain.size());
+                ASSERT_EQ(plain.size(), shared.size());
+                for (std::size_t i = 0; i < plain.size(); ++i)
+                {
+                    EXPECT_EQ(plain[i].modulePath, shared[i].modulePath);
+                    EXPECT_EQ(plain[i].functionName, shared[i].functionName);
+                    EXPECT_TRUE(equal(plain[i], shared[i])) << plain[i].functionName;
+                }
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,234 @@
+/**
+ * @file tests/signature_cache_tests.cpp
+ * @brief Round trips of the persistent signature cache.
+ */
+
+#include <cstdio>
+#include <string>
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "signature_cache.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            class SignatureCacheTests : public ::testing::Test
+            {
+            protected:
+                void SetUp() override
+                {
+                    _path = ::testing::TempDir() + "signature_cache_tests.cache";
+                    TearDown();
+                }
+
+                void TearDown() override
+                {
+                    std::remove(_path.c_str());
+                    std::remove((_path + ".idx").c_str());
+                    std::remove((_path + ".lock").c_str());
+                }
+
+                static SignatureCacheKey key(uint64_t hash, uint64_t seed = 0)
+                {
+                    SignatureCacheKey k;
+                    k.functionHash = hash;
+                    k.seed = seed;
+                    k.configHash = configurationHash("test");
+                    return k;
+                }
+
+                static CachedSignature value(const std::string& signature)
+                {
+                    CachedSignature v;
+                    v.signature = signature;
+                    v.stats.instructions = signature.size();
+                    v.stats.basicBlocks = 2;
+                    v.stats.globalStores = 3;
+                    return v;
+                }
+
+                static void truncateBy(const std::string& path, off_t bytes)
+                {
+                    struct stat st;
+                    ASSERT_EQ(0, stat(path.c_str(), &st));
+                    ASSERT_EQ(0, truncate(path.c_str(), st.st_size - bytes));
+                }
+
+            protected:
+                std::string _path;
+            };
+
+            TEST_F(SignatureCacheTests, insertedSignaturesAreFoundAfterReopen)
+            {
+                {
+                    SignatureCache cache;
+                    ASSERT_TRUE(cache.open(_path));
+                    EXPECT_TRUE(cache.insert(key(1), value("LOAD a STORE b")));
+                    EXPECT_TRUE(cache.insert(key(2), value("")));
+                    EXPECT_TRUE(cache.insert(key(1, 7), value("CALL f")));
+                    EXPECT_EQ(3u, cache.size());
+                }
+
+                SignatureCache cache;
+                ASSERT_TRUE(cache.open(_path));
+                EXPECT_EQ(3u, cache.size());
+
+                CachedSignature v;
+                ASSERT_TRUE(cache.lookup(key(1), v));
+                EXPECT_EQ("LOAD a STORE b", v.signature);
+                EXPECT_EQ(14u, v.stats.instructions);
+                EXPECT_EQ(2u, v.stats.basicBlocks);
+                EXPECT_EQ(3u, v.stats.globalStores);
+                ASSERT_TRUE(cache.lookup(key(2), v));
+                EXPECT_EQ("", v.signature);
+                ASSERT_TRUE(cache.lookup(key(1, 7), v));
+                EXPECT_EQ("CALL f", v.signature);
+                EXPECT_FALSE(cache.lookup(key(3), v));
+            }
+
+            TEST_F(SignatureCacheTests, keysDifferingInAnyPartDoNotHit)
+            {
+                SignatureCache cache;
+                ASSERT_TRUE(cache.open(_path));
+                ASSERT_TRUE(cache.insert(key(1), value("x")));
+
+                CachedSignature v;
+                SignatureCacheKey k = key(1);
+                k.configHash = configurationHash("other");
+                EXPECT_FALSE(cache.lookup(k, v));
+                k = key(1);
+                k.emulatorVersion = EMULATOR_VERSION + 1;
+                EXPECT_FALSE(cache.lookup(k, v));
+                EXPECT_FALSE(cache.lookup(key(1, 1), v));
+            }
+
+            TEST_F(SignatureCacheTests, latestInsertWins)
+            {
+                {
+                    SignatureCache cache;
+                    ASSERT_TRUE(cache.open(_path));
+                    ASSERT_TRUE(cache.insert(key(1), value("old")));
+                    ASSERT_TRUE(cache.insert(key(1), value("new")));
+                }
+
+                SignatureCache cache;
+                ASSERT_TRUE(cache.open(_path));
+                CachedSignature v;
+                ASSERT_TRUE(cache.lookup(key(1), v));
+                EXPECT_EQ("new", v.signature);
+                EXPECT_EQ(1u, cache.size());
+            }
+
+            TEST_F(SignatureCacheTests, recordsMissingFromIndexAreRecovered)
+            {
+                {
+                    SignatureCache cache;
+                    ASSERT_TRUE(cache.open(_path));
+                    ASSERT_TRUE(cache.insert(key(1), value("a")));
+                    ASSERT_TRUE(cache.insert(key(2), value("b")));
+                }
+                // The last index entry is torn.
+                truncateBy(_path + ".idx", 1);
+
+                SignatureCache cache;
+                ASSERT_TRUE(cache.open(_path));
+                CachedSignature v;
+                ASSERT_TRUE(cache.lookup(key(1), v));
+                EXPECT_EQ("a", v.signature);
+                ASSERT_TRUE(cache.lookup(key(2), v));
+                EXPECT_EQ("b", v.signature);
+            }
+
+            TEST_F(SignatureCacheTests, tornRecordIsDropped)
+            {
+                {
+                    SignatureCache cache;
+                    ASSERT_TRUE(cache.open(_path));
+                    ASSERT_TRUE(cache.insert(key(1), value("a")));
+                }
+                {
+                    SignatureCache cache;
+                    ASSERT_TRUE(cache.open(_path));
+                    ASSERT_TRUE(cache.insert(key(2), value("bbbbbbbbbbbbbbbbbbbb")));
+                }
+                // The process died in the middle of the last record, before
+                // its index entry.
+                truncateBy(_path, 4);
+                truncateBy(_path + ".idx", 1);
+
+                {
+                    SignatureCache cache;
+                    ASSERT_TRUE(cache.open(_path));
+                    CachedSignature v;
+                    EXPECT_TRUE(cache.lookup(key(1), v));
+                    EXPECT_FALSE(cache.lookup(key(2), v));
+                    ASSERT_TRUE(cache.insert(key(3), value("c")));
+                }
+
+                SignatureCache cache;
+                ASSERT_TRUE(cache.open(_path));
+                CachedSignature v;
+                ASSERT_TRUE(cache.lookup(key(3), v));
+                EXPECT_EQ("c", v.signature);
+                EXPECT_EQ(2u, cache.size());
+            }
+
+            TEST_F(SignatureCacheTests, processesSharingFilesKeepAllRecords)
+            {
+                const unsigned PER_PROCESS = 500;
+                SignatureCache cache;
+                ASSERT_TRUE(cache.open(_path));
+
+                pid_t pids[2];
+                for (unsigned p = 0; p < 2; ++p)
+                {
+                    pids[p] = fork();
+                    ASSERT_GE(pids[p], 0);
+                    if (pids[p] == 0)
+                    {
+                        SignatureCache child;
+                        bool ok = child.open(_path);
+                        for (unsigned i = 0; ok && i < PER_PROCESS; ++i)
+                        {
+                            ok = child.insert(
+                                    key(i, p),
+                                    value(std::string(1 + i % 50, 'a' + p)));
+                        }
+                        _exit(ok ? 0 : 1);
+                    }
+                }
+                for (pid_t pid : pids)
+                {
+                    int status = 0;
+                    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+                    ASSERT_TRUE(WIFEXITED(status));
+                    EXPECT_EQ(0, WEXITSTATUS(status));
+                }
+
+                // Opened before the children wrote, the cache finds their
+                // records on lookup.
+                CachedSignature v;
+                ASSERT_TRUE(cache.lookup(key(PER_PROCESS - 1, 1), v));
+                EXPECT_EQ(std::string(1 + (PER_PROCESS - 1) % 50, 'b'), v.signature);
+
+                SignatureCache reopened;
+                ASSERT_TRUE(reopened.open(_path));
+                EXPECT_EQ(2 * PER_PROCESS, reopened.size());
+                for (unsigned p = 0; p < 2; ++p)
+                {
+                    for (unsigned i = 0; i < PER_PROCESS; ++i)
+                    {
+                        ASSERT_TRUE(reopened.lookup(key(i, p), v));
+                        EXPECT_EQ(std::string(1 + i % 50, 'a' + p), v.signature);
+                    }
+                }
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
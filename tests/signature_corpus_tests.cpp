@@ -0,0 +1,167 @@
+/**
+ * @file tests/signature_corpus_tests.cpp
+ * @brief Round trips of the memory-mappable signature corpus.
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "signature_corpus.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            class SignatureCorpusTests : public ::testing::Test
+            {
+            protected:
+                struct Record
+                {
+                    std::string module;
+                    std::string function;
+                    std::string signature;
+                    bool failed;
+                };
+
+                void SetUp() override
+                {
+                    _path = ::testing::TempDir() + "signature_corpus_tests.corpus";
+                    _config.numHashes = 64;
+                    _config.bands = 16;
+                    _config.seed = 42;
+                    _records = {
+                            {"a.bc", "f", "LOAD g;ADD;STORE h;", false},
+                            {"a.bc", "g", "CALL f;LOAD g;", false},
+                            {"a.bc", "h", "", true},
+                            {"b.bc", "f", "LOAD g;ADD;STORE h;RET;", false},
+                            {"b.bc", "k", "", false}};
+                }
+
+                void TearDown() override
+                {
+                    std::remove(_path.c_str());
+                }
+
+                void write(std::size_t batchSize)
+                {
+                    CorpusWriter writer(_path, _config, batchSize);
+                    ASSERT_TRUE(writer.isOpen());
+                    auto appender = writer.makeAppender();
+                    for (std::size_t i = 0; i < _records.size(); ++i)
+                    {
+                        auto& r = _records[i];
+                        RunStats stats;
+                        stats.instructions = i + 1;
+                        stats.memoryStores = 10 * i;
+                        stats.globalStores = 100 * i;
+                        appender->add(r.module, r.function, r.signature, stats, r.failed);
+                    }
+                    appender.reset();
+                    ASSERT_TRUE(writer.finish());
+                }
+
+            protected:
+                std::string _path;
+                MinHashConfig _config;
+                std::vector<Record> _records;
+            };
+
+            TEST_F(SignatureCorpusTests, functionsRoundTrip)
+            {
+                write(2);
+
+                SignatureCorpus corpus;
+                ASSERT_TRUE(corpus.open(_path));
+                ASSERT_EQ(_records.size(), corpus.size());
+                MinHashConfig config = corpus.getMinHashConfig();
+                EXPECT_EQ(_config.numHashes, config.numHashes);
+                EXPECT_EQ(_config.bands, config.bands);
+                EXPECT_EQ(_config.shingle, config.shingle);
+                EXPECT_EQ(_config.seed, config.seed);
+
+                MinHasher hasher(_config);
+                for (std::size_t i = 0; i < _records.size(); ++i)
+                {
+                    auto& r = _records[i];
+                    EXPECT_EQ(r.module, corpus.getModuleName(i));
+                    EXPECT_EQ(r.function, corpus.getFunctionName(i));
+                    EXPECT_EQ(r.failed, corpus.isFailed(i));
+
+                    RunStats stats = corpus.getRunStats(i);
+                    EXPECT_EQ(i + 1, stats.instructions);
+                    EXPECT_EQ(10 * i, stats.memoryStores);
+                    EXPECT_EQ(100 * i, stats.globalStores);
+                    EXPECT_EQ(0u, stats.calls);
+
+                    std::string signature;
+                    for (uint32_t t : corpus.getTokenSequence(i))
+                    {
+                        signature += corpus.getTokenString(t);
+                        signature += ";";
+                    }
+                    EXPECT_EQ(r.failed ? std::string() : r.signature, signature);
+
+                    std::vector<uint32_t> sketch = hasher.sketch(r.signature);
+                    EXPECT_EQ(sketch, std::vector<uint32_t>(
+                            corpus.getSketch(i),
+                            corpus.getSketch(i) + _config.numHashes));
+                }
+
+                SketchView view = corpus.getSketches();
+                EXPECT_EQ(_records.size(), view.count);
+                EXPECT_EQ(_config.numHashes, view.numHashes);
+                EXPECT_EQ(corpus.getSketch(3), view[3]);
+            }
+
+            TEST_F(SignatureCorpusTests, batchSizeDoesNotChangeContents)
+            {
+                write(256);
+                std::FILE* f = std::fopen(_path.c_str(), "rb");
+                ASSERT_TRUE(f != nullptr);
+                std::vector<char> one(1 << 20);
+                one.resize(std::fread(one.data(), 1, one.size(), f));
+                std::fclose(f);
+
+                write(1);
+                f = std::fopen(_path.c_str(), "rb");
+                ASSERT_TRUE(f != nullptr);
+                std::vector<char> other(1 << 20);
+                other.resize(std::fread(other.data(), 1, other.size(), f));
+                std::fclose(f);
+
+                EXPECT_EQ(one, other);
+            }
+
+            TEST_F(SignatureCorpusTests, truncatedCorpusIsRejected)
+            {
+                write(2);
+                struct stat st;
+                ASSERT_EQ(0, stat(_path.c_str(), &st));
+                ASSERT_EQ(0, truncate(_path.c_str(), st.st_size - 8));
+
+                SignatureCorpus corpus;
+                EXPECT_FALSE(corpus.open(_path));
+                EXPECT_EQ(0u, corpus.size());
+            }
+
+            TEST_F(SignatureCorpusTests, emptyCorpusRoundTrips)
+            {
+                {
+                    CorpusWriter writer(_path, _config);
+                    ASSERT_TRUE(writer.finish());
+                }
+
+                SignatureCorpus corpus;
+                ASSERT_TRUE(corpus.open(_path));
+                EXPECT_EQ(0u, corpus.size());
+                EXPECT_EQ(0u, corpus.getSketches().count);
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
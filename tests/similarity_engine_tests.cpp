@@ -0,0 +1,188 @@
+/**
+ * @file tests/similarity_engine_tests.cpp
+ * @brief Tests of MinHash sketches and the LSH search over them.
+ */
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "similarity_engine.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            class SimilarityEngineTests : public ::testing::Test
+            {
+            protected:
+                static const unsigned ITEMS = 50;
+                static const unsigned TOKENS = 60;
+
+                void SetUp() override
+                {
+                    _path = ::testing::TempDir() + "similarity_engine_tests.sketches";
+                    _config.numHashes = 64;
+                    _config.bands = 16;
+                    _config.seed = 42;
+
+                    // Unrelated signatures, then near-duplicates of two of
+                    // them: one token replaced and one appended.
+                    for (unsigned i = 0; i < ITEMS; ++i)
+                    {
+                        std::string s;
+                        for (unsigned j = 0; j < TOKENS; ++j)
+                        {
+                            s += "OP" + std::to_string(i * 1000 + j) + ";";
+                        }
+                        _signatures.push_back(s);
+                    }
+                    std::string changed = _signatures[0];
+                    changed.replace(0, changed.find(';'), "CALL f");
+                    _signatures.push_back(changed);
+                    _signatures.push_back(_signatures[7] + "RET;");
+
+                    MinHasher hasher(_config);
+                    _sketches.resize(_signatures.size() * _config.numHashes);
+                    for (std::size_t i = 0; i < _signatures.size(); ++i)
+                    {
+                        hasher.sketch(
+                                _signatures[i],
+                                &_sketches[i * _config.numHashes]);
+                    }
+                }
+
+                void TearDown() override
+                {
+                    std::remove(_path.c_str());
+                }
+
+                SketchView view() const
+                {
+                    SketchView v;
+                    v.data = _sketches.data();
+                    v.count = _signatures.size();
+                    v.numHashes = _config.numHashes;
+                    return v;
+                }
+
+            protected:
+                std::string _path;
+                MinHashConfig _config;
+                std::vector<std::string> _signatures;
+                std::vector<uint32_t> _sketches;
+            };
+
+            TEST_F(SimilarityEngineTests, sketchesAreDeterministic)
+            {
+                MinHasher hasher(_config);
+                MinHasher other(_config);
+                auto s = hasher.sketch(_signatures[3]);
+                ASSERT_EQ(_config.numHashes, s.size());
+                EXPECT_EQ(s, other.sketch(_signatures[3]));
+                EXPECT_EQ(s, hasher.sketch(_signatures[3]));
+                EXPECT_NE(s, hasher.sketch(_signatures[4]));
+
+                MinHashConfig seeded = _config;
+                seeded.seed = 43;
+                EXPECT_NE(s, MinHasher(seeded).sketch(_signatures[3]));
+            }
+
+            TEST_F(SimilarityEngineTests, emptySignatureHasEmptySketch)
+            {
+                MinHasher hasher(_config);
+                std::vector<uint32_t> s(_config.numHashes);
+                EXPECT_FALSE(hasher.sketch("", s.data()));
+                for (uint32_t v : s)
+                {
+                    EXPECT_EQ(EMPTY_SKETCH_VALUE, v);
+                }
+            }
+
+            TEST_F(SimilarityEngineTests, sketchFileRoundTrip)
+            {
+                ASSERT_TRUE(SketchFile::write(_path, view(), _config.seed));
+
+                SketchFile file;
+                ASSERT_TRUE(file.open(_path));
+                EXPECT_EQ(_config.seed, file.getSeed());
+                SketchView v = file.getSketches();
+                ASSERT_EQ(_signatures.size(), v.count);
+                ASSERT_EQ(_config.numHashes, v.numHashes);
+                EXPECT_EQ(
+                        _sketches,
+                        std::vector<uint32_t>(v.data, v.data + v.count * v.numHashes));
+            }
+
+            TEST_F(SimilarityEngineTests, truncatedSketchFileIsRejected)
+            {
+                ASSERT_TRUE(SketchFile::write(_path, view(), _config.seed));
+                struct stat st;
+                ASSERT_EQ(0, stat(_path.c_str(), &st));
+                ASSERT_EQ(0, truncate(_path.c_str(), st.st_size - 1));
+
+                SketchFile file;
+                EXPECT_FALSE(file.open(_path));
+                EXPECT_EQ(0u, file.getSketches().count);
+
+                // Not even the header.
+                ASSERT_EQ(0, truncate(_path.c_str(), 16));
+                EXPECT_FALSE(file.open(_path));
+            }
+
+            TEST_F(SimilarityEngineTests, allPairsAboveFindsNearDuplicates)
+            {
+                SimilarityEngine engine(_config, 2);
+                ASSERT_TRUE(engine.build(view()));
+
+                auto pairs = engine.allPairsAbove(0.7);
+                ASSERT_EQ(2u, pairs.size());
+                EXPECT_EQ(0u, pairs[0].a);
+                EXPECT_EQ(unsigned(ITEMS), pairs[0].b);
+                EXPECT_EQ(7u, pairs[1].a);
+                EXPECT_EQ(ITEMS + 1u, pairs[1].b);
+                for (auto& p : pairs)
+                {
+                    EXPECT_GE(p.similarity, 0.7);
+                    EXPECT_LT(p.similarity, 1.0);
+                }
+            }
+
+            TEST_F(SimilarityEngineTests, topKFindsNearDuplicateFirst)
+            {
+                SimilarityEngine engine(_config);
+                ASSERT_TRUE(engine.build(view()));
+
+                SketchView v = view();
+                auto top = engine.topK(v[ITEMS], 3, ITEMS);
+                ASSERT_FALSE(top.empty());
+                EXPECT_EQ(0u, top[0].item);
+                EXPECT_GE(top[0].similarity, 0.7);
+
+                // Without exclusion the query finds itself first.
+                top = engine.topK(v[ITEMS + 1], 1);
+                ASSERT_EQ(1u, top.size());
+                EXPECT_EQ(ITEMS + 1u, top[0].item);
+                EXPECT_EQ(1.0, top[0].similarity);
+
+                auto batch = engine.topKBatch(v, 2);
+                ASSERT_EQ(v.count, batch.size());
+                ASSERT_FALSE(batch[7].empty());
+                EXPECT_EQ(7u, batch[7][0].item);
+            }
+
+            TEST_F(SimilarityEngineTests, buildRejectsOtherSketchWidth)
+            {
+                MinHashConfig wide = _config;
+                wide.numHashes = 128;
+                SimilarityEngine engine(wide);
+                EXPECT_FALSE(engine.build(view()));
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
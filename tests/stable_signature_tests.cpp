@@ -0,0 +1,114 @@
+/**
+ * @file tests/stable_signature_tests.cpp
+ * @brief Tests of signatures stable across emulation seeds.
+ */
+
+#include <memory>
+
+#include <gtest/gtest.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include "program_image.h"
+#include "stable_signature.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            class StableSignatureTests : public ::testing::Test
+            {
+            protected:
+                void SetUp() override
+                {
+                    SMDiagnostic err;
+                    _module = parseAssemblyString(
+                            "@g = global i32 7\n"
+                            "@h = global i32 0\n"
+                            "\n"
+                            "define i32 @f(i32 %a) {\n"
+                            "entry:\n"
+                            "  %v = load i32* @g\n"
+                            "  %w = add i32 %v, 1\n"
+                            "  store i32 %w, i32* @g\n"
+                            "  store i32 %a, i32* @h\n"
+                            "  %c = icmp ult i32 %a, 2147483648\n"
+                            "  br i1 %c, label %low, label %high\n"
+                            "low:\n"
+                            "  store i32 1, i32* inttoptr (i64 4096 to i32*)\n"
+                            "  ret i32 %w\n"
+                            "high:\n"
+                            "  store i32 2, i32* inttoptr (i64 8192 to i32*)\n"
+                            "  ret i32 %a\n"
+                            "}\n",
+                            err,
+                            _context);
+                    ASSERT_TRUE(_module != nullptr);
+                    _f = _module->getFunction("f");
+                }
+
+                static void expectEqual(
+                        const StableSignatureResult& a,
+                        const StableSignatureResult& b)
+                {
+                    EXPECT_EQ(a.signature, b.signature);
+                    EXPECT_EQ(a.featuresSeen, b.featuresSeen);
+                    EXPECT_EQ(a.runs, b.runs);
+                    EXPECT_EQ(a.failedRuns, b.failedRuns);
+                    ASSERT_EQ(a.features.size(), b.features.size());
+                    for (std::size_t i = 0; i < a.features.size(); ++i)
+                    {
+                        EXPECT_EQ(a.features[i].token, b.features[i].token);
+                        EXPECT_EQ(a.features[i].occurrence, b.features[i].occurrence);
+                        EXPECT_EQ(a.features[i].weight, b.features[i].weight);
+                    }
+                }
+
+            protected:
+                LLVMContext _context;
+                std::unique_ptr<Module> _module;
+                Function* _f = nullptr;
+            };
+
+            TEST_F(StableSignatureTests, argumentDependentFeaturesAreDropped)
+            {
+                LlvmIrEmulator emu(_module.get());
+                StabilityConfig config;
+                config.seeds = 8;
+                config.threshold = 1.0;
+                auto res = stableSignature(emu, _f, config);
+
+                EXPECT_EQ(8u, res.runs);
+                EXPECT_EQ(0u, res.failedRuns);
+                EXPECT_FALSE(res.signature.empty());
+                EXPECT_LT(res.features.size(), res.featuresSeen);
+                for (auto& sf : res.features)
+                {
+                    EXPECT_EQ(1.0, sf.weight);
+                }
+            }
+
+            TEST_F(StableSignatureTests, concurrentSeedsEqualSequentialOnes)
+            {
+                auto image = ProgramImage::build(_module.get());
+                ASSERT_TRUE(image != nullptr);
+                LlvmIrEmulator emu(_module.get());
+
+                StabilityConfig config;
+                config.seeds = 11;
+                config.threshold = 0.5;
+                auto sequential = stableSignature(emu, _f, config);
+                for (unsigned threads : {1u, 3u, 4u, 16u})
+                {
+                    config.threads = threads;
+                    expectEqual(sequential, stableSignature(image, _f, config));
+                }
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
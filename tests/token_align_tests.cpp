@@ -0,0 +1,162 @@
+/**
+ * @file tests/token_align_tests.cpp
+ * @brief Tests of token alignments against plain dynamic programming.
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "token_align.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace tests {
+
+            class TokenAlignTests : public ::testing::Test
+            {
+            protected:
+                TokenSequence random(std::size_t size, uint32_t alphabet)
+                {
+                    std::uniform_int_distribution<uint32_t> token(0, alphabet - 1);
+                    TokenSequence s(size);
+                    for (auto& t : s)
+                    {
+                        t = token(_rng);
+                    }
+                    return s;
+                }
+
+                static uint32_t lcsReference(const TokenSequence& a, const TokenSequence& b)
+                {
+                    std::vector<std::vector<uint32_t>> m(
+                            a.size() + 1,
+                            std::vector<uint32_t>(b.size() + 1, 0));
+                    for (std::size_t i = 1; i <= a.size(); ++i)
+                    {
+                        for (std::size_t j = 1; j <= b.size(); ++j)
+                        {
+                            m[i][j] = a[i - 1] == b[j - 1]
+                                    ? m[i - 1][j - 1] + 1
+                                    : std::max(m[i - 1][j], m[i][j - 1]);
+                        }
+                    }
+                    return m[a.size()][b.size()];
+                }
+
+                // Unbanded Smith-Waterman.
+                static int32_t swReference(
+                        const TokenSequence& a,
+                        const TokenSequence& b,
+                        const AlignScoring& sc)
+                {
+                    std::vector<std::vector<int32_t>> m(
+                            a.size() + 1,
+                            std::vector<int32_t>(b.size() + 1, 0));
+                    int32_t best = 0;
+                    for (std::size_t i = 1; i <= a.size(); ++i)
+                    {
+                        for (std::size_t j = 1; j <= b.size(); ++j)
+                        {
+                            int32_t h = m[i - 1][j - 1]
+                                    + (a[i - 1] == b[j - 1] ? sc.match : sc.mismatch);
+                            h = std::max(h, m[i - 1][j] + sc.gap);
+                            h = std::max(h, m[i][j - 1] + sc.gap);
+                            m[i][j] = std::max(h, 0);
+                            best = std::max(best, m[i][j]);
+                        }
+                    }
+                    return best;
+                }
+
+            protected:
+                std::mt19937 _rng{12345};
+            };
+
+            TEST_F(TokenAlignTests, multiWordLcsMatchesDynamicProgramming)
+            {
+                // Patterns of one to five 64-bit words, word boundaries
+                // included.
+                for (std::size_t n : {1u, 63u, 64u, 65u, 127u, 128u, 129u, 200u, 300u})
+                {
+                    for (std::size_t m : {0u, 1u, 50u, 64u, 150u, 333u})
+                    {
+                        for (uint32_t alphabet : {2u, 5u, 40u})
+                        {
+                            TokenSequence a = random(n, alphabet);
+                            TokenSequence b = random(m, alphabet);
+                            uint32_t expected = lcsReference(a, b);
+                            EXPECT_EQ(expected, LcsPattern(a).lcs(b))
+                                    << n << " x " << m << ", alphabet " << alphabet;
+                            EXPECT_EQ(expected, lcsLength(a, b));
+                        }
+                    }
+                }
+            }
+
+            TEST_F(TokenAlignTests, lcsOfEqualAndDisjointSequences)
+            {
+                TokenSequence a = random(150, 10);
+                EXPECT_EQ(150u, LcsPattern(a).lcs(a));
+
+                TokenSequence b(100, 99);
+                EXPECT_EQ(0u, LcsPattern(a).lcs(b));
+                EXPECT_EQ(0u, LcsPattern(TokenSequence()).lcs(a));
+            }
+
+            TEST_F(TokenAlignTests, scalarSmithWatermanMatchesDynamicProgramming)
+            {
+                AlignScoring sc;
+                for (std::size_t n : {0u, 1u, 7u, 30u, 61u})
+                {
+                    for (std::size_t m : {1u, 9u, 30u, 45u})
+                    {
+                        TokenSequence a = random(n, 4);
+                        TokenSequence b = random(m, 4);
+                        // The band covers the whole matrix.
+                        EXPECT_EQ(
+                                swReference(a, b, sc),
+                                smithWatermanScalar(a, b, sc, n + m + 1))
+                                << n << " x " << m;
+                    }
+                }
+            }
+
+            TEST_F(TokenAlignTests, avx2SmithWatermanMatchesScalar)
+            {
+                if (!hasAvx2Aligner())
+                {
+                    GTEST_SKIP() << "CPU without AVX2, smithWaterman() is the scalar kernel";
+                }
+
+                // Lengths and bands that are not multiples of the eight
+                // cells of a vector, and the default band.
+                AlignScoring scorings[2];
+                scorings[1].match = 3;
+                scorings[1].mismatch = -2;
+                scorings[1].gap = -2;
+                for (auto& sc : scorings)
+                {
+                    for (std::size_t n : {1u, 5u, 8u, 13u, 16u, 37u, 100u, 203u})
+                    {
+                        for (std::size_t m : {1u, 7u, 8u, 9u, 31u, 64u, 150u})
+                        {
+                            TokenSequence a = random(n, 4);
+                            TokenSequence b = random(m, 4);
+                            for (std::size_t band : {0u, 1u, 3u, 8u, 11u, 17u, 64u, 300u})
+                            {
+                                EXPECT_EQ(
+                                        smithWatermanScalar(a, b, sc, band),
+                                        smithWaterman(a, b, sc, band))
+                                        << n << " x " << m << ", band " << band;
+                            }
+                        }
+                    }
+                }
+            }
+
+        } // tests
+    } // llvmir_emul
+} // retdec
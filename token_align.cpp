@@ -0,0 +1,378 @@
+/**
+ * @file token_align.cpp
+ * @brief Token-level alignment of similarity strings.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define LLVMIR_EMUL_HAVE_AVX2_KERNEL 1
+#include <immintrin.h>
+#endif
+
+#include "parallel_for.h"
+#include "token_align.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+/**
+* Anti-diagonal buffers of the banded Smith-Waterman matrix. Cells of
+* diagonal d are (i, d - i) and are stored at index i, so the neighbours of
+* a cell are at the same or previous index of the two previous diagonals.
+*/
+            struct SwState
+            {
+                SwState(const TokenSequence& a, const TokenSequence& b, std::size_t band) :
+                        n(a.size()),
+                        m(b.size()),
+                        w(band ? band : (n > m ? n - m : m - n) + 32),
+                        reversed(b.rbegin(), b.rend()),
+                        d0(n + 2, 0),
+                        d1(n + 2, 0),
+                        d2(n + 2, 0)
+                {
+
+                }
+
+                // Cells of diagonal d inside the band and the matrix.
+                bool range(std::size_t d, std::size_t& lo, std::size_t& hi) const
+                {
+                    lo = std::max<std::size_t>(1, d > m ? d - m : 1);
+                    if (d > w)
+                    {
+                        lo = std::max(lo, (d - w + 1) / 2);
+                    }
+                    hi = std::min(n, d - 1);
+                    hi = std::min(hi, (d + w) / 2);
+                    return lo <= hi;
+                }
+
+                // Rotates buffers and fences the computed range with zeros,
+                // which is what out-of-band cells are worth.
+                void finish(std::size_t lo, std::size_t hi)
+                {
+                    d0[lo - 1] = 0;
+                    if (hi + 1 <= n)
+                    {
+                        d0[hi + 1] = 0;
+                    }
+                    std::swap(d2, d1);
+                    std::swap(d1, d0);
+                }
+
+                // Diagonal with no cells in the band, all its cells are 0.
+                void skip()
+                {
+                    std::fill(d0.begin(), d0.end(), 0);
+                    std::swap(d2, d1);
+                    std::swap(d1, d0);
+                }
+
+                std::size_t n;
+                std::size_t m;
+                std::size_t w;
+                /// b reversed -- b[d - i - 1] is reversed[m - d + i], which
+                /// is contiguous in i.
+                TokenSequence reversed;
+                /// Diagonal being computed, previous one, and the one before.
+                std::vector<int32_t> d0;
+                std::vector<int32_t> d1;
+                std::vector<int32_t> d2;
+            };
+
+            int32_t swCell(
+                    const SwState& st,
+                    const TokenSequence& a,
+                    std::size_t d,
+                    std::size_t i,
+                    const AlignScoring& sc)
+            {
+                int32_t sub = a[i - 1] == st.reversed[st.m - d + i] ? sc.match : sc.mismatch;
+                int32_t h = st.d2[i - 1] + sub;
+                h = std::max(h, st.d1[i - 1] + sc.gap);
+                h = std::max(h, st.d1[i] + sc.gap);
+                return std::max(h, 0);
+            }
+
+#ifdef LLVMIR_EMUL_HAVE_AVX2_KERNEL
+            __attribute__((target("avx2")))
+            int32_t smithWatermanAvx2(
+                    const TokenSequence& a,
+                    const TokenSequence& b,
+                    const AlignScoring& sc,
+                    std::size_t band)
+            {
+                SwState st(a, b, band);
+                const __m256i zero = _mm256_setzero_si256();
+                const __m256i gap = _mm256_set1_epi32(sc.gap);
+                const __m256i match = _mm256_set1_epi32(sc.match);
+                const __m256i mismatch = _mm256_set1_epi32(sc.mismatch);
+                __m256i bestv = zero;
+                int32_t best = 0;
+
+                for (std::size_t d = 2; d <= st.n + st.m; ++d)
+                {
+                    std::size_t lo, hi;
+                    if (!st.range(d, lo, hi))
+                    {
+                        st.skip();
+                        continue;
+                    }
+
+                    std::size_t i = lo;
+                    for (; i + 7 <= hi; i += 8)
+                    {
+                        __m256i av = _mm256_loadu_si256(
+                                reinterpret_cast<const __m256i*>(&a[i - 1]));
+                        __m256i bv = _mm256_loadu_si256(
+                                reinterpret_cast<const __m256i*>(&st.reversed[st.m - d + i]));
+                        __m256i sub = _mm256_blendv_epi8(
+                                mismatch, match, _mm256_cmpeq_epi32(av, bv));
+
+                        __m256i h = _mm256_add_epi32(
+                                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&st.d2[i - 1])), sub);
+                        h = _mm256_max_epi32(h, _mm256_add_epi32(
+                                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&st.d1[i - 1])), gap));
+                        h = _mm256_max_epi32(h, _mm256_add_epi32(
+                                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&st.d1[i])), gap));
+                        h = _mm256_max_epi32(h, zero);
+                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&st.d0[i]), h);
+                        bestv = _mm256_max_epi32(bestv, h);
+                    }
+                    for (; i <= hi; ++i)
+                    {
+                        st.d0[i] = swCell(st, a, d, i, sc);
+                        best = std::max(best, st.d0[i]);
+                    }
+                    st.finish(lo, hi);
+                }
+
+                int32_t lanes[8];
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), bestv);
+                return std::max(best, *std::max_element(lanes, lanes + 8));
+            }
+#endif
+
+        } // anonymous namespace
+
+//
+//=============================================================================
+// TokenInterner
+//=============================================================================
+//
+
+        uint32_t TokenInterner::intern(const char* token, std::size_t size)
+        {
+            auto res = _ids.emplace(std::string(token, size), _tokens.size());
+            if (res.second)
+            {
+                // Keys of unordered_map are never moved.
+                _tokens.push_back(&res.first->first);
+            }
+            return res.first->second;
+        }
+
+        TokenSequence TokenInterner::tokenize(const std::string& signature)
+        {
+            TokenSequence ret;
+            const char* p = signature.data();
+            const char* end = p + signature.size();
+            while (p < end)
+            {
+                const char* e = static_cast<const char*>(memchr(p, ';', end - p));
+                if (e == nullptr)
+                {
+                    e = end;
+                }
+                if (e != p)
+                {
+                    ret.push_back(intern(p, e - p));
+                }
+                p = e + 1;
+            }
+            return ret;
+        }
+
+        const std::string& TokenInterner::getToken(uint32_t id) const
+        {
+            return *_tokens.at(id);
+        }
+
+        std::size_t TokenInterner::size() const
+        {
+            return _tokens.size();
+        }
+
+//
+//=============================================================================
+// LCS
+//=============================================================================
+//
+
+        LcsPattern::LcsPattern(const TokenSequence& pattern) :
+                _size(pattern.size()),
+                _words((pattern.size() + 63) / 64)
+        {
+            for (std::size_t i = 0; i < pattern.size(); ++i)
+            {
+                auto res = _tokenRows.emplace(pattern[i], _tokenRows.size());
+                if (res.second)
+                {
+                    _rows.resize(_rows.size() + _words, 0);
+                }
+                _rows[res.first->second * _words + i / 64] |= uint64_t(1) << (i % 64);
+            }
+        }
+
+/**
+* V starts as all ones; for every text token with match vector M:
+* V = (V + (V & M)) | (V & ~M), with the addition carried across words.
+* Zero bits of V then count the LCS.
+*/
+        uint32_t LcsPattern::lcs(const uint32_t* text, std::size_t size) const
+        {
+            if (_size == 0 || size == 0)
+            {
+                return 0;
+            }
+
+            std::vector<uint64_t> v(_words, ~uint64_t(0));
+            for (std::size_t j = 0; j < size; ++j)
+            {
+                auto rIt = _tokenRows.find(text[j]);
+                if (rIt == _tokenRows.end())
+                {
+                    // No match anywhere, V does not change.
+                    continue;
+                }
+                const uint64_t* mrow = &_rows[rIt->second * _words];
+                uint64_t carry = 0;
+                for (std::size_t k = 0; k < _words; ++k)
+                {
+                    uint64_t u = v[k] & mrow[k];
+                    uint64_t sum = v[k] + u;
+                    uint64_t c1 = sum < v[k];
+                    uint64_t sum2 = sum + carry;
+                    uint64_t c2 = sum2 < sum;
+                    carry = c1 | c2;
+                    v[k] = sum2 | (v[k] & ~mrow[k]);
+                }
+            }
+
+            uint32_t zeros = 0;
+            for (std::size_t k = 0; k < _words; ++k)
+            {
+                uint64_t w = ~v[k];
+                if (k + 1 == _words && _size % 64)
+                {
+                    w &= (uint64_t(1) << (_size % 64)) - 1;
+                }
+                zeros += __builtin_popcountll(w);
+            }
+            return zeros;
+        }
+
+        uint32_t LcsPattern::lcs(const TokenSequence& text) const
+        {
+            return lcs(text.data(), text.size());
+        }
+
+        uint32_t lcsLength(const TokenSequence& a, const TokenSequence& b)
+        {
+            // Shorter pattern means fewer words per step.
+            return a.size() <= b.size()
+                    ? LcsPattern(a).lcs(b)
+                    : LcsPattern(b).lcs(a);
+        }
+
+//
+//=============================================================================
+// Smith-Waterman
+//=============================================================================
+//
+
+        int32_t smithWatermanScalar(
+                const TokenSequence& a,
+                const TokenSequence& b,
+                const AlignScoring& scoring,
+                std::size_t band)
+        {
+            SwState st(a, b, band);
+            int32_t best = 0;
+            for (std::size_t d = 2; d <= st.n + st.m; ++d)
+            {
+                std::size_t lo, hi;
+                if (!st.range(d, lo, hi))
+                {
+                    st.skip();
+                    continue;
+                }
+                for (std::size_t i = lo; i <= hi; ++i)
+                {
+                    st.d0[i] = swCell(st, a, d, i, scoring);
+                    best = std::max(best, st.d0[i]);
+                }
+                st.finish(lo, hi);
+            }
+            return best;
+        }
+
+        bool hasAvx2Aligner()
+        {
+#ifdef LLVMIR_EMUL_HAVE_AVX2_KERNEL
+            static const bool avx2 = __builtin_cpu_supports("avx2");
+            return avx2;
+#else
+            return false;
+#endif
+        }
+
+        int32_t smithWaterman(
+                const TokenSequence& a,
+                const TokenSequence& b,
+                const AlignScoring& scoring,
+                std::size_t band)
+        {
+#ifdef LLVMIR_EMUL_HAVE_AVX2_KERNEL
+            if (hasAvx2Aligner())
+            {
+                return smithWatermanAvx2(a, b, scoring, band);
+            }
+#endif
+            return smithWatermanScalar(a, b, scoring, band);
+        }
+
+        std::vector<AlignmentScore> scoreCandidates(
+                const TokenSequence& query,
+                const std::vector<const TokenSequence*>& candidates,
+                const AlignScoring& scoring,
+                unsigned threads)
+        {
+            std::vector<AlignmentScore> ret(candidates.size());
+            LcsPattern pattern(query);
+
+            parallelFor(candidates.size(), threads, [&](std::size_t b, std::size_t e)
+            {
+                for (std::size_t i = b; i < e; ++i)
+                {
+                    const TokenSequence& c = *candidates[i];
+                    AlignmentScore& s = ret[i];
+                    s.lcs = pattern.lcs(c);
+                    std::size_t total = query.size() + c.size();
+                    s.lcsSimilarity = total ? 2.0 * s.lcs / total : 1.0;
+
+                    s.localScore = smithWaterman(query, c, scoring);
+                    std::size_t shorter = std::min(query.size(), c.size());
+                    s.localSimilarity = shorter && scoring.match > 0
+                            ? double(s.localScore) / (double(scoring.match) * shorter)
+                            : 0.0;
+                }
+            }, 16);
+            return ret;
+        }
+
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,117 @@
+/**
+ * @file token_align.h
+ * @brief Token-level alignment of similarity strings.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_TOKEN_ALIGN_H
+#define RETDEC_LLVMIR_EMUL_TOKEN_ALIGN_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        using TokenSequence = std::vector<uint32_t>;
+
+/**
+ * Maps similarity string tokens (separated by @c ';') to dense integer ids,
+ * so that alignments compare integers instead of strings. Not thread safe
+ * -- intern everything before scoring in parallel.
+ */
+        class TokenInterner
+        {
+        public:
+            uint32_t intern(const char* token, std::size_t size);
+            TokenSequence tokenize(const std::string& signature);
+
+            const std::string& getToken(uint32_t id) const;
+            std::size_t size() const;
+
+        private:
+            std::unordered_map<std::string, uint32_t> _ids;
+            std::vector<const std::string*> _tokens;
+        };
+
+/**
+ * Bit-parallel longest common subsequence (Hyyro's variant of Allison-Dix).
+ * The pattern's match bit vectors are computed once, then every text is
+ * scanned in O(|text| * ceil(|pattern| / 64)).
+ */
+        class LcsPattern
+        {
+        public:
+            explicit LcsPattern(const TokenSequence& pattern);
+
+            uint32_t lcs(const uint32_t* text, std::size_t size) const;
+            uint32_t lcs(const TokenSequence& text) const;
+
+        private:
+            std::size_t _size;
+            std::size_t _words;
+            /// Match vectors of all distinct pattern tokens, @c _words each.
+            std::unordered_map<uint32_t, uint32_t> _tokenRows;
+            std::vector<uint64_t> _rows;
+        };
+
+        uint32_t lcsLength(const TokenSequence& a, const TokenSequence& b);
+
+        struct AlignScoring
+        {
+            int32_t match = 2;
+            int32_t mismatch = -1;
+            int32_t gap = -1;
+        };
+
+/**
+ * Smith-Waterman local alignment score with linear gaps, restricted to the
+ * band |i - j| <= @a band around the main diagonal. Band @c 0 means
+ * |len(a) - len(b)| + 32, which keeps the whole diagonal of the shorter
+ * sequence reachable.
+ *
+ * The matrix is computed by anti-diagonals, whose cells are independent.
+ * On x86-64 an AVX2 kernel processing eight cells at a time is selected
+ * at run time if the CPU supports it, otherwise a scalar kernel is used.
+ * Both give identical results.
+ */
+        int32_t smithWaterman(
+                const TokenSequence& a,
+                const TokenSequence& b,
+                const AlignScoring& scoring = AlignScoring(),
+                std::size_t band = 0);
+
+        int32_t smithWatermanScalar(
+                const TokenSequence& a,
+                const TokenSequence& b,
+                const AlignScoring& scoring = AlignScoring(),
+                std::size_t band = 0);
+
+        bool hasAvx2Aligner();
+
+        struct AlignmentScore
+        {
+            uint32_t lcs = 0;
+            /// 2 * lcs / (len(a) + len(b))
+            double lcsSimilarity = 0.0;
+            int32_t localScore = 0;
+            /// Local score relative to a perfect match of the shorter
+            /// sequence.
+            double localSimilarity = 0.0;
+        };
+
+/**
+ * Scores one query against many candidates -- the exact re-scoring step
+ * after an LSH search. Query preprocessing is shared by all candidates.
+ */
+        std::vector<AlignmentScore> scoreCandidates(
+                const TokenSequence& query,
+                const std::vector<const TokenSequence*>& candidates,
+                const AlignScoring& scoring = AlignScoring(),
+                unsigned threads = 1);
+
+    } // llvmir_emul
+} // retdec
+
+#endif
@@ -0,0 +1,580 @@
+/**
+ * @file worker_pool.cpp
+ * @brief Crash-isolated pool of forked emulation workers.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include "signature_cache.h"
+#include "signature_corpus.h"
+#include "worker_pool.h"
+
+using namespace llvm;
+
+namespace retdec {
+    namespace llvmir_emul {
+        namespace {
+
+            static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+                    "shared memory needs address-free 64-bit atomics");
+
+            const int64_t NO_FUNCTION = -1;
+
+            const uint32_t SLOT_FAILED = 1;
+            /// Last chunk of the function's signature.
+            const uint32_t SLOT_LAST = 2;
+
+            struct QueueHeader
+            {
+                std::atomic<uint64_t> next;
+                uint64_t count;
+            };
+
+/**
+* Head is advanced by the parent only, tail and the rest by the worker
+* only. They live on separate cache lines.
+*/
+            struct WorkerControl
+            {
+                std::atomic<int64_t> current;
+                std::atomic<int64_t> startedMs;
+                alignas(64) std::atomic<uint64_t> head;
+                alignas(64) std::atomic<uint64_t> tail;
+            };
+
+            struct SlotHeader
+            {
+                uint32_t function;
+                uint32_t flags;
+                uint32_t length;
+                uint32_t reserved;
+                uint64_t stats[7];
+            };
+
+            std::size_t alignUp(std::size_t n, std::size_t a)
+            {
+                return (n + a - 1) / a * a;
+            }
+
+            int64_t nowMs()
+            {
+                // Steady clock is CLOCK_MONOTONIC, comparable across processes.
+                return std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()).count();
+            }
+
+/**
+* One anonymous shared mapping per module: queue header, function indexes,
+* worker controls, then the rings.
+*/
+            class SharedRegion
+            {
+            public:
+                SharedRegion(
+                        std::size_t functions,
+                        unsigned workers,
+                        unsigned slots,
+                        unsigned slotBytes) :
+                        _slots(slots),
+                        _slotBytes(slotBytes),
+                        _slotSize(alignUp(sizeof(SlotHeader) + slotBytes, 64))
+                {
+                    _idsOffset = alignUp(sizeof(QueueHeader), 64);
+                    _controlsOffset = alignUp(_idsOffset + functions * sizeof(uint32_t), 64);
+                    _ringsOffset = _controlsOffset + workers * sizeof(WorkerControl);
+                    _size = _ringsOffset + std::size_t(workers) * slots * _slotSize;
+
+                    void* p = mmap(nullptr, _size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+                    if (p == MAP_FAILED)
+                    {
+                        return;
+                    }
+                    _data = static_cast<char*>(p);
+
+                    QueueHeader* q = new (_data) QueueHeader;
+                    q->next.store(0);
+                    q->count = functions;
+                    for (unsigned w = 0; w < workers; ++w)
+                    {
+                        WorkerControl* c = new (&control(w)) WorkerControl;
+                        c->current.store(NO_FUNCTION);
+                        c->startedMs.store(0);
+                        c->head.store(0);
+                        c->tail.store(0);
+                    }
+                }
+
+                SharedRegion(const SharedRegion&) = delete;
+                SharedRegion& operator=(const SharedRegion&) = delete;
+
+                ~SharedRegion()
+                {
+                    if (_data)
+                    {
+                        munmap(_data, _size);
+                    }
+                }
+
+                bool isValid() const
+                {
+                    return _data != nullptr;
+                }
+
+                QueueHeader& queue()
+                {
+                    return *reinterpret_cast<QueueHeader*>(_data);
+                }
+
+                uint32_t* ids()
+                {
+                    return reinterpret_cast<uint32_t*>(_data + _idsOffset);
+                }
+
+                WorkerControl& control(unsigned w)
+                {
+                    return reinterpret_cast<WorkerControl*>(_data + _controlsOffset)[w];
+                }
+
+                SlotHeader& slot(unsigned w, uint64_t pos)
+                {
+                    char* ring = _data + _ringsOffset + std::size_t(w) * _slots * _slotSize;
+                    return *reinterpret_cast<SlotHeader*>(ring + (pos % _slots) * _slotSize);
+                }
+
+                char* slotData(SlotHeader& s)
+                {
+                    return reinterpret_cast<char*>(&s + 1);
+                }
+
+                unsigned getSlots() const
+                {
+                    return _slots;
+                }
+
+                unsigned getSlotBytes() const
+                {
+                    return _slotBytes;
+                }
+
+            private:
+                char* _data = nullptr;
+                std::size_t _size = 0;
+                std::size_t _idsOffset = 0;
+                std::size_t _controlsOffset = 0;
+                std::size_t _ringsOffset = 0;
+                unsigned _slots;
+                unsigned _slotBytes;
+                std::size_t _slotSize;
+            };
+
+/**
+* Pushes the result in as many slots as its signature needs, waiting for
+* the parent to free them.
+*/
+            void pushResult(
+                    SharedRegion& shm,
+                    unsigned w,
+                    uint32_t function,
+                    const FunctionResult& r)
+            {
+                WorkerControl& ctl = shm.control(w);
+                const std::string& sig = r.signature;
+                std::size_t offset = 0;
+                do
+                {
+                    uint64_t tail = ctl.tail.load(std::memory_order_relaxed);
+                    while (tail - ctl.head.load(std::memory_order_acquire) >= shm.getSlots())
+                    {
+                        std::this_thread::sleep_for(std::chrono::microseconds(50));
+                    }
+
+                    SlotHeader& s = shm.slot(w, tail);
+                    std::size_t length = std::min<std::size_t>(sig.size() - offset, shm.getSlotBytes());
+                    s.function = function;
+                    s.length = length;
+                    s.flags = (r.failed ? SLOT_FAILED : 0)
+                            | (offset + length == sig.size() ? SLOT_LAST : 0);
+                    s.stats[0] = r.stats.instructions;
+                    s.stats[1] = r.stats.basicBlocks;
+                    s.stats[2] = r.stats.calls;
+                    s.stats[3] = r.stats.memoryLoads;
+                    s.stats[4] = r.stats.memoryStores;
+                    s.stats[5] = r.stats.globalLoads;
+                    s.stats[6] = r.stats.globalStores;
+                    std::memcpy(shm.slotData(s), sig.data() + offset, length);
+                    offset += length;
+
+                    ctl.tail.store(tail + 1, std::memory_order_release);
+                }
+                while (offset < sig.size());
+            }
+
+            [[noreturn]] void workerMain(
+                    Module* module,
+                    const std::vector<Function*>& functions,
+                    const WorkerPoolConfig& config,
+                    SharedRegion& shm,
+                    unsigned w,
+                    pid_t parent)
+            {
+                // Do not outlive the parent, nobody would drain the ring.
+                prctl(PR_SET_PDEATHSIG, SIGKILL);
+                if (getppid() != parent)
+                {
+                    _exit(1);
+                }
+
+                LlvmIrEmulator emu(module, config.emulation.lazy);
+                emu.setJitEnabled(config.emulation.jit);
+                emu.setTieringPolicy(config.emulation.tiering);
+
+                QueueHeader& queue = shm.queue();
+                WorkerControl& ctl = shm.control(w);
+                for (;;)
+                {
+                    uint64_t k = queue.next.fetch_add(1);
+                    if (k >= queue.count)
+                    {
+                        break;
+                    }
+                    uint32_t fi = shm.ids()[k];
+                    ctl.startedMs.store(nowMs());
+                    ctl.current.store(fi);
+
+                    FunctionResult r = emulateFunction(emu, functions[fi], config.emulation);
+                    pushResult(shm, w, fi, r);
+                    ctl.current.store(NO_FUNCTION);
+                }
+
+                // Skip destructors and atexit handlers, they belong to the
+                // parent's copy of the process state.
+                _exit(0);
+            }
+
+        } // anonymous namespace
+
+        WorkerPool::WorkerPool(const WorkerPoolConfig& config) :
+                _config(config)
+        {
+            if (_config.workers == 0)
+            {
+                _config.workers = std::max(1u, std::thread::hardware_concurrency());
+            }
+            _config.ringSlots = std::max(1u, _config.ringSlots);
+            _config.slotBytes = std::max(64u, _config.slotBytes);
+        }
+
+        bool WorkerPool::run(
+                const std::vector<std::string>& modulePaths,
+                BatchPipeline::Sink sink,
+                std::string& error)
+        {
+            std::unique_ptr<CorpusWriter::Appender> appender;
+            if (_config.emulation.corpus)
+            {
+                appender = _config.emulation.corpus->makeAppender();
+            }
+            BatchPipeline::Sink emit = [&](const FunctionResult& r) {
+                if (appender)
+                {
+                    appender->add(r);
+                }
+                sink(r);
+            };
+
+            for (auto& path : modulePaths)
+            {
+                if (!runModule(path, emit, error))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        WorkerPoolStats WorkerPool::getStats() const
+        {
+            return _stats;
+        }
+
+        bool WorkerPool::runModule(
+                const std::string& path,
+                const BatchPipeline::Sink& emit,
+                std::string& error)
+        {
+            const BatchConfig& ec = _config.emulation;
+
+            LLVMContext context;
+            SMDiagnostic err;
+            std::unique_ptr<Module> module = ec.lazy
+                    ? getLazyIRFileModule(path, err, context)
+                    : parseIRFile(path, err, context);
+            if (!module)
+            {
+                // Unparsable module yields one failed result.
+                FunctionResult failed;
+                failed.modulePath = path;
+                failed.failed = true;
+                emit(failed);
+                return true;
+            }
+
+            std::vector<Function*> functions;
+            for (Function& f : *module)
+            {
+                if (!f.isDeclaration())
+                {
+                    functions.push_back(&f);
+                }
+            }
+
+            const std::size_t n = functions.size();
+            std::vector<FunctionResult> results(n);
+            std::vector<char> done(n, false);
+            std::vector<SignatureCacheKey> keys(ec.cache ? n : 0);
+            std::vector<uint32_t> ids;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                results[i].modulePath = path;
+                results[i].functionName = functions[i]->getName().str();
+                if (ec.cache)
+                {
+                    keys[i] = signatureCacheKey(functions[i], ec);
+                    CachedSignature cs;
+                    if (ec.cache->lookup(keys[i], cs))
+                    {
+                        results[i].signature = std::move(cs.signature);
+                        results[i].stats = cs.stats;
+                        results[i].cached = true;
+                        done[i] = true;
+                        continue;
+                    }
+                }
+                ids.push_back(i);
+            }
+
+            std::size_t emitted = 0;
+            auto emitReady = [&]()
+            {
+                while (emitted < n && done[emitted])
+                {
+                    emit(results[emitted]);
+                    results[emitted] = FunctionResult();
+                    ++emitted;
+                }
+            };
+
+            if (ids.empty())
+            {
+                emitReady();
+                return true;
+            }
+
+            const unsigned workers = std::min<std::size_t>(_config.workers, ids.size());
+            SharedRegion shm(ids.size(), workers, _config.ringSlots, _config.slotBytes);
+            if (!shm.isValid())
+            {
+                error = std::string("mmap: ") + strerror(errno);
+                return false;
+            }
+            std::copy(ids.begin(), ids.end(), shm.ids());
+
+            struct Worker
+            {
+                pid_t pid = -1;
+                bool killed = false;
+                /// Chunks of a signature whose last chunk did not come yet.
+                std::string partial;
+            };
+            std::vector<Worker> pool(workers);
+            const pid_t parent = getpid();
+
+            auto spawn = [&](unsigned w)
+            {
+                pid_t pid = fork();
+                if (pid == 0)
+                {
+                    workerMain(module.get(), functions, _config, shm, w, parent);
+                }
+                pool[w].pid = pid;
+                pool[w].killed = false;
+                pool[w].partial.clear();
+                return pid > 0;
+            };
+
+            std::size_t remaining = ids.size();
+            auto finish = [&](uint32_t fi, bool failed)
+            {
+                if (done[fi])
+                {
+                    return;
+                }
+                results[fi].failed = failed;
+                if (failed)
+                {
+                    results[fi].signature.clear();
+                }
+                else if (ec.cache)
+                {
+                    CachedSignature cs;
+                    cs.signature = results[fi].signature;
+                    cs.stats = results[fi].stats;
+                    ec.cache->insert(keys[fi], cs);
+                }
+                done[fi] = true;
+                --remaining;
+            };
+
+            auto drain = [&](unsigned w)
+            {
+                WorkerControl& ctl = shm.control(w);
+                uint64_t head = ctl.head.load(std::memory_order_relaxed);
+                uint64_t tail = ctl.tail.load(std::memory_order_acquire);
+                for (; head < tail; ++head)
+                {
+                    SlotHeader& s = shm.slot(w, head);
+                    pool[w].partial.append(shm.slotData(s), s.length);
+                    if (s.flags & SLOT_LAST)
+                    {
+                        FunctionResult& r = results[s.function];
+                        r.signature = std::move(pool[w].partial);
+                        r.stats.instructions = s.stats[0];
+                        r.stats.basicBlocks = s.stats[1];
+                        r.stats.calls = s.stats[2];
+                        r.stats.memoryLoads = s.stats[3];
+                        r.stats.memoryStores = s.stats[4];
+                        r.stats.globalLoads = s.stats[5];
+                        r.stats.globalStores = s.stats[6];
+                        finish(s.function, s.flags & SLOT_FAILED);
+                        pool[w].partial.clear();
+                    }
+                    ctl.head.store(head + 1, std::memory_order_release);
+                }
+            };
+
+            for (unsigned w = 0; w < workers; ++w)
+            {
+                if (!spawn(w))
+                {
+                    error = std::string("fork: ") + strerror(errno);
+                    for (auto& wk : pool)
+                    {
+                        if (wk.pid > 0)
+                        {
+                            kill(wk.pid, SIGKILL);
+                            waitpid(wk.pid, nullptr, 0);
+                        }
+                    }
+                    return false;
+                }
+            }
+
+            while (remaining)
+            {
+                bool progress = false;
+                unsigned live = 0;
+                for (unsigned w = 0; w < workers; ++w)
+                {
+                    WorkerControl& ctl = shm.control(w);
+                    uint64_t before = ctl.head.load(std::memory_order_relaxed);
+                    drain(w);
+                    progress |= ctl.head.load(std::memory_order_relaxed) != before;
+
+                    Worker& wk = pool[w];
+                    if (wk.pid <= 0)
+                    {
+                        continue;
+                    }
+
+                    int status = 0;
+                    if (waitpid(wk.pid, &status, WNOHANG) != wk.pid)
+                    {
+                        int64_t cur = ctl.current.load();
+                        if (_config.functionTimeoutMs
+                                && !wk.killed
+                                && cur != NO_FUNCTION
+                                && nowMs() - ctl.startedMs.load() > _config.functionTimeoutMs)
+                        {
+                            kill(wk.pid, SIGKILL);
+                            wk.killed = true;
+                            ++_stats.timeouts;
+                        }
+                        ++live;
+                        continue;
+                    }
+
+                    // Results pushed before the exit are still valid.
+                    drain(w);
+                    progress = true;
+                    wk.pid = -1;
+                    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+                    {
+                        continue;
+                    }
+
+                    ++_stats.crashes;
+                    int64_t cur = ctl.current.load();
+                    ctl.current.store(NO_FUNCTION);
+                    if (cur == NO_FUNCTION)
+                    {
+                        // Died outside of emulation, a replacement would
+                        // most likely die too.
+                        continue;
+                    }
+                    finish(cur, true);
+                    if (shm.queue().next.load() < ids.size())
+                    {
+                        ++_stats.restarts;
+                        if (spawn(w))
+                        {
+                            ++live;
+                        }
+                    }
+                }
+
+                if (live == 0 && remaining)
+                {
+                    // Nobody left to emulate the rest.
+                    for (uint32_t fi : ids)
+                    {
+                        finish(fi, true);
+                    }
+                }
+                emitReady();
+                if (!progress)
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+            }
+
+            for (auto& wk : pool)
+            {
+                if (wk.pid > 0)
+                {
+                    waitpid(wk.pid, nullptr, 0);
+                }
+            }
+            emitReady();
+            return true;
+        }
+
+    } // llvmir_emul
+} // retdec
@@ -0,0 +1,92 @@
+/**
+ * @file worker_pool.h
+ * @brief Crash-isolated pool of forked emulation workers.
+ */
+
+#ifndef RETDEC_LLVMIR_EMUL_WORKER_POOL_H
+#define RETDEC_LLVMIR_EMUL_WORKER_POOL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "batch_pipeline.h"
+
+namespace retdec {
+    namespace llvmir_emul {
+
+        struct WorkerPoolConfig
+        {
+            /// Worker processes, 0 means hardware concurrency.
+            unsigned workers = 0;
+            /// Result ring of every worker: slots and bytes of signature
+            /// per slot. Longer signatures take several slots.
+            unsigned ringSlots = 64;
+            unsigned slotBytes = 4096;
+            /// Kill a worker that emulates one function longer than this,
+            /// 0 means no limit. The function is reported failed.
+            unsigned functionTimeoutMs = 0;
+            /// Emulation settings. Cache and corpus are used by the parent
+            /// process only.
+            BatchConfig emulation;
+        };
+
+        struct WorkerPoolStats
+        {
+            /// Workers that died on a signal or with non-zero status.
+            std::size_t crashes = 0;
+            /// Workers killed for exceeding the function time limit.
+            std::size_t timeouts = 0;
+            std::size_t restarts = 0;
+        };
+
+/**
+ * Emulates all defined functions of modules in forked worker processes, so
+ * that a function which crashes the emulator (assertion, wild pointer from
+ * emulated memory) costs one failed result instead of the whole batch.
+ *
+ * Modules are processed one after another. The parent parses the module
+ * and forks the workers, which inherit it copy-on-write and create their
+ * own emulators. Shared anonymous memory holds:
+ * - the work queue -- indexes of functions to emulate and an atomic cursor
+ *   workers take them with,
+ * - a control block per worker with the function it is emulating,
+ * - a single-producer ring per worker that results are pushed into.
+ *
+ * The parent drains the rings, reaps workers, reports the function a dead
+ * worker was emulating as failed and forks a replacement. Results are
+ * passed to the sink in function order, like @c BatchPipeline does.
+ *
+ * The parent never emulates, so every worker (including replacements)
+ * starts from the pristine module.
+ */
+        class WorkerPool
+        {
+        public:
+            explicit WorkerPool(const WorkerPoolConfig& config);
+
+/**
+ * @return @c False if workers could not be started, @a error says why.
+ */
+            bool run(
+                    const std::vector<std::string>& modulePaths,
+                    BatchPipeline::Sink sink,
+                    std::string& error);
+
+            WorkerPoolStats getStats() const;
+
+        private:
+            bool runModule(
+                    const std::string& path,
+                    const BatchPipeline::Sink& emit,
+                    std::string& error);
+
+        private:
+            WorkerPoolConfig _config;
+            WorkerPoolStats _stats;
+        };
+
+    } // llvmir_emul
+} // retdec
+
+#endif